@@ -140,6 +140,7 @@ CFLAGS = /nologo /TC /MD \
          /D"_CRT_SECURE_NO_DEPRECATE" \
          /D"__LITTLE_ENDIAN__" \
          /D"VL_DISABLE_AVX" \
+         /D"VL_DISABLE_AVX2" \
          /I. \
          /W1 /Zp8 /openmp
 
@@ -176,13 +177,18 @@ libsrc = \
   vl\host.c \
   vl\ikmeans.c \
   vl\imopv.c \
+  vl\imopv_avx2.c \
   vl\imopv_sse2.c \
+  vl\ivfpq.c \
+  vl\kdindex.c \
   vl\kdtree.c \
   vl\kmeans.c \
+  vl\kmtree.c \
   vl\lbp.c \
   vl\liop.c \
   vl\mathop.c \
   vl\mathop_avx.c \
+  vl\mathop_avx2.c \
   vl\mathop_sse2.c \
   vl\mser.c \
   vl\pgm.c \
@@ -191,6 +197,7 @@ libsrc = \
   vl\rodrigues.c \
   vl\scalespace.c \
   vl\sift.c \
+  vl\sift_avx2.c \
   vl\slic.c \
   vl\stringop.c \
   vl\svm.c \
@@ -433,6 +440,19 @@ $(objdir)\imopv_sse2.obj : vl\imopv_sse2.c
 	@echo .... CC [+SSE2] $(@)
 	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX /D"__SSE2__" /c /Fo"$(@)" "vl\$(@B).c"
 
+# special sources with AVX2 and FMA support
+$(objdir)\mathop_avx2.obj : vl\mathop_avx2.c
+	@echo .... CC [+AVX2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX2 /D"__FMA__" /c /Fo"$(@)" "vl\$(@B).c"
+
+$(objdir)\imopv_avx2.obj : vl\imopv_avx2.c
+	@echo .... CC [+AVX2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX2 /D"__FMA__" /c /Fo"$(@)" "vl\$(@B).c"
+
+$(objdir)\sift_avx2.obj : vl\sift_avx2.c
+	@echo .... CC [+AVX2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX2 /D"__FMA__" /c /Fo"$(@)" "vl\$(@B).c"
+
 # vl\*.c -> $objdir\*.obj
 {vl}.c{$(objdir)}.obj:
 	@echo .... CC $(@)
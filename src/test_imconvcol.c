@@ -0,0 +1,91 @@
+/** @file test_imconvcol.c
+ ** @brief Column convolution SIMD test
+ **/
+
+#include <vl/imopv.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+
+#define MAX_SIZE 45
+#define MAX_HALF_WIDTH 12
+
+static float image [MAX_SIZE * MAX_SIZE] ;
+static float dest [MAX_SIZE * MAX_SIZE] ;
+static float dest2 [MAX_SIZE * MAX_SIZE] ;
+static float filt [2 * MAX_HALF_WIDTH + 1] ;
+
+/* the SIMD convolution must match the plain C one up to rounding (the
+ * SIMD code may use fused multiply-add), for all image sizes,
+ * filters, steps and flags, including the borders and the columns that
+ * do not fill a SIMD register */
+
+static int
+test_convolution (vl_size width, vl_size height, vl_index filtBegin, vl_index filtEnd,
+                  int step, unsigned int flags)
+{
+  vl_size stride = width + 3 ;
+  vl_size numRows = (height - 1) / step + 1 ;
+  vl_size dstStride = (flags & VL_TRANSPOSE) ? numRows : width ;
+  vl_size dstSize = numRows * width ;
+  float tolerance = 0 ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  for (i = 0 ; i < (vl_uindex)(filtEnd - filtBegin + 1) ; ++i) {
+    tolerance += vl_abs_f (filt[i]) ;
+  }
+  tolerance *= 1e-5f ;
+
+  for (i = 0 ; i < dstSize ; ++i) dest[i] = dest2[i] = -1 ;
+
+  vl_set_simd_enabled (VL_FALSE) ;
+  vl_imconvcol_vf (dest, dstStride, image, width, height, stride,
+                   filt, filtBegin, filtEnd, step, flags) ;
+  vl_set_simd_enabled (VL_TRUE) ;
+  vl_imconvcol_vf (dest2, dstStride, image, width, height, stride,
+                   filt, filtBegin, filtEnd, step, flags) ;
+
+  for (i = 0 ; i < dstSize ; ++i) {
+    if (! (vl_abs_f (dest[i] - dest2[i]) <= tolerance)) errors ++ ;
+  }
+  if (errors) {
+    VL_PRINTF("test_imconvcol: %dx%d filter [%d,%d] step %d flags %d: %d errors\n",
+              (int)width, (int)height, (int)filtBegin, (int)filtEnd, step, flags, errors) ;
+  }
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_size width, height ;
+  vl_index halfWidth ;
+  int step, flags, errors = 0 ;
+  vl_uindex i ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < MAX_SIZE * MAX_SIZE ; ++i) image[i] = (float) vl_rand_real1 (rand) ;
+  for (i = 0 ; i < 2 * MAX_HALF_WIDTH + 1 ; ++i) filt[i] = (float) vl_rand_real1 (rand) - 0.3f ;
+
+  for (width = 1 ; width + 3 <= MAX_SIZE ; width += 3) {
+    for (height = 1 ; height <= MAX_SIZE ; height += 4) {
+      for (halfWidth = 0 ; halfWidth <= MAX_HALF_WIDTH ; halfWidth += 4) {
+        for (step = 1 ; step <= 2 ; ++step) {
+          for (flags = 0 ; flags < 2 ; ++flags) {
+            unsigned int padding = flags ? VL_PAD_BY_CONTINUITY : VL_PAD_BY_ZERO ;
+            errors += test_convolution (width, height, -halfWidth, halfWidth, step, padding) ;
+            errors += test_convolution (width, height, -halfWidth, halfWidth, step,
+                                        padding | VL_TRANSPOSE) ;
+            /* asymmetric filter */
+            errors += test_convolution (width, height, -halfWidth, halfWidth / 2, step,
+                                        padding | VL_TRANSPOSE) ;
+          }
+        }
+      }
+    }
+  }
+
+  VL_PRINTF("test_imconvcol: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,175 @@
+/** @file test_ivfpq_io.c
+ ** @brief IVF-PQ saving and loading test
+ **/
+
+#include <vl/ivfpq.h>
+#include <vl/random.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DIMENSION 16
+#define NUM_DATA 2000
+#define NUM_LISTS 8
+#define NUM_SUBQUANTIZERS 4
+#define NUM_QUERIES 50
+#define NUM_NEIGHBORS 5
+#define NUM_CORRUPTIONS 300
+
+static char const * fileName = "/tmp/test_ivfpq_io.bin" ;
+static char const * corruptedFileName = "/tmp/test_ivfpq_io_corrupted.bin" ;
+
+static float data [DIMENSION * NUM_DATA] ;
+static float queries [DIMENSION * NUM_QUERIES] ;
+
+static vl_size
+read_file (char const * name, char ** buffer)
+{
+  FILE * file = fopen (name, "rb") ;
+  long size ;
+  if (file == NULL) return 0 ;
+  fseek (file, 0, SEEK_END) ;
+  size = ftell (file) ;
+  fseek (file, 0, SEEK_SET) ;
+  *buffer = vl_malloc (size) ;
+  if (fread (*buffer, 1, size, file) != (size_t) size) size = 0 ;
+  fclose (file) ;
+  return (vl_size) size ;
+}
+
+static void
+write_file (char const * name, char const * buffer, vl_size size)
+{
+  FILE * file = fopen (name, "wb") ;
+  fwrite (buffer, 1, size, file) ;
+  fclose (file) ;
+}
+
+/* an index loaded back must give exactly the same results */
+
+static int
+test_round_trip (VlIVFPQ * index)
+{
+  VlIVFPQ * loaded ;
+  vl_uindex expected [NUM_QUERIES * NUM_NEIGHBORS] ;
+  vl_uindex indexes [NUM_QUERIES * NUM_NEIGHBORS] ;
+  float expectedDistances [NUM_QUERIES * NUM_NEIGHBORS] ;
+  float distances [NUM_QUERIES * NUM_NEIGHBORS] ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_ivfpq_search (index, expected, NUM_NEIGHBORS, NUM_QUERIES, expectedDistances, queries) ;
+  if (vl_ivfpq_save (index, fileName) != VL_ERR_OK) {
+    VL_PRINTF("test_ivfpq_io: could not save %s\n", fileName) ;
+    return 1 ;
+  }
+  loaded = vl_ivfpq_load (fileName) ;
+  if (loaded == NULL) {
+    VL_PRINTF("test_ivfpq_io: could not load %s\n", fileName) ;
+    return 1 ;
+  }
+  vl_ivfpq_search (loaded, indexes, NUM_NEIGHBORS, NUM_QUERIES, distances, queries) ;
+
+  if (vl_ivfpq_get_num_data (loaded) != vl_ivfpq_get_num_data (index) ||
+      vl_ivfpq_get_num_probes (loaded) != vl_ivfpq_get_num_probes (index)) {
+    errors ++ ;
+  }
+  for (i = 0 ; i < NUM_LISTS ; ++i) {
+    if (vl_ivfpq_get_list_size (loaded, i) != vl_ivfpq_get_list_size (index, i)) errors ++ ;
+  }
+  for (i = 0 ; i < NUM_QUERIES * NUM_NEIGHBORS ; ++i) {
+    if (indexes[i] != expected[i] || distances[i] != expectedDistances[i]) errors ++ ;
+  }
+  if (errors) {
+    VL_PRINTF("test_ivfpq_io: round trip: %d errors\n", errors) ;
+  }
+  vl_ivfpq_delete (loaded) ;
+  return errors ;
+}
+
+/* a corrupted or truncated file must either be rejected or give an
+ * index whose search returns valid identifiers */
+
+static int
+test_corruption (void)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex indexes [NUM_QUERIES * NUM_NEIGHBORS] ;
+  char * original = NULL ;
+  char * buffer ;
+  vl_size size, i ;
+  int trial, numRejected = 0, errors = 0 ;
+
+  size = read_file (fileName, &original) ;
+  buffer = vl_malloc (size + 64) ;
+
+  for (trial = 0 ; trial < NUM_CORRUPTIONS ; ++trial) {
+    VlIVFPQ * loaded ;
+    vl_size corruptedSize = size ;
+    memcpy (buffer, original, size) ;
+    if (trial % 10 == 0) {
+      /* truncate or extend */
+      corruptedSize = (trial % 20 == 0) ? vl_rand_uindex (rand, size) : size + 8 ;
+      if (corruptedSize > size) memset (buffer + size, 0, corruptedSize - size) ;
+    } else {
+      /* overwrite a few aligned words with random values, either
+         small or arbitrary; the first half of the trials target the
+         header, which holds all the sizes */
+      int k, numWords = 1 + (int) vl_rand_uindex (rand, 3) ;
+      vl_size range = (trial < NUM_CORRUPTIONS / 2) ? 80 : size ;
+      for (k = 0 ; k < numWords ; ++k) {
+        vl_uindex pos = vl_rand_uindex (rand, range / 4) * 4 ;
+        vl_uint32 value = (trial % 2) ? vl_rand_uint32 (rand) : (vl_uint32) vl_rand_uindex (rand, 2 * NUM_DATA) ;
+        memcpy (buffer + pos, &value, 4) ;
+      }
+    }
+    write_file (corruptedFileName, buffer, corruptedSize) ;
+
+    loaded = vl_ivfpq_load (corruptedFileName) ;
+    if (loaded == NULL) {
+      if (vl_get_last_error () != VL_ERR_BAD_ARG) errors ++ ;
+      numRejected ++ ;
+      continue ;
+    }
+    vl_ivfpq_search (loaded, indexes, NUM_NEIGHBORS, NUM_QUERIES, NULL, queries) ;
+    for (i = 0 ; i < NUM_QUERIES * NUM_NEIGHBORS ; ++i) {
+      if (indexes[i] != (vl_uindex)-1 && indexes[i] >= vl_ivfpq_get_num_data (loaded)) errors ++ ;
+    }
+    vl_ivfpq_delete (loaded) ;
+  }
+
+  VL_PRINTF("test_ivfpq_io: %d of %d corrupted files rejected\n",
+            numRejected, NUM_CORRUPTIONS) ;
+  if (errors) {
+    VL_PRINTF("test_ivfpq_io: corruption: %d errors\n", errors) ;
+  }
+  remove (corruptedFileName) ;
+  vl_free (buffer) ;
+  vl_free (original) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  VlIVFPQ * index ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] = (float) vl_rand_real1 (rand) ;
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) queries[i] = (float) vl_rand_real1 (rand) ;
+
+  index = vl_ivfpq_new (VL_TYPE_FLOAT, DIMENSION, NUM_LISTS, NUM_SUBQUANTIZERS) ;
+  vl_ivfpq_set_num_probes (index, 3) ;
+  vl_ivfpq_train (index, data, NUM_DATA) ;
+  vl_ivfpq_add (index, data, NUM_DATA) ;
+
+  errors += test_round_trip (index) ;
+  errors += test_corruption () ;
+  vl_ivfpq_delete (index) ;
+  remove (fileName) ;
+
+  VL_PRINTF("test_ivfpq_io: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,131 @@
+/** @file test_kdforest_batch.c
+ ** @brief KD-forest batch query test
+ **/
+
+#include <vl/kdtree.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+
+#define DIMENSION 6
+#define NUM_DATA 5000
+#define NUM_QUERIES 700
+#define NUM_NEIGHBORS 4
+
+static double data [DIMENSION * NUM_DATA] ;
+static double queries [DIMENSION * NUM_QUERIES] ;
+static float dataf [DIMENSION * NUM_DATA] ;
+static float queriesf [DIMENSION * NUM_QUERIES] ;
+static double expected [NUM_NEIGHBORS * NUM_QUERIES] ;
+static double expectedf [NUM_NEIGHBORS * NUM_QUERIES] ;
+
+/* the distances of the nearest neighbors by brute force */
+
+static void
+brute_force (double * best, vl_type dataType)
+{
+  VlDoubleVectorComparisonFunction fd = vl_get_vector_comparison_function_d (VlDistanceL2) ;
+  VlFloatVectorComparisonFunction ff = vl_get_vector_comparison_function_f (VlDistanceL2) ;
+  vl_uindex q, i, k ;
+  for (q = 0 ; q < NUM_QUERIES ; ++q) {
+    double * qbest = best + q * NUM_NEIGHBORS ;
+    for (k = 0 ; k < NUM_NEIGHBORS ; ++k) qbest[k] = VL_INFINITY_D ;
+    for (i = 0 ; i < NUM_DATA ; ++i) {
+      double dist = (dataType == VL_TYPE_FLOAT) ?
+        ff (DIMENSION, queriesf + q * DIMENSION, dataf + i * DIMENSION) :
+        fd (DIMENSION, queries + q * DIMENSION, data + i * DIMENSION) ;
+      for (k = NUM_NEIGHBORS ; k > 0 && qbest[k-1] > dist ; --k) {
+        if (k < NUM_NEIGHBORS) qbest[k] = qbest[k-1] ;
+      }
+      if (k < NUM_NEIGHBORS) qbest[k] = dist ;
+    }
+  }
+}
+
+static int
+test_batch (vl_type dataType, VlKDTreeThresholdingMethod method,
+            vl_bool compact, vl_bool reorder)
+{
+  VlKDForest * forest = vl_kdforest_new (dataType, DIMENSION, 3, VlDistanceL2) ;
+  vl_uint32 indexes [NUM_NEIGHBORS * NUM_QUERIES] ;
+  vl_uint32 indexesArray [NUM_NEIGHBORS * NUM_QUERIES] ;
+  double distances [NUM_NEIGHBORS * NUM_QUERIES] ;
+  double distancesArray [NUM_NEIGHBORS * NUM_QUERIES] ;
+  double const * best = (dataType == VL_TYPE_FLOAT) ? expectedf : expected ;
+  void const * queryData = (dataType == VL_TYPE_FLOAT) ? (void const*)queriesf : (void const*)queries ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_kdforest_set_thresholding_method (forest, method) ;
+  vl_kdforest_set_compact_layout (forest, compact) ;
+  vl_kdforest_set_data_reordering (forest, reorder) ;
+  vl_kdforest_build (forest, NUM_DATA,
+                     (dataType == VL_TYPE_FLOAT) ? (void const*)dataf : (void const*)data) ;
+  vl_kdforest_set_max_num_comparisons (forest, 0) ;
+
+  vl_kdforest_query_batch (forest, indexes, NUM_NEIGHBORS, NUM_QUERIES, distances, queryData) ;
+  vl_kdforest_query_with_array (forest, indexesArray, NUM_NEIGHBORS, NUM_QUERIES, distancesArray, queryData) ;
+
+  for (i = 0 ; i < NUM_NEIGHBORS * NUM_QUERIES ; ++i) {
+    double dist, distArray ;
+    if (dataType == VL_TYPE_FLOAT) {
+      dist = ((float*)distances)[i] ;
+      distArray = ((float*)distancesArray)[i] ;
+    } else {
+      dist = distances[i] ;
+      distArray = distancesArray[i] ;
+    }
+    if (dist != best[i] || distArray != best[i] || indexes[i] >= NUM_DATA) errors ++ ;
+  }
+
+  /* a bounded search must still return valid neighbors */
+  vl_kdforest_set_max_num_comparisons (forest, 100) ;
+  vl_kdforest_query_batch (forest, indexes, NUM_NEIGHBORS, NUM_QUERIES, NULL, queryData) ;
+  for (i = 0 ; i < NUM_NEIGHBORS * NUM_QUERIES ; ++i) {
+    if (indexes[i] >= NUM_DATA) errors ++ ;
+  }
+
+  if (errors) {
+    VL_PRINTF("test_kdforest_batch: %s %s compact=%d reorder=%d: %d errors\n",
+              vl_get_type_name (dataType),
+              method == VL_KDTREE_MEAN ? "mean" : "median",
+              compact, reorder, errors) ;
+  }
+  vl_kdforest_delete (forest) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  int method, compact, reorder, errors = 0 ;
+  vl_uindex i ;
+
+  /* skewed data, so that the trees split at the mean are unbalanced */
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) {
+    double x = vl_rand_real1 (rand) ;
+    data[i] = x * x * x * x ;
+    dataf[i] = (float) data[i] ;
+  }
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) {
+    double x = vl_rand_real1 (rand) ;
+    queries[i] = x * x * x * x ;
+    queriesf[i] = (float) queries[i] ;
+  }
+  brute_force (expected, VL_TYPE_DOUBLE) ;
+  brute_force (expectedf, VL_TYPE_FLOAT) ;
+
+  for (method = 0 ; method < 2 ; ++method) {
+    for (compact = 0 ; compact < 2 ; ++compact) {
+      for (reorder = 0 ; reorder < 2 ; ++reorder) {
+        VlKDTreeThresholdingMethod m = method ? VL_KDTREE_MEAN : VL_KDTREE_MEDIAN ;
+        errors += test_batch (VL_TYPE_FLOAT, m, compact, reorder) ;
+        if (! compact) errors += test_batch (VL_TYPE_DOUBLE, m, compact, reorder) ;
+      }
+    }
+  }
+
+  VL_PRINTF("test_kdforest_batch: %d errors\n", errors) ;
+  return errors > 0 ;
+}
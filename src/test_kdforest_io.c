@@ -0,0 +1,229 @@
+/** @file test_kdforest_io.c
+ ** @brief KD-forest saving and loading test
+ **/
+
+#include <vl/kdtree.h>
+#include <vl/random.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DIMENSION 8
+#define NUM_DATA 3000
+#define NUM_QUERIES 200
+#define NUM_NEIGHBORS 5
+#define NUM_CORRUPTIONS 300
+
+static char const * fileName = "/tmp/test_kdforest_io.bin" ;
+static char const * corruptedFileName = "/tmp/test_kdforest_io_corrupted.bin" ;
+
+static float data [DIMENSION * NUM_DATA] ;
+static float queries [DIMENSION * NUM_QUERIES] ;
+
+/* the exact neighbors of all the queries */
+
+static void
+query_all (VlKDForest * forest, VlKDForestNeighbor * neighbors)
+{
+  vl_uindex q ;
+  for (q = 0 ; q < NUM_QUERIES ; ++q) {
+    vl_kdforest_query (forest, neighbors + q * NUM_NEIGHBORS, NUM_NEIGHBORS,
+                       queries + q * DIMENSION) ;
+  }
+}
+
+static vl_size
+read_file (char const * name, char ** buffer)
+{
+  FILE * file = fopen (name, "rb") ;
+  long size ;
+  if (file == NULL) return 0 ;
+  fseek (file, 0, SEEK_END) ;
+  size = ftell (file) ;
+  fseek (file, 0, SEEK_SET) ;
+  *buffer = vl_malloc (size) ;
+  if (fread (*buffer, 1, size, file) != (size_t) size) size = 0 ;
+  fclose (file) ;
+  return (vl_size) size ;
+}
+
+static void
+write_file (char const * name, char const * buffer, vl_size size)
+{
+  FILE * file = fopen (name, "wb") ;
+  fwrite (buffer, 1, size, file) ;
+  fclose (file) ;
+}
+
+/* a forest loaded back must give exactly the same neighbors */
+
+static int
+test_round_trip (vl_bool compact, vl_bool saveData)
+{
+  VlKDForest * forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, 3, VlDistanceL2) ;
+  VlKDForest * loaded ;
+  VlKDForestNeighbor expected [NUM_QUERIES * NUM_NEIGHBORS] ;
+  VlKDForestNeighbor neighbors [NUM_QUERIES * NUM_NEIGHBORS] ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_kdforest_set_compact_layout (forest, compact) ;
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_set_max_num_comparisons (forest, 0) ;
+  query_all (forest, expected) ;
+
+  if (vl_kdforest_save (forest, fileName, saveData) != VL_ERR_OK) {
+    VL_PRINTF("test_kdforest_io: could not save %s\n", fileName) ;
+    vl_kdforest_delete (forest) ;
+    return 1 ;
+  }
+  loaded = vl_kdforest_load (fileName, saveData ? NULL : data) ;
+  if (loaded == NULL) {
+    VL_PRINTF("test_kdforest_io: could not load %s\n", fileName) ;
+    vl_kdforest_delete (forest) ;
+    return 1 ;
+  }
+  vl_kdforest_set_max_num_comparisons (loaded, 0) ;
+  query_all (loaded, neighbors) ;
+
+  if (vl_kdforest_get_num_trees (loaded) != vl_kdforest_get_num_trees (forest)) errors ++ ;
+  for (i = 0 ; i < vl_kdforest_get_num_trees (forest) ; ++i) {
+    if (vl_kdforest_get_depth_of_tree (loaded, i) != vl_kdforest_get_depth_of_tree (forest, i) ||
+        vl_kdforest_get_num_nodes_of_tree (loaded, i) != vl_kdforest_get_num_nodes_of_tree (forest, i)) {
+      errors ++ ;
+    }
+  }
+  for (i = 0 ; i < NUM_QUERIES * NUM_NEIGHBORS ; ++i) {
+    if (neighbors[i].index != expected[i].index ||
+        neighbors[i].distance != expected[i].distance) {
+      errors ++ ;
+    }
+  }
+  if (errors) {
+    VL_PRINTF("test_kdforest_io: round trip compact=%d saveData=%d: %d errors\n",
+              compact, saveData, errors) ;
+  }
+
+  vl_kdforest_delete (loaded) ;
+  vl_kdforest_delete (forest) ;
+  return errors ;
+}
+
+/* a corrupted or truncated file must either be rejected or give a
+ * forest whose search returns valid data points */
+
+static int
+test_corruption (vl_bool compact)
+{
+  VlKDForest * forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, 2, VlDistanceL2) ;
+  VlKDForestNeighbor neighbors [NUM_QUERIES * NUM_NEIGHBORS] ;
+  VlRand * rand = vl_get_rand () ;
+  char * original = NULL ;
+  char * buffer ;
+  vl_size size, i ;
+  int trial, numRejected = 0, errors = 0 ;
+
+  vl_kdforest_set_compact_layout (forest, compact) ;
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_save (forest, fileName, VL_TRUE) ;
+  vl_kdforest_delete (forest) ;
+  size = read_file (fileName, &original) ;
+  buffer = vl_malloc (size) ;
+
+  for (trial = 0 ; trial < NUM_CORRUPTIONS ; ++trial) {
+    VlKDForest * loaded ;
+    vl_size corruptedSize = size ;
+    memcpy (buffer, original, size) ;
+    if (trial % 10 == 0) {
+      /* truncate */
+      corruptedSize = vl_rand_uindex (rand, size) ;
+    } else {
+      /* overwrite a few aligned words with random values, either
+         small or arbitrary */
+      int k, numWords = 1 + (int) vl_rand_uindex (rand, 3) ;
+      for (k = 0 ; k < numWords ; ++k) {
+        vl_uindex pos = vl_rand_uindex (rand, size / 4) * 4 ;
+        vl_uint32 value = (trial % 2) ? vl_rand_uint32 (rand) : (vl_uint32) vl_rand_uindex (rand, 2 * NUM_DATA) ;
+        memcpy (buffer + pos, &value, 4) ;
+      }
+    }
+    write_file (corruptedFileName, buffer, corruptedSize) ;
+
+    loaded = vl_kdforest_load (corruptedFileName, NULL) ;
+    if (loaded == NULL) {
+      if (vl_get_last_error () != VL_ERR_BAD_ARG && vl_get_last_error () != VL_ERR_IO) errors ++ ;
+      numRejected ++ ;
+      continue ;
+    }
+    vl_kdforest_set_max_num_comparisons (loaded, 0) ;
+    query_all (loaded, neighbors) ;
+    for (i = 0 ; i < NUM_QUERIES * NUM_NEIGHBORS ; ++i) {
+      if (neighbors[i].index >= NUM_DATA) errors ++ ;
+    }
+    vl_kdforest_delete (loaded) ;
+  }
+
+  VL_PRINTF("test_kdforest_io: compact=%d: %d of %d corrupted files rejected\n",
+            compact, numRejected, NUM_CORRUPTIONS) ;
+  if (errors) {
+    VL_PRINTF("test_kdforest_io: corruption compact=%d: %d errors\n", compact, errors) ;
+  }
+  remove (corruptedFileName) ;
+  vl_free (buffer) ;
+  vl_free (original) ;
+  return errors ;
+}
+
+/* a header whose node count disagrees with the trees must be
+ * rejected, as the searchers size their heaps from it */
+
+static int
+test_bad_max_num_nodes (void)
+{
+  VlKDForest * forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, 2, VlDistanceL2) ;
+  char * buffer = NULL ;
+  vl_size size ;
+  vl_uint64 maxNumNodes = 2 ;
+  int errors = 0 ;
+
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_save (forest, fileName, VL_TRUE) ;
+  vl_kdforest_delete (forest) ;
+  size = read_file (fileName, &buffer) ;
+
+  /* maxNumNodes is at byte offset 72 of the header */
+  memcpy (buffer + 72, &maxNumNodes, sizeof(maxNumNodes)) ;
+  write_file (corruptedFileName, buffer, size) ;
+  forest = vl_kdforest_load (corruptedFileName, NULL) ;
+  if (forest != NULL) {
+    VL_PRINTF("test_kdforest_io: a file with a wrong maxNumNodes was accepted\n") ;
+    vl_kdforest_delete (forest) ;
+    errors ++ ;
+  }
+
+  remove (corruptedFileName) ;
+  vl_free (buffer) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] = (float) vl_rand_real1 (rand) ;
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) queries[i] = (float) vl_rand_real1 (rand) ;
+
+  errors += test_round_trip (VL_FALSE, VL_TRUE) ;
+  errors += test_round_trip (VL_FALSE, VL_FALSE) ;
+  errors += test_round_trip (VL_TRUE, VL_TRUE) ;
+  errors += test_corruption (VL_FALSE) ;
+  errors += test_corruption (VL_TRUE) ;
+  errors += test_bad_max_num_nodes () ;
+  remove (fileName) ;
+
+  VL_PRINTF("test_kdforest_io: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,108 @@
+/** @file test_kdforest_layout.c
+ ** @brief KD-forest node layout test
+ **/
+
+#include <vl/kdtree.h>
+#include <vl/random.h>
+
+#define DIMENSION 8
+#define NUM_DATA 20000
+#define NUM_QUERIES 500
+#define NUM_NEIGHBORS 6
+
+static float data [DIMENSION * NUM_DATA] ;
+static float queries [DIMENSION * NUM_QUERIES] ;
+static double datad [DIMENSION * NUM_DATA] ;
+static double queriesd [DIMENSION * NUM_QUERIES] ;
+
+static void
+query_all (VlKDForest * forest, VlKDForestNeighbor * neighbors)
+{
+  vl_uindex q ;
+  for (q = 0 ; q < NUM_QUERIES ; ++q) {
+    void const * query = (vl_kdforest_get_data_type (forest) == VL_TYPE_FLOAT) ?
+      (void const *) (queries + q * DIMENSION) : (void const *) (queriesd + q * DIMENSION) ;
+    vl_kdforest_query (forest, neighbors + q * NUM_NEIGHBORS, NUM_NEIGHBORS, query) ;
+  }
+}
+
+/* a forest with the compact layout or reordered data must return the
+ * same neighbors as the same forest with the default layout, both for
+ * exact and approximate searches (the latter only for float data, as
+ * the compact layout rounds the thresholds to single precision) */
+
+static int
+test_layout (vl_type dataType, VlKDTreeThresholdingMethod method,
+             vl_bool compact, vl_bool reorder, vl_size maxNumComparisons)
+{
+  VlKDForest * forests [2] ;
+  static VlKDForestNeighbor neighbors [2][NUM_QUERIES * NUM_NEIGHBORS] ;
+  vl_uindex i, t ;
+  int errors = 0 ;
+
+  for (t = 0 ; t < 2 ; ++t) {
+    forests[t] = vl_kdforest_new (dataType, DIMENSION, 4, VlDistanceL2) ;
+    vl_kdforest_set_thresholding_method (forests[t], method) ;
+    vl_kdforest_set_compact_layout (forests[t], t == 1 && compact) ;
+    vl_kdforest_set_data_reordering (forests[t], t == 1 && reorder) ;
+    vl_rand_seed (vl_get_rand (), 0) ;
+    vl_kdforest_build (forests[t], NUM_DATA,
+                       (dataType == VL_TYPE_FLOAT) ? (void const *) data : (void const *) datad) ;
+    vl_kdforest_set_max_num_comparisons (forests[t], maxNumComparisons) ;
+    query_all (forests[t], neighbors[t]) ;
+  }
+
+  for (t = 0 ; t < vl_kdforest_get_num_trees (forests[0]) ; ++t) {
+    if (vl_kdforest_get_depth_of_tree (forests[1], t) != vl_kdforest_get_depth_of_tree (forests[0], t) ||
+        vl_kdforest_get_num_nodes_of_tree (forests[1], t) != vl_kdforest_get_num_nodes_of_tree (forests[0], t)) {
+      errors ++ ;
+    }
+  }
+  for (i = 0 ; i < NUM_QUERIES * NUM_NEIGHBORS ; ++i) {
+    if (neighbors[1][i].index != neighbors[0][i].index ||
+        neighbors[1][i].distance != neighbors[0][i].distance) {
+      errors ++ ;
+    }
+  }
+  if (errors) {
+    VL_PRINTF("test_kdforest_layout: %s %s compact=%d reorder=%d, max %d comparisons: %d errors\n",
+              vl_get_type_name (dataType), method == VL_KDTREE_MEAN ? "mean" : "median",
+              compact, reorder, (int) maxNumComparisons, errors) ;
+  }
+  vl_kdforest_delete (forests[0]) ;
+  vl_kdforest_delete (forests[1]) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_size maxNumComparisons [3] = {0, 50, 500} ;
+  vl_bool compact [3] = {VL_TRUE, VL_FALSE, VL_TRUE} ;
+  vl_bool reorder [3] = {VL_FALSE, VL_TRUE, VL_TRUE} ;
+  vl_uindex i, k, l ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 1) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) {
+    datad[i] = vl_rand_real1 (rand) ;
+    data[i] = (float) datad[i] ;
+  }
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) {
+    queriesd[i] = vl_rand_real1 (rand) ;
+    queries[i] = (float) queriesd[i] ;
+  }
+
+  for (l = 0 ; l < 3 ; ++l) {
+    for (k = 0 ; k < 3 ; ++k) {
+      errors += test_layout (VL_TYPE_FLOAT, VL_KDTREE_MEDIAN, compact[l], reorder[l], maxNumComparisons[k]) ;
+      errors += test_layout (VL_TYPE_FLOAT, VL_KDTREE_MEAN, compact[l], reorder[l], maxNumComparisons[k]) ;
+    }
+    errors += test_layout (VL_TYPE_DOUBLE, VL_KDTREE_MEDIAN, compact[l], reorder[l], 0) ;
+    errors += test_layout (VL_TYPE_DOUBLE, VL_KDTREE_MEAN, compact[l], reorder[l], 0) ;
+  }
+
+  VL_PRINTF("test_kdforest_layout: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,117 @@
+/** @file test_kdforest_range.c
+ ** @brief KD-forest range query test
+ **/
+
+#include <vl/kdtree.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+
+#define DIMENSION 3
+#define NUM_DATA 4000
+#define NUM_QUERIES 100
+
+static float data [DIMENSION * NUM_DATA] ;
+static float queries [DIMENSION * NUM_QUERIES] ;
+
+/* the points within the radius, by brute force, must be exactly the
+ * ones found by the single and the multiple range queries, in the
+ * same order (by distance and then by index) */
+
+static int
+test_range (VlVectorComparisonType distance, VlKDTreeThresholdingMethod method,
+            vl_bool compact, double radius)
+{
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f (distance) ;
+  VlKDForest * forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, 2, distance) ;
+  vl_size offsets [NUM_QUERIES + 1] ;
+  vl_uint32 * indexes = NULL ;
+  float * distances = NULL ;
+  vl_size numFound = 0 ;
+  vl_uindex q, i ;
+  int errors = 0 ;
+
+  vl_kdforest_set_thresholding_method (forest, method) ;
+  vl_kdforest_set_compact_layout (forest, compact) ;
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_query_range_with_array (forest, offsets, &indexes, (void**)&distances,
+                                      radius, NUM_QUERIES, queries) ;
+
+  for (q = 0 ; q < NUM_QUERIES ; ++q) {
+    VlKDForestNeighbor const * neighbors ;
+    float const * query = queries + q * DIMENSION ;
+    vl_size n = vl_kdforest_query_range (forest, &neighbors, radius, query) ;
+    vl_size numExpected = 0 ;
+    double lastDist = -1 ;
+    vl_uindex lastIndex = 0 ;
+
+    for (i = 0 ; i < n ; ++i) {
+      double dist = distFn (DIMENSION, query, data + neighbors[i].index * DIMENSION) ;
+      if (neighbors[i].index >= NUM_DATA ||
+          dist > radius ||
+          neighbors[i].distance != dist ||
+          dist < lastDist ||
+          (dist == lastDist && neighbors[i].index <= lastIndex)) {
+        errors ++ ;
+      }
+      lastDist = dist ;
+      lastIndex = neighbors[i].index ;
+    }
+    for (i = 0 ; i < NUM_DATA ; ++i) {
+      if (distFn (DIMENSION, query, data + i * DIMENSION) <= radius) numExpected ++ ;
+    }
+    if (n != numExpected) errors ++ ;
+
+    if (offsets[q] != numFound || offsets[q+1] - offsets[q] != n) {
+      errors ++ ;
+    } else {
+      for (i = 0 ; i < n ; ++i) {
+        if (indexes[offsets[q] + i] != neighbors[i].index ||
+            distances[offsets[q] + i] != (float) neighbors[i].distance) {
+          errors ++ ;
+        }
+      }
+    }
+    numFound += n ;
+  }
+  if (radius > 0 && numFound < NUM_QUERIES) errors ++ ;
+
+  if (errors) {
+    VL_PRINTF("test_kdforest_range: %s %s compact=%d: %d errors\n",
+              vl_get_vector_comparison_type_name (distance),
+              method == VL_KDTREE_MEAN ? "mean" : "median",
+              compact, errors) ;
+  }
+  if (indexes) vl_free (indexes) ;
+  if (distances) vl_free (distances) ;
+  vl_kdforest_delete (forest) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  int method, compact, errors = 0 ;
+  vl_uindex i ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) {
+    /* quantized coordinates, so that there are ties */
+    data[i] = (float) vl_rand_uindex (rand, 64) / 64 ;
+  }
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) {
+    queries[i] = (float) vl_rand_uindex (rand, 64) / 64 ;
+  }
+
+  for (method = 0 ; method < 2 ; ++method) {
+    for (compact = 0 ; compact < 2 ; ++compact) {
+      VlKDTreeThresholdingMethod m = method ? VL_KDTREE_MEAN : VL_KDTREE_MEDIAN ;
+      errors += test_range (VlDistanceL2, m, compact, 0.01) ;
+      errors += test_range (VlDistanceL1, m, compact, 0.15) ;
+      errors += test_range (VlDistanceL2, m, compact, 0) ;
+    }
+  }
+
+  VL_PRINTF("test_kdforest_range: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,104 @@
+/** @file test_kdforest_threads.c
+ ** @brief KD-forest parallel construction test
+ **/
+
+#include <vl/kdtree.h>
+#include <vl/random.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#define DIMENSION 10
+#define NUM_DATA 60000
+#define NUM_TREES 4
+
+static char const * fileName = "/tmp/test_kdforest_threads.bin" ;
+
+static float data [DIMENSION * NUM_DATA] ;
+
+/* build a forest with numThreads threads and return its saved image */
+
+static vl_size
+build (VlKDTreeThresholdingMethod method, vl_bool compact,
+       vl_size numThreads, char ** buffer)
+{
+  VlKDForest * forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, NUM_TREES, VlDistanceL2) ;
+  FILE * file ;
+  long size = 0 ;
+
+  vl_set_num_threads (numThreads) ;
+  vl_rand_seed (vl_get_rand (), 0) ;
+  vl_kdforest_set_thresholding_method (forest, method) ;
+  vl_kdforest_set_compact_layout (forest, compact) ;
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_save (forest, fileName, VL_FALSE) ;
+  vl_kdforest_delete (forest) ;
+
+  *buffer = NULL ;
+  file = fopen (fileName, "rb") ;
+  if (file == NULL) return 0 ;
+  fseek (file, 0, SEEK_END) ;
+  size = ftell (file) ;
+  fseek (file, 0, SEEK_SET) ;
+  *buffer = vl_malloc (size) ;
+  if (fread (*buffer, 1, size, file) != (size_t) size) size = 0 ;
+  fclose (file) ;
+  return (vl_size) size ;
+}
+
+/* the trees must be identical for any number of threads */
+
+static int
+test (VlKDTreeThresholdingMethod method, vl_bool compact)
+{
+  vl_size numThreads [3] = {2, 3, 8} ;
+  char * expected, * buffer ;
+  vl_size expectedSize, size ;
+  vl_uindex t ;
+  int errors = 0 ;
+
+  expectedSize = build (method, compact, 1, &expected) ;
+  if (expectedSize == 0) {
+    VL_PRINTF("test_kdforest_threads: could not save %s\n", fileName) ;
+    return 1 ;
+  }
+  for (t = 0 ; t < 3 ; ++t) {
+    size = build (method, compact, numThreads[t], &buffer) ;
+    if (size != expectedSize || memcmp (buffer, expected, size) != 0) {
+      VL_PRINTF("test_kdforest_threads: %s compact=%d with %d threads differs from 1 thread\n",
+                method == VL_KDTREE_MEAN ? "mean" : "median", compact,
+                (int) numThreads[t]) ;
+      errors ++ ;
+    }
+    vl_free (buffer) ;
+  }
+  vl_free (expected) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 1) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] = (float) vl_rand_real1 (rand) ;
+
+#if defined(_OPENMP)
+  /* make sure that the requested threads are really used */
+  omp_set_dynamic (0) ;
+#endif
+
+  errors += test (VL_KDTREE_MEDIAN, VL_FALSE) ;
+  errors += test (VL_KDTREE_MEAN, VL_FALSE) ;
+  errors += test (VL_KDTREE_MEDIAN, VL_TRUE) ;
+  remove (fileName) ;
+
+  VL_PRINTF("test_kdforest_threads: %d errors\n", errors) ;
+  return errors > 0 ;
+}
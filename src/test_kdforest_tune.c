@@ -0,0 +1,102 @@
+/** @file test_kdforest_tune.c
+ ** @brief KD-forest recall autotuner test
+ **/
+
+#include <vl/kdtree.h>
+#include <vl/random.h>
+
+#define DIMENSION 16
+#define NUM_DATA 20000
+#define NUM_QUERIES 300
+#define NUM_NEIGHBORS 5
+#define MAX_NUM_TREES 8
+
+static float data [DIMENSION * NUM_DATA] ;
+static float tuningQueries [DIMENSION * NUM_QUERIES] ;
+static float queries [DIMENSION * NUM_QUERIES] ;
+static vl_uint32 truth [NUM_NEIGHBORS * NUM_QUERIES] ;
+
+/* the fraction of the exact neighbors found for the test queries */
+
+static double
+get_recall (VlKDForest * forest)
+{
+  static vl_uint32 indexes [NUM_NEIGHBORS * NUM_QUERIES] ;
+  vl_size numFound = 0 ;
+  vl_uindex q, i, j ;
+  vl_kdforest_query_with_array (forest, indexes, NUM_NEIGHBORS, NUM_QUERIES, NULL, queries) ;
+  for (q = 0 ; q < NUM_QUERIES ; ++q) {
+    for (i = 0 ; i < NUM_NEIGHBORS ; ++i) {
+      for (j = 0 ; j < NUM_NEIGHBORS ; ++j) {
+        if (indexes[q * NUM_NEIGHBORS + j] == truth[q * NUM_NEIGHBORS + i]) {
+          numFound ++ ;
+          break ;
+        }
+      }
+    }
+  }
+  return (double) numFound / (NUM_NEIGHBORS * NUM_QUERIES) ;
+}
+
+/* the parameters selected by the tuner must reach the target recall
+ * on the tuning queries and, up to sampling noise, on different
+ * queries from the same distribution */
+
+static int
+test_tune (double targetRecall)
+{
+  VlKDForest * forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, 1, VlDistanceL2) ;
+  VlKDForestTuning tuning ;
+  double recall ;
+  int errors = 0 ;
+
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_tune (forest, &tuning, NUM_NEIGHBORS, targetRecall, MAX_NUM_TREES,
+                    NUM_QUERIES, tuningQueries) ;
+  vl_kdforest_delete (forest) ;
+
+  if (tuning.numTrees < 1 || tuning.numTrees > MAX_NUM_TREES) errors ++ ;
+  if (tuning.recall < targetRecall) errors ++ ;
+
+  forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, tuning.numTrees, VlDistanceL2) ;
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_set_max_num_comparisons (forest, tuning.maxNumComparisons) ;
+  recall = get_recall (forest) ;
+  vl_kdforest_delete (forest) ;
+  if (recall < targetRecall - 0.05) errors ++ ;
+
+  VL_PRINTF("test_kdforest_tune: target %g: %d trees, %d comparisons, recall %g (test %g)\n",
+            targetRecall, (int) tuning.numTrees, (int) tuning.maxNumComparisons,
+            tuning.recall, recall) ;
+  if (errors) {
+    VL_PRINTF("test_kdforest_tune: target %g: %d errors\n", targetRecall, errors) ;
+  }
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  VlKDForest * forest ;
+  double targets [3] = {0.5, 0.8, 0.95} ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] = (float) vl_rand_real1 (rand) ;
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) tuningQueries[i] = (float) vl_rand_real1 (rand) ;
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) queries[i] = (float) vl_rand_real1 (rand) ;
+
+  /* exact neighbors of the test queries */
+  forest = vl_kdforest_new (VL_TYPE_FLOAT, DIMENSION, 1, VlDistanceL2) ;
+  vl_kdforest_build (forest, NUM_DATA, data) ;
+  vl_kdforest_set_max_num_comparisons (forest, 0) ;
+  vl_kdforest_query_with_array (forest, truth, NUM_NEIGHBORS, NUM_QUERIES, NULL, queries) ;
+  vl_kdforest_delete (forest) ;
+
+  for (i = 0 ; i < 3 ; ++i) errors += test_tune (targets[i]) ;
+
+  VL_PRINTF("test_kdforest_tune: %d errors\n", errors) ;
+  return errors > 0 ;
+}
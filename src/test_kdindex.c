@@ -0,0 +1,102 @@
+/** @file test_kdindex.c
+ ** @brief Dynamic KD-tree index test
+ **/
+
+#include <vl/kdindex.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+
+#define DIMENSION 4
+#define MAX_NUM_DATA 12000
+#define NUM_NEIGHBORS 3
+#define NUM_STEPS 400
+
+static float data [DIMENSION * MAX_NUM_DATA] ;
+
+/* an exact query must return the same distances as brute force over
+ * the points which are in the index */
+
+static int
+check_queries (VlKDIndex * index, vl_size numInserted)
+{
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f (VlDistanceL2) ;
+  VlRand * rand = vl_get_rand () ;
+  VlKDForestNeighbor neighbors [NUM_NEIGHBORS] ;
+  float query [DIMENSION] ;
+  int q, errors = 0 ;
+
+  for (q = 0 ; q < 5 ; ++q) {
+    float best [NUM_NEIGHBORS] ;
+    vl_uindex i, k ;
+    for (i = 0 ; i < DIMENSION ; ++i) query[i] = (float) vl_rand_real1 (rand) ;
+    for (k = 0 ; k < NUM_NEIGHBORS ; ++k) best[k] = VL_INFINITY_F ;
+    for (i = 0 ; i < numInserted ; ++i) {
+      float dist ;
+      if (! vl_kdindex_contains (index, i)) continue ;
+      dist = distFn (DIMENSION, query, data + i * DIMENSION) ;
+      for (k = NUM_NEIGHBORS ; k > 0 && best[k-1] > dist ; --k) {
+        if (k < NUM_NEIGHBORS) best[k] = best[k-1] ;
+      }
+      if (k < NUM_NEIGHBORS) best[k] = dist ;
+    }
+    vl_kdindex_query (index, neighbors, NUM_NEIGHBORS, query) ;
+    for (k = 0 ; k < NUM_NEIGHBORS ; ++k) {
+      if (best[k] == VL_INFINITY_F) {
+        if (neighbors[k].index != (vl_uindex)-1) errors ++ ;
+      } else if ((float)neighbors[k].distance != best[k] ||
+                 ! vl_kdindex_contains (index, neighbors[k].index)) {
+        errors ++ ;
+      }
+    }
+  }
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  VlKDIndex * index = vl_kdindex_new (VL_TYPE_FLOAT, DIMENSION, 2, VlDistanceL2) ;
+  vl_size numInserted = 0 ;
+  vl_size maxNumLevels = 0 ;
+  int step, errors = 0 ;
+  vl_uindex i ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * MAX_NUM_DATA ; ++i) data[i] = (float) vl_rand_real1 (rand) ;
+
+  for (step = 0 ; step < NUM_STEPS ; ++step) {
+    vl_size numData = vl_rand_uindex (rand, 60) ;
+    vl_size numRemoved = vl_rand_uindex (rand, 40) ;
+    if (numInserted + numData > MAX_NUM_DATA) numData = MAX_NUM_DATA - numInserted ;
+    if (numData > 0) {
+      if (vl_kdindex_insert (index, data + numInserted * DIMENSION, numData) != numInserted) errors ++ ;
+      numInserted += numData ;
+    }
+    for (i = 0 ; i < numRemoved && numInserted > 0 ; ++i) {
+      vl_kdindex_remove (index, vl_rand_uindex (rand, numInserted)) ;
+    }
+
+    /* prepare a merge and commit it after a few more steps, so that
+       points are inserted and removed in between */
+    if (step % 3 == 0) {
+      vl_kdindex_commit_merge (index) ;
+    } else if (vl_kdindex_needs_merge (index)) {
+      vl_kdindex_prepare_merge (index) ;
+    }
+    maxNumLevels = VL_MAX(maxNumLevels, vl_kdindex_get_num_levels (index)) ;
+
+    /* switch between exact and budgeted search; only the exact one
+       is checked */
+    vl_kdindex_set_max_num_comparisons (index, (step % 7 == 6) ? 10 : 0) ;
+    if (step % 7 != 6) errors += check_queries (index, numInserted) ;
+  }
+
+  VL_PRINTF("test_kdindex: %d points inserted, %d in the index, %d levels at most\n",
+            (int) numInserted, (int) vl_kdindex_get_num_data (index), (int) maxNumLevels) ;
+  if (maxNumLevels < 2) errors ++ ;
+  vl_kdindex_delete (index) ;
+
+  VL_PRINTF("test_kdindex: %d errors\n", errors) ;
+  return errors > 0 ;
+}
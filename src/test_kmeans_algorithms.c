@@ -0,0 +1,139 @@
+/** @file test_kmeans_algorithms.c
+ ** @brief K-means Elkan, Hamerly and Yinyang algorithms test
+ **/
+
+#include <vl/kmeans.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+#include <string.h>
+
+#define DIMENSION 16
+#define NUM_DATA 4000
+#define NUM_CENTERS 40
+#define NUM_ITERATIONS 20
+
+static double data [DIMENSION * NUM_DATA] ;
+static double initialCenters [DIMENSION * NUM_CENTERS] ;
+static double centers [DIMENSION * NUM_CENTERS] ;
+static vl_uint32 assignments [NUM_DATA] ;
+
+/* clustered data, possibly far from the origin */
+
+static void
+make_data (double offset)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex i, d ;
+  vl_rand_seed (rand, 1) ;
+  for (i = 0 ; i < NUM_DATA ; ++i) {
+    vl_uindex c = vl_rand_uindex (rand, NUM_CENTERS) ;
+    for (d = 0 ; d < DIMENSION ; ++d) {
+      data[i * DIMENSION + d] = offset + (double) ((c * 37) % 11) * ((d + c) % 3) +
+        vl_rand_real1 (rand) + vl_rand_real1 (rand) - 1 ;
+    }
+  }
+  for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) {
+    initialCenters[i] = data[DIMENSION * 7 + i] ;
+  }
+}
+
+/* Lloyd's algorithm with exactly computed distances, as a reference */
+
+static void
+exact_lloyd (void)
+{
+  static double accumulators [DIMENSION * NUM_CENTERS] ;
+  vl_size counts [NUM_CENTERS] ;
+  vl_uindex t, i, c, d ;
+  memcpy (centers, initialCenters, sizeof(centers)) ;
+  for (t = 0 ; t < NUM_ITERATIONS ; ++t) {
+    for (i = 0 ; i < NUM_DATA ; ++i) {
+      double best = VL_INFINITY_D ;
+      for (c = 0 ; c < NUM_CENTERS ; ++c) {
+        double distance = 0 ;
+        for (d = 0 ; d < DIMENSION ; ++d) {
+          double delta = data[i * DIMENSION + d] - centers[c * DIMENSION + d] ;
+          distance += delta * delta ;
+        }
+        if (distance < best) {
+          best = distance ;
+          assignments[i] = (vl_uint32) c ;
+        }
+      }
+    }
+    memset (accumulators, 0, sizeof(accumulators)) ;
+    memset (counts, 0, sizeof(counts)) ;
+    for (i = 0 ; i < NUM_DATA ; ++i) {
+      counts[assignments[i]] ++ ;
+      for (d = 0 ; d < DIMENSION ; ++d) {
+        accumulators[assignments[i] * DIMENSION + d] += data[i * DIMENSION + d] ;
+      }
+    }
+    for (c = 0 ; c < NUM_CENTERS ; ++c) {
+      if (counts[c] == 0) continue ;
+      for (d = 0 ; d < DIMENSION ; ++d) {
+        centers[c * DIMENSION + d] = accumulators[c * DIMENSION + d] / counts[c] ;
+      }
+    }
+  }
+}
+
+/* the accelerated algorithms must reach the same centers as Lloyd's
+ * algorithm from the same initialization, as their bounds only skip
+ * distances that cannot change the assignments */
+
+static int
+test_algorithm (VlKMeansAlgorithm algorithm, vl_size numGroups,
+                double offset, double const * expected)
+{
+  VlKMeans * kmeans = vl_kmeans_new (VL_TYPE_DOUBLE, VlDistanceL2) ;
+  double const * result ;
+  double maxDifference = 0 ;
+  vl_uindex i ;
+
+  vl_kmeans_set_algorithm (kmeans, algorithm) ;
+  vl_kmeans_set_num_center_groups (kmeans, numGroups) ;
+  vl_kmeans_set_max_num_iterations (kmeans, NUM_ITERATIONS) ;
+  vl_kmeans_set_min_energy_variation (kmeans, 0) ;
+  vl_kmeans_set_centers (kmeans, initialCenters, DIMENSION, NUM_CENTERS) ;
+  vl_kmeans_refine_centers (kmeans, data, NUM_DATA) ;
+
+  result = vl_kmeans_get_centers (kmeans) ;
+  for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) {
+    maxDifference = VL_MAX(maxDifference, vl_abs_d (result[i] - expected[i])) ;
+  }
+  vl_kmeans_delete (kmeans) ;
+
+  if (maxDifference > 1e-6) {
+    VL_PRINTF("test_kmeans_algorithms: algorithm %d, %d groups, offset %g: centers differ by %g\n",
+              (int) algorithm, (int) numGroups, offset, maxDifference) ;
+    return 1 ;
+  }
+  return 0 ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  static double lloydCenters [DIMENSION * NUM_CENTERS] ;
+  double offsets [2] = {0, 1e7} ;
+  int o, errors = 0 ;
+
+  for (o = 0 ; o < 2 ; ++o) {
+    make_data (offsets[o]) ;
+    exact_lloyd () ;
+    memcpy (lloydCenters, centers, sizeof(centers)) ;
+    /* the blocked inner products of Lloyd's algorithm are accurate
+       only near the origin */
+    if (offsets[o] == 0) {
+      errors += test_algorithm (VlKMeansLloyd, 1, offsets[o], lloydCenters) ;
+    }
+    errors += test_algorithm (VlKMeansElkan, 1, offsets[o], lloydCenters) ;
+    errors += test_algorithm (VlKMeansHamerly, 1, offsets[o], lloydCenters) ;
+    errors += test_algorithm (VlKMeansYinyang, 4, offsets[o], lloydCenters) ;
+    errors += test_algorithm (VlKMeansYinyang, 10, offsets[o], lloydCenters) ;
+  }
+
+  VL_PRINTF("test_kmeans_algorithms: %d errors\n", errors) ;
+  return errors > 0 ;
+}
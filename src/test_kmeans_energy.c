@@ -0,0 +1,105 @@
+/** @file test_kmeans_energy.c
+ ** @brief K-means approximate algorithms energy test
+ **/
+
+#include <vl/kmeans.h>
+#include <vl/random.h>
+
+#define DIMENSION 8
+#define NUM_DATA 20000
+#define NUM_CLUSTERS 40
+#define NUM_CENTERS 40
+#define NUM_TRIALS 8
+
+static float data [DIMENSION * NUM_DATA] ;
+
+/* the exact energy of the centers found by kmeans */
+
+static double
+get_energy (VlKMeans * kmeans)
+{
+  static vl_uint32 assignments [NUM_DATA] ;
+  static float distances [NUM_DATA] ;
+  double energy = 0 ;
+  vl_uindex i ;
+  vl_kmeans_quantize (kmeans, assignments, distances, data, NUM_DATA) ;
+  for (i = 0 ; i < NUM_DATA ; ++i) energy += distances[i] ;
+  return energy ;
+}
+
+/* the average energy over a few trials; since each trial may end in
+ * a different local minimum, only the average is compared */
+
+static double
+run (VlKMeansAlgorithm algorithm, VlKMeansInitialization initialization,
+     vl_size maxNumIterations)
+{
+  double energy = 0 ;
+  vl_uindex trial ;
+  for (trial = 0 ; trial < NUM_TRIALS ; ++trial) {
+    VlKMeans * kmeans = vl_kmeans_new (VL_TYPE_FLOAT, VlDistanceL2) ;
+    vl_rand_seed (vl_get_rand (), trial) ;
+    vl_kmeans_set_algorithm (kmeans, algorithm) ;
+    vl_kmeans_set_initialization (kmeans, initialization) ;
+    vl_kmeans_set_max_num_iterations (kmeans, maxNumIterations) ;
+    vl_kmeans_set_batch_size (kmeans, 500) ;
+    vl_kmeans_cluster (kmeans, data, DIMENSION, NUM_DATA, NUM_CENTERS) ;
+    energy += get_energy (kmeans) ;
+    vl_kmeans_delete (kmeans) ;
+  }
+  return energy / NUM_TRIALS ;
+}
+
+/* the energy of an approximate solution must be close to the one
+ * of the reference method */
+
+static int
+check (char const * name, double energy,
+       char const * referenceName, double reference, double tolerance)
+{
+  VL_PRINTF("test_kmeans_energy: %s: average energy %g, %s %g\n",
+            name, energy, referenceName, reference) ;
+  if (energy > (1 + tolerance) * reference) {
+    VL_PRINTF("test_kmeans_energy: %s: average energy more than %g%% above %s\n",
+              name, 100 * tolerance, referenceName) ;
+    return 1 ;
+  }
+  return 0 ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  static float means [DIMENSION * NUM_CLUSTERS] ;
+  double reference, energy ;
+  vl_uindex i, d ;
+  int errors = 0 ;
+
+  /* a mixture of clusters of different sizes */
+  vl_rand_seed (rand, 1) ;
+  for (i = 0 ; i < DIMENSION * NUM_CLUSTERS ; ++i) means[i] = (float) vl_rand_real1 (rand) ;
+  for (i = 0 ; i < NUM_DATA ; ++i) {
+    vl_uindex c = vl_rand_uindex (rand, NUM_CLUSTERS) ;
+    c = vl_rand_uindex (rand, c + 1) ;
+    for (d = 0 ; d < DIMENSION ; ++d) {
+      double noise = vl_rand_real1 (rand) + vl_rand_real1 (rand) + vl_rand_real1 (rand) - 1.5 ;
+      data[i * DIMENSION + d] = (float) (means[c * DIMENSION + d] + 0.1 * noise) ;
+    }
+  }
+
+  reference = run (VlKMeansLloyd, VlKMeansPlusPlus, 100) ;
+  energy = run (VlKMeansMiniBatch, VlKMeansPlusPlus, 200) ;
+  errors += check ("mini-batch", energy, "Lloyd", reference, 0.05) ;
+
+  energy = run (VlKMeansLloyd, VlKMeansParallelPlusPlus, 100) ;
+  errors += check ("k-means|| + Lloyd", energy, "k-means++ + Lloyd", reference, 0.05) ;
+
+  /* the k-means|| seeding alone must be about as good as k-means++ */
+  reference = run (VlKMeansLloyd, VlKMeansPlusPlus, 0) ;
+  energy = run (VlKMeansLloyd, VlKMeansParallelPlusPlus, 0) ;
+  errors += check ("k-means|| seeding", energy, "k-means++ seeding", reference, 0.1) ;
+
+  VL_PRINTF("test_kmeans_energy: %d errors\n", errors) ;
+  return errors > 0 ;
+}
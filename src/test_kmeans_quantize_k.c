@@ -0,0 +1,117 @@
+/** @file test_kmeans_quantize_k.c
+ ** @brief K-means top-k quantization test
+ **/
+
+#include <vl/kmeans.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+#include <stdlib.h>
+
+#define DIMENSION 12
+#define NUM_DATA 1500
+#define NUM_CENTERS 70
+#define MAX_NUM_NEIGHBORS 8
+
+static double data [DIMENSION * NUM_DATA] ;
+static double centers [DIMENSION * NUM_CENTERS] ;
+static float dataf [DIMENSION * NUM_DATA] ;
+static float centersf [DIMENSION * NUM_CENTERS] ;
+
+static int
+compare_doubles (void const * a, void const * b)
+{
+  double x = *(double const *)a ;
+  double y = *(double const *)b ;
+  return (x > y) - (x < y) ;
+}
+
+/* the k centers returned for each point must be the k closest by
+ * brute force, sorted, and with their exact distances; centers
+ * tied up to rounding with the k-th one may be swapped */
+
+static int
+test (vl_type dataType, VlVectorComparisonType distance, vl_size numNeighbors, double offset)
+{
+  VlKMeans * kmeans = vl_kmeans_new (dataType, distance) ;
+  VlDoubleVectorComparisonFunction fd = vl_get_vector_comparison_function_d (distance) ;
+  VlFloatVectorComparisonFunction ff = vl_get_vector_comparison_function_f (distance) ;
+  static vl_uint32 assignments [MAX_NUM_NEIGHBORS * NUM_DATA] ;
+  static double distances [MAX_NUM_NEIGHBORS * NUM_DATA] ;
+  double all [NUM_CENTERS] ;
+  double tolerance = (dataType == VL_TYPE_FLOAT) ? 1e-5 : 1e-12 ;
+  vl_uindex i, c, k ;
+  int errors = 0 ;
+
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) dataf[i] = (float) (data[i] + offset) ;
+  for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) centersf[i] = (float) (centers[i] + offset) ;
+
+  if (dataType == VL_TYPE_FLOAT) {
+    vl_kmeans_set_centers (kmeans, centersf, DIMENSION, NUM_CENTERS) ;
+    vl_kmeans_quantize_k (kmeans, assignments, distances, dataf, NUM_DATA, numNeighbors) ;
+  } else {
+    for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) centers[i] += offset ;
+    for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] += offset ;
+    vl_kmeans_set_centers (kmeans, centers, DIMENSION, NUM_CENTERS) ;
+    vl_kmeans_quantize_k (kmeans, assignments, distances, data, NUM_DATA, numNeighbors) ;
+  }
+
+  for (i = 0 ; i < NUM_DATA ; ++i) {
+    vl_uint32 const * a = assignments + i * numNeighbors ;
+    for (c = 0 ; c < NUM_CENTERS ; ++c) {
+      all[c] = (dataType == VL_TYPE_FLOAT) ?
+        ff (DIMENSION, dataf + i * DIMENSION, centersf + c * DIMENSION) :
+        fd (DIMENSION, data + i * DIMENSION, centers + c * DIMENSION) ;
+    }
+    for (k = 0 ; k < numNeighbors ; ++k) {
+      double d = (dataType == VL_TYPE_FLOAT) ?
+        ((float*)distances)[i * numNeighbors + k] : distances[i * numNeighbors + k] ;
+      if (a[k] >= NUM_CENTERS || d != all[a[k]]) { errors ++ ; continue ; }
+      if (k > 0 && d < all[a[k-1]]) errors ++ ;
+    }
+    qsort (all, NUM_CENTERS, sizeof(double), compare_doubles) ;
+    for (k = 0 ; k < numNeighbors ; ++k) {
+      double d = (dataType == VL_TYPE_FLOAT) ?
+        ((float*)distances)[i * numNeighbors + k] : distances[i * numNeighbors + k] ;
+      if (vl_abs_d (d - all[k]) > tolerance * all[k]) errors ++ ;
+    }
+  }
+
+  if (dataType == VL_TYPE_DOUBLE) {
+    for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) centers[i] -= offset ;
+    for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] -= offset ;
+  }
+  if (errors) {
+    VL_PRINTF("test_kmeans_quantize_k: %s %s k=%d offset=%g: %d errors\n",
+              vl_get_type_name (dataType),
+              distance == VlDistanceL2 ? "l2" : "l1",
+              (int) numNeighbors, offset, errors) ;
+  }
+  vl_kmeans_delete (kmeans) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_size numNeighbors [4] = {1, 2, 5, MAX_NUM_NEIGHBORS} ;
+  double offsets [2] = {0, 100} ;
+  vl_uindex i, k, o ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] = vl_rand_real1 (rand) ;
+  for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) centers[i] = vl_rand_real1 (rand) ;
+
+  for (o = 0 ; o < 2 ; ++o) {
+    for (k = 0 ; k < 4 ; ++k) {
+      errors += test (VL_TYPE_FLOAT, VlDistanceL2, numNeighbors[k], offsets[o]) ;
+      errors += test (VL_TYPE_DOUBLE, VlDistanceL2, numNeighbors[k], offsets[o]) ;
+      errors += test (VL_TYPE_FLOAT, VlDistanceL1, numNeighbors[k], offsets[o]) ;
+      errors += test (VL_TYPE_DOUBLE, VlDistanceL1, numNeighbors[k], offsets[o]) ;
+    }
+  }
+
+  VL_PRINTF("test_kmeans_quantize_k: %d errors\n", errors) ;
+  return errors > 0 ;
+}
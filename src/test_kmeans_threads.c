@@ -0,0 +1,83 @@
+/** @file test_kmeans_threads.c
+ ** @brief K-means center update thread independence test
+ **/
+
+#include <vl/kmeans.h>
+#include <vl/random.h>
+#include <string.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#define DIMENSION 12
+#define NUM_DATA 5000
+#define NUM_CENTERS 60
+#define NUM_ITERATIONS 15
+
+static float data [DIMENSION * NUM_DATA] ;
+
+/* cluster with a fixed number of iterations using numThreads threads */
+
+static void
+run (VlKMeansAlgorithm algorithm, VlVectorComparisonType distance,
+     vl_size numThreads, float * centers)
+{
+  VlKMeans * kmeans = vl_kmeans_new (VL_TYPE_FLOAT, distance) ;
+  vl_set_num_threads (numThreads) ;
+  vl_rand_seed (vl_get_rand (), 0) ;
+  vl_kmeans_set_algorithm (kmeans, algorithm) ;
+  vl_kmeans_set_max_num_iterations (kmeans, NUM_ITERATIONS) ;
+  vl_kmeans_set_min_energy_variation (kmeans, 0) ;
+  vl_kmeans_set_initialization (kmeans, VlKMeansRandomSelection) ;
+  vl_kmeans_cluster (kmeans, data, DIMENSION, NUM_DATA, NUM_CENTERS) ;
+  memcpy (centers, vl_kmeans_get_centers (kmeans), sizeof(float) * DIMENSION * NUM_CENTERS) ;
+  vl_kmeans_delete (kmeans) ;
+}
+
+/* the centers must be bit-identical for any number of threads */
+
+static int
+test (char const * name, VlKMeansAlgorithm algorithm, VlVectorComparisonType distance)
+{
+  static float expected [DIMENSION * NUM_CENTERS] ;
+  static float centers [DIMENSION * NUM_CENTERS] ;
+  vl_size numThreads [3] = {2, 3, 8} ;
+  vl_uindex t ;
+  int errors = 0 ;
+
+  run (algorithm, distance, 1, expected) ;
+  for (t = 0 ; t < 3 ; ++t) {
+    run (algorithm, distance, numThreads[t], centers) ;
+    if (memcmp (centers, expected, sizeof(centers)) != 0) {
+      VL_PRINTF("test_kmeans_threads: %s with %d threads differs from 1 thread\n",
+                name, (int) numThreads[t]) ;
+      errors ++ ;
+    }
+  }
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex i ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 1) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) data[i] = (float) vl_rand_real1 (rand) ;
+
+#if defined(_OPENMP)
+  /* make sure that the requested threads are really used */
+  omp_set_dynamic (0) ;
+#endif
+
+  errors += test ("lloyd l2", VlKMeansLloyd, VlDistanceL2) ;
+  errors += test ("lloyd l1", VlKMeansLloyd, VlDistanceL1) ;
+  errors += test ("elkan l2", VlKMeansElkan, VlDistanceL2) ;
+  errors += test ("ann l2", VlKMeansANN, VlDistanceL2) ;
+
+  VL_PRINTF("test_kmeans_threads: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,193 @@
+/** @file test_kmeans_ui8.c
+ ** @brief K-means on 8-bit data test
+ **/
+
+#include <vl/kmeans.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+#include <string.h>
+
+#define DIMENSION 35
+#define NUM_DATA 2000
+#define NUM_CENTERS 10
+
+static vl_uint8 dataUi8 [DIMENSION * NUM_DATA] ;
+static float dataFloat [DIMENSION * NUM_DATA] ;
+
+static void
+read_float (void * buffer, vl_uindex begin, vl_size numData, void * userData VL_UNUSED)
+{
+  memcpy (buffer, dataFloat + begin * DIMENSION, sizeof(float) * DIMENSION * numData) ;
+}
+
+/* the integer distances must match the double ones exactly, with and
+ * without SIMD, for all lengths (to exercise the vector tails) */
+
+static int
+test_distances (void)
+{
+  VlVectorComparisonType types [3] = {VlDistanceL2, VlDistanceL1, VlKernelL2} ;
+  double X [DIMENSION] ;
+  double Y [DIMENSION] ;
+  int simd, t, errors = 0 ;
+  vl_size n ;
+  vl_uindex i ;
+
+  for (i = 0 ; i < DIMENSION ; ++i) {
+    X[i] = dataUi8[i] ;
+    Y[i] = dataUi8[DIMENSION + i] ;
+  }
+
+  for (simd = 0 ; simd < 2 ; ++simd) {
+    vl_set_simd_enabled (simd) ;
+    for (t = 0 ; t < 3 ; ++t) {
+      VlUInt8VectorComparisonFunction fi = vl_get_vector_comparison_function_ui8 (types[t]) ;
+      VlDoubleVectorComparisonFunction fd = vl_get_vector_comparison_function_d (types[t]) ;
+      for (n = 0 ; n <= DIMENSION ; ++n) {
+        vl_uint32 a = fi (n, dataUi8, dataUi8 + DIMENSION) ;
+        double b = fd (n, X, Y) ;
+        if ((double)a != b) {
+          VL_PRINTF("test_kmeans_ui8: %s simd=%d n=%d: %u != %g\n",
+                    vl_get_vector_comparison_type_name(types[t]), simd, (int)n, a, b) ;
+          errors ++ ;
+        }
+      }
+    }
+  }
+  vl_set_simd_enabled (VL_TRUE) ;
+  return errors ;
+}
+
+/* quantizing the 8-bit data must give the same result as quantizing
+ * the data converted to float, with both integer and fractional centers */
+
+static int
+test_quantize (VlVectorComparisonType distance)
+{
+  VlKMeans * kmeans = vl_kmeans_new (VL_TYPE_FLOAT, distance) ;
+  float centers [DIMENSION * NUM_CENTERS] ;
+  vl_uint32 assignUi8 [NUM_DATA], assignFloat [NUM_DATA] ;
+  float distUi8 [NUM_DATA], distFloat [NUM_DATA] ;
+  int fractional, errors = 0 ;
+  vl_uindex i ;
+
+  for (fractional = 0 ; fractional < 2 ; ++fractional) {
+    for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) {
+      centers[i] = dataFloat[5 * DIMENSION + i] + (fractional ? 0.25f : 0.0f) ;
+    }
+    vl_kmeans_set_centers (kmeans, centers, DIMENSION, NUM_CENTERS) ;
+    vl_kmeans_quantize_ui8 (kmeans, assignUi8, distUi8, dataUi8, NUM_DATA) ;
+    vl_kmeans_quantize (kmeans, assignFloat, distFloat, dataFloat, NUM_DATA) ;
+    for (i = 0 ; i < NUM_DATA ; ++i) {
+      if (distUi8[i] != distFloat[i] ||
+          (assignUi8[i] != assignFloat[i] &&
+           vl_get_vector_comparison_function_f(distance)
+           (DIMENSION, dataFloat + i * DIMENSION, centers + assignUi8[i] * DIMENSION) != distFloat[i])) {
+        VL_PRINTF("test_kmeans_ui8: quantize %s fractional=%d: point %d differs\n",
+                  vl_get_vector_comparison_type_name(distance), fractional, (int)i) ;
+        errors ++ ;
+        break ;
+      }
+    }
+  }
+  vl_kmeans_delete (kmeans) ;
+  return errors ;
+}
+
+/* each algorithm and distance must either run the out-of-core
+ * implementation, giving the same centers as on the converted data, or
+ * be rejected with VL_ERR_BAD_ARG leaving the centers untouched */
+
+static int
+test_refine (VlKMeansAlgorithm algorithm, VlVectorComparisonType distance)
+{
+  VlKMeans * kmeansUi8 = vl_kmeans_new (VL_TYPE_FLOAT, distance) ;
+  VlKMeans * kmeansFloat = vl_kmeans_new (VL_TYPE_FLOAT, distance) ;
+  vl_bool supported =
+    (algorithm == VlKMeansLloyd && distance == VlDistanceL2) ||
+    (algorithm == VlKMeansMiniBatch) ;
+  double energyUi8, energyFloat ;
+  float const * centers ;
+  int errors = 0 ;
+
+  vl_kmeans_set_algorithm (kmeansUi8, algorithm) ;
+  vl_kmeans_set_algorithm (kmeansFloat, algorithm) ;
+  vl_kmeans_set_max_num_iterations (kmeansUi8, 20) ;
+  vl_kmeans_set_max_num_iterations (kmeansFloat, 20) ;
+  vl_kmeans_set_batch_size (kmeansUi8, 256) ;
+  vl_kmeans_set_batch_size (kmeansFloat, 256) ;
+  vl_kmeans_set_centers (kmeansUi8, dataFloat, DIMENSION, NUM_CENTERS) ;
+  vl_kmeans_set_centers (kmeansFloat, dataFloat, DIMENSION, NUM_CENTERS) ;
+
+  vl_set_last_error (VL_ERR_OK, "") ;
+  vl_rand_seed (vl_get_rand(), 1) ;
+  energyUi8 = vl_kmeans_refine_centers_ui8 (kmeansUi8, dataUi8, NUM_DATA) ;
+  centers = vl_kmeans_get_centers (kmeansUi8) ;
+
+  if (supported) {
+    vl_rand_seed (vl_get_rand(), 1) ;
+    energyFloat = vl_kmeans_refine_centers_with_reader (kmeansFloat, read_float, NULL, NUM_DATA) ;
+    if (vl_get_last_error() != VL_ERR_OK ||
+        energyUi8 != energyFloat ||
+        memcmp (centers, vl_kmeans_get_centers (kmeansFloat),
+                sizeof(float) * DIMENSION * NUM_CENTERS)) {
+      errors ++ ;
+    }
+  } else {
+    if (vl_get_last_error() != VL_ERR_BAD_ARG ||
+        energyUi8 != VL_INFINITY_D ||
+        memcmp (centers, dataFloat, sizeof(float) * DIMENSION * NUM_CENTERS)) {
+      errors ++ ;
+    }
+  }
+
+  /* clustering goes through the same checks */
+  vl_set_last_error (VL_ERR_OK, "") ;
+  energyUi8 = vl_kmeans_cluster_ui8 (kmeansUi8, dataUi8, DIMENSION, NUM_DATA, NUM_CENTERS) ;
+  if (supported != (vl_get_last_error() == VL_ERR_OK && energyUi8 < VL_INFINITY_D)) {
+    errors ++ ;
+  }
+
+  if (errors) {
+    VL_PRINTF("test_kmeans_ui8: refine %s %s (supported=%d) failed\n",
+              vl_get_vector_comparison_type_name(distance),
+              algorithm == VlKMeansLloyd ? "lloyd" :
+              algorithm == VlKMeansElkan ? "elkan" :
+              algorithm == VlKMeansHamerly ? "hamerly" :
+              algorithm == VlKMeansYinyang ? "yinyang" :
+              algorithm == VlKMeansANN ? "ann" : "minibatch",
+              supported) ;
+  }
+  vl_kmeans_delete (kmeansFloat) ;
+  vl_kmeans_delete (kmeansUi8) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlKMeansAlgorithm algorithms [6] = {
+    VlKMeansLloyd, VlKMeansElkan, VlKMeansHamerly,
+    VlKMeansYinyang, VlKMeansANN, VlKMeansMiniBatch} ;
+  VlVectorComparisonType distances [2] = {VlDistanceL2, VlDistanceL1} ;
+  VlRand * rand = vl_get_rand () ;
+  int a, d, errors = 0 ;
+  vl_uindex i ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) {
+    dataUi8[i] = (vl_uint8) vl_rand_uint32 (rand) ;
+    dataFloat[i] = dataUi8[i] ;
+  }
+
+  errors += test_distances () ;
+  for (d = 0 ; d < 2 ; ++d) {
+    errors += test_quantize (distances[d]) ;
+    for (a = 0 ; a < 6 ; ++a) {
+      errors += test_refine (algorithms[a], distances[d]) ;
+    }
+  }
+
+  VL_PRINTF("test_kmeans_ui8: %d errors\n", errors) ;
+  return errors > 0 ;
+}
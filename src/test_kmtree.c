@@ -0,0 +1,108 @@
+/** @file test_kmtree.c
+ ** @brief K-means tree test
+ **/
+
+#include <vl/kmtree.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+
+#define DIMENSION 5
+#define NUM_DATA 3000
+#define NUM_QUERIES 200
+#define NUM_NEIGHBORS 4
+
+static double data [DIMENSION * NUM_DATA] ;
+static double queries [DIMENSION * NUM_QUERIES] ;
+static float dataf [DIMENSION * NUM_DATA] ;
+static float queriesf [DIMENSION * NUM_QUERIES] ;
+
+/* an exact search must return the same distances as brute force, and
+ * the array version the same results as the single queries */
+
+static int
+test_query (vl_type dataType, VlVectorComparisonType distance, vl_size branching)
+{
+  VlDoubleVectorComparisonFunction fd = vl_get_vector_comparison_function_d (distance) ;
+  VlFloatVectorComparisonFunction ff = vl_get_vector_comparison_function_f (distance) ;
+  VlKMTree * tree = vl_kmtree_new (dataType, DIMENSION, branching, distance) ;
+  void const * queryData = (dataType == VL_TYPE_FLOAT) ? (void const*)queriesf : (void const*)queries ;
+  vl_uint32 indexes [NUM_NEIGHBORS * NUM_QUERIES] ;
+  double distances [NUM_NEIGHBORS * NUM_QUERIES] ;
+  VlKDForestNeighbor neighbors [NUM_NEIGHBORS] ;
+  vl_uindex q, i, k ;
+  int errors = 0 ;
+
+  vl_kmtree_build (tree, NUM_DATA,
+                   (dataType == VL_TYPE_FLOAT) ? (void const*)dataf : (void const*)data) ;
+  vl_kmtree_set_max_num_comparisons (tree, 0) ;
+  vl_kmtree_query_with_array (tree, indexes, NUM_NEIGHBORS, NUM_QUERIES, distances, queryData) ;
+
+  for (q = 0 ; q < NUM_QUERIES ; ++q) {
+    double best [NUM_NEIGHBORS] ;
+    for (k = 0 ; k < NUM_NEIGHBORS ; ++k) best[k] = VL_INFINITY_D ;
+    for (i = 0 ; i < NUM_DATA ; ++i) {
+      double dist = (dataType == VL_TYPE_FLOAT) ?
+        ff (DIMENSION, queriesf + q * DIMENSION, dataf + i * DIMENSION) :
+        fd (DIMENSION, queries + q * DIMENSION, data + i * DIMENSION) ;
+      for (k = NUM_NEIGHBORS ; k > 0 && best[k-1] > dist ; --k) {
+        if (k < NUM_NEIGHBORS) best[k] = best[k-1] ;
+      }
+      if (k < NUM_NEIGHBORS) best[k] = dist ;
+    }
+
+    vl_kmtree_query (tree, neighbors, NUM_NEIGHBORS,
+                     (char const*)queryData + q * DIMENSION * vl_get_type_size (dataType)) ;
+    for (k = 0 ; k < NUM_NEIGHBORS ; ++k) {
+      double dist = (dataType == VL_TYPE_FLOAT) ?
+        ((float*)distances)[q * NUM_NEIGHBORS + k] : distances[q * NUM_NEIGHBORS + k] ;
+      if (neighbors[k].distance != best[k] ||
+          neighbors[k].index >= NUM_DATA ||
+          indexes[q * NUM_NEIGHBORS + k] != neighbors[k].index ||
+          dist != best[k]) {
+        errors ++ ;
+      }
+    }
+  }
+
+  /* a bounded search must still return valid neighbors */
+  vl_kmtree_set_max_num_comparisons (tree, 50) ;
+  vl_kmtree_query_with_array (tree, indexes, NUM_NEIGHBORS, NUM_QUERIES, NULL, queryData) ;
+  for (i = 0 ; i < NUM_NEIGHBORS * NUM_QUERIES ; ++i) {
+    if (indexes[i] >= NUM_DATA) errors ++ ;
+  }
+
+  if (errors) {
+    VL_PRINTF("test_kmtree: %s %s branching=%d: %d errors\n",
+              vl_get_type_name (dataType),
+              vl_get_vector_comparison_type_name (distance),
+              (int) branching, errors) ;
+  }
+  vl_kmtree_delete (tree) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  VlRand * rand = vl_get_rand () ;
+  int errors = 0 ;
+  vl_uindex i ;
+
+  vl_rand_seed (rand, 0) ;
+  for (i = 0 ; i < DIMENSION * NUM_DATA ; ++i) {
+    data[i] = vl_rand_real1 (rand) ;
+    dataf[i] = (float) data[i] ;
+  }
+  for (i = 0 ; i < DIMENSION * NUM_QUERIES ; ++i) {
+    queries[i] = vl_rand_real1 (rand) ;
+    queriesf[i] = (float) queries[i] ;
+  }
+
+  errors += test_query (VL_TYPE_FLOAT, VlDistanceL2, 4) ;
+  errors += test_query (VL_TYPE_FLOAT, VlDistanceL2, 16) ;
+  errors += test_query (VL_TYPE_DOUBLE, VlDistanceL2, 8) ;
+  errors += test_query (VL_TYPE_FLOAT, VlDistanceL1, 8) ;
+
+  VL_PRINTF("test_kmtree: %d errors\n", errors) ;
+  return errors > 0 ;
+}
@@ -0,0 +1,116 @@
+/** @file test_parallel_repetitions.c
+ ** @brief Concurrent k-means and GMM repetitions test
+ **/
+
+#include <vl/kmeans.h>
+#include <vl/gmm.h>
+#include <vl/random.h>
+#include <string.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#define DIMENSION 8
+#define NUM_DATA 3000
+#define NUM_CENTERS 12
+#define NUM_REPETITIONS 5
+
+static float data [DIMENSION * NUM_DATA] ;
+
+/* cluster with concurrent repetitions using numThreads threads */
+
+static double
+run_kmeans (vl_size numThreads, float * centers)
+{
+  VlKMeans * kmeans = vl_kmeans_new (VL_TYPE_FLOAT, VlDistanceL2) ;
+  double energy ;
+  vl_set_num_threads (numThreads) ;
+  vl_rand_seed (vl_get_rand (), 0) ;
+  vl_kmeans_set_num_repetitions (kmeans, NUM_REPETITIONS) ;
+  vl_kmeans_set_parallel_repetitions (kmeans, VL_TRUE) ;
+  vl_kmeans_set_initialization (kmeans, VlKMeansPlusPlus) ;
+  energy = vl_kmeans_cluster (kmeans, data, DIMENSION, NUM_DATA, NUM_CENTERS) ;
+  memcpy (centers, vl_kmeans_get_centers (kmeans), sizeof(float) * DIMENSION * NUM_CENTERS) ;
+  vl_kmeans_delete (kmeans) ;
+  return energy ;
+}
+
+static double
+run_gmm (vl_size numThreads, float * means)
+{
+  VlGMM * gmm = vl_gmm_new (VL_TYPE_FLOAT, DIMENSION, NUM_CENTERS) ;
+  double loglikelihood ;
+  vl_set_num_threads (numThreads) ;
+  vl_rand_seed (vl_get_rand (), 0) ;
+  vl_gmm_set_num_repetitions (gmm, NUM_REPETITIONS) ;
+  vl_gmm_set_parallel_repetitions (gmm, VL_TRUE) ;
+  vl_gmm_set_max_num_iterations (gmm, 20) ;
+  loglikelihood = vl_gmm_cluster (gmm, data, NUM_DATA) ;
+  memcpy (means, vl_gmm_get_means (gmm), sizeof(float) * DIMENSION * NUM_CENTERS) ;
+  vl_gmm_delete (gmm) ;
+  return loglikelihood ;
+}
+
+/* the solution must not depend on the number of threads; the
+ * inner loops of a repetition may reorder floating point sums, so
+ * the comparison allows for rounding */
+
+static int
+compare (char const * name, vl_size numThreads,
+         double value, double expectedValue,
+         float const * result, float const * expected)
+{
+  vl_uindex i ;
+  int errors = 0 ;
+  if (vl_abs_d (value - expectedValue) > 1e-4 * vl_abs_d (expectedValue)) errors ++ ;
+  for (i = 0 ; i < DIMENSION * NUM_CENTERS ; ++i) {
+    if (vl_abs_f (result[i] - expected[i]) > 1e-3f) errors ++ ;
+  }
+  if (errors) {
+    VL_PRINTF("test_parallel_repetitions: %s with %d threads: %g instead of %g, %d errors\n",
+              name, (int) numThreads, value, expectedValue, errors) ;
+  }
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  static float expected [DIMENSION * NUM_CENTERS] ;
+  static float result [DIMENSION * NUM_CENTERS] ;
+  VlRand * rand = vl_get_rand () ;
+  double expectedValue, value ;
+  vl_size numThreads [3] = {2, 3, 8} ;
+  vl_uindex i, t ;
+  int errors = 0 ;
+
+  vl_rand_seed (rand, 1) ;
+  for (i = 0 ; i < NUM_DATA ; ++i) {
+    vl_uindex c = vl_rand_uindex (rand, NUM_CENTERS) ;
+    vl_uindex d ;
+    for (d = 0 ; d < DIMENSION ; ++d) {
+      data[i * DIMENSION + d] = (float) (((c * 7 + d * 3) % 10) + vl_rand_real1 (rand)) ;
+    }
+  }
+
+#if defined(_OPENMP)
+  /* split the threads between the repetitions and their loops */
+  omp_set_max_active_levels (2) ;
+#endif
+
+  expectedValue = run_kmeans (1, expected) ;
+  for (t = 0 ; t < 3 ; ++t) {
+    value = run_kmeans (numThreads[t], result) ;
+    errors += compare ("kmeans", numThreads[t], value, expectedValue, result, expected) ;
+  }
+
+  expectedValue = run_gmm (1, expected) ;
+  for (t = 0 ; t < 3 ; ++t) {
+    value = run_gmm (numThreads[t], result) ;
+    errors += compare ("gmm", numThreads[t], value, expectedValue, result, expected) ;
+  }
+
+  VL_PRINTF("test_parallel_repetitions: %d errors\n", errors) ;
+  return errors > 0 ;
+}
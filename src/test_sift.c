@@ -0,0 +1,376 @@
+/** @file test_sift.c
+ ** @brief SIFT test
+ **/
+
+#include <vl/sift.h>
+#include <vl/mathop.h>
+#include <vl/random.h>
+#include <math.h>
+
+#define WIDTH 200
+#define HEIGHT 160
+#define NUM_BLOBS 60
+#define MAX_NUM_KEYPOINTS 4000
+#define TILED_WIDTH 700
+#define TILED_HEIGHT 520
+
+static vl_sift_pix image [WIDTH * HEIGHT] ;
+static vl_sift_pix largeImage [TILED_WIDTH * TILED_HEIGHT] ;
+
+/* keypoints detected in each octave */
+typedef struct _Detection
+{
+  VlSiftKeypoint keys [MAX_NUM_KEYPOINTS] ;
+  int numKeys ;
+  int octaveBegin [32] ;
+  int numOctaves ;
+} Detection ;
+
+static Detection all, limited ;
+
+/* an image with blobs of several sizes */
+
+static void
+make_image (vl_sift_pix * im, int width, int height, int numBlobs)
+{
+  VlRand * rand = vl_get_rand () ;
+  int b, x, y ;
+  vl_rand_seed (rand, 0) ;
+  for (b = 0 ; b < numBlobs ; ++b) {
+    double cx = vl_rand_real1 (rand) * width ;
+    double cy = vl_rand_real1 (rand) * height ;
+    double sigma = 1.5 + vl_rand_real1 (rand) * 8 ;
+    double weight = vl_rand_real1 (rand) - 0.5 ;
+    for (y = 0 ; y < height ; ++y) {
+      for (x = 0 ; x < width ; ++x) {
+        double d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy) ;
+        im[x + y * width] += (vl_sift_pix) (weight * exp (- 0.5 * d2 / (sigma * sigma))) ;
+      }
+    }
+  }
+}
+
+/* the SIMD descriptor must match the plain C one up to rounding; the
+ * scale space is computed once, so that both see the same keypoints */
+
+static int
+test_descriptors (void)
+{
+  VlSiftFilt * filt = vl_sift_new (WIDTH, HEIGHT, -1, 3, -1) ;
+  vl_size numDescriptors = 0 ;
+  int errors = 0 ;
+  int err = vl_sift_process_first_octave (filt, image) ;
+
+  while (err != VL_ERR_EOF) {
+    VlSiftKeypoint const * keys ;
+    int k ;
+    vl_sift_detect (filt) ;
+    keys = vl_sift_get_keypoints (filt) ;
+    for (k = 0 ; k < vl_sift_get_nkeypoints (filt) ; ++k) {
+      double angles [4] ;
+      int a, numAngles = vl_sift_calc_keypoint_orientations (filt, angles, keys + k) ;
+      for (a = 0 ; a < numAngles ; ++a) {
+        vl_sift_pix descr [128], descr2 [128] ;
+        int i ;
+        vl_set_simd_enabled (VL_FALSE) ;
+        vl_sift_calc_keypoint_descriptor (filt, descr, keys + k, angles[a]) ;
+        vl_set_simd_enabled (VL_TRUE) ;
+        vl_sift_calc_keypoint_descriptor (filt, descr2, keys + k, angles[a]) ;
+        for (i = 0 ; i < 128 ; ++i) {
+          if (! (vl_abs_f (descr[i] - descr2[i]) <= 1e-5f)) errors ++ ;
+        }
+        numDescriptors ++ ;
+      }
+    }
+    err = vl_sift_process_next_octave (filt) ;
+  }
+  vl_sift_delete (filt) ;
+
+  VL_PRINTF("test_sift: compared %d descriptors\n", (int) numDescriptors) ;
+  if (numDescriptors == 0) errors ++ ;
+  if (errors) {
+    VL_PRINTF("test_sift: descriptors: %d errors\n", errors) ;
+  }
+  return errors ;
+}
+
+/* the batch functions must give the same orientations and
+ * descriptors as the per-keypoint ones, for any number of threads;
+ * the keypoints of the previous octave are included as well, as they
+ * must get no orientation */
+
+static int
+test_batch (vl_size numThreads)
+{
+  VlSiftFilt * filt = vl_sift_new (WIDTH, HEIGHT, -1, 3, -1) ;
+  static VlSiftKeypoint keys [2 * MAX_NUM_KEYPOINTS] ;
+  static VlSiftKeypoint orientedKeys [8 * MAX_NUM_KEYPOINTS] ;
+  static double orientedAngles [8 * MAX_NUM_KEYPOINTS] ;
+  static double angles [8 * MAX_NUM_KEYPOINTS] ;
+  static int numAngles [2 * MAX_NUM_KEYPOINTS] ;
+  static vl_sift_pix descrs [128 * 8 * MAX_NUM_KEYPOINTS] ;
+  int numPreviousKeys = 0, numOriented = 0, numDescriptors = 0, errors = 0 ;
+  int err ;
+
+  vl_set_num_threads (numThreads) ;
+  err = vl_sift_process_first_octave (filt, image) ;
+  while (err != VL_ERR_EOF) {
+    int k, a, i, numKeys ;
+    vl_sift_detect (filt) ;
+    numKeys = VL_MIN(vl_sift_get_nkeypoints (filt), MAX_NUM_KEYPOINTS) ;
+    for (k = 0 ; k < numKeys ; ++k) {
+      keys[numPreviousKeys + k] = vl_sift_get_keypoints (filt)[k] ;
+    }
+    numKeys += numPreviousKeys ;
+
+    vl_sift_calc_keypoint_orientations_with_array (filt, numAngles, angles, keys, numKeys) ;
+    numOriented = 0 ;
+    for (k = 0 ; k < numKeys ; ++k) {
+      double expected [4] ;
+      int numExpected = vl_sift_calc_keypoint_orientations (filt, expected, keys + k) ;
+      if (numAngles[k] != numExpected) { errors ++ ; continue ; }
+      for (a = 0 ; a < numExpected ; ++a) {
+        if (angles[4 * k + a] != expected[a]) errors ++ ;
+        orientedKeys[numOriented] = keys[k] ;
+        orientedAngles[numOriented++] = expected[a] ;
+      }
+    }
+
+    vl_sift_calc_keypoint_descriptors (filt, descrs, orientedKeys, orientedAngles, numOriented) ;
+    for (k = 0 ; k < numOriented ; ++k) {
+      vl_sift_pix expected [128] ;
+      vl_sift_calc_keypoint_descriptor (filt, expected, orientedKeys + k, orientedAngles[k]) ;
+      for (i = 0 ; i < 128 ; ++i) {
+        if (descrs[128 * k + i] != expected[i]) errors ++ ;
+      }
+    }
+    numDescriptors += numOriented ;
+
+    /* keep the keypoints of this octave for the next one */
+    numPreviousKeys = VL_MIN(numKeys - numPreviousKeys, MAX_NUM_KEYPOINTS) ;
+    for (k = 0 ; k < numPreviousKeys ; ++k) {
+      keys[k] = keys[numKeys - numPreviousKeys + k] ;
+    }
+    err = vl_sift_process_next_octave (filt) ;
+  }
+  vl_sift_delete (filt) ;
+
+  VL_PRINTF("test_sift: batch with %d threads: compared %d descriptors\n",
+            (int) numThreads, numDescriptors) ;
+  if (numDescriptors == 0) errors ++ ;
+  if (errors) {
+    VL_PRINTF("test_sift: batch with %d threads: %d errors\n", (int) numThreads, errors) ;
+  }
+  return errors ;
+}
+
+/* detect the keypoints of all the octaves with a given budget */
+
+static void
+detect (Detection * detection, int maxNumKeys, int maxOctaveNumKeys, int numBuckets)
+{
+  VlSiftFilt * filt = vl_sift_new (WIDTH, HEIGHT, -1, 3, -1) ;
+  int err ;
+  vl_sift_set_peak_thresh (filt, 0) ;
+  vl_sift_set_max_nkeypoints (filt, maxNumKeys) ;
+  vl_sift_set_max_octave_nkeypoints (filt, maxOctaveNumKeys) ;
+  vl_sift_set_nbuckets (filt, numBuckets) ;
+  detection->numKeys = 0 ;
+  detection->numOctaves = 0 ;
+  err = vl_sift_process_first_octave (filt, image) ;
+  while (err != VL_ERR_EOF) {
+    int k ;
+    vl_sift_detect (filt) ;
+    detection->octaveBegin[detection->numOctaves++] = detection->numKeys ;
+    for (k = 0 ; k < vl_sift_get_nkeypoints (filt) && detection->numKeys < MAX_NUM_KEYPOINTS ; ++k) {
+      detection->keys[detection->numKeys++] = vl_sift_get_keypoints (filt)[k] ;
+    }
+    err = vl_sift_process_next_octave (filt) ;
+  }
+  detection->octaveBegin[detection->numOctaves] = detection->numKeys ;
+  vl_sift_delete (filt) ;
+}
+
+/* the keypoints kept in each octave must be a subsequence of the
+ * keypoints detected without budget, and have a response not weaker
+ * than the ones dropped, unless the octave is split in buckets */
+
+static int
+check_selection (Detection const * detection, vl_bool strongest)
+{
+  int o, errors = 0 ;
+  if (detection->numOctaves != all.numOctaves) return 1 ;
+  for (o = 0 ; o < all.numOctaves ; ++o) {
+    int i = all.octaveBegin[o] ;
+    int j ;
+    float minKept = VL_INFINITY_F, maxDropped = 0 ;
+    for (j = detection->octaveBegin[o] ; j < detection->octaveBegin[o+1] ; ++j) {
+      VlSiftKeypoint const * key = detection->keys + j ;
+      for ( ; i < all.octaveBegin[o+1] ; ++i) {
+        if (all.keys[i].x == key->x && all.keys[i].y == key->y &&
+            all.keys[i].sigma == key->sigma) break ;
+        maxDropped = VL_MAX(maxDropped, vl_abs_f (all.keys[i].response)) ;
+      }
+      if (i == all.octaveBegin[o+1]) {
+        errors ++ ;
+        break ;
+      }
+      minKept = VL_MIN(minKept, vl_abs_f (key->response)) ;
+      ++ i ;
+    }
+    for ( ; i < all.octaveBegin[o+1] ; ++i) {
+      maxDropped = VL_MAX(maxDropped, vl_abs_f (all.keys[i].response)) ;
+    }
+    if (strongest && minKept < maxDropped) errors ++ ;
+  }
+  return errors ;
+}
+
+/* the detector must keep at most the budgeted number of keypoints,
+ * choosing the strongest ones */
+
+static int
+test_budget (void)
+{
+  int o, maxOctaveNumKeys = 0, errors = 0 ;
+
+  detect (&all, 0, 0, 0) ;
+  for (o = 0 ; o < all.numOctaves ; ++o) {
+    maxOctaveNumKeys = VL_MAX(maxOctaveNumKeys, all.octaveBegin[o+1] - all.octaveBegin[o]) ;
+  }
+  VL_PRINTF("test_sift: %d keypoints without budget\n", all.numKeys) ;
+  if (all.numKeys < 50 || all.numKeys >= MAX_NUM_KEYPOINTS) errors ++ ;
+
+  /* per octave budget */
+  detect (&limited, 0, maxOctaveNumKeys / 3, 0) ;
+  for (o = 0 ; o < all.numOctaves ; ++o) {
+    int n = all.octaveBegin[o+1] - all.octaveBegin[o] ;
+    if (limited.octaveBegin[o+1] - limited.octaveBegin[o] != VL_MIN(n, maxOctaveNumKeys / 3)) errors ++ ;
+  }
+  errors += check_selection (&limited, VL_TRUE) ;
+
+  /* image budget */
+  detect (&limited, all.numKeys / 4, 0, 0) ;
+  if (limited.numKeys > all.numKeys / 4 || limited.numKeys < all.numKeys / 8) errors ++ ;
+  errors += check_selection (&limited, VL_TRUE) ;
+
+  /* image budget with spatial buckets */
+  detect (&limited, all.numKeys / 4, 0, 2) ;
+  if (limited.numKeys > all.numKeys / 4) errors ++ ;
+  errors += check_selection (&limited, VL_FALSE) ;
+
+  /* a budget that no octave reaches changes nothing (the image
+     budget is shared by the octaves in proportion to their area) */
+  detect (&limited, 4 * all.numKeys, maxOctaveNumKeys, 0) ;
+  if (limited.numKeys != all.numKeys) errors ++ ;
+
+  if (errors) {
+    VL_PRINTF("test_sift: budget: %d errors\n", errors) ;
+  }
+  return errors ;
+}
+
+/* processing the image by tiles must give the same frames and
+ * descriptors as processing it at once, including at the image
+ * boundary; the tiles are smoothed in different pieces, so a few
+ * keypoints whose orientation or localization is on the verge of a
+ * decision may still differ */
+
+static vl_size
+find_frame (double const * frames, vl_size numFrames, double const * frame)
+{
+  vl_uindex i ;
+  for (i = 0 ; i < numFrames ; ++i) {
+    double const * fr = frames + 4 * i ;
+    if (fabs (fr[0] - frame[0]) < 1e-3 && fabs (fr[1] - frame[1]) < 1e-3 &&
+        fabs (fr[2] - frame[2]) < 1e-3 && fabs (fr[3] - frame[3]) < 1e-3) break ;
+  }
+  return i ;
+}
+
+static int
+test_tiled (void)
+{
+  VlSiftFilt * filt = vl_sift_new (TILED_WIDTH, TILED_HEIGHT, 2, 3, 0) ;
+  VlSiftFilt * tileFilt = vl_sift_new (360, 320, 2, 3, 0) ;
+  double * frames = NULL, * tiledFrames = NULL ;
+  vl_sift_pix * descrs = NULL, * tiledDescrs = NULL ;
+  vl_size numFrames = 0, numTiledFrames, i ;
+  int numUnmatched = 0, numDifferent = 0, errors = 0 ;
+  int err ;
+
+  make_image (largeImage, TILED_WIDTH, TILED_HEIGHT, 12 * NUM_BLOBS) ;
+
+  /* the whole image at once */
+  for (err = vl_sift_process_first_octave (filt, largeImage) ;
+       err == VL_ERR_OK ;
+       err = vl_sift_process_next_octave (filt)) {
+    VlSiftKeypoint const * keys ;
+    int k ;
+    vl_sift_detect (filt) ;
+    keys = vl_sift_get_keypoints (filt) ;
+    for (k = 0 ; k < vl_sift_get_nkeypoints (filt) ; ++k) {
+      double angles [4] ;
+      int a, numAngles = vl_sift_calc_keypoint_orientations (filt, angles, keys + k) ;
+      frames = vl_realloc (frames, sizeof(double) * 4 * (numFrames + numAngles)) ;
+      descrs = vl_realloc (descrs, sizeof(vl_sift_pix) * 128 * (numFrames + numAngles)) ;
+      for (a = 0 ; a < numAngles ; ++a, ++numFrames) {
+        frames[4*numFrames+0] = keys[k].x ;
+        frames[4*numFrames+1] = keys[k].y ;
+        frames[4*numFrames+2] = keys[k].sigma ;
+        frames[4*numFrames+3] = angles[a] ;
+        vl_sift_calc_keypoint_descriptor (filt, descrs + 128 * numFrames, keys + k, angles[a]) ;
+      }
+    }
+  }
+
+  numTiledFrames = vl_sift_process_tiled (tileFilt, largeImage, TILED_WIDTH, TILED_HEIGHT,
+                                          &tiledFrames, &tiledDescrs) ;
+  VL_PRINTF("test_sift: %d frames, %d tiled frames (halo %d)\n",
+            (int) numFrames, (int) numTiledFrames, vl_sift_get_tile_halo (tileFilt)) ;
+  if (numFrames < 200) errors ++ ;
+
+  for (i = 0 ; i < numTiledFrames ; ++i) {
+    vl_size j = find_frame (frames, numFrames, tiledFrames + 4 * i) ;
+    int d ;
+    if (j == numFrames) {
+      numUnmatched ++ ;
+      continue ;
+    }
+    for (d = 0 ; d < 128 ; ++d) {
+      if (! (vl_abs_f (descrs[128*j + d] - tiledDescrs[128*i + d]) <= 1e-3f)) break ;
+    }
+    if (d < 128) numDifferent ++ ;
+  }
+  for (i = 0 ; i < numFrames ; ++i) {
+    if (find_frame (tiledFrames, numTiledFrames, frames + 4 * i) == numTiledFrames) numUnmatched ++ ;
+  }
+  VL_PRINTF("test_sift: tiled: %d unmatched frames, %d different descriptors\n",
+            numUnmatched, numDifferent) ;
+  if (numUnmatched > (int) numFrames / 100 || numDifferent > (int) numFrames / 100) errors ++ ;
+
+  if (errors) {
+    VL_PRINTF("test_sift: tiled: %d errors\n", errors) ;
+  }
+  vl_free (frames) ;
+  vl_free (descrs) ;
+  vl_free (tiledFrames) ;
+  vl_free (tiledDescrs) ;
+  vl_sift_delete (filt) ;
+  vl_sift_delete (tileFilt) ;
+  return errors ;
+}
+
+int
+main (int argc VL_UNUSED, char ** argv VL_UNUSED)
+{
+  int errors = 0 ;
+  make_image (image, WIDTH, HEIGHT, NUM_BLOBS) ;
+  errors += test_descriptors () ;
+  errors += test_batch (1) ;
+  errors += test_batch (4) ;
+  errors += test_budget () ;
+  errors += test_tiled () ;
+  VL_PRINTF("test_sift: %d errors\n", errors) ;
+  return errors > 0 ;
+}
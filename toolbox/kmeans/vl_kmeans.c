@@ -26,6 +26,9 @@ enum {
   opt_num_comparisons,
   opt_min_energy_variation,
   opt_num_trees,
+  opt_batch_size,
+  opt_num_center_groups,
+  opt_ann_index,
   opt_multithreading
 } ;
 
@@ -45,6 +48,9 @@ vlmxOption  options [] = {
   {"NumTrees",          1,   opt_num_trees           },
   {"MaxNumComparisons", 1,   opt_num_comparisons     },
   {"MinEnergyVariation",1,   opt_min_energy_variation},
+  {"BatchSize",         1,   opt_batch_size          },
+  {"NumCenterGroups",   1,   opt_num_center_groups   },
+  {"AnnIndex",          1,   opt_ann_index           },
   {0,                   0,   0                       }
 } ;
 
@@ -76,6 +82,9 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   int initialization = INIT_PLUSPLUS ;
   vl_size maxNumComparisons = 100 ;
   vl_size numTrees = 3;
+  vl_size batchSize = 1024 ;
+  vl_size numCenterGroups = 0 ;
+  VlKMeansANNIndex annIndex = VlKMeansANNKDForest ;
 
   vl_type dataType ;
   mxClassID classID ;
@@ -101,9 +110,10 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   switch (classID) {
     case mxSINGLE_CLASS: dataType = VL_TYPE_FLOAT ; break ;
     case mxDOUBLE_CLASS: dataType = VL_TYPE_DOUBLE ; break ;
+    case mxUINT8_CLASS: dataType = VL_TYPE_FLOAT ; break ;
     default:
       vlmxError (vlmxErrInvalidArgument,
-                "DATA must be of class SINGLE or DOUBLE") ;
+                "DATA must be of class SINGLE, DOUBLE, or UINT8") ;
       abort() ;
   }
 
@@ -162,6 +172,12 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
           algorithm = VlKMeansElkan ;
         } else if (vlmxCompareStringsI("ann", buf) == 0) {
           algorithm = VlKMeansANN ;
+        } else if (vlmxCompareStringsI("minibatch", buf) == 0) {
+          algorithm = VlKMeansMiniBatch ;
+        } else if (vlmxCompareStringsI("hamerly", buf) == 0) {
+          algorithm = VlKMeansHamerly ;
+        } else if (vlmxCompareStringsI("yinyang", buf) == 0) {
+          algorithm = VlKMeansYinyang ;
         } else {
           vlmxError (vlmxErrInvalidArgument,
                     "Invalid value %s for ALGORITHM", buf) ;
@@ -180,6 +196,9 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
         if (vlmxCompareStringsI("plusplus", buf) == 0 ||
             vlmxCompareStringsI("++", buf) == 0) {
           initialization = VlKMeansPlusPlus ;
+        } else if (vlmxCompareStringsI("parallelplusplus", buf) == 0 ||
+                   vlmxCompareStringsI("||", buf) == 0) {
+          initialization = VlKMeansParallelPlusPlus ;
         } else if (vlmxCompareStringsI("randsel", buf) == 0) {
           initialization = VlKMeansRandomSelection ;
         } else {
@@ -246,6 +265,49 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
             maxNumComparisons = (vl_size) mxGetScalar (optarg) ;
          break;
 
+       case opt_batch_size :
+            if (!vlmxIsPlainScalar (optarg)) {
+              vlmxError (vlmxErrInvalidArgument,
+                     "BATCHSIZE must be a scalar.") ;
+            }
+            if (mxGetScalar (optarg) < 1) {
+              vlmxError (vlmxErrInvalidArgument,
+                    "BATCHSIZE must be larger than or equal to 1.") ;
+            }
+            batchSize = (vl_size) mxGetScalar (optarg) ;
+         break;
+
+       case opt_num_center_groups :
+            if (!vlmxIsPlainScalar (optarg)) {
+              vlmxError (vlmxErrInvalidArgument,
+                     "NUMCENTERGROUPS must be a scalar.") ;
+            }
+            if (mxGetScalar (optarg) < 0) {
+              vlmxError (vlmxErrInvalidArgument,
+                    "NUMCENTERGROUPS must be larger than or equal to 0.") ;
+            }
+            numCenterGroups = (vl_size) mxGetScalar (optarg) ;
+         break;
+
+       case opt_ann_index :
+        if (!vlmxIsString (optarg, -1)) {
+          vlmxError (vlmxErrInvalidArgument,
+                    "ANNINDEX must be a string.") ;
+        }
+        if (mxGetString (optarg, buf, sizeof(buf))) {
+          vlmxError (vlmxErrInvalidArgument,
+                    "ANNINDEX argument too long.") ;
+        }
+        if (vlmxCompareStringsI("kdforest", buf) == 0) {
+          annIndex = VlKMeansANNKDForest ;
+        } else if (vlmxCompareStringsI("kmeanstree", buf) == 0) {
+          annIndex = VlKMeansANNKMeansTree ;
+        } else {
+          vlmxError (vlmxErrInvalidArgument,
+                    "Invalid value %s for ANNINDEX", buf) ;
+        }
+        break ;
+
       default :
         abort() ;
         break ;
@@ -256,6 +318,11 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
    *                                                        Do the job
    * -------------------------------------------------------------- */
 
+  if (classID == mxUINT8_CLASS && distance != VlDistanceL2) {
+    vlmxError (vlmxErrInvalidArgument,
+              "UINT8 data can be clustered only with the L2 distance.") ;
+  }
+
   data = mxGetPr(IN(DATA)) ;
 
   kmeans = vl_kmeans_new (dataType, distance) ;
@@ -267,6 +334,9 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   vl_kmeans_set_max_num_iterations (kmeans, maxNumIterations) ;
   vl_kmeans_set_max_num_comparisons (kmeans, maxNumComparisons) ;
   vl_kmeans_set_num_trees (kmeans, numTrees);
+  vl_kmeans_set_batch_size (kmeans, batchSize) ;
+  vl_kmeans_set_num_center_groups (kmeans, numCenterGroups) ;
+  vl_kmeans_set_ann_index (kmeans, annIndex) ;
   
   if (minEnergyVariation >= 0) {
     vl_kmeans_set_min_energy_variation (kmeans, minEnergyVariation) ;
@@ -280,11 +350,15 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
       case VlKMeansLloyd: algorithmName = "Lloyd" ; break ;
       case VlKMeansElkan: algorithmName = "Elkan" ; break ;
       case VlKMeansANN:   algorithmName = "ANN" ; break ;
+      case VlKMeansMiniBatch: algorithmName = "MiniBatch" ; break ;
+      case VlKMeansHamerly: algorithmName = "Hamerly" ; break ;
+      case VlKMeansYinyang: algorithmName = "Yinyang" ; break ;
       default : abort() ;
     }
     switch (vl_kmeans_get_initialization(kmeans)) {
       case VlKMeansPlusPlus : initializationName = "plusplus" ; break ;
       case VlKMeansRandomSelection : initializationName = "randsel" ; break ;
+      case VlKMeansParallelPlusPlus : initializationName = "parallelplusplus" ; break ;
       default: abort() ;
     }
     mexPrintf("kmeans: Initialization = %s\n", initializationName) ;
@@ -298,7 +372,11 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
     mexPrintf("kmeans: num. data points = %d\n", numData) ;
     mexPrintf("kmeans: num. centers = %d\n", numCenters) ;
     mexPrintf("kmeans: max num. comparisons = %d\n", maxNumComparisons) ;
+    mexPrintf("kmeans: ANN index = %s\n",
+              annIndex == VlKMeansANNKDForest ? "kdforest" : "kmeanstree") ;
     mexPrintf("kmeans: num. trees = %d\n", numTrees) ;
+    mexPrintf("kmeans: batch size = %d\n", batchSize) ;
+    mexPrintf("kmeans: num. center groups = %d\n", numCenterGroups) ;
     mexPrintf("\n") ;
   }
 
@@ -306,10 +384,16 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   /*                                    Clustering and quantization */
   /* -------------------------------------------------------------- */
 
-  energy = vl_kmeans_cluster(kmeans, data, dimension, numData, numCenters) ;
+  if (classID == mxUINT8_CLASS) {
+    energy = vl_kmeans_cluster_ui8(kmeans, data, dimension, numData, numCenters) ;
+  } else {
+    energy = vl_kmeans_cluster(kmeans, data, dimension, numData, numCenters) ;
+  }
 
   /* copy centers */
-  OUT(CENTERS) = mxCreateNumericMatrix (dimension, numCenters, classID, mxREAL) ;
+  OUT(CENTERS) = mxCreateNumericMatrix (dimension, numCenters,
+                                        (classID == mxUINT8_CLASS) ? mxSINGLE_CLASS : classID,
+                                        mxREAL) ;
   memcpy (mxGetData(OUT(CENTERS)),
           vl_kmeans_get_centers (kmeans),
           vl_get_type_size (dataType) * dimension * vl_kmeans_get_num_centers(kmeans)) ;
@@ -321,7 +405,11 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
     OUT(ASSIGNMENTS) = mxCreateNumericMatrix (1, numData, mxUINT32_CLASS, mxREAL) ;
     assignments = mxGetData (OUT(ASSIGNMENTS)) ;
 
-    vl_kmeans_quantize (kmeans, assignments, NULL, data, numData) ;
+    if (classID == mxUINT8_CLASS) {
+      vl_kmeans_quantize_ui8 (kmeans, assignments, NULL, data, numData) ;
+    } else {
+      vl_kmeans_quantize (kmeans, assignments, NULL, data, numData) ;
+    }
 
     /* use MATLAB indexing convention */
     for (j = 0 ; j < numData ; ++j) { assignments[j] += 1 ; }
@@ -1,8 +1,9 @@
 %VL_KMEANS  Cluster data using k-means
 %   [C, A] = VL_KMEANS(X, NUMCENTERS) clusters the columns of the
 %   matrix X in NUMCENTERS centers C using k-means. X may be either
-%   SINGLE or DOUBLE. C has the same number of rows of X and NUMCENTER
-%   columns, with one column per center. A is a UINT32 row vector
+%   SINGLE, DOUBLE, or UINT8 (L2 distance only). C has the same number
+%   of rows of X and NUMCENTER columns, with one column per center, and
+%   is SINGLE if X is UINT8. A is a UINT32 row vector
 %   specifying the assignments of the data X to the NUMCENTER
 %   centers.
 %
@@ -20,27 +21,40 @@
 %     Use either L1 or L2 distance.
 %
 %   Initialization::
-%     Use either random data points (RANDSEL) or k-means++ (PLUSPLUS)
-%     to initialize the centers.
+%     Use either random data points (RANDSEL), k-means++ (PLUSPLUS),
+%     or k-means|| (PARALLELPLUSPLUS) to initialize the centers. The
+%     latter is similar to k-means++, but requires only a few passes
+%     over the data, which is much faster for many centers.
 %
 %   Algorithm:: [LLOYD]
-%     One of LLOYD, ELKAN, or ANN. LLOYD is the standard Lloyd
+%     One of LLOYD, ELKAN, HAMERLY, YINYANG, ANN, or MINIBATCH. LLOYD is the standard Lloyd
 %     algorithm (similar to expectation maximisation). ELKAN is a
 %     faster version of LLOYD using triangular inequalities to cut
 %     down significantly the number of sample-to-center
-%     comparisons. ANN is the same as Lloyd, but uses an approximated
+%     comparisons. HAMERLY and YINYANG give the same result as ELKAN,
+%     but store only one or a few bounds per data point, which makes
+%     them usable with many centers. ANN is the same as Lloyd, but uses an approximated
 %     nearest neighbours (ANN) algorithm to accelerate the
 %     sample-to-center comparisons. The latter is particularly
-%     suitable for very large problems.
+%     suitable for very large problems. MINIBATCH updates the
+%     centers from small random batches of data points at each
+%     iteration and never visits the whole dataset; the returned
+%     energy is an estimate.
 %
 %   NumRepetitions:: [1]
 %     Number of time to restart k-means. The solution with minimal
 %     energy is returned.
 %
-%   The following options tune the KD-Tree forest used for ANN
+%   The following options tune the index used for ANN
 %   computations in the ANN algorithm (see also VL_KDTREEBUILD()
 %   andVL_KDTREEQUERY()).
 %
+%   AnnIndex:: [KDFOREST]
+%     Index of the centers used by the ANN algorithm, either a
+%     randomized KD-Tree forest (KDFOREST) or a priority search
+%     k-means tree (KMEANSTREE). The latter is often more accurate
+%     for high dimensional data.
+%
 %   NumTrees:: [3]
 %     The number of trees int the randomized KD-Tree forest.
 %
@@ -50,7 +64,16 @@
 %
 %   MaxNumIterations:: [100]
 %     Maximum number of iterations allowed for the kmeans algorithm
-%     to converge.
+%     to converge. For the MINIBATCH algorithm, this is the number
+%     of batches processed.
+%
+%   BatchSize:: [1024]
+%     Number of data points sampled at each iteration of the
+%     MINIBATCH algorithm.
+%
+%   NumCenterGroups:: [0]
+%     Number of center groups used by the YINYANG algorithm. Zero
+%     selects a tenth of the number of centers (at most 256).
 %
 %   Example::
 %     VL_KMEANS(X, 10, 'verbose', 'distance', 'l1', 'algorithm',
@@ -51,6 +51,9 @@ VLFeat strives to be clutter-free, simple, portable, and well documented.
   - @subpage gmm
   - @subpage aib
   - @subpage kdtree
+  - @subpage kdindex
+  - @subpage kmtree
+  - @subpage ivfpq
 
 - **Segmentation**
   - @subpage slic
@@ -852,6 +855,15 @@ typedef struct _VlState
 /* Global state instance */
 VlState _vl_state ;
 
+/* Maximum number of threads of the calling thread (0 to use the
+   global setting). This is read by every parallel region, so it is
+   kept in OpenMP thread-private storage rather than in the thread
+   state, whose access requires a lock. */
+#if defined(_OPENMP)
+static vl_size _vl_thread_num_threads = 0 ;
+#pragma omp threadprivate(_vl_thread_num_threads)
+#endif
+
 /* ----------------------------------------------------------------- */
 VL_INLINE VlState * vl_get_state () ;
 VL_INLINE VlThreadState * vl_get_thread_specific_state () ;
@@ -1084,6 +1096,34 @@ vl_get_simd_enabled (void)
   return vl_get_state()->simdEnabled ;
 }
 
+/** @brief Check for FMA instruction set
+ ** @return @c true if FMA (FMA3) is present.
+ **/
+
+vl_bool
+vl_cpu_has_fma (void)
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasFMA ;
+#else
+  return VL_FALSE ;
+#endif
+}
+
+/** @brief Check for AVX2 instruction set
+ ** @return @c true if AVX2 is present.
+ **/
+
+vl_bool
+vl_cpu_has_avx2 (void)
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasAVX2 ;
+#else
+  return VL_FALSE ;
+#endif
+}
+
 /** @brief Check for AVX instruction set
  ** @return @c true if AVX is present.
  **/
@@ -1175,6 +1215,9 @@ vl_size
 vl_get_max_threads (void)
 {
 #if defined(_OPENMP)
+  if (_vl_thread_num_threads > 0) {
+    return VL_MIN(_vl_thread_num_threads, vl_get_state()->numThreads) ;
+  }
   return vl_get_state()->numThreads ;
 #else
   return 1 ;
@@ -1217,6 +1260,34 @@ void
 vl_set_num_threads (vl_size numThreads VL_UNUSED) { }
 #endif
 
+/** @brief Set the maximum number of threads used by VLFeat in the current thread.
+ ** @param numThreads number of threads to use.
+ **
+ ** This function is similar to ::vl_set_num_threads(), but the
+ ** setting is specific to the calling thread: it limits the number
+ ** of threads used by the VLFeat computations started by the calling
+ ** thread (the global setting remains an upper bound). This is useful
+ ** to split the threads among several computations that run
+ ** concurrently, provided that OpenMP nested parallelism is
+ ** enabled. If @c numThreads is set to 0, the calling thread uses the
+ ** global setting again.
+ **
+ ** If VLFeat was compiled without, this function does nothing.
+ **
+ ** @sa vl_get_max_threads(), @ref threads-parallel
+ **/
+
+#if defined(_OPENMP)
+void
+vl_set_thread_num_threads (vl_size numThreads)
+{
+  _vl_thread_num_threads = numThreads ;
+}
+#else
+void
+vl_set_thread_num_threads (vl_size numThreads VL_UNUSED) { }
+#endif
+
 /* ---------------------------------------------------------------- */
 /** @brief Set last VLFeat error
  ** @param error error code.
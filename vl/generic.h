@@ -103,6 +103,8 @@ VL_EXPORT char const * vl_get_version_string (void) ;
 VL_EXPORT char * vl_configuration_to_string_copy (void) ;
 VL_EXPORT void vl_set_simd_enabled (vl_bool x) ;
 VL_EXPORT vl_bool vl_get_simd_enabled (void) ;
+VL_EXPORT vl_bool vl_cpu_has_fma (void) ;
+VL_EXPORT vl_bool vl_cpu_has_avx2 (void) ;
 VL_EXPORT vl_bool vl_cpu_has_avx (void) ;
 VL_EXPORT vl_bool vl_cpu_has_sse3 (void) ;
 VL_EXPORT vl_bool vl_cpu_has_sse2 (void) ;
@@ -113,6 +115,7 @@ VL_EXPORT VlRand * vl_get_rand (void) ;
  ** @{ */
 VL_EXPORT vl_size vl_get_max_threads (void) ;
 VL_EXPORT void vl_set_num_threads (vl_size n) ;
+VL_EXPORT void vl_set_thread_num_threads (vl_size n) ;
 VL_EXPORT vl_size vl_get_thread_limit (void) ;
 /** @} (*/
 
@@ -317,6 +317,7 @@ struct _VlGMM
   vl_size numData ;                   /**< Number of last time clustered data points.  */
   vl_size maxNumIterations ;          /**< Maximum number of refinement iterations. */
   vl_size numRepetitions   ;          /**< Number of clustering repetitions. */
+  vl_bool parallelRepetitions ;       /**< Whether repetitions run concurrently. */
   int     verbosity ;                 /**< Verbosity level. */
   void *  means;                      /**< Means of Gaussian modes. */
   void *  covariances;                /**< Diagonals of covariance matrices of Gaussian modes. */
@@ -364,6 +365,7 @@ vl_gmm_new (vl_type dataType, vl_size dimension, vl_size numComponents)
   self->verbosity = 0 ;
   self->maxNumIterations = 50;
   self->numRepetitions = 1;
+  self->parallelRepetitions = VL_FALSE ;
   self->sigmaLowBound =  NULL ;
   self->priors = NULL ;
   self->covariances = NULL ;
@@ -583,6 +585,30 @@ vl_gmm_set_num_repetitions (VlGMM * self, vl_size numRepetitions)
   self->numRepetitions = numRepetitions ;
 }
 
+/** @brief Get whether repetitions run concurrently.
+ ** @param self object
+ ** @return ::VL_TRUE if the repetitions run concurrently.
+ **/
+
+vl_bool
+vl_gmm_get_parallel_repetitions (VlGMM const * self)
+{
+  return self->parallelRepetitions ;
+}
+
+/** @brief Set whether repetitions run concurrently.
+ ** @param self object
+ ** @param parallelRepetitions ::VL_TRUE to run the repetitions concurrently.
+ **
+ ** See ::vl_gmm_cluster for details.
+ **/
+
+void
+vl_gmm_set_parallel_repetitions (VlGMM * self, vl_bool parallelRepetitions)
+{
+  self->parallelRepetitions = parallelRepetitions ;
+}
+
 /** @brief Get data dimension
  ** @param self object
  ** @return data dimension.
@@ -1485,9 +1511,11 @@ vl_gmm_new_copy (VlGMM const * self)
   gmm->initialization = self->initialization;
   gmm->maxNumIterations = self->maxNumIterations;
   gmm->numRepetitions = self->numRepetitions;
+  gmm->parallelRepetitions = self->parallelRepetitions;
   gmm->verbosity = self->verbosity;
   gmm->LL = self->LL;
 
+  memcpy(gmm->sigmaLowBound, self->sigmaLowBound, sizeof(double)*self->dimension);
   memcpy(gmm->means, self->means, size*self->numClusters*self->dimension);
   memcpy(gmm->covariances, self->covariances, size*self->numClusters*self->dimension);
   memcpy(gmm->priors, self->priors, size*self->numClusters);
@@ -1548,10 +1576,106 @@ vl_gmm_init_with_kmeans
 #include<fenv.h>
 #endif
 
+/* Run the repetitions of vl_gmm_cluster concurrently (see also
+ * _vl_kmeans_cluster_parallel_repetitions). Each repetition works
+ * on a copy of the GMM object (and of the KMeans initialization
+ * object, if one was specified by the user). */
+
+static double
+_vl_gmm_cluster_parallel_repetitions (VlGMM * self,
+                                      void const * data,
+                                      vl_size numData)
+{
+  vl_size const numRepetitions = self->numRepetitions ;
+  vl_size const numTeams = VL_MIN(numRepetitions, vl_get_max_threads()) ;
+  vl_size const numThreadsPerTeam = VL_MAX(vl_get_max_threads() / numTeams, 1) ;
+  VlGMM ** solutions = vl_malloc (sizeof(VlGMM*) * numRepetitions) ;
+  VlKMeans ** kmeansInits = vl_calloc (numRepetitions, sizeof(VlKMeans*)) ;
+  double * LLs = vl_malloc (sizeof(double) * numRepetitions) ;
+  vl_uint32 * seeds = vl_malloc (sizeof(vl_uint32) * numRepetitions) ;
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex best = 0 ;
+  vl_index repetition ;
+  void * temp ;
+  double LL ;
+
+  for (repetition = 0 ; repetition < (signed)numRepetitions ; ++ repetition) {
+    seeds[repetition] = vl_rand_uint32 (rand) ;
+    solutions[repetition] = vl_gmm_new_copy (self) ;
+    solutions[repetition]->numRepetitions = 1 ;
+    if (self->kmeansInit && ! self->kmeansInitIsOwner) {
+      kmeansInits[repetition] = vl_kmeans_new_copy (self->kmeansInit) ;
+      vl_gmm_set_kmeans_init_object (solutions[repetition], kmeansInits[repetition]) ;
+    }
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(repetition) \
+  num_threads(numTeams) schedule(dynamic)
+#endif
+  for (repetition = 0 ; repetition < (signed)numRepetitions ; ++ repetition) {
+    VlRand * threadRand = vl_get_rand () ;
+    VlRand savedRand = *threadRand ;
+
+    if (self->verbosity) {
+      VL_PRINTF("gmm: clustering: starting repetition %d of %d (concurrent)\n", repetition + 1, numRepetitions) ;
+    }
+
+    vl_rand_seed (threadRand, seeds[repetition]) ;
+    vl_set_thread_num_threads (numThreadsPerTeam) ;
+    LLs[repetition] = vl_gmm_cluster (solutions[repetition], data, numData) ;
+    vl_set_thread_num_threads (0) ;
+    *threadRand = savedRand ;
+  }
+
+  for (repetition = 1 ; repetition < (signed)numRepetitions ; ++ repetition) {
+    if (LLs[repetition] > LLs[best]) best = repetition ;
+  }
+
+  /* swap the best solution in */
+  _vl_gmm_prepare_for_data (self, numData) ;
+
+  temp = self->priors ;
+  self->priors = solutions[best]->priors ;
+  solutions[best]->priors = temp ;
+
+  temp = self->means ;
+  self->means = solutions[best]->means ;
+  solutions[best]->means = temp ;
+
+  temp = self->covariances ;
+  self->covariances = solutions[best]->covariances ;
+  solutions[best]->covariances = temp ;
+
+  temp = self->posteriors ;
+  self->posteriors = solutions[best]->posteriors ;
+  solutions[best]->posteriors = temp ;
+
+  LL = self->LL = LLs[best] ;
+
+  for (repetition = 0 ; repetition < (signed)numRepetitions ; ++ repetition) {
+    vl_gmm_delete (solutions[repetition]) ;
+    if (kmeansInits[repetition]) vl_kmeans_delete (kmeansInits[repetition]) ;
+  }
+  vl_free (seeds) ;
+  vl_free (LLs) ;
+  vl_free (kmeansInits) ;
+  vl_free (solutions) ;
+
+  if (self->verbosity) {
+    VL_PRINTF("gmm: all repetitions terminated with final loglikelihood %f\n", self->LL) ;
+  }
+
+  return LL ;
+}
+
 /** @brief Run GMM clustering - includes initialization and EM
  ** @param self GMM object instance.
  ** @param data data points which should be clustered.
  ** @param numData number of data points.
+ **
+ ** If ::vl_gmm_set_parallel_repetitions is set, the repetitions run
+ ** concurrently, as explained for ::vl_kmeans_cluster.
  **/
 
 double vl_gmm_cluster (VlGMM * self,
@@ -1568,6 +1692,10 @@ double vl_gmm_cluster (VlGMM * self,
 
   assert(self->numRepetitions >=1) ;
 
+  if (self->parallelRepetitions && self->numRepetitions > 1) {
+    return _vl_gmm_cluster_parallel_repetitions (self, data, numData) ;
+  }
+
   bestPriors = vl_malloc(size * self->numClusters) ;
   bestMeans = vl_malloc(size * self->dimension * self->numClusters) ;
   bestCovariances = vl_malloc(size * self->dimension * self->numClusters) ;
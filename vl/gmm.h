@@ -116,6 +116,7 @@ vl_get_gmm_data_posteriors_d(double * posteriors,
  ** @{
  **/
 VL_EXPORT void vl_gmm_set_num_repetitions (VlGMM * self, vl_size numRepetitions) ;
+VL_EXPORT void vl_gmm_set_parallel_repetitions (VlGMM * self, vl_bool parallelRepetitions) ;
 VL_EXPORT void vl_gmm_set_max_num_iterations (VlGMM * self, vl_size maxNumIterations) ;
 VL_EXPORT void vl_gmm_set_verbosity (VlGMM * self, int verbosity) ;
 VL_EXPORT void vl_gmm_set_initialization (VlGMM * self, VlGMMInitialization init);
@@ -134,6 +135,7 @@ VL_EXPORT void const * vl_gmm_get_posteriors (VlGMM const * self);
 VL_EXPORT vl_type vl_gmm_get_data_type (VlGMM const * self);
 VL_EXPORT vl_size vl_gmm_get_dimension (VlGMM const * self);
 VL_EXPORT vl_size vl_gmm_get_num_repetitions (VlGMM const * self);
+VL_EXPORT vl_bool vl_gmm_get_parallel_repetitions (VlGMM const * self);
 VL_EXPORT vl_size vl_gmm_get_num_data (VlGMM const * self);
 VL_EXPORT vl_size vl_gmm_get_num_clusters (VlGMM const * self);
 VL_EXPORT double vl_gmm_get_loglikelihood (VlGMM const * self);
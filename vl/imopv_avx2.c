@@ -0,0 +1,160 @@
+/** @file imopv_avx2.c
+ ** @brief Vectorized image operations - AVX2 - Definition
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "imopv.h"
+#include "imopv_avx2.h"
+
+#ifndef VL_DISABLE_AVX2
+
+#if !defined(__AVX2__) || !defined(__FMA__)
+#error Compiling AVX2 functions but AVX2 or FMA does not seem to be supported by the compiler.
+#endif
+
+#include <immintrin.h>
+
+/* Number of output rows computed at once by the blocked kernel. */
+#define BLOCK 8
+
+/* Transpose the 8 x 8 block r[0..7] in place. */
+
+VL_INLINE void
+_vl_transpose_avx2_f (__m256 r [8])
+{
+  __m256 t0 = _mm256_unpacklo_ps (r[0], r[1]) ;
+  __m256 t1 = _mm256_unpackhi_ps (r[0], r[1]) ;
+  __m256 t2 = _mm256_unpacklo_ps (r[2], r[3]) ;
+  __m256 t3 = _mm256_unpackhi_ps (r[2], r[3]) ;
+  __m256 t4 = _mm256_unpacklo_ps (r[4], r[5]) ;
+  __m256 t5 = _mm256_unpackhi_ps (r[4], r[5]) ;
+  __m256 t6 = _mm256_unpacklo_ps (r[6], r[7]) ;
+  __m256 t7 = _mm256_unpackhi_ps (r[6], r[7]) ;
+  __m256 s0 = _mm256_shuffle_ps (t0, t2, _MM_SHUFFLE(1,0,1,0)) ;
+  __m256 s1 = _mm256_shuffle_ps (t0, t2, _MM_SHUFFLE(3,2,3,2)) ;
+  __m256 s2 = _mm256_shuffle_ps (t1, t3, _MM_SHUFFLE(1,0,1,0)) ;
+  __m256 s3 = _mm256_shuffle_ps (t1, t3, _MM_SHUFFLE(3,2,3,2)) ;
+  __m256 s4 = _mm256_shuffle_ps (t4, t6, _MM_SHUFFLE(1,0,1,0)) ;
+  __m256 s5 = _mm256_shuffle_ps (t4, t6, _MM_SHUFFLE(3,2,3,2)) ;
+  __m256 s6 = _mm256_shuffle_ps (t5, t7, _MM_SHUFFLE(1,0,1,0)) ;
+  __m256 s7 = _mm256_shuffle_ps (t5, t7, _MM_SHUFFLE(3,2,3,2)) ;
+  r[0] = _mm256_permute2f128_ps (s0, s4, 0x20) ;
+  r[1] = _mm256_permute2f128_ps (s1, s5, 0x20) ;
+  r[2] = _mm256_permute2f128_ps (s2, s6, 0x20) ;
+  r[3] = _mm256_permute2f128_ps (s3, s7, 0x20) ;
+  r[4] = _mm256_permute2f128_ps (s0, s4, 0x31) ;
+  r[5] = _mm256_permute2f128_ps (s1, s5, 0x31) ;
+  r[6] = _mm256_permute2f128_ps (s2, s6, 0x31) ;
+  r[7] = _mm256_permute2f128_ps (s3, s7, 0x31) ;
+}
+
+/* ---------------------------------------------------------------- */
+/** @internal
+ ** @brief Convolve image along columns (AVX2 and FMA)
+ ** @see ::vl_imconvcol_vf
+ **
+ ** Each pass computes eight adjacent columns. Where the filter
+ ** support is inside the image, the pass is register-blocked over
+ ** ::BLOCK output rows, which gives independent FMA chains and
+ ** allows transposing the 8 x 8 output block in registers so that
+ ** the transposed result is written by rows rather than one pixel at
+ ** a time. The output rows close to the image boundary and the last
+ ** columns are computed one at a time with the padding rules of
+ ** ::vl_imconvcol_vf.
+ **/
+
+VL_EXPORT void
+_vl_imconvcol_vf_avx2 (float* dst, vl_size dst_stride,
+                       float const* src,
+                       vl_size src_width, vl_size src_height, vl_size src_stride,
+                       float const* filt, vl_index filt_begin, vl_index filt_end,
+                       int step, unsigned int flags)
+{
+  vl_index x = 0 ;
+  vl_index j, k, r ;
+  vl_index height = (signed)src_height ;
+  vl_index dheight = (height - 1) / step + 1 ;
+  vl_bool transp = flags & VL_TRANSPOSE ;
+  vl_bool zeropad = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
+
+  /* dst [x,j] = sum_k filt [k - filt_begin] src [x, j * step - k] */
+#define DST(x,j) (transp ? dst + (j) + (x) * dst_stride : dst + (x) + (j) * dst_stride)
+
+  for (x = 0 ; x + 8 <= (signed)src_width ; x += 8) {
+    j = 0 ;
+    while (j < dheight) {
+      vl_index y = j * step ;
+
+      if (j + BLOCK <= dheight &&
+          y - filt_end >= 0 &&
+          (j + BLOCK - 1) * step - filt_begin <= height - 1) {
+        /* ---------------------------------------  Blocked interior */
+        __m256 acc [BLOCK] ;
+        for (r = 0 ; r < BLOCK ; ++r) acc [r] = _mm256_setzero_ps () ;
+        for (k = filt_end ; k >= filt_begin ; --k) {
+          __m256 c = _mm256_broadcast_ss (filt + k - filt_begin) ;
+          float const * srci = src + x + (y - k) * src_stride ;
+          for (r = 0 ; r < BLOCK ; ++r) {
+            acc [r] = _mm256_fmadd_ps (_mm256_loadu_ps (srci + r * step * src_stride), c, acc [r]) ;
+          }
+        }
+        if (transp) {
+          _vl_transpose_avx2_f (acc) ;
+          for (r = 0 ; r < 8 ; ++r) _mm256_storeu_ps (DST(x + r, j), acc [r]) ;
+        } else {
+          for (r = 0 ; r < BLOCK ; ++r) _mm256_storeu_ps (DST(x, j + r), acc [r]) ;
+        }
+        j += BLOCK ;
+      } else {
+        /* ---------------------------------------  Single row */
+        union {__m256 v ; float x [8] ; } acc ;
+        acc.v = _mm256_setzero_ps () ;
+        for (k = filt_end ; k >= filt_begin ; --k) {
+          vl_index p = y - k ;
+          __m256 c = _mm256_broadcast_ss (filt + k - filt_begin) ;
+          __m256 v ;
+          if (p < 0 || p > height - 1) {
+            if (zeropad) continue ;
+            p = (p < 0) ? 0 : height - 1 ;
+          }
+          v = _mm256_loadu_ps (src + x + p * src_stride) ;
+          acc.v = _mm256_fmadd_ps (v, c, acc.v) ;
+        }
+        if (transp) {
+          for (r = 0 ; r < 8 ; ++r) *DST(x + r, j) = acc.x [r] ;
+        } else {
+          _mm256_storeu_ps (DST(x, j), acc.v) ;
+        }
+        j += 1 ;
+      }
+    }
+  }
+
+  /* ---------------------------------------------  Remaining columns */
+  for ( ; x < (signed)src_width ; ++x) {
+    for (j = 0 ; j < dheight ; ++j) {
+      vl_index y = j * step ;
+      float acc = 0 ;
+      for (k = filt_end ; k >= filt_begin ; --k) {
+        vl_index p = y - k ;
+        if (p < 0 || p > height - 1) {
+          if (zeropad) continue ;
+          p = (p < 0) ? 0 : height - 1 ;
+        }
+        acc += src [x + p * src_stride] * filt [k - filt_begin] ;
+      }
+      *DST(x, j) = acc ;
+    }
+  }
+#undef DST
+}
+
+/* ! VL_DISABLE_AVX2 */
+#endif
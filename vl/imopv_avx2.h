@@ -0,0 +1,31 @@
+/** @file imopv_avx2.h
+ ** @brief Vectorized image operations - AVX2
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_IMOPV_AVX2_H
+#define VL_IMOPV_AVX2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX2
+
+VL_EXPORT
+void _vl_imconvcol_vf_avx2 (float* dst, vl_size dst_stride,
+                            float const* src,
+                            vl_size src_width, vl_size src_height, vl_size src_stride,
+                            float const* filt, vl_index filt_begin, vl_index filt_end,
+                            int step, unsigned int flags) ;
+
+/* ! VL_DISABLE_AVX2 */
+#endif
+
+/* ! VL_IMOPV_AVX2_H */
+#endif
@@ -0,0 +1,1083 @@
+/** @file ivfpq.c
+ ** @brief Inverted file with product quantization - Definition
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+/**
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@page ivfpq Inverted file with product quantization
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+@ref ivfpq.h implements the inverted file with product quantization
+(IVF-PQ) of @cite{jegou11product}, an index for approximate nearest
+neighbor search in very large collections of vectors. While the
+indexes of @ref kdtree, @ref kdindex, and @ref kmtree store the data
+and compare the queries to it, an IVF-PQ index stores only a short
+code for each vector (typically 8 to 64 bytes for a SIFT descriptor,
+which takes 512 bytes in single precision) and compares the queries
+to the codes directly. In this manner, billions of vectors fit in
+memory.
+
+- @ref ivfpq-overview
+- @ref ivfpq-tech
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section ivfpq-overview Overview
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+To create a ::VlIVFPQ object use ::vl_ivfpq_new specifying the data
+type and dimension, the number of inverted lists, and the number of
+sub-quantizers, which is also the size in bytes of the codes. The
+index must be trained by ::vl_ivfpq_train on a representative sample
+of the data before use. Then vectors are added by ::vl_ivfpq_add,
+which encodes them in parallel and does not retain a pointer to the
+data. The vectors are identified by the order in which they are
+added, starting from zero.
+
+::vl_ivfpq_search finds the approximate nearest neighbors of a batch
+of queries in parallel. Only the inverted lists of the
+::vl_ivfpq_set_num_probes centers closest to each query are
+searched; increasing this number improves the accuracy of the search
+and reduces its speed. The returned distances are approximations of
+the squared Euclidean distances.
+
+::vl_ivfpq_save writes the index to a binary file, which can be
+loaded back by ::vl_ivfpq_load.
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section ivfpq-tech Technical details
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+<b>Encoding.</b> A coarse quantizer, obtained by clustering the
+training data by ::VlKMeans, assigns each vector @f$ x @f$ to the
+inverted list of the closest center @f$ c @f$. The residual @f$ r =
+x - c @f$ is split into @f$ M @f$ sub-vectors @f$ r_1,\dots,r_M @f$
+of equal dimension, and each sub-vector is quantized to one of
+::VL_IVFPQ_NUM_SUBCENTERS centers @f$ p_{m1},\dots,p_{m256} @f$ of
+the corresponding sub-quantizer, which are obtained by clustering the
+sub-vectors of the residuals of the training data. The code of @f$ x
+@f$ is the sequence of the @f$ M @f$ indexes of these centers, one
+byte each, and is stored in the inverted list together with the
+identifier of @f$ x @f$.
+
+<b>Searching.</b> The squared distance of a query @f$ q @f$ to a
+vector encoded in the list of the center @f$ c @f$ is approximated by
+the distance to its reconstruction (asymmetric distance computation):
+@f[
+ \|q - c - \sum_m p_{mk_m}\|^2 = \sum_{m=1}^M \|(q - c)_m - p_{mk_m}\|^2.
+@f]
+For each searched list, the @f$ M \times 256 @f$ terms of the sum
+are computed once and stored in a lookup table, so that the distance
+to each code costs only @f$ M @f$ table lookups and additions. The
+table is small enough to stay in the first level cache. The
+neighbors are kept in a heap, as done by ::VlKDForest.
+
+If the tables fit in ::VL_IVFPQ_MAX_PRECOMPUTED_TABLE_SIZE entries,
+the computation of the lookup tables is further simplified by
+rewriting the terms as
+@f[
+ \|(q - c)_m - p_{mk}\|^2 = \|(q - c)_m\|^2 +
+ (\|p_{mk}\|^2 + 2\langle c_m, p_{mk} \rangle) - 2 \langle q_m, p_{mk} \rangle.
+@f]
+The sum over @f$ m @f$ of the first terms is the squared distance of
+@f$ q @f$ to @f$ c @f$, which is computed anyway to select the lists
+to search. The second terms do not depend on the query and are
+precomputed when the index is trained. The third terms do not depend
+on the list and are computed once per query. Thus the lookup table of
+a list is obtained by adding two tables, without any multiplication.
+
+<b>File format.</b> The file written by ::vl_ivfpq_save contains a
+header, the centers of the coarse quantizer and of the
+sub-quantizers, the sizes of the inverted lists and, for each list,
+the identifiers of the entries (as 64-bit integers) followed by their
+codes. The precomputed tables are not saved, but computed again when
+the index is loaded. Like the files of ::vl_kdforest_save, a file can
+be loaded only on a host with the same byte order.
+**/
+
+#include "ivfpq.h"
+#include "kdtree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VL_HEAP_prefix     vl_ivfpq_neighbor_heap
+#define VL_HEAP_type       VlKDForestNeighbor
+#define VL_HEAP_cmp(v,x,y) (v[y].distance - v[x].distance)
+#include "heap-def.h"
+
+#define VL_IVFPQ_FILE_MAGIC "VLIVFPQ"
+#define VL_IVFPQ_FILE_VERSION 1
+#define VL_IVFPQ_FILE_BYTE_ORDER 0x01020304
+
+typedef struct _VlIVFPQFileHeader
+{
+  char magic [8] ;
+  vl_uint32 version ;
+  vl_uint32 byteOrder ;
+  vl_uint32 dataType ;
+  vl_uint32 reserved ;
+  vl_uint64 dimension ;
+  vl_uint64 numLists ;
+  vl_uint64 numSubquantizers ;
+  vl_uint64 numData ;
+  vl_uint64 numProbes ;
+  vl_uint64 maxNumIterations ;
+} VlIVFPQFileHeader ;
+
+/** ------------------------------------------------------------------
+ ** @brief Create a new IVF-PQ index
+ ** @param dataType type of data (::VL_TYPE_FLOAT or ::VL_TYPE_DOUBLE)
+ ** @param dimension data dimensionality.
+ ** @param numLists number of inverted lists.
+ ** @param numSubquantizers number of sub-quantizers.
+ ** @return new IVF-PQ index.
+ **
+ ** The data dimension @a dimension must be a multiple of the number
+ ** of sub-quantizers @a numSubquantizers, which is also the size of
+ ** the codes in bytes. The index must be trained by
+ ** ::vl_ivfpq_train before use.
+ **/
+
+VlIVFPQ *
+vl_ivfpq_new (vl_type dataType,
+              vl_size dimension,
+              vl_size numLists,
+              vl_size numSubquantizers)
+{
+  VlIVFPQ * self = vl_calloc (sizeof(VlIVFPQ), 1) ;
+
+  assert(dataType == VL_TYPE_FLOAT || dataType == VL_TYPE_DOUBLE) ;
+  assert(numLists >= 1) ;
+  assert(numSubquantizers >= 1) ;
+  assert(dimension >= 1 && dimension % numSubquantizers == 0) ;
+
+  self->dataType = dataType ;
+  self->dimension = dimension ;
+  self->numLists = numLists ;
+  self->numSubquantizers = numSubquantizers ;
+  self->subdimension = dimension / numSubquantizers ;
+  self->maxNumIterations = 25 ;
+  self->numProbes = 1 ;
+  self->lists = vl_calloc (sizeof(VlIVFPQList), numLists) ;
+  return self ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete IVF-PQ index
+ ** @param self IVF-PQ index.
+ **/
+
+void
+vl_ivfpq_delete (VlIVFPQ * self)
+{
+  vl_uindex li ;
+  for (li = 0 ; li < self->numLists ; ++li) {
+    if (self->lists[li].ids) vl_free (self->lists[li].ids) ;
+    if (self->lists[li].codes) vl_free (self->lists[li].codes) ;
+  }
+  vl_free (self->lists) ;
+  if (self->coarseQuantizer) vl_kmeans_delete (self->coarseQuantizer) ;
+  if (self->codebooks) vl_free (self->codebooks) ;
+  if (self->precomputedTables) vl_free (self->precomputedTables) ;
+  vl_free (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Convert data to single precision
+ ** @param self IVF-PQ index.
+ ** @param data data.
+ ** @param numData number of data points.
+ ** @return @a data or a single precision copy of it.
+ **
+ ** If the result is not @a data, it must be freed by ::vl_free.
+ **/
+
+static float const *
+vl_ivfpq_get_float_data (VlIVFPQ const * self, void const * data, vl_size numData)
+{
+  switch (self->dataType) {
+    case VL_TYPE_FLOAT:
+      return (float const*) data ;
+    case VL_TYPE_DOUBLE: {
+      vl_size n = numData * self->dimension ;
+      float * copy = vl_malloc (sizeof(float) * n) ;
+      vl_uindex i ;
+      for (i = 0 ; i < n ; ++i) copy[i] = (float) ((double const*)data)[i] ;
+      return copy ;
+    }
+    default:
+      abort() ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Precompute the list terms of the lookup tables
+ ** @param self IVF-PQ index.
+ **
+ ** See @ref ivfpq-tech.
+ **/
+
+static void
+vl_ivfpq_precompute_tables (VlIVFPQ * self)
+{
+  vl_size M = self->numSubquantizers ;
+  vl_size tableSize = M * VL_IVFPQ_NUM_SUBCENTERS ;
+  float const * centers = vl_kmeans_get_centers (self->coarseQuantizer) ;
+  vl_index li ;
+
+  if (self->precomputedTables) {
+    vl_free (self->precomputedTables) ;
+    self->precomputedTables = NULL ;
+  }
+  if (self->numLists * tableSize > VL_IVFPQ_MAX_PRECOMPUTED_TABLE_SIZE) return ;
+
+  self->precomputedTables = vl_malloc (sizeof(float) * self->numLists * tableSize) ;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(shared) num_threads(vl_get_max_threads())
+#endif
+  for (li = 0 ; li < (signed)self->numLists ; ++li) {
+    float const * center = centers + li * self->dimension ;
+    float * table = self->precomputedTables + li * tableSize ;
+    vl_uindex m, k, j ;
+    for (m = 0 ; m < M ; ++m) {
+      for (k = 0 ; k < VL_IVFPQ_NUM_SUBCENTERS ; ++k) {
+        float const * p = self->codebooks + (m * VL_IVFPQ_NUM_SUBCENTERS + k) * self->subdimension ;
+        float const * c = center + m * self->subdimension ;
+        float acc = 0 ;
+        for (j = 0 ; j < self->subdimension ; ++j) {
+          acc += p[j] * (p[j] + 2 * c[j]) ;
+        }
+        table[m * VL_IVFPQ_NUM_SUBCENTERS + k] = acc ;
+      }
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Train the IVF-PQ index
+ ** @param self IVF-PQ index.
+ ** @param data training data.
+ ** @param numData number of training data points.
+ **
+ ** The function learns the coarse quantizer and the sub-quantizers
+ ** by clustering the training data by ::VlKMeans (see @ref
+ ** ivfpq-tech). The number of training points @a numData must not be
+ ** smaller than the number of lists nor than
+ ** ::VL_IVFPQ_NUM_SUBCENTERS. The clustering uses the default random
+ ** number generator (::vl_get_rand).
+ **
+ ** The index must not contain any vector. Training an index again
+ ** discards the previous quantizers.
+ **/
+
+void
+vl_ivfpq_train (VlIVFPQ * self, void const * data, vl_size numData)
+{
+  vl_size D = self->dimension ;
+  vl_size d = self->subdimension ;
+  float const * x = vl_ivfpq_get_float_data (self, data, numData) ;
+  float const * centers ;
+  float * residuals ;
+  float * buffer ;
+  vl_uint32 * assignments ;
+  VlKMeans * kmeans ;
+  vl_uindex i, j, m ;
+
+  assert (data) ;
+  assert (numData >= self->numLists) ;
+  assert (numData >= VL_IVFPQ_NUM_SUBCENTERS) ;
+  assert (self->numData == 0) ;
+
+  /* coarse quantizer */
+  if (self->coarseQuantizer) vl_kmeans_delete (self->coarseQuantizer) ;
+  self->coarseQuantizer = vl_kmeans_new (VL_TYPE_FLOAT, VlDistanceL2) ;
+  vl_kmeans_set_algorithm (self->coarseQuantizer, VlKMeansLloyd) ;
+  vl_kmeans_set_initialization (self->coarseQuantizer, VlKMeansPlusPlus) ;
+  vl_kmeans_set_max_num_iterations (self->coarseQuantizer, self->maxNumIterations) ;
+  vl_kmeans_set_num_repetitions (self->coarseQuantizer, 1) ;
+  vl_kmeans_cluster (self->coarseQuantizer, x, D, numData, self->numLists) ;
+
+  /* residuals */
+  assignments = vl_malloc (sizeof(vl_uint32) * numData) ;
+  residuals = vl_malloc (sizeof(float) * numData * D) ;
+  vl_kmeans_quantize (self->coarseQuantizer, assignments, NULL, x, numData) ;
+  centers = vl_kmeans_get_centers (self->coarseQuantizer) ;
+  for (i = 0 ; i < numData ; ++i) {
+    for (j = 0 ; j < D ; ++j) {
+      residuals[i * D + j] = x[i * D + j] - centers[assignments[i] * D + j] ;
+    }
+  }
+
+  /* sub-quantizers */
+  if (self->codebooks) vl_free (self->codebooks) ;
+  self->codebooks = vl_malloc (sizeof(float) * VL_IVFPQ_NUM_SUBCENTERS * D) ;
+  buffer = vl_malloc (sizeof(float) * numData * d) ;
+  kmeans = vl_kmeans_new (VL_TYPE_FLOAT, VlDistanceL2) ;
+  vl_kmeans_set_algorithm (kmeans, VlKMeansLloyd) ;
+  vl_kmeans_set_initialization (kmeans, VlKMeansPlusPlus) ;
+  vl_kmeans_set_max_num_iterations (kmeans, self->maxNumIterations) ;
+  vl_kmeans_set_num_repetitions (kmeans, 1) ;
+  for (m = 0 ; m < self->numSubquantizers ; ++m) {
+    for (i = 0 ; i < numData ; ++i) {
+      memcpy (buffer + i * d, residuals + i * D + m * d, sizeof(float) * d) ;
+    }
+    vl_kmeans_cluster (kmeans, buffer, d, numData, VL_IVFPQ_NUM_SUBCENTERS) ;
+    memcpy (self->codebooks + m * VL_IVFPQ_NUM_SUBCENTERS * d,
+            vl_kmeans_get_centers (kmeans),
+            sizeof(float) * VL_IVFPQ_NUM_SUBCENTERS * d) ;
+  }
+  vl_kmeans_delete (kmeans) ;
+  vl_free (buffer) ;
+  vl_free (residuals) ;
+  vl_free (assignments) ;
+  if (x != data) vl_free ((void*)x) ;
+
+  vl_ivfpq_precompute_tables (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Encode a residual
+ ** @param self IVF-PQ index.
+ ** @param code code (output).
+ ** @param residual residual.
+ **/
+
+static void
+vl_ivfpq_encode (VlIVFPQ const * self, vl_uint8 * code, float const * residual)
+{
+  vl_size d = self->subdimension ;
+  vl_uindex m, k, j ;
+  for (m = 0 ; m < self->numSubquantizers ; ++m) {
+    float const * r = residual + m * d ;
+    float const * p = self->codebooks + m * VL_IVFPQ_NUM_SUBCENTERS * d ;
+    float bestDistance = VL_INFINITY_F ;
+    vl_uindex best = 0 ;
+    for (k = 0 ; k < VL_IVFPQ_NUM_SUBCENTERS ; ++k, p += d) {
+      float acc = 0 ;
+      for (j = 0 ; j < d ; ++j) {
+        float delta = r[j] - p[j] ;
+        acc += delta * delta ;
+      }
+      if (acc < bestDistance) {
+        bestDistance = acc ;
+        best = k ;
+      }
+    }
+    code[m] = (vl_uint8) best ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Add vectors to the IVF-PQ index
+ ** @param self IVF-PQ index.
+ ** @param data vectors to add.
+ ** @param numData number of vectors to add.
+ ** @return identifier of the first vector.
+ **
+ ** The function encodes the vectors @a data in parallel and appends
+ ** them to the inverted lists. The vectors are not retained. They
+ ** receive consecutive identifiers, starting from the returned
+ ** value. The index must have been trained by ::vl_ivfpq_train.
+ **/
+
+vl_uindex
+vl_ivfpq_add (VlIVFPQ * self, void const * data, vl_size numData)
+{
+  vl_size D = self->dimension ;
+  vl_size M = self->numSubquantizers ;
+  vl_uindex firstId = self->numData ;
+  float const * x ;
+  float const * centers ;
+  vl_uint32 * assignments ;
+  vl_uint8 * codes ;
+  vl_uindex i ;
+
+  assert (self->codebooks) ;
+  if (numData == 0) return firstId ;
+  assert (data) ;
+
+  x = vl_ivfpq_get_float_data (self, data, numData) ;
+  assignments = vl_malloc (sizeof(vl_uint32) * numData) ;
+  codes = vl_malloc (M * numData) ;
+  vl_kmeans_quantize (self->coarseQuantizer, assignments, NULL, x, numData) ;
+  centers = vl_kmeans_get_centers (self->coarseQuantizer) ;
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) num_threads(vl_get_max_threads())
+#endif
+  {
+    vl_index di ;
+    vl_uindex j ;
+    /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+    float * residual = malloc (sizeof(float) * D) ;
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (di = 0 ; di < (signed)numData ; ++di) {
+      float const * center = centers + assignments[di] * D ;
+      for (j = 0 ; j < D ; ++j) {
+        residual[j] = x[di * D + j] - center[j] ;
+      }
+      vl_ivfpq_encode (self, codes + di * M, residual) ;
+    }
+
+    free (residual) ;
+  }
+
+  /* append the codes to the inverted lists */
+  for (i = 0 ; i < numData ; ++i) {
+    VlIVFPQList * list = self->lists + assignments[i] ;
+    if (list->numEntries == list->numAllocatedEntries) {
+      list->numAllocatedEntries = VL_MAX(16, 2 * list->numAllocatedEntries) ;
+      list->ids = vl_realloc (list->ids, sizeof(vl_uindex) * list->numAllocatedEntries) ;
+      list->codes = vl_realloc (list->codes, M * list->numAllocatedEntries) ;
+    }
+    list->ids[list->numEntries] = firstId + i ;
+    memcpy (list->codes + list->numEntries * M, codes + i * M, M) ;
+    list->numEntries ++ ;
+  }
+  self->numData += numData ;
+
+  vl_free (codes) ;
+  vl_free (assignments) ;
+  if (x != data) vl_free ((void*)x) ;
+  return firstId ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Approximate distance of a code
+ ** @param table lookup table.
+ ** @param code code.
+ ** @param numSubquantizers number of sub-quantizers.
+ ** @return sum of the table entries selected by the code.
+ **
+ ** The sum is split in four independent accumulators, so that the
+ ** lookups of consecutive sub-quantizers can be executed in parallel.
+ **/
+
+VL_INLINE float
+vl_ivfpq_lookup (float const * table, vl_uint8 const * code, vl_size numSubquantizers)
+{
+  float acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0 ;
+  vl_uindex m = 0 ;
+  for ( ; m + 4 <= numSubquantizers ; m += 4) {
+    acc0 += table[code[m]] ;
+    acc1 += table[VL_IVFPQ_NUM_SUBCENTERS + code[m+1]] ;
+    acc2 += table[2 * VL_IVFPQ_NUM_SUBCENTERS + code[m+2]] ;
+    acc3 += table[3 * VL_IVFPQ_NUM_SUBCENTERS + code[m+3]] ;
+    table += 4 * VL_IVFPQ_NUM_SUBCENTERS ;
+  }
+  for ( ; m < numSubquantizers ; ++m) {
+    acc0 += table[code[m]] ;
+    table += VL_IVFPQ_NUM_SUBCENTERS ;
+  }
+  return (acc0 + acc1) + (acc2 + acc3) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Search an inverted list
+ ** @param self IVF-PQ index.
+ ** @param list inverted list.
+ ** @param table lookup table of the list.
+ ** @param baseDistance distance added to the sum of the table entries.
+ ** @param neighbors neighbors found so far (a max-heap).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param numAddedNeighbors number of neighbors in @a neighbors (input/output).
+ **/
+
+static void
+vl_ivfpq_search_list (VlIVFPQ const * self,
+                      VlIVFPQList const * list,
+                      float const * table,
+                      float baseDistance,
+                      VlKDForestNeighbor * neighbors,
+                      vl_size numNeighbors,
+                      vl_size * numAddedNeighbors)
+{
+  vl_size M = self->numSubquantizers ;
+  vl_uint8 const * code = list->codes ;
+  vl_uindex e ;
+
+  for (e = 0 ; e < list->numEntries ; ++e, code += M) {
+    float dist = baseDistance + vl_ivfpq_lookup (table, code, M) ;
+    if (*numAddedNeighbors < numNeighbors) {
+      VlKDForestNeighbor * newNeighbor = neighbors + *numAddedNeighbors ;
+      newNeighbor->index = list->ids[e] ;
+      newNeighbor->distance = dist ;
+      vl_ivfpq_neighbor_heap_push (neighbors, numAddedNeighbors) ;
+    } else if (neighbors[0].distance > dist) {
+      neighbors[0].index = list->ids[e] ;
+      neighbors[0].distance = dist ;
+      vl_ivfpq_neighbor_heap_update (neighbors, *numAddedNeighbors, 0) ;
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Search the IVF-PQ index
+ ** @param self IVF-PQ index.
+ ** @param indexes identifiers of the nearest neighbors (output).
+ ** @param numNeighbors number of nearest neighbors to find per query.
+ ** @param numQueries number of queries.
+ ** @param distances squared distances to the nearest neighbors (output).
+ ** @param queries queries.
+ ** @return number of codes compared to the queries.
+ **
+ ** The function finds the approximate nearest neighbors of the
+ ** queries @a queries in parallel, searching the
+ ** ::vl_ivfpq_get_num_probes inverted lists closest to each query
+ ** (see @ref ivfpq-tech). The output @a indexes is a @a numNeighbors
+ ** by @a numQueries array with the identifiers of the neighbors of
+ ** each query, sorted by increasing distance. If fewer than @a
+ ** numNeighbors vectors are found, the remaining identifiers are set
+ ** to @c -1 and the corresponding distances to NaN. The approximate
+ ** squared Euclidean distances are written to @a distances, an array
+ ** of the same size and of the same type as the data, unless @a
+ ** distances is @c NULL.
+ **/
+
+vl_size
+vl_ivfpq_search (VlIVFPQ const * self,
+                 vl_uindex * indexes,
+                 vl_size numNeighbors,
+                 vl_size numQueries,
+                 void * distances,
+                 void const * queries)
+{
+  vl_size D = self->dimension ;
+  vl_size M = self->numSubquantizers ;
+  vl_size d = self->subdimension ;
+  vl_size tableSize = M * VL_IVFPQ_NUM_SUBCENTERS ;
+  vl_size numProbes = VL_MIN(self->numProbes, self->numLists) ;
+  vl_size numComparisons = 0 ;
+  float const * x ;
+  float const * centers ;
+  vl_uint32 * probes ;
+  float * probeDistances ;
+
+  assert (self->codebooks) ;
+  assert (indexes) ;
+  assert (numNeighbors > 0) ;
+  if (numQueries == 0) return 0 ;
+  assert (queries) ;
+
+  /* select the lists to search */
+  x = vl_ivfpq_get_float_data (self, queries, numQueries) ;
+  probes = vl_malloc (sizeof(vl_uint32) * numProbes * numQueries) ;
+  probeDistances = vl_malloc (sizeof(float) * numProbes * numQueries) ;
+  vl_kmeans_quantize_k (self->coarseQuantizer, probes, probeDistances,
+                        x, numQueries, numProbes) ;
+  centers = vl_kmeans_get_centers (self->coarseQuantizer) ;
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) num_threads(vl_get_max_threads())
+#endif
+  {
+    vl_index qi ;
+    vl_size thisNumComparisons = 0 ;
+    VlKDForestNeighbor * neighbors ;
+    float * table ;
+    float * queryTable ;
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      neighbors = vl_calloc (sizeof(VlKDForestNeighbor), numNeighbors) ;
+      table = vl_malloc (sizeof(float) * tableSize) ;
+      queryTable = vl_malloc (sizeof(float) * VL_MAX(tableSize, D)) ;
+    }
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (qi = 0 ; qi < (signed)numQueries ; ++ qi) {
+      float const * query = x + qi * D ;
+      vl_size numAddedNeighbors = 0 ;
+      vl_uindex pi, ni, m, k, j ;
+
+      /* query terms of the lookup tables: -2 <q_m, p_mk> */
+      if (self->precomputedTables) {
+        for (m = 0 ; m < M ; ++m) {
+          for (k = 0 ; k < VL_IVFPQ_NUM_SUBCENTERS ; ++k) {
+            float const * p = self->codebooks + (m * VL_IVFPQ_NUM_SUBCENTERS + k) * d ;
+            float acc = 0 ;
+            for (j = 0 ; j < d ; ++j) acc += query[m * d + j] * p[j] ;
+            queryTable[m * VL_IVFPQ_NUM_SUBCENTERS + k] = -2 * acc ;
+          }
+        }
+      }
+
+      for (pi = 0 ; pi < numProbes ; ++pi) {
+        vl_uindex li = probes[qi * numProbes + pi] ;
+        VlIVFPQList const * list = self->lists + li ;
+        float baseDistance = 0 ;
+        if (list->numEntries == 0) continue ;
+
+        if (self->precomputedTables) {
+          float const * listTable = self->precomputedTables + li * tableSize ;
+          for (j = 0 ; j < tableSize ; ++j) table[j] = listTable[j] + queryTable[j] ;
+          baseDistance = probeDistances[qi * numProbes + pi] ;
+        } else {
+          /* compute the table from the residual of the query */
+          float * residual = queryTable ;
+          for (j = 0 ; j < D ; ++j) residual[j] = query[j] - centers[li * D + j] ;
+          for (m = 0 ; m < M ; ++m) {
+            for (k = 0 ; k < VL_IVFPQ_NUM_SUBCENTERS ; ++k) {
+              float const * p = self->codebooks + (m * VL_IVFPQ_NUM_SUBCENTERS + k) * d ;
+              float acc = 0 ;
+              for (j = 0 ; j < d ; ++j) {
+                float delta = residual[m * d + j] - p[j] ;
+                acc += delta * delta ;
+              }
+              table[m * VL_IVFPQ_NUM_SUBCENTERS + k] = acc ;
+            }
+          }
+        }
+
+        vl_ivfpq_search_list (self, list, table, baseDistance,
+                              neighbors, numNeighbors, &numAddedNeighbors) ;
+        thisNumComparisons += list->numEntries ;
+      }
+
+      /* sort neighbors by increasing distance */
+      for (ni = numAddedNeighbors ; ni < numNeighbors ; ++ ni) {
+        neighbors[ni].index = -1 ;
+        neighbors[ni].distance = VL_NAN_F ;
+      }
+      while (numAddedNeighbors) {
+        vl_ivfpq_neighbor_heap_pop (neighbors, &numAddedNeighbors) ;
+      }
+
+      for (ni = 0 ; ni < numNeighbors ; ++ni) {
+        indexes [qi*numNeighbors + ni] = neighbors[ni].index ;
+        if (distances) {
+          switch (self->dataType) {
+            case VL_TYPE_FLOAT:
+              *((float*)distances + qi*numNeighbors + ni) = (float) neighbors[ni].distance ;
+              break ;
+            case VL_TYPE_DOUBLE:
+              *((double*)distances + qi*numNeighbors + ni) = neighbors[ni].distance ;
+              break ;
+            default:
+              abort() ;
+          }
+        }
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      numComparisons += thisNumComparisons ;
+      vl_free (neighbors) ;
+      vl_free (table) ;
+      vl_free (queryTable) ;
+    }
+  }
+
+  vl_free (probes) ;
+  vl_free (probeDistances) ;
+  if (x != queries) vl_free ((void*)x) ;
+  return numComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Save the IVF-PQ index to a file
+ ** @param self IVF-PQ index.
+ ** @param fileName name of the file.
+ ** @return error code.
+ **
+ ** The function writes the quantizers and the inverted lists of the
+ ** index, which must have been trained, in a binary file that can be
+ ** loaded back by ::vl_ivfpq_load (see @ref ivfpq-tech). The
+ ** function returns ::VL_ERR_OK on success and ::VL_ERR_IO if the
+ ** file cannot be written.
+ **/
+
+int
+vl_ivfpq_save (VlIVFPQ const * self, char const * fileName)
+{
+  VlIVFPQFileHeader header ;
+  vl_size M = self->numSubquantizers ;
+  vl_uint64 * buffer ;
+  vl_size bufferSize = 1 ;
+  vl_uindex li, e ;
+  vl_bool ok ;
+  FILE * file ;
+
+  assert (self->codebooks) ;
+
+  memset (&header, 0, sizeof(header)) ;
+  memcpy (header.magic, VL_IVFPQ_FILE_MAGIC, sizeof(header.magic)) ;
+  header.version = VL_IVFPQ_FILE_VERSION ;
+  header.byteOrder = VL_IVFPQ_FILE_BYTE_ORDER ;
+  header.dataType = self->dataType ;
+  header.dimension = self->dimension ;
+  header.numLists = self->numLists ;
+  header.numSubquantizers = M ;
+  header.numData = self->numData ;
+  header.numProbes = self->numProbes ;
+  header.maxNumIterations = self->maxNumIterations ;
+
+  file = fopen (fileName, "wb") ;
+  if (file == NULL) {
+    return vl_set_last_error (VL_ERR_IO, "Could not open IVF-PQ file `%s' for writing", fileName) ;
+  }
+
+  for (li = 0 ; li < self->numLists ; ++li) {
+    bufferSize = VL_MAX(bufferSize, self->lists[li].numEntries) ;
+  }
+  buffer = vl_malloc (sizeof(vl_uint64) * VL_MAX(bufferSize, self->numLists)) ;
+
+  ok = (fwrite (&header, sizeof(header), 1, file) == 1) ;
+  ok = ok && (fwrite (vl_kmeans_get_centers (self->coarseQuantizer),
+                      sizeof(float) * self->dimension, self->numLists, file) == self->numLists) ;
+  ok = ok && (fwrite (self->codebooks, sizeof(float) * self->dimension,
+                      VL_IVFPQ_NUM_SUBCENTERS, file) == VL_IVFPQ_NUM_SUBCENTERS) ;
+  for (li = 0 ; li < self->numLists ; ++li) buffer[li] = self->lists[li].numEntries ;
+  ok = ok && (fwrite (buffer, sizeof(vl_uint64), self->numLists, file) == self->numLists) ;
+  for (li = 0 ; ok && li < self->numLists ; ++li) {
+    VlIVFPQList const * list = self->lists + li ;
+    if (list->numEntries == 0) continue ;
+    for (e = 0 ; e < list->numEntries ; ++e) buffer[e] = list->ids[e] ;
+    ok = (fwrite (buffer, sizeof(vl_uint64), list->numEntries, file) == list->numEntries) &&
+         (fwrite (list->codes, M, list->numEntries, file) == list->numEntries) ;
+  }
+  ok = (fclose (file) == 0) && ok ;
+  vl_free (buffer) ;
+
+  if (! ok) {
+    return vl_set_last_error (VL_ERR_IO, "Error writing IVF-PQ file `%s'", fileName) ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Get the length of a file
+ ** @param file file.
+ ** @param size length of the file in bytes (output).
+ ** @return @c VL_TRUE on success.
+ **
+ ** The function leaves the file position unchanged.
+ **/
+
+static vl_bool
+vl_ivfpq_get_file_size (FILE * file, vl_uint64 * size)
+{
+#if defined(VL_OS_WIN)
+  __int64 position = _ftelli64 (file) ;
+  __int64 end ;
+  if (position < 0 || _fseeki64 (file, 0, SEEK_END) != 0) return VL_FALSE ;
+  end = _ftelli64 (file) ;
+  if (end < 0 || _fseeki64 (file, position, SEEK_SET) != 0) return VL_FALSE ;
+#else
+  long position = ftell (file) ;
+  long end ;
+  if (position < 0 || fseek (file, 0, SEEK_END) != 0) return VL_FALSE ;
+  end = ftell (file) ;
+  if (end < 0 || fseek (file, position, SEEK_SET) != 0) return VL_FALSE ;
+#endif
+  *size = (vl_uint64) end ;
+  return VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Load an IVF-PQ index from a file
+ ** @param fileName name of the file.
+ ** @return new IVF-PQ index or @c NULL on failure.
+ **
+ ** The function loads an index saved by ::vl_ivfpq_save. The loaded
+ ** index can be searched and extended by ::vl_ivfpq_add.
+ **
+ ** The sizes in the header are checked against the length of the
+ ** file before any memory is allocated, so that a corrupted file
+ ** cannot cause large allocations or reads past its end.
+ **
+ ** On failure, the function returns @c NULL and sets the last error
+ ** (::vl_get_last_error) to ::VL_ERR_IO if the file cannot be opened
+ ** or to ::VL_ERR_BAD_ARG if the file is not valid or was saved on an
+ ** incompatible host.
+ **/
+
+VlIVFPQ *
+vl_ivfpq_load (char const * fileName)
+{
+  VlIVFPQFileHeader header ;
+  VlIVFPQ * self = NULL ;
+  vl_uint64 * buffer = NULL ;
+  float * centers = NULL ;
+  vl_uint64 numData = 0 ;
+  vl_uint64 fileSize, remaining ;
+  vl_uindex li, e ;
+  FILE * file = fopen (fileName, "rb") ;
+
+  if (file == NULL) {
+    vl_set_last_error (VL_ERR_IO, "Could not open IVF-PQ file `%s'", fileName) ;
+    return NULL ;
+  }
+
+  /* validate the header */
+  if (fread (&header, sizeof(header), 1, file) != 1 ||
+      memcmp (header.magic, VL_IVFPQ_FILE_MAGIC, sizeof(header.magic)) != 0) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "`%s' is not an IVF-PQ file", fileName) ;
+    goto fail ;
+  }
+  if (header.version != VL_IVFPQ_FILE_VERSION) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' has unsupported version %d",
+                       fileName, header.version) ;
+    goto fail ;
+  }
+  if (header.byteOrder != VL_IVFPQ_FILE_BYTE_ORDER) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' was saved on an incompatible host",
+                       fileName) ;
+    goto fail ;
+  }
+  if ((header.dataType != VL_TYPE_FLOAT && header.dataType != VL_TYPE_DOUBLE) ||
+      header.dimension < 1 || header.numLists < 1 || header.numSubquantizers < 1 ||
+      header.dimension % header.numSubquantizers != 0) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+
+  /* check the sizes against the file length, without overflowing:
+     centers, codebooks and list sizes, then an identifier and a code
+     for each entry */
+  if (! vl_ivfpq_get_file_size (file, &fileSize)) {
+    vl_set_last_error (VL_ERR_IO, "Could not get the size of IVF-PQ file `%s'", fileName) ;
+    goto fail ;
+  }
+  remaining = fileSize - sizeof(header) ;
+  if (header.dimension > remaining / (sizeof(float) * VL_IVFPQ_NUM_SUBCENTERS) ||
+      header.numLists > (remaining - sizeof(float) * VL_IVFPQ_NUM_SUBCENTERS * header.dimension) /
+                        (sizeof(float) * header.dimension + sizeof(vl_uint64))) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+  remaining -= sizeof(float) * header.dimension * (VL_IVFPQ_NUM_SUBCENTERS + header.numLists) ;
+  remaining -= sizeof(vl_uint64) * header.numLists ;
+  if (header.numData > remaining / (sizeof(vl_uint64) + header.numSubquantizers) ||
+      header.numData * (sizeof(vl_uint64) + header.numSubquantizers) != remaining) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+
+  self = vl_ivfpq_new (header.dataType, header.dimension,
+                       header.numLists, header.numSubquantizers) ;
+  self->numProbes = VL_MAX(header.numProbes, 1) ;
+  self->maxNumIterations = header.maxNumIterations ;
+
+  /* quantizers */
+  centers = vl_malloc (sizeof(float) * self->dimension * self->numLists) ;
+  self->codebooks = vl_malloc (sizeof(float) * self->dimension * VL_IVFPQ_NUM_SUBCENTERS) ;
+  buffer = vl_malloc (sizeof(vl_uint64) * self->numLists) ;
+  if (fread (centers, sizeof(float) * self->dimension, self->numLists, file) != self->numLists ||
+      fread (self->codebooks, sizeof(float) * self->dimension,
+             VL_IVFPQ_NUM_SUBCENTERS, file) != VL_IVFPQ_NUM_SUBCENTERS ||
+      fread (buffer, sizeof(vl_uint64), self->numLists, file) != self->numLists) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+  self->coarseQuantizer = vl_kmeans_new (VL_TYPE_FLOAT, VlDistanceL2) ;
+  vl_kmeans_set_centers (self->coarseQuantizer, centers, self->dimension, self->numLists) ;
+
+  /* inverted lists */
+  for (li = 0 ; li < self->numLists ; ++li) {
+    if (buffer[li] > header.numData - numData) break ;
+    numData += buffer[li] ;
+    self->lists[li].numEntries = buffer[li] ;
+  }
+  if (li < self->numLists || numData != header.numData) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+  vl_free (buffer) ;
+  buffer = NULL ;
+  for (li = 0 ; li < self->numLists ; ++li) {
+    VlIVFPQList * list = self->lists + li ;
+    vl_size n = list->numEntries ;
+    if (n == 0) continue ;
+    list->numAllocatedEntries = n ;
+    list->ids = vl_malloc (sizeof(vl_uindex) * n) ;
+    list->codes = vl_malloc (self->numSubquantizers * n) ;
+    buffer = vl_malloc (sizeof(vl_uint64) * n) ;
+    if (fread (buffer, sizeof(vl_uint64), n, file) != n ||
+        fread (list->codes, self->numSubquantizers, n, file) != n) {
+      vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+      goto fail ;
+    }
+    for (e = 0 ; e < n ; ++e) {
+      if (buffer[e] >= numData) {
+        vl_set_last_error (VL_ERR_BAD_ARG, "IVF-PQ file `%s' is corrupted", fileName) ;
+        goto fail ;
+      }
+      list->ids[e] = (vl_uindex) buffer[e] ;
+    }
+    vl_free (buffer) ;
+    buffer = NULL ;
+  }
+  self->numData = numData ;
+  fclose (file) ;
+  vl_free (centers) ;
+
+  vl_ivfpq_precompute_tables (self) ;
+  return self ;
+
+fail:
+  fclose (file) ;
+  if (buffer) vl_free (buffer) ;
+  if (centers) vl_free (centers) ;
+  if (self) vl_ivfpq_delete (self) ;
+  return NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of vectors in the index
+ ** @param self IVF-PQ index.
+ ** @return number of vectors.
+ **/
+
+vl_size
+vl_ivfpq_get_num_data (VlIVFPQ const * self)
+{
+  return self->numData ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the dimension of the data
+ ** @param self IVF-PQ index.
+ ** @return dimension of the data.
+ **/
+
+vl_size
+vl_ivfpq_get_data_dimension (VlIVFPQ const * self)
+{
+  return self->dimension ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the data type
+ ** @param self IVF-PQ index.
+ ** @return data type.
+ **/
+
+vl_type
+vl_ivfpq_get_data_type (VlIVFPQ const * self)
+{
+  return self->dataType ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of inverted lists
+ ** @param self IVF-PQ index.
+ ** @return number of inverted lists.
+ **/
+
+vl_size
+vl_ivfpq_get_num_lists (VlIVFPQ const * self)
+{
+  return self->numLists ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of entries of an inverted list
+ ** @param self IVF-PQ index.
+ ** @param list index of the inverted list.
+ ** @return number of entries of the list.
+ **/
+
+vl_size
+vl_ivfpq_get_list_size (VlIVFPQ const * self, vl_uindex list)
+{
+  assert (list < self->numLists) ;
+  return self->lists[list].numEntries ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of sub-quantizers
+ ** @param self IVF-PQ index.
+ ** @return number of sub-quantizers (size of the codes in bytes).
+ **/
+
+vl_size
+vl_ivfpq_get_num_subquantizers (VlIVFPQ const * self)
+{
+  return self->numSubquantizers ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Check whether the index has been trained
+ ** @param self IVF-PQ index.
+ ** @return ::VL_TRUE if the index has been trained.
+ **/
+
+vl_bool
+vl_ivfpq_is_trained (VlIVFPQ const * self)
+{
+  return self->codebooks != NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the number of inverted lists searched for each query
+ ** @param self IVF-PQ index.
+ ** @param n number of lists.
+ **
+ ** The default is one. The number must not be smaller than one.
+ **/
+
+void
+vl_ivfpq_set_num_probes (VlIVFPQ * self, vl_size n)
+{
+  assert (n >= 1) ;
+  self->numProbes = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of inverted lists searched for each query
+ ** @param self IVF-PQ index.
+ ** @return number of lists.
+ **/
+
+vl_size
+vl_ivfpq_get_num_probes (VlIVFPQ const * self)
+{
+  return self->numProbes ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the maximum number of k-means iterations used for training
+ ** @param self IVF-PQ index.
+ ** @param n maximum number of iterations.
+ **
+ ** The default is 25.
+ **/
+
+void
+vl_ivfpq_set_max_num_iterations (VlIVFPQ * self, vl_size n)
+{
+  self->maxNumIterations = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of k-means iterations used for training
+ ** @param self IVF-PQ index.
+ ** @return maximum number of iterations.
+ **/
+
+vl_size
+vl_ivfpq_get_max_num_iterations (VlIVFPQ const * self)
+{
+  return self->maxNumIterations ;
+}
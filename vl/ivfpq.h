@@ -0,0 +1,105 @@
+/** @file ivfpq.h
+ ** @brief Inverted file with product quantization (@ref ivfpq)
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_IVFPQ_H
+#define VL_IVFPQ_H
+
+#include "generic.h"
+#include "kmeans.h"
+
+/** @brief Number of centers of each sub-quantizer of a ::VlIVFPQ */
+#define VL_IVFPQ_NUM_SUBCENTERS 256
+/** @brief Maximum number of entries of the tables precomputed by a ::VlIVFPQ */
+#define VL_IVFPQ_MAX_PRECOMPUTED_TABLE_SIZE (1 << 26)
+
+/** @brief Inverted list of a ::VlIVFPQ */
+typedef struct _VlIVFPQList
+{
+  vl_uindex * ids ;              /**< identifiers of the entries */
+  vl_uint8 * codes ;             /**< codes of the entries */
+  vl_size numEntries ;           /**< number of entries */
+  vl_size numAllocatedEntries ;  /**< number of allocated entries */
+} VlIVFPQList ;
+
+/** @brief Inverted file with product quantization */
+typedef struct _VlIVFPQ
+{
+  vl_type dataType ;
+  vl_size dimension ;
+  vl_size numLists ;
+  vl_size numSubquantizers ;
+  vl_size subdimension ;
+
+  /* quantizers */
+  VlKMeans * coarseQuantizer ;
+  float * codebooks ;
+  float * precomputedTables ;
+  vl_size maxNumIterations ;
+
+  /* inverted lists */
+  VlIVFPQList * lists ;
+  vl_size numData ;
+
+  /* query */
+  vl_size numProbes ;
+} VlIVFPQ ;
+
+/** @name Creating and disposing
+ ** @{ */
+VL_EXPORT VlIVFPQ * vl_ivfpq_new (vl_type dataType,
+                                  vl_size dimension,
+                                  vl_size numLists,
+                                  vl_size numSubquantizers) ;
+VL_EXPORT void vl_ivfpq_delete (VlIVFPQ * self) ;
+/** @} */
+
+/** @name Training, adding, and searching
+ ** @{ */
+VL_EXPORT void vl_ivfpq_train (VlIVFPQ * self,
+                               void const * data,
+                               vl_size numData) ;
+
+VL_EXPORT vl_uindex vl_ivfpq_add (VlIVFPQ * self,
+                                  void const * data,
+                                  vl_size numData) ;
+
+VL_EXPORT vl_size vl_ivfpq_search (VlIVFPQ const * self,
+                                   vl_uindex * indexes,
+                                   vl_size numNeighbors,
+                                   vl_size numQueries,
+                                   void * distances,
+                                   void const * queries) ;
+/** @} */
+
+/** @name Saving and loading
+ ** @{ */
+VL_EXPORT int vl_ivfpq_save (VlIVFPQ const * self, char const * fileName) ;
+VL_EXPORT VlIVFPQ * vl_ivfpq_load (char const * fileName) ;
+/** @} */
+
+/** @name Retrieving and setting parameters
+ ** @{ */
+VL_EXPORT vl_size vl_ivfpq_get_num_data (VlIVFPQ const * self) ;
+VL_EXPORT vl_size vl_ivfpq_get_data_dimension (VlIVFPQ const * self) ;
+VL_EXPORT vl_type vl_ivfpq_get_data_type (VlIVFPQ const * self) ;
+VL_EXPORT vl_size vl_ivfpq_get_num_lists (VlIVFPQ const * self) ;
+VL_EXPORT vl_size vl_ivfpq_get_list_size (VlIVFPQ const * self, vl_uindex list) ;
+VL_EXPORT vl_size vl_ivfpq_get_num_subquantizers (VlIVFPQ const * self) ;
+VL_EXPORT vl_bool vl_ivfpq_is_trained (VlIVFPQ const * self) ;
+VL_EXPORT void vl_ivfpq_set_num_probes (VlIVFPQ * self, vl_size n) ;
+VL_EXPORT vl_size vl_ivfpq_get_num_probes (VlIVFPQ const * self) ;
+VL_EXPORT void vl_ivfpq_set_max_num_iterations (VlIVFPQ * self, vl_size n) ;
+VL_EXPORT vl_size vl_ivfpq_get_max_num_iterations (VlIVFPQ const * self) ;
+/** @} */
+
+/* VL_IVFPQ_H */
+#endif
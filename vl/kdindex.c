@@ -0,0 +1,924 @@
+/** @file kdindex.c
+ ** @brief Dynamic KD-tree index - Definition
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+/**
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@page kdindex Dynamic KD-tree index
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+@ref kdindex.h implements a ::VlKDIndex object, an index for nearest
+neighbor search which, differently from a ::VlKDForest (@ref kdtree),
+supports adding and removing points at any time.
+
+- @ref kdindex-overview
+- @ref kdindex-tech
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section kdindex-overview Overview
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+To create a ::VlKDIndex object use ::vl_kdindex_new specifying the
+data type and dimension, the number of trees of each forest, and the
+distance, as for ::vl_kdforest_new. To delete it use
+::vl_kdindex_delete.
+
+Points are added by ::vl_kdindex_insert, which returns the
+identifier of the first of them; the identifiers of the points added
+by a call are consecutive and are never reused. Differently from
+::VlKDForest, the index stores a copy of the points, so that the
+caller does not need to retain them. A point is removed by
+::vl_kdindex_remove.
+
+Inserting and removing points is fast because it never builds a
+forest. Instead, when ::vl_kdindex_needs_merge returns @c VL_TRUE the
+caller should reorganize the index by ::vl_kdindex_prepare_merge,
+which builds a new forest aside while queries keep running, and then
+::vl_kdindex_commit_merge, which quickly puts the new forest in
+place:
+
+@code
+vl_kdindex_insert (index, data, numData) ;
+if (vl_kdindex_needs_merge (index)) {
+  vl_kdindex_prepare_merge (index) ;
+  vl_kdindex_commit_merge (index) ;
+}
+@endcode
+
+::vl_kdindex_query and ::vl_kdindex_query_with_array find the nearest
+neighbors of one or more queries. They are analogous to
+::vl_kdforest_query and ::vl_kdforest_query_with_array, but the
+neighbor indexes are the identifiers returned by ::vl_kdindex_insert.
+The search can be made approximate by
+::vl_kdindex_set_max_num_comparisons.
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section kdindex-tech Technical details
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+The index uses the logarithmic method of @cite{bentley80decomposable}.
+New points are first appended to a buffer, which is searched
+exhaustively. When the buffer contains ::VL_KDINDEX_BUFFER_SIZE points
+or more, its points should be moved to a forest. Forests are organized
+in levels, where level @f$ l @f$ contains either no forest or a forest
+of at most @f$ 2^l @f$ times the buffer size points. The buffer points
+are merged with the points of the levels @f$ 0,1,\dots,l-1 @f$ in a new
+forest at the first empty level @f$ l @f$ large enough to contain them,
+similarly to adding one to a binary counter. Hence the number of
+forests is logarithmic in the number of points, and each point is
+moved a logarithmic number of times.
+
+Removing a point only marks it as such, and the point is skipped in
+the results of the queries. When more than half of the points of a
+level are removed, the level should be rebuilt from the remaining
+ones, so that the cost of searching a level is at most twice the cost
+of searching a level without removed points.
+
+Merges and rebuilds never run inside ::vl_kdindex_insert and
+::vl_kdindex_remove. ::vl_kdindex_prepare_merge builds the new level
+aside, without changing the index (the build itself runs in parallel,
+see ::vl_kdforest_build), so that the index can be searched by other
+threads meanwhile. ::vl_kdindex_commit_merge then swaps the new level
+for the old ones in time linear in the number of merged points. The
+buffer grows until the merge is committed, so a caller that does not
+merge pays an exhaustive search of the points inserted since.
+
+A query searches the buffer and the forest of each level and merges
+the results. If the nearest neighbors found in a level include
+removed points, the level is searched again for more neighbors.
+Queries must not run concurrently with insertions, removals, or
+commits.
+**/
+
+#include "kdindex.h"
+#include "mathop.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define VL_HEAP_prefix     vl_kdindex_neighbor_heap
+#define VL_HEAP_type       VlKDForestNeighbor
+#define VL_HEAP_cmp(v,x,y) (v[y].distance - v[x].distance)
+#include "heap-def.h"
+
+/** ------------------------------------------------------------------
+ ** @brief Create new dynamic KD-tree index
+ ** @param dataType type of data (::VL_TYPE_FLOAT or ::VL_TYPE_DOUBLE)
+ ** @param dimension data dimensionality.
+ ** @param numTrees number of trees of each forest.
+ ** @param distance type of distance norm (::VlDistanceL1 or ::VlDistanceL2).
+ ** @return new KD-tree index.
+ **
+ ** The data dimension @a dimension and the number of trees @a
+ ** numTrees must not be smaller than one.
+ **/
+
+VlKDIndex *
+vl_kdindex_new (vl_type dataType,
+                vl_size dimension, vl_size numTrees,
+                VlVectorComparisonType distance)
+{
+  VlKDIndex * self = vl_calloc (sizeof(VlKDIndex), 1) ;
+
+  assert(dataType == VL_TYPE_FLOAT || dataType == VL_TYPE_DOUBLE) ;
+  assert(dimension >= 1) ;
+  assert(numTrees >= 1) ;
+
+  self->dataType = dataType ;
+  self->dimension = dimension ;
+  self->numTrees = numTrees ;
+  self->distance = distance ;
+  self->thresholdingMethod = VL_KDTREE_MEDIAN ;
+  self->searchMaxNumComparisons = 0 ;
+
+  switch (self->dataType) {
+    case VL_TYPE_FLOAT:
+      self->distanceFunction = (void(*)(void))
+      vl_get_vector_comparison_function_f (distance) ;
+      break;
+    case VL_TYPE_DOUBLE :
+      self->distanceFunction = (void(*)(void))
+      vl_get_vector_comparison_function_d (distance) ;
+      break ;
+    default :
+      abort() ;
+  }
+
+  self->bufferCapacity = VL_KDINDEX_BUFFER_SIZE ;
+  self->bufferData = vl_malloc (vl_get_type_size(dataType) * dimension *
+                                self->bufferCapacity) ;
+  self->bufferIds = vl_malloc (sizeof(vl_uindex) * self->bufferCapacity) ;
+  return self ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Dispose of the content of a level
+ ** @param level level.
+ **/
+
+static void
+vl_kdindex_level_clear (VlKDIndexLevel * level)
+{
+  if (level->forest) vl_kdforest_delete (level->forest) ;
+  if (level->data) vl_free (level->data) ;
+  if (level->ids) vl_free (level->ids) ;
+  memset (level, 0, sizeof(VlKDIndexLevel)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete dynamic KD-tree index
+ ** @param self KD-tree index to delete.
+ ** @sa ::vl_kdindex_new
+ **/
+
+void
+vl_kdindex_delete (VlKDIndex * self)
+{
+  vl_uindex l ;
+  for (l = 0 ; l < self->numLevels ; ++l) {
+    vl_kdindex_level_clear (self->levels + l) ;
+  }
+  vl_kdindex_level_clear (&self->pending) ;
+  vl_free (self->bufferData) ;
+  vl_free (self->bufferIds) ;
+  if (self->states) vl_free (self->states) ;
+  vl_free (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Build the forest of a level
+ ** @param self object.
+ ** @param level level (output).
+ ** @param data data points (the level takes ownership).
+ ** @param ids identifiers of the data points (the level takes ownership).
+ ** @param numData number of data points.
+ **
+ ** The function only writes @a level, so that it can build a level
+ ** which is not part of the index yet.
+ **/
+
+static void
+vl_kdindex_level_build (VlKDIndex const * self, VlKDIndexLevel * level,
+                        void * data, vl_uindex * ids, vl_size numData)
+{
+  assert (level->forest == NULL) ;
+  assert (numData > 0) ;
+
+  level->data = data ;
+  level->ids = ids ;
+  level->numData = numData ;
+  level->numRemoved = 0 ;
+  level->forest = vl_kdforest_new (self->dataType, self->dimension,
+                                   self->numTrees, self->distance) ;
+  vl_kdforest_set_thresholding_method (level->forest, self->thresholdingMethod) ;
+  vl_kdforest_set_max_num_comparisons (level->forest, self->searchMaxNumComparisons) ;
+  vl_kdforest_build (level->forest, numData, data) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Copy the points of a level to the end of an array
+ ** @param self object.
+ ** @param level level.
+ ** @param data data points (output).
+ ** @param ids identifiers of the data points (output).
+ ** @param numData number of data points in @a data (input/output).
+ **
+ ** Only the points that have not been removed are copied.
+ **/
+
+static void
+vl_kdindex_level_gather (VlKDIndex const * self, VlKDIndexLevel const * level,
+                         void * data, vl_uindex * ids, vl_size * numData)
+{
+  vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+  vl_uindex i ;
+
+  for (i = 0 ; i < level->numData ; ++i) {
+    if (self->states[level->ids[i]] == 0) continue ;
+    memcpy ((char*)data + *numData * pointSize,
+            (char const*)level->data + i * pointSize, pointSize) ;
+    ids[*numData] = level->ids[i] ;
+    *numData += 1 ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Check whether a level has too many removed points
+ ** @param level level.
+ ** @return @c VL_TRUE if more than half of the points have been removed.
+ **/
+
+VL_INLINE vl_bool
+vl_kdindex_level_needs_rebuild (VlKDIndexLevel const * level)
+{
+  return level->forest != NULL && 2 * level->numRemoved > level->numData ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Add points to the index
+ ** @param self object.
+ ** @param data data points.
+ ** @param numData number of data points.
+ ** @return identifier of the first data point.
+ **
+ ** The function copies the @a numData points @a data into the buffer
+ ** of the index. The points receive consecutive identifiers starting
+ ** from the returned value. The function never builds a forest; when
+ ** the buffer is full ::vl_kdindex_needs_merge returns @c VL_TRUE (see
+ ** @ref kdindex-tech).
+ **/
+
+vl_uindex
+vl_kdindex_insert (VlKDIndex * self, void const * data, vl_size numData)
+{
+  vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+  vl_uindex firstId = self->numInserted ;
+  vl_uindex i ;
+
+  /* mark the new points as buffered */
+  if (self->numInserted + numData > self->numAllocatedStates) {
+    self->numAllocatedStates = VL_MAX(2 * self->numAllocatedStates,
+                                      self->numInserted + numData) ;
+    self->states = vl_realloc (self->states, self->numAllocatedStates) ;
+  }
+  memset (self->states + firstId, 1, numData) ;
+  self->numInserted += numData ;
+  self->numData += numData ;
+
+  if (self->bufferNumData + numData > self->bufferCapacity) {
+    self->bufferCapacity = VL_MAX(2 * self->bufferCapacity,
+                                  self->bufferNumData + numData) ;
+    self->bufferData = vl_realloc (self->bufferData, pointSize * self->bufferCapacity) ;
+    self->bufferIds = vl_realloc (self->bufferIds, sizeof(vl_uindex) * self->bufferCapacity) ;
+  }
+  memcpy ((char*)self->bufferData + pointSize * self->bufferNumData, data,
+          pointSize * numData) ;
+  for (i = 0 ; i < numData ; ++i) {
+    self->bufferIds[self->bufferNumData++] = firstId + i ;
+  }
+  return firstId ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Remove a point from the index
+ ** @param self object.
+ ** @param id identifier of the data point.
+ ** @return @c VL_TRUE if the point was removed, @c VL_FALSE if the
+ ** point was not in the index.
+ **
+ ** The point is only marked as removed. When more than half of the
+ ** points of a level have been removed ::vl_kdindex_needs_merge
+ ** returns @c VL_TRUE (see @ref kdindex-tech).
+ **/
+
+vl_bool
+vl_kdindex_remove (VlKDIndex * self, vl_uindex id)
+{
+  if (! vl_kdindex_contains (self, id)) return VL_FALSE ;
+
+  self->numData -= 1 ;
+
+  if (self->states[id] == 1) {
+    /* replace the point by the last buffered one */
+    vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+    vl_uindex i ;
+    self->states[id] = 0 ;
+    for (i = 0 ; self->bufferIds[i] != id ; ++i) ;
+    self->bufferNumData -= 1 ;
+    self->bufferIds[i] = self->bufferIds[self->bufferNumData] ;
+    memmove ((char*)self->bufferData + i * pointSize,
+             (char const*)self->bufferData + self->bufferNumData * pointSize,
+             pointSize) ;
+    return VL_TRUE ;
+  }
+
+  self->levels[self->states[id] - 2].numRemoved += 1 ;
+  self->states[id] = 0 ;
+  return VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Check whether the index needs a merge
+ ** @param self object.
+ ** @return @c VL_TRUE if ::vl_kdindex_prepare_merge would prepare a merge.
+ **
+ ** A merge is needed when the buffer contains at least
+ ** ::VL_KDINDEX_BUFFER_SIZE points or when more than half of the points
+ ** of a level have been removed, and no merge has been prepared yet.
+ **/
+
+vl_bool
+vl_kdindex_needs_merge (VlKDIndex const * self)
+{
+  vl_uindex l ;
+  if (self->hasPendingMerge) return VL_FALSE ;
+  if (self->bufferNumData >= VL_KDINDEX_BUFFER_SIZE) return VL_TRUE ;
+  for (l = 0 ; l < self->numLevels ; ++l) {
+    if (vl_kdindex_level_needs_rebuild (self->levels + l)) return VL_TRUE ;
+  }
+  return VL_FALSE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Prepare a merge
+ ** @param self object.
+ ** @return @c VL_TRUE if a merge has been prepared.
+ **
+ ** If the buffer is full, the function merges the buffered points
+ ** with the points of the levels @c 0,1,...,l-1, where @c l is the
+ ** first empty level which can contain all of them. Otherwise, if a
+ ** level has too many removed points, the function rebuilds it from
+ ** the remaining ones. Otherwise, or if a merge has already been
+ ** prepared, it does nothing.
+ **
+ ** The new forest is built aside and becomes part of the index only
+ ** when ::vl_kdindex_commit_merge is called. The function reads the
+ ** index without changing it, so that it can run concurrently with
+ ** queries, but not with ::vl_kdindex_insert, ::vl_kdindex_remove, or
+ ** ::vl_kdindex_commit_merge. Points can be inserted and removed
+ ** between preparing and committing a merge.
+ **/
+
+vl_bool
+vl_kdindex_prepare_merge (VlKDIndex * self)
+{
+  vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+  vl_size numMerged = 0 ;
+  vl_size numCarried = 0 ;
+  vl_uindex levelIndex ;
+  vl_uint64 sourceLevels = 0 ;
+  vl_uindex firstUnmergedId = 0 ;
+  vl_uindex l ;
+  void * carryData = NULL ;
+  vl_uindex * carryIds = NULL ;
+
+  if (! vl_kdindex_needs_merge (self)) return VL_FALSE ;
+
+  if (self->bufferNumData >= VL_KDINDEX_BUFFER_SIZE) {
+    /* find the target level and the number of points to merge */
+    numMerged = self->bufferNumData ;
+    for (levelIndex = 0 ; levelIndex < VL_KDINDEX_MAX_NUM_LEVELS ; ++levelIndex) {
+      VlKDIndexLevel const * level = self->levels + levelIndex ;
+      if (level->forest == NULL &&
+          numMerged <= ((vl_size)VL_KDINDEX_BUFFER_SIZE << levelIndex)) break ;
+      if (level->forest) {
+        sourceLevels |= (vl_uint64)1 << levelIndex ;
+        numMerged += level->numData - level->numRemoved ;
+      }
+    }
+    assert (levelIndex < VL_KDINDEX_MAX_NUM_LEVELS) ;
+    /* the buffered points have identifiers smaller than the next one */
+    firstUnmergedId = self->numInserted ;
+  } else {
+    for (levelIndex = 0 ; levelIndex < self->numLevels ; ++levelIndex) {
+      if (vl_kdindex_level_needs_rebuild (self->levels + levelIndex)) break ;
+    }
+    assert (levelIndex < self->numLevels) ;
+    sourceLevels = (vl_uint64)1 << levelIndex ;
+    numMerged = self->levels[levelIndex].numData - self->levels[levelIndex].numRemoved ;
+  }
+
+  if (numMerged > 0) {
+    carryData = vl_malloc (pointSize * numMerged) ;
+    carryIds = vl_malloc (sizeof(vl_uindex) * numMerged) ;
+  }
+  if (firstUnmergedId > 0) {
+    memcpy (carryData, self->bufferData, pointSize * self->bufferNumData) ;
+    memcpy (carryIds, self->bufferIds, sizeof(vl_uindex) * self->bufferNumData) ;
+    numCarried = self->bufferNumData ;
+  }
+  for (l = 0 ; l < VL_KDINDEX_MAX_NUM_LEVELS ; ++l) {
+    if (sourceLevels & ((vl_uint64)1 << l)) {
+      vl_kdindex_level_gather (self, self->levels + l, carryData, carryIds, &numCarried) ;
+    }
+  }
+  assert (numCarried == numMerged) ;
+
+  memset (&self->pending, 0, sizeof(VlKDIndexLevel)) ;
+  if (numMerged > 0) {
+    vl_kdindex_level_build (self, &self->pending, carryData, carryIds, numMerged) ;
+  }
+  self->pendingLevelIndex = levelIndex ;
+  self->pendingSourceLevels = sourceLevels ;
+  self->pendingFirstUnmergedId = firstUnmergedId ;
+  self->hasPendingMerge = VL_TRUE ;
+  return VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Commit a merge
+ ** @param self object.
+ **
+ ** The function replaces the levels merged by
+ ** ::vl_kdindex_prepare_merge, and the buffered points that were
+ ** merged, by the level prepared by it. The points removed since then
+ ** are marked as such in the new level. The function does not build
+ ** any forest and takes time linear in the number of merged points.
+ ** It does nothing if no merge has been prepared.
+ **/
+
+void
+vl_kdindex_commit_merge (VlKDIndex * self)
+{
+  vl_uindex levelIndex = self->pendingLevelIndex ;
+  VlKDIndexLevel * level = self->levels + levelIndex ;
+  vl_uindex i, l ;
+
+  if (! self->hasPendingMerge) return ;
+
+  for (l = 0 ; l < VL_KDINDEX_MAX_NUM_LEVELS ; ++l) {
+    if (self->pendingSourceLevels & ((vl_uint64)1 << l)) {
+      vl_kdindex_level_clear (self->levels + l) ;
+    }
+  }
+
+  /* keep only the points buffered after the merge was prepared */
+  if (self->pendingFirstUnmergedId > 0) {
+    vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+    vl_size numKept = 0 ;
+    for (i = 0 ; i < self->bufferNumData ; ++i) {
+      if (self->bufferIds[i] < self->pendingFirstUnmergedId) continue ;
+      self->bufferIds[numKept] = self->bufferIds[i] ;
+      memmove ((char*)self->bufferData + numKept * pointSize,
+               (char const*)self->bufferData + i * pointSize, pointSize) ;
+      numKept ++ ;
+    }
+    self->bufferNumData = numKept ;
+  }
+
+  assert (level->forest == NULL) ;
+  if (self->pending.forest) {
+    *level = self->pending ;
+    for (i = 0 ; i < level->numData ; ++i) {
+      vl_uindex id = level->ids[i] ;
+      if (self->states[id]) {
+        self->states[id] = (vl_uint8) (2 + levelIndex) ;
+      } else {
+        level->numRemoved += 1 ;
+      }
+    }
+    self->numLevels = VL_MAX(self->numLevels, levelIndex + 1) ;
+  }
+  while (self->numLevels > 0 && self->levels[self->numLevels - 1].forest == NULL) {
+    self->numLevels -= 1 ;
+  }
+
+  memset (&self->pending, 0, sizeof(VlKDIndexLevel)) ;
+  self->pendingSourceLevels = 0 ;
+  self->pendingFirstUnmergedId = 0 ;
+  self->hasPendingMerge = VL_FALSE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Add a candidate to a set of nearest neighbors
+ ** @param neighbors neighbors (a max-heap).
+ ** @param numNeighbors maximum number of neighbors.
+ ** @param numAddedNeighbors number of neighbors in @a neighbors (input/output).
+ ** @param index index of the candidate.
+ ** @param distance distance of the candidate.
+ **/
+
+VL_INLINE void
+vl_kdindex_neighbor_heap_insert (VlKDForestNeighbor * neighbors,
+                                 vl_size numNeighbors,
+                                 vl_size * numAddedNeighbors,
+                                 vl_uindex index, double distance)
+{
+  if (*numAddedNeighbors < numNeighbors) {
+    neighbors[*numAddedNeighbors].index = index ;
+    neighbors[*numAddedNeighbors].distance = distance ;
+    vl_kdindex_neighbor_heap_push (neighbors, numAddedNeighbors) ;
+  } else if (neighbors[0].distance > distance) {
+    neighbors[0].index = index ;
+    neighbors[0].distance = distance ;
+    vl_kdindex_neighbor_heap_update (neighbors, *numAddedNeighbors, 0) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Query the index using given searchers
+ ** @param self object.
+ ** @param searchers searcher of each level (@c NULL for empty levels).
+ ** @param neighbors list of nearest neighbors found (output).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param query query point.
+ ** @param scratch temporary buffer (input/output).
+ ** @param scratchSize size of the temporary buffer (input/output).
+ ** @return number of comparisons.
+ **/
+
+static vl_size
+vl_kdindex_query_with_searchers (VlKDIndex const * self,
+                                 VlKDForestSearcher ** searchers,
+                                 VlKDForestNeighbor * neighbors,
+                                 vl_size numNeighbors,
+                                 void const * query,
+                                 VlKDForestNeighbor ** scratch,
+                                 vl_size * scratchSize)
+{
+  vl_size numComparisons = 0 ;
+  vl_size numAddedNeighbors = 0 ;
+  vl_uindex i, l ;
+
+  /* search the buffer exhaustively */
+  for (i = 0 ; i < self->bufferNumData ; ++i) {
+    double dist ;
+    switch (self->dataType) {
+      case VL_TYPE_FLOAT:
+        dist = ((VlFloatVectorComparisonFunction)self->distanceFunction)
+               (self->dimension, query,
+                (float const*)self->bufferData + i * self->dimension) ;
+        break ;
+      case VL_TYPE_DOUBLE:
+        dist = ((VlDoubleVectorComparisonFunction)self->distanceFunction)
+               (self->dimension, query,
+                (double const*)self->bufferData + i * self->dimension) ;
+        break ;
+      default:
+        abort() ;
+    }
+    vl_kdindex_neighbor_heap_insert (neighbors, numNeighbors, &numAddedNeighbors,
+                                     self->bufferIds[i], dist) ;
+  }
+  numComparisons += self->bufferNumData ;
+
+  /* search the levels */
+  for (l = 0 ; l < self->numLevels ; ++l) {
+    VlKDIndexLevel const * level = self->levels + l ;
+    vl_size numLevelNeighbors = numNeighbors ;
+    if (level->forest == NULL) continue ;
+    if (level->numRemoved > 0) numLevelNeighbors *= 2 ;
+
+    /* ask for more neighbors until enough of them are not removed */
+    while (1) {
+      vl_size numFound = 0 ;
+      vl_size numValid = 0 ;
+      numLevelNeighbors = VL_MIN(numLevelNeighbors, level->numData) ;
+      if (*scratchSize < numLevelNeighbors) {
+        *scratchSize = numLevelNeighbors ;
+        /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+        *scratch = realloc (*scratch, sizeof(VlKDForestNeighbor) * *scratchSize) ;
+      }
+      numComparisons += vl_kdforestsearcher_query (searchers[l], *scratch,
+                                                   numLevelNeighbors, query) ;
+      for (i = 0 ; i < numLevelNeighbors ; ++i) {
+        VlKDForestNeighbor const * neighbor = *scratch + i ;
+        if (neighbor->index == (vl_uindex)-1) break ;
+        numFound ++ ;
+        if (self->states[level->ids[neighbor->index]]) numValid ++ ;
+      }
+      if (numValid >= numNeighbors ||
+          numFound < numLevelNeighbors ||
+          numLevelNeighbors == level->numData) break ;
+      numLevelNeighbors *= 2 ;
+    }
+
+    for (i = 0 ; i < numLevelNeighbors ; ++i) {
+      VlKDForestNeighbor const * neighbor = *scratch + i ;
+      vl_uindex id ;
+      if (neighbor->index == (vl_uindex)-1) break ;
+      id = level->ids[neighbor->index] ;
+      if (self->states[id] == 0) continue ;
+      vl_kdindex_neighbor_heap_insert (neighbors, numNeighbors, &numAddedNeighbors,
+                                       id, neighbor->distance) ;
+    }
+  }
+
+  /* sort neighbors by increasing distance */
+  for (i = numAddedNeighbors ; i < numNeighbors ; ++ i) {
+    neighbors[i].index = -1 ;
+    neighbors[i].distance = VL_NAN_F ;
+  }
+  while (numAddedNeighbors) {
+    vl_kdindex_neighbor_heap_pop (neighbors, &numAddedNeighbors) ;
+  }
+  return numComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Query the index
+ ** @param self object.
+ ** @param neighbors list of nearest neighbors found (output).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param query query point.
+ ** @return number of comparisons.
+ **
+ ** The function is the same as ::vl_kdforest_query, except that the
+ ** neighbor indexes are the identifiers returned by
+ ** ::vl_kdindex_insert. If less than @a numNeighbors neighbors are
+ ** found, the remaining entries of @a neighbors have index @c -1 and
+ ** distance NaN.
+ **
+ ** If the maximum number of comparisons is set, it applies to the
+ ** search of each level separately.
+ **/
+
+vl_size
+vl_kdindex_query (VlKDIndex * self,
+                  VlKDForestNeighbor * neighbors,
+                  vl_size numNeighbors,
+                  void const * query)
+{
+  VlKDForestSearcher * searchers [VL_KDINDEX_MAX_NUM_LEVELS] ;
+  VlKDForestNeighbor * scratch = NULL ;
+  vl_size scratchSize = 0 ;
+  vl_size numComparisons ;
+  vl_uindex l ;
+
+  assert (neighbors) ;
+  assert (numNeighbors > 0) ;
+  assert (query) ;
+
+  for (l = 0 ; l < self->numLevels ; ++l) {
+    VlKDForest * forest = self->levels[l].forest ;
+    searchers[l] = NULL ;
+    if (forest == NULL) continue ;
+    searchers[l] = vl_kdforest_get_searcher (forest, 0) ;
+    if (searchers[l] == NULL) {
+      searchers[l] = vl_kdforest_new_searcher (forest) ;
+    }
+  }
+
+  numComparisons = vl_kdindex_query_with_searchers (self, searchers, neighbors,
+                                                    numNeighbors, query,
+                                                    &scratch, &scratchSize) ;
+  free (scratch) ;
+  return numComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run multiple queries
+ ** @param self object.
+ ** @param indexes identifiers of the neighbors (output).
+ ** @param numNeighbors number of nearest neighbors to be found for each query.
+ ** @param numQueries number of query points.
+ ** @param distances distances of the neighbors (output).
+ ** @param queries list of vectors to use as queries.
+ ** @return number of comparisons.
+ **
+ ** @a indexes and @a distances are @a numNeighbors by @a numQueries
+ ** matrices containing the identifiers and distances of the nearest
+ ** neighbors of each query. @a distances has the same data type as
+ ** the index and can be @c NULL. The queries are processed in
+ ** parallel.
+ **
+ ** @sa ::vl_kdindex_query.
+ **/
+
+vl_size
+vl_kdindex_query_with_array (VlKDIndex * self,
+                             vl_uindex * indexes,
+                             vl_size numNeighbors,
+                             vl_size numQueries,
+                             void * distances,
+                             void const * queries)
+{
+  vl_size numComparisons = 0 ;
+  vl_size dataSize = vl_get_type_size (self->dataType) ;
+
+  assert (indexes) ;
+  assert (numNeighbors > 0) ;
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) num_threads(vl_get_max_threads())
+#endif
+  {
+    vl_index qi ;
+    vl_uindex l ;
+    vl_size thisNumComparisons = 0 ;
+    VlKDForestSearcher * searchers [VL_KDINDEX_MAX_NUM_LEVELS] ;
+    VlKDForestNeighbor * scratch = NULL ;
+    vl_size scratchSize = 0 ;
+    VlKDForestNeighbor * neighbors ;
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      for (l = 0 ; l < self->numLevels ; ++l) {
+        VlKDForest * forest = self->levels[l].forest ;
+        searchers[l] = forest ? vl_kdforest_new_searcher (forest) : NULL ;
+      }
+      neighbors = vl_calloc (sizeof(VlKDForestNeighbor), numNeighbors) ;
+    }
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (qi = 0 ; qi < (signed)numQueries ; ++ qi) {
+      vl_uindex ni ;
+      thisNumComparisons += vl_kdindex_query_with_searchers
+        (self, searchers, neighbors, numNeighbors,
+         (char const*)queries + qi * self->dimension * dataSize,
+         &scratch, &scratchSize) ;
+      for (ni = 0 ; ni < numNeighbors ; ++ni) {
+        indexes [qi*numNeighbors + ni] = neighbors[ni].index ;
+        if (distances) {
+          switch (self->dataType) {
+            case VL_TYPE_FLOAT:
+              *((float*)distances + qi*numNeighbors + ni) = (float) neighbors[ni].distance ;
+              break ;
+            case VL_TYPE_DOUBLE:
+              *((double*)distances + qi*numNeighbors + ni) = neighbors[ni].distance ;
+              break ;
+            default:
+              abort() ;
+          }
+        }
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      numComparisons += thisNumComparisons ;
+      for (l = 0 ; l < self->numLevels ; ++l) {
+        if (searchers[l]) vl_kdforestsearcher_delete (searchers[l]) ;
+      }
+      vl_free (neighbors) ;
+    }
+    free (scratch) ;
+  }
+  return numComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of points in the index
+ ** @param self object.
+ ** @return number of points that have been inserted and not removed.
+ **/
+
+vl_size
+vl_kdindex_get_num_data (VlKDIndex const * self)
+{
+  return self->numData ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of levels of the index
+ ** @param self object.
+ ** @return number of levels.
+ **
+ ** Some of the levels may be empty (see @ref kdindex-tech).
+ **/
+
+vl_size
+vl_kdindex_get_num_levels (VlKDIndex const * self)
+{
+  return self->numLevels ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Check whether a point is in the index
+ ** @param self object.
+ ** @param id identifier of the point.
+ ** @return @c VL_TRUE if the point has been inserted and not removed.
+ **/
+
+vl_bool
+vl_kdindex_contains (VlKDIndex const * self, vl_uindex id)
+{
+  return id < self->numInserted && self->states[id] != 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the dimension of the data
+ ** @param self object.
+ ** @return dimension of the data.
+ **/
+
+vl_size
+vl_kdindex_get_data_dimension (VlKDIndex const * self)
+{
+  return self->dimension ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the data type
+ ** @param self object.
+ ** @return data type (one of ::VL_TYPE_FLOAT, ::VL_TYPE_DOUBLE).
+ **/
+
+vl_type
+vl_kdindex_get_data_type (VlKDIndex const * self)
+{
+  return self->dataType ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the maximum number of comparisons for a search
+ ** @param self object.
+ ** @param n maximum number of leaves.
+ **
+ ** The limit applies to the search of each level separately. A value
+ ** equal to zero means no limit.
+ **
+ ** @sa ::vl_kdforest_set_max_num_comparisons
+ **/
+
+void
+vl_kdindex_set_max_num_comparisons (VlKDIndex * self, vl_size n)
+{
+  vl_uindex l ;
+  self->searchMaxNumComparisons = n ;
+  for (l = 0 ; l < self->numLevels ; ++l) {
+    if (self->levels[l].forest) {
+      vl_kdforest_set_max_num_comparisons (self->levels[l].forest, n) ;
+    }
+  }
+  if (self->pending.forest) {
+    vl_kdforest_set_max_num_comparisons (self->pending.forest, n) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of comparisons for a search
+ ** @param self object.
+ ** @return maximum number of leaves.
+ ** @sa ::vl_kdindex_set_max_num_comparisons.
+ **/
+
+vl_size
+vl_kdindex_get_max_num_comparisons (VlKDIndex const * self)
+{
+  return self->searchMaxNumComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the thresholding method
+ ** @param self object.
+ ** @param method one of ::VlKDTreeThresholdingMethod.
+ **
+ ** The method applies to the forests built after the call.
+ **
+ ** @sa ::vl_kdforest_set_thresholding_method
+ **/
+
+void
+vl_kdindex_set_thresholding_method (VlKDIndex * self, VlKDTreeThresholdingMethod method)
+{
+  assert(method == VL_KDTREE_MEDIAN || method == VL_KDTREE_MEAN) ;
+  self->thresholdingMethod = method ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the thresholding method
+ ** @param self object.
+ ** @return thresholding method.
+ ** @sa ::vl_kdindex_set_thresholding_method
+ **/
+
+VlKDTreeThresholdingMethod
+vl_kdindex_get_thresholding_method (VlKDIndex const * self)
+{
+  return self->thresholdingMethod ;
+}
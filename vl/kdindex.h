@@ -0,0 +1,118 @@
+/** @file kdindex.h
+ ** @brief Dynamic KD-tree index (@ref kdindex)
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_KDINDEX_H
+#define VL_KDINDEX_H
+
+#include "generic.h"
+#include "kdtree.h"
+
+/** @brief Number of buffered points after which a ::VlKDIndex needs a merge */
+#define VL_KDINDEX_BUFFER_SIZE 1024
+/** @brief Maximum number of levels of a ::VlKDIndex */
+#define VL_KDINDEX_MAX_NUM_LEVELS 48
+
+/** @brief Level of a ::VlKDIndex */
+typedef struct _VlKDIndexLevel
+{
+  VlKDForest * forest ; /**< forest indexing the level data (or @c NULL) */
+  void * data ;         /**< data points */
+  vl_uindex * ids ;     /**< identifiers of the data points */
+  vl_size numData ;     /**< number of data points */
+  vl_size numRemoved ;  /**< number of data points removed since the level was built */
+} VlKDIndexLevel ;
+
+/** @brief Dynamic KD-tree index */
+typedef struct _VlKDIndex
+{
+  vl_type dataType ;
+  vl_size dimension ;
+  vl_size numTrees ;
+  VlVectorComparisonType distance ;
+  void (*distanceFunction)(void) ;
+
+  /* query */
+  VlKDTreeThresholdingMethod thresholdingMethod ;
+  vl_size searchMaxNumComparisons ;
+
+  /* points not indexed yet */
+  void * bufferData ;
+  vl_uindex * bufferIds ;
+  vl_size bufferNumData ;
+  vl_size bufferCapacity ;
+
+  /* levels */
+  VlKDIndexLevel levels [VL_KDINDEX_MAX_NUM_LEVELS] ;
+  vl_size numLevels ;
+
+  /* merge prepared and not committed yet */
+  vl_bool hasPendingMerge ;
+  VlKDIndexLevel pending ;
+  vl_uindex pendingLevelIndex ;
+  vl_uint64 pendingSourceLevels ;
+  vl_uindex pendingFirstUnmergedId ;
+
+  /* state of each point: 0 if removed, 1 if in the buffer, 2 + l if in level l */
+  vl_uint8 * states ;
+  vl_size numAllocatedStates ;
+  vl_size numInserted ;
+  vl_size numData ;
+} VlKDIndex ;
+
+/** @name Creating and disposing
+ ** @{ */
+VL_EXPORT VlKDIndex * vl_kdindex_new (vl_type dataType,
+                                      vl_size dimension, vl_size numTrees,
+                                      VlVectorComparisonType distance) ;
+VL_EXPORT void vl_kdindex_delete (VlKDIndex * self) ;
+/** @} */
+
+/** @name Inserting, removing, and querying
+ ** @{ */
+VL_EXPORT vl_uindex vl_kdindex_insert (VlKDIndex * self,
+                                       void const * data,
+                                       vl_size numData) ;
+
+VL_EXPORT vl_bool vl_kdindex_remove (VlKDIndex * self, vl_uindex id) ;
+
+VL_EXPORT vl_bool vl_kdindex_needs_merge (VlKDIndex const * self) ;
+VL_EXPORT vl_bool vl_kdindex_prepare_merge (VlKDIndex * self) ;
+VL_EXPORT void vl_kdindex_commit_merge (VlKDIndex * self) ;
+
+VL_EXPORT vl_size vl_kdindex_query (VlKDIndex * self,
+                                    VlKDForestNeighbor * neighbors,
+                                    vl_size numNeighbors,
+                                    void const * query) ;
+
+VL_EXPORT vl_size vl_kdindex_query_with_array (VlKDIndex * self,
+                                               vl_uindex * indexes,
+                                               vl_size numNeighbors,
+                                               vl_size numQueries,
+                                               void * distances,
+                                               void const * queries) ;
+/** @} */
+
+/** @name Retrieving and setting parameters
+ ** @{ */
+VL_EXPORT vl_size vl_kdindex_get_num_data (VlKDIndex const * self) ;
+VL_EXPORT vl_size vl_kdindex_get_num_levels (VlKDIndex const * self) ;
+VL_EXPORT vl_bool vl_kdindex_contains (VlKDIndex const * self, vl_uindex id) ;
+VL_EXPORT vl_size vl_kdindex_get_data_dimension (VlKDIndex const * self) ;
+VL_EXPORT vl_type vl_kdindex_get_data_type (VlKDIndex const * self) ;
+VL_EXPORT void vl_kdindex_set_max_num_comparisons (VlKDIndex * self, vl_size n) ;
+VL_EXPORT vl_size vl_kdindex_get_max_num_comparisons (VlKDIndex const * self) ;
+VL_EXPORT void vl_kdindex_set_thresholding_method (VlKDIndex * self, VlKDTreeThresholdingMethod method) ;
+VL_EXPORT VlKDTreeThresholdingMethod vl_kdindex_get_thresholding_method (VlKDIndex const * self) ;
+/** @} */
+
+/* VL_KDINDEX_H */
+#endif
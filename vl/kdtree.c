@@ -27,6 +27,8 @@ implemented
 fast matching of feature descriptors.
 
 - @ref kdtree-overview
+- @ref kdtree-statistics
+- @ref kdtree-persistence
 - @ref kdtree-tech
 
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -50,6 +52,67 @@ with the searcher object as an argument. To set a maximum number of
 comparisons per query and calculate approximate nearest neighbors use
 ::vl_kdforest_set_max_num_comparisons.
 
+Many queries can be processed at once by ::vl_kdforest_query_with_array
+or, more efficiently, by ::vl_kdforest_query_batch, which groups
+queries that fall in the same regions of the space.
+
+To find instead all the points within a given distance of a query use
+::vl_kdforest_query_range, ::vl_kdforestsearcher_query_range, or
+::vl_kdforest_query_range_with_array for many queries at once. These
+searches are always exact and return a variable number of neighbors.
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section kdtree-statistics Search statistics and tuning
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+Each searcher records, for every query, the number of comparisons
+with the data points, the number of visited nodes, and the largest
+size of the search heap, both as totals and as histograms with
+logarithmically spaced bins (::VlKDForestSearchStatistics). The
+statistics of a searcher are returned by
+::vl_kdforestsearcher_get_statistics, and the ones of all the
+searchers of a forest, including the deleted ones, by
+::vl_kdforest_get_search_statistics. For example, the histogram of the
+comparisons shows how often the maximum number of comparisons is
+reached, and the one of the heap size how much memory the search
+uses.
+
+The accuracy and the speed of the search depend on the number of trees
+and on the maximum number of comparisons. ::vl_kdforest_tune selects
+the ones that find a given fraction of the exact nearest neighbors of
+a set of held-out queries (recall) in the least time:
+
+@code
+VlKDForestTuning tuning ;
+vl_kdforest_tune (forest, &tuning, numNeighbors, 0.9, 16, numQueries, queries) ;
+@endcode
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section kdtree-persistence Saving and loading forests
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+Building a forest for a large dataset is expensive. Once built, a
+forest can be saved to disk with ::vl_kdforest_save, optionally
+together with the indexed data, and loaded back with
+::vl_kdforest_load:
+
+@code
+vl_kdforest_build (forest, numData, data) ;
+vl_kdforest_save (forest, "forest.bin", VL_TRUE) ;
+...
+forest = vl_kdforest_load ("forest.bin", NULL) ;
+@endcode
+
+::vl_kdforest_load maps the file in memory instead of reading it.
+Hence loading does not copy the forest, and processes loading the
+same file share the same physical memory. Since the file may be
+corrupted, the loader checks every node and data index entry once,
+in time linear in the size of the trees. The file stores the trees
+in the same binary format used in memory; it starts with a version number
+and a description of the host that wrote it, and it can be loaded
+only by hosts with the same byte order and word size. A loaded forest
+is read-only and must not be rebuilt by ::vl_kdforest_build.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section kdtree-tech Technical details
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -78,6 +141,18 @@ root) and it is weighed by the lower bound on the distance of any
 point in the partition and the query point. Such a lower bound is
 trivial to compute because partitions are hyper-rectangles.
 
+<b>Memory layout.</b> Queries visit a small number of nodes scattered
+across the trees, so that their speed is often limited by cache
+misses. ::vl_kdforest_set_compact_layout stores the nodes in a compact
+format and in van Emde Boas order, in which any root-to-leaf path
+spans few cache lines. Moreover, the data points in a leaf are
+normally scattered in the data array.
+::vl_kdforest_set_data_reordering makes the forest keep a copy of the
+data sorted in the leaf order of the first tree, so that the points
+of a leaf, and of any subtree, of that tree are contiguous in memory.
+The copy is transparent: the neighbors are still identified by their
+index in the original data.
+
 <b>Querying usage.</b> As said before a user has to create an instance
 ::VlKDForestSearcher using ::vl_kdforest_new_searcher in order to be able
 to make queries. When a user wants to delete a KD-Tree all the searchers
@@ -91,6 +166,17 @@ using the vl_kdforest_delete_searcher method.
 #include "random.h"
 #include "mathop.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(VL_OS_WIN)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #if defined(_OPENMP)
 #include <omp.h>
@@ -111,6 +197,8 @@ using the vl_kdforest_delete_searcher method.
 #define VL_HEAP_cmp(v,x,y) (v[y].distance - v[x].distance)
 #include "heap-def.h"
 
+static void vl_kdforest_unmap_file (void * mapping, vl_size size) ;
+
 /** ------------------------------------------------------------------
  ** @internal
  ** @brief Allocate a new node from the tree pool
@@ -153,36 +241,45 @@ vl_kdtree_compare_index_entries (void const * a,
 
 /** ------------------------------------------------------------------
  ** @internal
- ** @brief Build KDTree recursively
+ ** @brief Split a KDTree node
  ** @param forest forest to which the tree belongs.
  ** @param tree tree being built.
  ** @param nodeIndex node to process.
  ** @param dataBegin begin of data for this node.
  ** @param dataEnd end of data for this node.
- ** @param depth depth of this node.
+ ** @param rand random number generator.
+ ** @param splitIndex last data point of the lower child (output).
+ ** @return ::VL_FALSE if the node is a leaf.
+ **
+ ** The function sets the splitting dimension and threshold of the
+ ** node and sorts its data accordingly, but it does not create the
+ ** children. It only modifies the node and the data index entries
+ ** in the range [@a dataBegin, @a dataEnd), so that different
+ ** nodes can be split in parallel.
  **/
 
-static void
-vl_kdtree_build_recursively
-(VlKDForest * forest,
+static vl_bool
+vl_kdtree_split_node
+(VlKDForest const * forest,
  VlKDTree * tree, vl_uindex nodeIndex,
  vl_uindex dataBegin, vl_uindex dataEnd,
- unsigned int depth)
+ VlRand * rand,
+ vl_uindex * splitIndex)
 {
-  vl_uindex d, i, medianIndex, splitIndex ;
+  vl_uindex d, i, medianIndex, split ;
   VlKDTreeNode * node = tree->nodes + nodeIndex ;
+  VlKDTreeSplitDimension splitHeapArray [VL_KDTREE_SPLIT_HEAP_SIZE] ;
+  vl_size splitHeapNumNodes = 0 ;
   VlKDTreeSplitDimension * splitDimension ;
 
   /* base case: there is only one data point */
   if (dataEnd - dataBegin <= 1) {
-    if (tree->depth < depth) tree->depth = depth ;
     node->lowerChild = - (signed) dataBegin - 1;
     node->upperChild = - (signed) dataEnd - 1 ;
-    return ;
+    return VL_FALSE ;
   }
 
   /* compute the dimension with largest variance > 0 */
-  forest->splitHeapNumNodes = 0 ;
   for (d = 0 ; d < forest->dimension ; ++ d) {
     double mean = 0 ; /* unnormalized */
     double secondMoment = 0 ;
@@ -203,7 +300,7 @@ vl_kdtree_build_recursively
       if(useAllData == VL_TRUE) {
         sampleIndex = (vl_uint32)i;
       } else {
-        sampleIndex = (vl_rand_uint32(forest->rand) % VL_KDTREE_VARIANCE_EST_NUM_SAMPLES);
+        sampleIndex = (vl_rand_uint32(rand) % VL_KDTREE_VARIANCE_EST_NUM_SAMPLES);
       }
       sampleIndex += dataBegin;
 
@@ -230,34 +327,34 @@ vl_kdtree_build_recursively
     if (variance <= 0) continue ;
 
     /* keep splitHeapSize most varying dimensions */
-    if (forest->splitHeapNumNodes < forest->splitHeapSize) {
+    if (splitHeapNumNodes < forest->splitHeapSize) {
       VlKDTreeSplitDimension * splitDimension
-        = forest->splitHeapArray + forest->splitHeapNumNodes ;
+        = splitHeapArray + splitHeapNumNodes ;
       splitDimension->dimension = (unsigned int)d ;
       splitDimension->mean = mean ;
       splitDimension->variance = variance ;
-      vl_kdtree_split_heap_push (forest->splitHeapArray, &forest->splitHeapNumNodes) ;
+      vl_kdtree_split_heap_push (splitHeapArray, &splitHeapNumNodes) ;
     } else {
-      VlKDTreeSplitDimension * splitDimension = forest->splitHeapArray + 0 ;
+      VlKDTreeSplitDimension * splitDimension = splitHeapArray + 0 ;
       if (splitDimension->variance < variance) {
         splitDimension->dimension = (unsigned int)d ;
         splitDimension->mean = mean ;
         splitDimension->variance = variance ;
-        vl_kdtree_split_heap_update (forest->splitHeapArray, forest->splitHeapNumNodes, 0) ;
+        vl_kdtree_split_heap_update (splitHeapArray, splitHeapNumNodes, 0) ;
       }
     }
   }
 
   /* additional base case: the maximum variance is equal to 0 (overlapping points) */
-  if (forest->splitHeapNumNodes == 0) {
+  if (splitHeapNumNodes == 0) {
     node->lowerChild = - (signed) dataBegin - 1 ;
     node->upperChild = - (signed) dataEnd - 1 ;
-    return ;
+    return VL_FALSE ;
   }
 
   /* toss a dice to decide the splitting dimension (variance > 0) */
-  splitDimension = forest->splitHeapArray
-  + (vl_rand_uint32(forest->rand) % VL_MIN(forest->splitHeapSize, forest->splitHeapNumNodes)) ;
+  splitDimension = splitHeapArray
+  + (vl_rand_uint32(rand) % VL_MIN(forest->splitHeapSize, splitHeapNumNodes)) ;
 
   node->splitDimension = splitDimension->dimension ;
 
@@ -286,21 +383,21 @@ vl_kdtree_build_recursively
   switch (forest->thresholdingMethod) {
     case VL_KDTREE_MEAN :
       node->splitThreshold = splitDimension->mean ;
-      for (splitIndex = dataBegin ;
-           splitIndex < dataEnd && tree->dataIndex[splitIndex].value <= node->splitThreshold ;
-           ++ splitIndex) ;
-      splitIndex -= 1 ;
+      for (split = dataBegin ;
+           split < dataEnd && tree->dataIndex[split].value <= node->splitThreshold ;
+           ++ split) ;
+      split -= 1 ;
       /* If the mean does not provide a proper partition, fall back to
        * median. This usually happens if all points have the same
        * value and the zero variance test fails for numerical accuracy
        * reasons. In this case, also due to numerical accuracy, the
        * mean value can be smaller, equal, or larger than all
        * points. */
-      if (dataBegin <= splitIndex && splitIndex + 1 < dataEnd) break ;
+      if (dataBegin <= split && split + 1 < dataEnd) break ;
 
     case VL_KDTREE_MEDIAN :
       medianIndex = (dataBegin + dataEnd - 1) / 2 ;
-      splitIndex = medianIndex ;
+      split = medianIndex ;
       node -> splitThreshold = tree->dataIndex[medianIndex].value ;
       break ;
 
@@ -308,12 +405,44 @@ vl_kdtree_build_recursively
       abort() ;
   }
 
+  *splitIndex = split ;
+  return VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Build KDTree recursively
+ ** @param forest forest to which the tree belongs.
+ ** @param tree tree being built.
+ ** @param nodeIndex node to process.
+ ** @param dataBegin begin of data for this node.
+ ** @param dataEnd end of data for this node.
+ ** @param depth depth of this node.
+ ** @param rand random number generator.
+ **/
+
+static void
+vl_kdtree_build_recursively
+(VlKDForest const * forest,
+ VlKDTree * tree, vl_uindex nodeIndex,
+ vl_uindex dataBegin, vl_uindex dataEnd,
+ unsigned int depth,
+ VlRand * rand)
+{
+  vl_uindex splitIndex ;
+  VlKDTreeNode * node = tree->nodes + nodeIndex ;
+
+  if (! vl_kdtree_split_node (forest, tree, nodeIndex, dataBegin, dataEnd, rand, &splitIndex)) {
+    if (tree->depth < depth) tree->depth = depth ;
+    return ;
+  }
+
   /* divide subparts */
   node->lowerChild = vl_kdtree_node_new (tree, nodeIndex) ;
-  vl_kdtree_build_recursively (forest, tree, node->lowerChild, dataBegin, splitIndex + 1, depth + 1) ;
+  vl_kdtree_build_recursively (forest, tree, node->lowerChild, dataBegin, splitIndex + 1, depth + 1, rand) ;
 
   node->upperChild = vl_kdtree_node_new (tree, nodeIndex) ;
-  vl_kdtree_build_recursively (forest, tree, node->upperChild, splitIndex + 1, dataEnd, depth + 1) ;
+  vl_kdtree_build_recursively (forest, tree, node->upperChild, splitIndex + 1, dataEnd, depth + 1, rand) ;
 }
 
 /** ------------------------------------------------------------------
@@ -346,12 +475,17 @@ vl_kdforest_new (vl_type dataType,
   self -> numTrees = numTrees ;
   self -> trees = 0 ;
   self -> thresholdingMethod = VL_KDTREE_MEDIAN ;
+  self -> compactLayout = VL_FALSE ;
+  self -> dataReordering = VL_FALSE ;
+  self -> originalData = NULL ;
+  self -> dataOrder = NULL ;
   self -> splitHeapSize = VL_MIN(numTrees, VL_KDTREE_SPLIT_HEAP_SIZE) ;
-  self -> splitHeapNumNodes = 0 ;
   self -> distance = distance;
   self -> maxNumNodes = 0 ;
   self -> numSearchers = 0 ;
   self -> headSearcher = 0 ;
+  self -> mapping = NULL ;
+  self -> mappingSize = 0 ;
 
   switch (self->dataType) {
     case VL_TYPE_FLOAT:
@@ -369,6 +503,67 @@ vl_kdforest_new (vl_type dataType,
   return self ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal @brief Get the histogram bin of a value
+ ** @param value value.
+ ** @return bin index.
+ **
+ ** @sa ::VlKDForestSearchStatistics
+ **/
+
+static vl_uindex
+vl_kdforest_statistics_bin (vl_size value)
+{
+  vl_uindex bin = 0 ;
+  while (value > 0 && bin + 1 < VL_KDFOREST_STATISTICS_NUM_BINS) {
+    value >>= 1 ;
+    bin ++ ;
+  }
+  return bin ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Record the statistics of a searcher query
+ ** @param self searcher.
+ **/
+
+static void
+vl_kdforestsearcher_record_query (VlKDForestSearcher * self)
+{
+  VlKDForestSearchStatistics * statistics = &self->statistics ;
+  statistics->numQueries ++ ;
+  statistics->numComparisons += self->searchNumComparisons ;
+  statistics->numRecursions += self->searchNumRecursions ;
+  statistics->numSimplifications += self->searchNumSimplifications ;
+  statistics->maxHeapSize = VL_MAX(statistics->maxHeapSize, self->searchMaxHeapNumNodes) ;
+  statistics->comparisonsHistogram [vl_kdforest_statistics_bin (self->searchNumComparisons)] ++ ;
+  statistics->recursionsHistogram [vl_kdforest_statistics_bin (self->searchNumRecursions)] ++ ;
+  statistics->heapSizeHistogram [vl_kdforest_statistics_bin (self->searchMaxHeapNumNodes)] ++ ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Accumulate search statistics
+ ** @param self statistics (input/output).
+ ** @param other statistics to add to @a self.
+ **/
+
+static void
+vl_kdforest_statistics_accumulate (VlKDForestSearchStatistics * self,
+                                   VlKDForestSearchStatistics const * other)
+{
+  vl_uindex b ;
+  self->numQueries += other->numQueries ;
+  self->numComparisons += other->numComparisons ;
+  self->numRecursions += other->numRecursions ;
+  self->numSimplifications += other->numSimplifications ;
+  self->maxHeapSize = VL_MAX(self->maxHeapSize, other->maxHeapSize) ;
+  for (b = 0 ; b < VL_KDFOREST_STATISTICS_NUM_BINS ; ++b) {
+    self->comparisonsHistogram[b] += other->comparisonsHistogram[b] ;
+    self->recursionsHistogram[b] += other->recursionsHistogram[b] ;
+    self->heapSizeHistogram[b] += other->heapSizeHistogram[b] ;
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @brief Create a KDForest searcher object, used for processing queries
  ** @param kdforest a forest to which the queries should be pointing.
@@ -434,8 +629,10 @@ vl_kdforestsearcher_delete (VlKDForestSearcher * self)
     self->forest->headSearcher = NULL;
   }
   self->forest->numSearchers -- ;
+  vl_kdforest_statistics_accumulate (&self->forest->searchStatistics, &self->statistics) ;
   vl_free(self->searchHeapArray) ;
   vl_free(self->searchIdBook) ;
+  free(self->rangeNeighbors) ;
   vl_free(self) ;
 }
 
@@ -470,13 +667,25 @@ vl_kdforest_delete (VlKDForest * self)
   if (self->trees) {
     for (ti = 0 ; ti < self->numTrees ; ++ ti) {
       if (self->trees[ti]) {
-        if (self->trees[ti]->nodes) vl_free (self->trees[ti]->nodes) ;
-        if (self->trees[ti]->dataIndex) vl_free (self->trees[ti]->dataIndex) ;
+        /* the nodes of a loaded forest belong to the file mapping */
+        if (! self->mapping) {
+          if (self->trees[ti]->nodes) vl_free (self->trees[ti]->nodes) ;
+          if (self->trees[ti]->compactNodes) vl_free (self->trees[ti]->compactNodes) ;
+          if (self->trees[ti]->compactBounds) vl_free (self->trees[ti]->compactBounds) ;
+          if (self->trees[ti]->dataIndex) vl_free (self->trees[ti]->dataIndex) ;
+        }
         vl_free (self->trees[ti]) ;
       }
     }
     vl_free (self->trees) ;
   }
+  if (self->mapping) {
+    vl_kdforest_unmap_file (self->mapping, self->mappingSize) ;
+  }
+  if (self->dataOrder) {
+    vl_free ((void*)self->data) ;
+    vl_free (self->dataOrder) ;
+  }
   vl_free (self) ;
 }
 
@@ -512,6 +721,195 @@ vl_kdtree_calc_bounds_recursively (VlKDTree * tree,
   }
 }
 
+/* A task of the parallel construction of the forest: either a node
+ * to split (nodeIndex is the node) or a subtree to build (nodeIndex
+ * is its parent, link the child field of the parent). */
+
+typedef struct _VlKDTreeBuildTask
+{
+  vl_uindex treeIndex ;
+  vl_uindex nodeIndex ;
+  vl_index * link ;
+  vl_uindex dataBegin ;
+  vl_uindex dataEnd ;
+  unsigned int depth ;
+  vl_uint32 seed ;
+  /* results */
+  vl_bool isLeaf ;
+  vl_uindex splitIndex ;
+  vl_uint32 childSeeds [2] ;
+  vl_uindex nodeBase ;
+  vl_size numNodes ;
+} VlKDTreeBuildTask ;
+
+static VlKDTreeBuildTask *
+vl_kdtree_build_task_new (VlKDTreeBuildTask ** tasks, vl_size * numTasks, vl_size * capacity)
+{
+  if (*numTasks == *capacity) {
+    *capacity = VL_MAX(2 * *capacity, 16) ;
+    *tasks = vl_realloc (*tasks, sizeof(VlKDTreeBuildTask) * *capacity) ;
+  }
+  return *tasks + (*numTasks)++ ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Compute the van Emde Boas order of a subtree
+ ** @param tree KDTree object instance.
+ ** @param nodeIndex root of the subtree.
+ ** @param height number of levels of the subtree to order.
+ ** @param newIndexes position of each node in the order (output).
+ ** @param numOrdered number of nodes ordered so far (input/output).
+ **
+ ** The top half of the levels of the subtree is ordered first,
+ ** followed by the subtrees rooted at the next level, each ordered
+ ** recursively in the same manner.
+ **/
+
+static void
+vl_kdtree_order_veb (VlKDTree const * tree, vl_uindex nodeIndex, unsigned int height,
+                     vl_uindex * newIndexes, vl_size * numOrdered) ;
+
+static void
+vl_kdtree_order_veb_bottom (VlKDTree const * tree, vl_uindex nodeIndex,
+                            unsigned int depth, unsigned int topHeight, unsigned int bottomHeight,
+                            vl_uindex * newIndexes, vl_size * numOrdered)
+{
+  VlKDTreeNode const * node = tree->nodes + nodeIndex ;
+  if (depth == topHeight) {
+    vl_kdtree_order_veb (tree, nodeIndex, bottomHeight, newIndexes, numOrdered) ;
+  } else if (node->lowerChild > 0) {
+    vl_kdtree_order_veb_bottom (tree, node->lowerChild, depth + 1, topHeight, bottomHeight,
+                                newIndexes, numOrdered) ;
+    vl_kdtree_order_veb_bottom (tree, node->upperChild, depth + 1, topHeight, bottomHeight,
+                                newIndexes, numOrdered) ;
+  }
+}
+
+static void
+vl_kdtree_order_veb (VlKDTree const * tree, vl_uindex nodeIndex, unsigned int height,
+                     vl_uindex * newIndexes, vl_size * numOrdered)
+{
+  VlKDTreeNode const * node = tree->nodes + nodeIndex ;
+  unsigned int topHeight = height / 2 ;
+  if (height <= 1 || node->lowerChild < 0) {
+    newIndexes[nodeIndex] = (*numOrdered)++ ;
+    return ;
+  }
+  vl_kdtree_order_veb (tree, nodeIndex, topHeight, newIndexes, numOrdered) ;
+  vl_kdtree_order_veb_bottom (tree, nodeIndex, 0, topHeight, height - topHeight,
+                              newIndexes, numOrdered) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Convert a tree to the compact layout
+ ** @param tree KDTree object instance.
+ **
+ ** The nodes are renumbered in van Emde Boas order, so that a
+ ** root-to-leaf path touches few cache lines irrespective of the
+ ** size of the cache: the top levels of the tree, which are visited
+ ** by all the queries, are contiguous, and so are the levels of each
+ ** small subtree. The bounds, which are needed only when a node is
+ ** stored in the search heap, are moved to a separate array. The
+ ** function must be called after the bounds have been computed. The
+ ** compact arrays must be already allocated, and the original nodes
+ ** are left to the caller to dispose of.
+ **/
+
+static void
+vl_kdtree_compact (VlKDTree * tree)
+{
+  VlKDTreeCompactNode * compactNodes = tree->compactNodes ;
+  float * compactBounds = tree->compactBounds ;
+  vl_size numOrdered = 0 ;
+  vl_uindex i ;
+
+  /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+  vl_uindex * newIndexes = malloc (sizeof(vl_uindex) * tree->numUsedNodes) ;
+
+  vl_kdtree_order_veb (tree, 0, tree->depth + 1, newIndexes, &numOrdered) ;
+  assert (numOrdered == tree->numUsedNodes) ;
+  assert (newIndexes[0] == 0) ;
+
+  for (i = 0 ; i < tree->numUsedNodes ; ++i) {
+    VlKDTreeNode const * node = tree->nodes + i ;
+    vl_uindex k = newIndexes[i] ;
+    VlKDTreeCompactNode * compactNode = compactNodes + k ;
+    compactNode->splitDimension = node->splitDimension ;
+    compactNode->splitThreshold = (float) node->splitThreshold ;
+    compactBounds[2 * k + 0] = (float) node->lowerBound ;
+    compactBounds[2 * k + 1] = (float) node->upperBound ;
+    if (node->lowerChild < 0) {
+      compactNode->lowerChild = (vl_int32) node->lowerChild ;
+      compactNode->upperChild = (vl_int32) node->upperChild ;
+    } else {
+      compactNode->lowerChild = (vl_int32) newIndexes[node->lowerChild] ;
+      compactNode->upperChild = (vl_int32) newIndexes[node->upperChild] ;
+    }
+  }
+
+  free (newIndexes) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Sort a copy of the data in the leaf order of the first tree
+ ** @param self KDForest object.
+ **
+ ** The data index entries of all the trees are changed to refer to
+ ** the copy. ::vl_kdforest_restore_neighbor_indexes maps them back
+ ** to the original data.
+ **
+ ** @sa ::vl_kdforest_set_data_reordering
+ **/
+
+static void
+vl_kdforest_reorder_data (VlKDForest * self)
+{
+  vl_size dataSize = vl_get_type_size (self->dataType) * self->dimension ;
+  char * data = vl_malloc (dataSize * self->numData) ;
+  vl_uindex * position = vl_malloc (sizeof(vl_uindex) * self->numData) ;
+  vl_uindex i, ti ;
+
+  self->dataOrder = vl_malloc (sizeof(vl_uindex) * self->numData) ;
+  for (i = 0 ; i < self->numData ; ++i) {
+    vl_uindex di = self->trees[0]->dataIndex[i].index ;
+    self->dataOrder[i] = di ;
+    position[di] = i ;
+    memcpy (data + i * dataSize, (char const*)self->data + di * dataSize, dataSize) ;
+  }
+  for (ti = 0 ; ti < self->numTrees ; ++ti) {
+    VlKDTreeDataIndexEntry * dataIndex = self->trees[ti]->dataIndex ;
+    for (i = 0 ; i < self->numData ; ++i) {
+      dataIndex[i].index = position[dataIndex[i].index] ;
+    }
+  }
+  vl_free (position) ;
+  self->originalData = self->data ;
+  self->data = data ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Map the neighbors back to the original data
+ ** @param self KDForest object.
+ ** @param neighbors neighbors.
+ ** @param numNeighbors number of neighbors.
+ **
+ ** @sa ::vl_kdforest_set_data_reordering
+ **/
+
+static void
+vl_kdforest_restore_neighbor_indexes (VlKDForest const * self,
+                                      VlKDForestNeighbor * neighbors,
+                                      vl_size numNeighbors)
+{
+  vl_uindex i ;
+  if (self->dataOrder == NULL) return ;
+  for (i = 0 ; i < numNeighbors ; ++i) {
+    if (neighbors[i].index != (vl_uindex) -1) {
+      neighbors[i].index = self->dataOrder[neighbors[i].index] ;
+    }
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @brief Build KDTree from data
  ** @param self KDTree object
@@ -524,6 +922,13 @@ vl_kdtree_calc_bounds_recursively (VlKDTree * tree,
  ** unchanged for the lifespan of the object.
  **
  ** The number of data points @c numData must not be smaller than one.
+ **
+ ** The trees are built in parallel. Subsets larger than
+ ** ::VL_KDTREE_BUILD_TASK_MIN_NUM_DATA points are split in parallel
+ ** as well, so that even a single tree uses all the threads. The
+ ** randomness of each tree is drawn from an independent stream
+ ** seeded by the default random number generator (::vl_get_rand),
+ ** so that the result does not depend on the number of threads.
  **/
 
 void
@@ -531,7 +936,12 @@ vl_kdforest_build (VlKDForest * self, vl_size numData, void const * data)
 {
   vl_uindex di, ti ;
   vl_size maxNumNodes ;
-  double * searchBounds;
+  VlKDTreeBuildTask * frontier = NULL, * nextFrontier = NULL, * subtrees = NULL ;
+  vl_size frontierSize = 0, nextFrontierSize = 0, numSubtrees = 0 ;
+  vl_size frontierCapacity = 0, nextFrontierCapacity = 0, subtreesCapacity = 0 ;
+  vl_size * nodeEnds ;
+  vl_bool compact ;
+  vl_index t ;
 
   assert(data) ;
   assert(numData >= 1) ;
@@ -543,6 +953,7 @@ vl_kdforest_build (VlKDForest * self, vl_size numData, void const * data)
   maxNumNodes = 0 ;
 
   for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+    VlKDTreeBuildTask * task ;
     self->trees[ti] = vl_malloc (sizeof(VlKDTree)) ;
     self->trees[ti]->dataIndex = vl_malloc (sizeof(VlKDTreeDataIndexEntry) * self->numData) ;
     for (di = 0 ; di < self->numData ; ++ di) {
@@ -551,31 +962,314 @@ vl_kdforest_build (VlKDForest * self, vl_size numData, void const * data)
     self->trees[ti]->numUsedNodes = 0 ;
     /* num. nodes of a complete binary tree with numData leaves */
     self->trees[ti]->numAllocatedNodes = 2 * self->numData - 1 ;
-    self->trees[ti]->nodes = vl_malloc (sizeof(VlKDTreeNode) * self->trees[ti]->numAllocatedNodes) ;
+    /* zeroed so that the node padding saved by vl_kdforest_save is
+       deterministic */
+    self->trees[ti]->nodes = vl_calloc (self->trees[ti]->numAllocatedNodes, sizeof(VlKDTreeNode)) ;
+    self->trees[ti]->compactNodes = NULL ;
+    self->trees[ti]->compactBounds = NULL ;
     self->trees[ti]->depth = 0 ;
-    vl_kdtree_build_recursively (self, self->trees[ti],
-                                 vl_kdtree_node_new(self->trees[ti], 0), 0,
-                                 self->numData, 0) ;
-    maxNumNodes += self->trees[ti]->numUsedNodes ;
+
+    if (self->numData > VL_KDTREE_BUILD_TASK_MIN_NUM_DATA) {
+      task = vl_kdtree_build_task_new (&frontier, &frontierSize, &frontierCapacity) ;
+      task->nodeIndex = vl_kdtree_node_new (self->trees[ti], 0) ;
+    } else {
+      task = vl_kdtree_build_task_new (&subtrees, &numSubtrees, &subtreesCapacity) ;
+      task->nodeIndex = 0 ;
+    }
+    task->treeIndex = ti ;
+    task->link = NULL ;
+    task->dataBegin = 0 ;
+    task->dataEnd = self->numData ;
+    task->depth = 0 ;
+    task->seed = vl_rand_uint32 (self->rand) ;
+  }
+
+  /* Split the nodes with many data points level by level, processing
+   * the nodes of a level in parallel. Each node has its own random
+   * number generator, seeded by its parent, and the children are
+   * created in a fixed order, so that the result does not depend on
+   * the number of threads. */
+  while (frontierSize > 0) {
+    VlKDTreeBuildTask * swap ;
+    vl_size swapCapacity ;
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(t) schedule(dynamic) num_threads(vl_get_max_threads())
+#endif
+    for (t = 0 ; t < (signed)frontierSize ; ++t) {
+      VlKDTreeBuildTask * task = frontier + t ;
+      VlRand rand ;
+      vl_rand_init (&rand) ;
+      vl_rand_seed (&rand, task->seed) ;
+      task->isLeaf = ! vl_kdtree_split_node (self, self->trees[task->treeIndex],
+                                             task->nodeIndex,
+                                             task->dataBegin, task->dataEnd,
+                                             &rand, &task->splitIndex) ;
+      task->childSeeds[0] = vl_rand_uint32 (&rand) ;
+      task->childSeeds[1] = vl_rand_uint32 (&rand) ;
+    }
+
+    nextFrontierSize = 0 ;
+    for (t = 0 ; t < (signed)frontierSize ; ++t) {
+      VlKDTreeBuildTask const * task = frontier + t ;
+      VlKDTree * tree = self->trees[task->treeIndex] ;
+      VlKDTreeNode * node = tree->nodes + task->nodeIndex ;
+      int c ;
+
+      if (task->isLeaf) {
+        if (tree->depth < task->depth) tree->depth = task->depth ;
+        continue ;
+      }
+
+      for (c = 0 ; c < 2 ; ++c) {
+        vl_uindex begin = (c == 0) ? task->dataBegin : task->splitIndex + 1 ;
+        vl_uindex end = (c == 0) ? task->splitIndex + 1 : task->dataEnd ;
+        vl_index * link = (c == 0) ? &node->lowerChild : &node->upperChild ;
+        VlKDTreeBuildTask * child ;
+        if (end - begin > VL_KDTREE_BUILD_TASK_MIN_NUM_DATA) {
+          child = vl_kdtree_build_task_new (&nextFrontier, &nextFrontierSize, &nextFrontierCapacity) ;
+          child->nodeIndex = vl_kdtree_node_new (tree, task->nodeIndex) ;
+          child->link = NULL ;
+          *link = child->nodeIndex ;
+        } else {
+          /* the subtree is built later, from a child of this node */
+          child = vl_kdtree_build_task_new (&subtrees, &numSubtrees, &subtreesCapacity) ;
+          child->nodeIndex = task->nodeIndex ;
+          child->link = link ;
+        }
+        child->treeIndex = task->treeIndex ;
+        child->dataBegin = begin ;
+        child->dataEnd = end ;
+        child->depth = task->depth + 1 ;
+        child->seed = task->childSeeds[c] ;
+      }
+    }
+
+    swap = frontier ; frontier = nextFrontier ; nextFrontier = swap ;
+    swapCapacity = frontierCapacity ; frontierCapacity = nextFrontierCapacity ; nextFrontierCapacity = swapCapacity ;
+    frontierSize = nextFrontierSize ;
   }
 
-  searchBounds = vl_malloc(sizeof(double) * 2 * self->dimension);
+  /* Build the remaining subtrees in parallel. Each subtree is
+   * assigned a range of 2n-1 nodes, the most that it can use; the
+   * ranges add up to the size of the node pool. */
+  nodeEnds = vl_malloc (sizeof(vl_size) * self->numTrees) ;
+  for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+    nodeEnds[ti] = self->trees[ti]->numUsedNodes ;
+  }
+  for (t = 0 ; t < (signed)numSubtrees ; ++t) {
+    VlKDTreeBuildTask * task = subtrees + t ;
+    VlKDTree * tree = self->trees[task->treeIndex] ;
+    task->nodeBase = tree->numUsedNodes ;
+    tree->numUsedNodes += 2 * (task->dataEnd - task->dataBegin) - 1 ;
+    assert (tree->numUsedNodes <= tree->numAllocatedNodes) ;
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(shared) private(t) schedule(dynamic) num_threads(vl_get_max_threads())
+#endif
+  for (t = 0 ; t < (signed)numSubtrees ; ++t) {
+    VlKDTreeBuildTask * task = subtrees + t ;
+    VlKDTree subtree = *self->trees[task->treeIndex] ;
+    VlRand rand ;
+    vl_rand_init (&rand) ;
+    vl_rand_seed (&rand, task->seed) ;
+    subtree.numUsedNodes = task->nodeBase ;
+    subtree.numAllocatedNodes = task->nodeBase + 2 * (task->dataEnd - task->dataBegin) - 1 ;
+    subtree.depth = 0 ;
+    vl_kdtree_build_recursively (self, &subtree,
+                                 vl_kdtree_node_new (&subtree, task->nodeIndex),
+                                 task->dataBegin, task->dataEnd,
+                                 task->depth, &rand) ;
+    task->numNodes = subtree.numUsedNodes - task->nodeBase ;
+    task->depth = subtree.depth ;
+  }
+
+  /* attach the subtrees, packing the nodes if some are unused */
+  for (t = 0 ; t < (signed)numSubtrees ; ++t) {
+    VlKDTreeBuildTask const * task = subtrees + t ;
+    VlKDTree * tree = self->trees[task->treeIndex] ;
+    vl_uindex base = nodeEnds[task->treeIndex] ;
+    if (base < task->nodeBase) {
+      vl_uindex shift = task->nodeBase - base ;
+      vl_uindex i ;
+      memmove (tree->nodes + base, tree->nodes + task->nodeBase,
+               sizeof(VlKDTreeNode) * task->numNodes) ;
+      for (i = base ; i < base + task->numNodes ; ++i) {
+        VlKDTreeNode * node = tree->nodes + i ;
+        if (node->lowerChild > 0) node->lowerChild -= shift ;
+        if (node->upperChild > 0) node->upperChild -= shift ;
+        if (i > base) node->parent -= shift ;
+      }
+    }
+    if (task->link) *task->link = base ;
+    if (tree->depth < task->depth) tree->depth = task->depth ;
+    nodeEnds[task->treeIndex] = base + task->numNodes ;
+  }
 
   for (ti = 0 ; ti < self->numTrees ; ++ ti) {
-    double * iter = searchBounds  ;
-    double * end = iter + 2 * self->dimension ;
-    while (iter < end) {
-      *iter++ = - VL_INFINITY_F ;
-      *iter++ = + VL_INFINITY_F ;
+    self->trees[ti]->numUsedNodes = nodeEnds[ti] ;
+    maxNumNodes += self->trees[ti]->numUsedNodes ;
+  }
+
+  vl_free (nodeEnds) ;
+  if (frontier) vl_free (frontier) ;
+  if (nextFrontier) vl_free (nextFrontier) ;
+  if (subtrees) vl_free (subtrees) ;
+
+  /* node indexes and data positions must fit in 31 bits */
+  compact = self->compactLayout && 2 * self->numData - 1 <= 0x7fffffff ;
+  if (compact) {
+    for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+      VlKDTree * tree = self->trees[ti] ;
+      tree->compactNodes = vl_malloc (sizeof(VlKDTreeCompactNode) * tree->numUsedNodes) ;
+      tree->compactBounds = vl_malloc (sizeof(float) * 2 * tree->numUsedNodes) ;
     }
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel default(shared) private(t) num_threads(vl_get_max_threads())
+#endif
+  {
+    /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+    double * searchBounds = malloc (sizeof(double) * 2 * self->dimension) ;
+
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+    for (t = 0 ; t < (signed)self->numTrees ; ++ t) {
+      double * iter = searchBounds  ;
+      double * end = iter + 2 * self->dimension ;
+      while (iter < end) {
+        *iter++ = - VL_INFINITY_F ;
+        *iter++ = + VL_INFINITY_F ;
+      }
+
+      vl_kdtree_calc_bounds_recursively (self->trees[t], 0, searchBounds) ;
+
+      if (compact) {
+        vl_kdtree_compact (self->trees[t]) ;
+      }
+    }
+
+    free (searchBounds) ;
+  }
 
-    vl_kdtree_calc_bounds_recursively (self->trees[ti], 0, searchBounds) ;
+  if (compact) {
+    for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+      vl_free (self->trees[ti]->nodes) ;
+      self->trees[ti]->nodes = NULL ;
+    }
   }
 
-  vl_free(searchBounds);
   self -> maxNumNodes = maxNumNodes;
+
+  if (self->dataReordering) {
+    vl_kdforest_reorder_data (self) ;
+  }
+}
+
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Get the splitting rule of a node
+ ** @param tree KDTree object instance.
+ ** @param nodeIndex node.
+ ** @param splitDimension splitting dimension (output).
+ ** @param splitThreshold splitting threshold (output).
+ ** @param lowerChild lower child (output).
+ ** @param upperChild upper child (output).
+ **
+ ** The function works with either node layout.
+ **/
+
+VL_INLINE void
+vl_kdtree_get_node_split (VlKDTree const * tree, vl_uindex nodeIndex,
+                          vl_uindex * splitDimension, double * splitThreshold,
+                          vl_index * lowerChild, vl_index * upperChild)
+{
+  if (tree->compactNodes) {
+    VlKDTreeCompactNode const * node = tree->compactNodes + nodeIndex ;
+    *splitDimension = node->splitDimension ;
+    *splitThreshold = node->splitThreshold ;
+    *lowerChild = node->lowerChild ;
+    *upperChild = node->upperChild ;
+  } else {
+    VlKDTreeNode const * node = tree->nodes + nodeIndex ;
+    *splitDimension = node->splitDimension ;
+    *splitThreshold = node->splitThreshold ;
+    *lowerChild = node->lowerChild ;
+    *upperChild = node->upperChild ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Get a component of a query point
+ **/
+
+VL_INLINE double
+vl_kdforest_get_query_component (VlKDForest const * forest, void const * query, vl_uindex i)
+{
+  switch (forest->dataType) {
+    case VL_TYPE_FLOAT : return ((float const*) query)[i] ;
+    case VL_TYPE_DOUBLE : return ((double const*) query)[i] ;
+    default : abort() ;
+  }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal @brief Descend a node towards a query
+ ** @param tree KDTree object instance.
+ ** @param nodeIndex (internal) node.
+ ** @param x query component along the splitting dimension.
+ ** @param x2 splitting threshold.
+ ** @param lowerChild lower child.
+ ** @param upperChild upper child.
+ ** @param dist lower bound of the distance of the query to the node.
+ ** @param saveChild child on the other side of the query (output).
+ ** @param saveDist lower bound of the distance to @a saveChild (output).
+ ** @return child on the side of the query.
+ **/
+
+VL_INLINE vl_index
+vl_kdtree_descend_node (VlKDTree const * tree, vl_uindex nodeIndex,
+                        double x, double x2,
+                        vl_index lowerChild, vl_index upperChild,
+                        double dist, vl_index * saveChild, double * saveDist)
+{
+  double delta ;
+
+  /*
+   *   x1  x2 x3
+   * x (---|---]
+   *   (--x|---]
+   *   (---|x--]
+   *   (---|---] x
+   */
+
+  delta = x - x2 ;
+  *saveDist = dist + delta*delta ;
+
+  /* the node bounds are fetched only if needed */
+  if (x <= x2) {
+    double x1 = tree->compactNodes ?
+      tree->compactBounds[2 * nodeIndex + 0] : tree->nodes[nodeIndex].lowerBound ;
+    *saveChild = upperChild ;
+    if (x <= x1) {
+      delta = x - x1 ;
+      *saveDist -= delta*delta ;
+    }
+    return lowerChild ;
+  } else {
+    double x3 = tree->compactNodes ?
+      tree->compactBounds[2 * nodeIndex + 1] : tree->nodes[nodeIndex].upperBound ;
+    *saveChild = lowerChild ;
+    if (x > x3) {
+      delta = x - x3 ;
+      *saveDist -= delta*delta ;
+    }
+    return upperChild ;
+  }
+}
 
 /** ------------------------------------------------------------------
  ** @internal @brief
@@ -592,34 +1286,22 @@ vl_kdforest_query_recursively (VlKDForestSearcher * searcher,
                                void const * query)
 {
 
-  VlKDTreeNode const * node = tree->nodes + nodeIndex ;
-  vl_uindex i = node->splitDimension ;
-  vl_index nextChild, saveChild ;
-  double delta, saveDist ;
+  vl_uindex i ;
+  vl_index lowerChild, upperChild, nextChild, saveChild ;
+  double saveDist ;
   double x ;
-  double x1 = node->lowerBound ;
-  double x2 = node->splitThreshold ;
-  double x3 = node->upperBound ;
+  double x2 ;
   VlKDForestSearchState * searchState ;
 
   searcher->searchNumRecursions ++ ;
 
-  switch (searcher->forest->dataType) {
-    case VL_TYPE_FLOAT :
-      x = ((float const*) query)[i] ;
-      break ;
-    case VL_TYPE_DOUBLE :
-      x = ((double const*) query)[i] ;
-      break ;
-    default :
-      abort() ;
-  }
+  vl_kdtree_get_node_split (tree, nodeIndex, &i, &x2, &lowerChild, &upperChild) ;
 
   /* base case: this is a leaf node */
-  if (node->lowerChild < 0) {
+  if (lowerChild < 0) {
 
-    vl_index begin = - node->lowerChild - 1 ;
-    vl_index end   = - node->upperChild - 1 ;
+    vl_index begin = - lowerChild - 1 ;
+    vl_index end   = - upperChild - 1 ;
     vl_index iter ;
 
     for (iter = begin ;
@@ -675,37 +1357,13 @@ vl_kdforest_query_recursively (VlKDForestSearcher * searcher,
   }
 
 #if 0
-  assert (x1 <= x2 && x2 <= x3) ;
-  assert (node->lowerChild >= 0) ;
-  assert (node->upperChild >= 0) ;
+  assert (lowerChild >= 0) ;
+  assert (upperChild >= 0) ;
 #endif
 
-  /*
-   *   x1  x2 x3
-   * x (---|---]
-   *   (--x|---]
-   *   (---|x--]
-   *   (---|---] x
-   */
-
-  delta = x - x2 ;
-  saveDist = dist + delta*delta ;
-
-  if (x <= x2) {
-    nextChild = node->lowerChild ;
-    saveChild = node->upperChild ;
-    if (x <= x1) {
-      delta = x - x1 ;
-      saveDist -= delta*delta ;
-    }
-  } else {
-    nextChild = node->upperChild ;
-    saveChild = node->lowerChild ;
-    if (x > x3) {
-      delta = x - x3 ;
-      saveDist -= delta*delta ;
-    }
-  }
+  x = vl_kdforest_get_query_component (searcher->forest, query, i) ;
+  nextChild = vl_kdtree_descend_node (tree, nodeIndex, x, x2, lowerChild, upperChild,
+                                      dist, &saveChild, &saveDist) ;
 
   if (*numAddedNeighbors < numNeighbors || neighbors[0].distance > saveDist) {
     searchState = searcher->searchHeapArray + searcher->searchHeapNumNodes ;
@@ -726,6 +1384,13 @@ vl_kdforest_query_recursively (VlKDForestSearcher * searcher,
                                         query) ;
 }
 
+static vl_size
+vl_kdforestsearcher_search (VlKDForestSearcher * self,
+                            VlKDForestNeighbor * neighbors,
+                            vl_size numNeighbors,
+                            vl_size numAddedNeighbors,
+                            void const * query) ;
+
 /** ------------------------------------------------------------------
  ** @brief Query the forest
  ** @param self object.
@@ -777,11 +1442,8 @@ vl_kdforestsearcher_query (VlKDForestSearcher * self,
                            void const * query)
 {
 
-  vl_uindex i, ti ;
-  vl_bool exactSearch = self->forest->searchMaxNumComparisons == 0 ;
-
+  vl_uindex ti ;
   VlKDForestSearchState * searchState  ;
-  vl_size numAddedNeighbors = 0 ;
 
   assert (neighbors) ;
   assert (numNeighbors > 0) ;
@@ -805,6 +1467,36 @@ vl_kdforestsearcher_query (VlKDForestSearcher * self,
     vl_kdforest_search_heap_push (self->searchHeapArray, &self->searchHeapNumNodes) ;
   }
 
+  return vl_kdforestsearcher_search (self, neighbors, numNeighbors, 0, query) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run the branch-and-bound search of a query
+ ** @param self object.
+ ** @param neighbors list of nearest neighbors found (input/output).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param numAddedNeighbors number of neighbors already in @a neighbors.
+ ** @param query query point.
+ ** @return number of comparisons.
+ **
+ ** The search starts from the states in the search heap of the
+ ** searcher and from the neighbors already found, which form a
+ ** max-heap.
+ **/
+
+static vl_size
+vl_kdforestsearcher_search (VlKDForestSearcher * self,
+                            VlKDForestNeighbor * neighbors,
+                            vl_size numNeighbors,
+                            vl_size numAddedNeighbors,
+                            void const * query)
+{
+  vl_uindex i ;
+  vl_bool exactSearch = self->forest->searchMaxNumComparisons == 0 ;
+
+  self->searchMaxHeapNumNodes = self->searchHeapNumNodes ;
+
   /* branch and bound */
   while (exactSearch || self->searchNumComparisons < self->forest->searchMaxNumComparisons)
   {
@@ -831,6 +1523,8 @@ vl_kdforestsearcher_query (VlKDForestSearcher * self,
                                    &numAddedNeighbors,
                                    searchState->distanceLowerBound,
                                    query) ;
+    self->searchMaxHeapNumNodes = VL_MAX(self->searchMaxHeapNumNodes,
+                                         self->searchHeapNumNodes) ;
   }
 
   /* sort neighbors by increasing distance */
@@ -843,6 +1537,8 @@ vl_kdforestsearcher_query (VlKDForestSearcher * self,
     vl_kdforest_neighbor_heap_pop (neighbors, &numAddedNeighbors) ;
   }
 
+  vl_kdforest_restore_neighbor_indexes (self->forest, neighbors, numNeighbors) ;
+  vl_kdforestsearcher_record_query (self) ;
   return self->searchNumComparisons ;
 }
 
@@ -941,6 +1637,840 @@ vl_kdforest_query_with_array (VlKDForest * self,
   return numComparisons ;
 }
 
+/* ---------------------------------------------------------------- */
+/*                                                   Batch querying */
+/* ---------------------------------------------------------------- */
+
+/* A query of a batch and the bucket it reaches in the current tree */
+typedef struct _VlKDForestBatchEntry
+{
+  vl_uindex bucket ;
+  vl_uindex query ;
+} VlKDForestBatchEntry ;
+
+/* A bucket: a node and the data index entries that it covers */
+typedef struct _VlKDForestBatchBucket
+{
+  vl_uindex nodeIndex ;
+  vl_uindex begin ;
+  vl_uindex end ;
+  unsigned int depth ;
+} VlKDForestBatchBucket ;
+
+/* A node covering more data points than a bucket */
+typedef struct _VlKDForestBatchNode
+{
+  vl_uindex middle ;    /* first data index entry of the upper child */
+  vl_index lowerChild ; /* lower child in the batch nodes or -1 */
+  vl_index upperChild ; /* upper child in the batch nodes or -1 */
+} VlKDForestBatchNode ;
+
+static int
+vl_kdforest_compare_batch_entries (void const * a, void const * b)
+{
+  VlKDForestBatchEntry const * ea = a ;
+  VlKDForestBatchEntry const * eb = b ;
+  if (ea->bucket != eb->bucket) return (ea->bucket < eb->bucket) ? -1 : +1 ;
+  if (ea->query != eb->query) return (ea->query < eb->query) ? -1 : +1 ;
+  return 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Get the first data index entry covered by a node
+ ** @param tree KDTree object instance.
+ ** @param nodeIndex node.
+ ** @return first data index entry of the node.
+ **/
+
+static vl_uindex
+vl_kdtree_get_node_begin (VlKDTree const * tree, vl_uindex nodeIndex)
+{
+  vl_uindex splitDimension ;
+  double splitThreshold ;
+  vl_index lowerChild, upperChild ;
+
+  /* the first entry is in the leftmost leaf */
+  vl_kdtree_get_node_split (tree, nodeIndex, &splitDimension, &splitThreshold, &lowerChild, &upperChild) ;
+  while (lowerChild > 0) {
+    vl_kdtree_get_node_split (tree, lowerChild, &splitDimension, &splitThreshold, &lowerChild, &upperChild) ;
+  }
+  return - lowerChild - 1 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Index the nodes above the buckets of a tree
+ ** @param tree tree.
+ ** @param nodeIndex node.
+ ** @param begin first data index entry of the node.
+ ** @param end one plus the last data index entry of the node.
+ ** @param bucketSize maximum number of data points of a bucket.
+ ** @param nodes nodes above the buckets (input/output).
+ ** @param numNodes number of nodes in @a nodes (input/output).
+ ** @param capacity capacity of @a nodes (input/output).
+ ** @return index of the node in @a nodes.
+ **
+ ** The function adds to @a nodes the node @a nodeIndex, which must
+ ** cover more than @a bucketSize data points, and recursively its
+ ** descendants that cover more than @a bucketSize data points. For
+ ** each of them it records the data covered by the two children, so
+ ** that the buckets can be found without visiting the rest of the
+ ** tree, even if the tree is not balanced (e.g. for ::VL_KDTREE_MEAN).
+ **/
+
+static vl_index
+vl_kdtree_index_batch_nodes (VlKDTree const * tree, vl_uindex nodeIndex,
+                             vl_uindex begin, vl_uindex end, vl_size bucketSize,
+                             VlKDForestBatchNode ** nodes, vl_size * numNodes,
+                             vl_size * capacity)
+{
+  vl_uindex splitDimension, middle ;
+  double splitThreshold ;
+  vl_index lowerChild, upperChild ;
+  vl_index k = *numNodes ;
+
+  vl_kdtree_get_node_split (tree, nodeIndex, &splitDimension, &splitThreshold, &lowerChild, &upperChild) ;
+  middle = vl_kdtree_get_node_begin (tree, upperChild) ;
+
+  if (*numNodes == *capacity) {
+    *capacity = VL_MAX(2 * *capacity, 16) ;
+    *nodes = vl_realloc (*nodes, sizeof(VlKDForestBatchNode) * *capacity) ;
+  }
+  *numNodes += 1 ;
+  (*nodes)[k].middle = middle ;
+  (*nodes)[k].lowerChild = -1 ;
+  (*nodes)[k].upperChild = -1 ;
+
+  if (middle - begin > bucketSize && lowerChild > 0) {
+    vl_index child = vl_kdtree_index_batch_nodes (tree, lowerChild, begin, middle, bucketSize,
+                                                  nodes, numNodes, capacity) ;
+    (*nodes)[k].lowerChild = child ;
+  }
+  if (end - middle > bucketSize && upperChild > 0) {
+    vl_index child = vl_kdtree_index_batch_nodes (tree, upperChild, middle, end, bucketSize,
+                                                  nodes, numNodes, capacity) ;
+    (*nodes)[k].upperChild = child ;
+  }
+  return k ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Find the bucket reached by a query
+ ** @param self KDForest object.
+ ** @param tree tree.
+ ** @param nodes nodes above the buckets of @a tree (may be @c NULL).
+ ** @param query query point.
+ ** @param bucket bucket reached (output).
+ **
+ ** The function follows the same path as the first descent of a
+ ** search, until it leaves the nodes @a nodes indexed by
+ ** ::vl_kdtree_index_batch_nodes. If @a nodes is @c NULL, the root is
+ ** the bucket.
+ **/
+
+static void
+vl_kdforest_find_bucket (VlKDForest const * self, VlKDTree const * tree,
+                         VlKDForestBatchNode const * nodes,
+                         void const * query, VlKDForestBatchBucket * bucket)
+{
+  vl_uindex nodeIndex = 0 ;
+  vl_uindex begin = 0 ;
+  vl_uindex end = self->numData ;
+  unsigned int depth = 0 ;
+  vl_index k = nodes ? 0 : -1 ;
+
+  while (k >= 0) {
+    vl_uindex i ;
+    double x2, saveDist ;
+    vl_index lowerChild, upperChild, saveChild ;
+    vl_index nextChild ;
+    vl_kdtree_get_node_split (tree, nodeIndex, &i, &x2, &lowerChild, &upperChild) ;
+    nextChild = vl_kdtree_descend_node (tree, nodeIndex,
+                                        vl_kdforest_get_query_component (self, query, i),
+                                        x2, lowerChild, upperChild,
+                                        0, &saveChild, &saveDist) ;
+    if (nextChild == lowerChild) {
+      end = nodes[k].middle ;
+      k = nodes[k].lowerChild ;
+    } else {
+      begin = nodes[k].middle ;
+      k = nodes[k].upperChild ;
+    }
+    nodeIndex = nextChild ;
+    depth ++ ;
+  }
+  bucket->nodeIndex = nodeIndex ;
+  bucket->begin = begin ;
+  bucket->end = end ;
+  bucket->depth = depth ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Descend a tree towards a query
+ ** @param self KDForest object.
+ ** @param tree tree.
+ ** @param query query point.
+ ** @param maxDepth maximum depth to reach.
+ ** @param searcher searcher (may be @c NULL).
+ ** @param neighbors neighbors found so far.
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param numAddedNeighbors number of neighbors found so far.
+ ** @return node reached.
+ **
+ ** The function follows the same path as the first descent of a
+ ** search. If @a searcher is not @c NULL, the nodes not taken are
+ ** pushed on the search heap, as done by
+ ** ::vl_kdforest_query_recursively.
+ **/
+
+static vl_uindex
+vl_kdforest_descend (VlKDForest const * self, VlKDTree * tree,
+                     void const * query, unsigned int maxDepth,
+                     VlKDForestSearcher * searcher,
+                     VlKDForestNeighbor const * neighbors,
+                     vl_size numNeighbors,
+                     vl_size numAddedNeighbors)
+{
+  vl_uindex nodeIndex = 0 ;
+  unsigned int depth ;
+  for (depth = 0 ; depth < maxDepth ; ++ depth) {
+    vl_uindex i ;
+    double x2, saveDist ;
+    vl_index lowerChild, upperChild, saveChild ;
+    vl_index nextChild ;
+    vl_kdtree_get_node_split (tree, nodeIndex, &i, &x2, &lowerChild, &upperChild) ;
+    if (lowerChild < 0) break ;
+    nextChild = vl_kdtree_descend_node (tree, nodeIndex,
+                                        vl_kdforest_get_query_component (self, query, i),
+                                        x2, lowerChild, upperChild,
+                                        0, &saveChild, &saveDist) ;
+    if (searcher &&
+        (numAddedNeighbors < numNeighbors || neighbors[0].distance > saveDist)) {
+      VlKDForestSearchState * searchState = searcher->searchHeapArray + searcher->searchHeapNumNodes ;
+      searchState->tree = tree ;
+      searchState->nodeIndex = saveChild ;
+      searchState->distanceLowerBound = saveDist ;
+      vl_kdforest_search_heap_push (searcher->searchHeapArray,
+                                    &searcher->searchHeapNumNodes) ;
+    }
+    nodeIndex = nextChild ;
+  }
+  return nodeIndex ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run multiple queries in batches
+ ** @param self object.
+ ** @param indexes assignments of points.
+ ** @param numNeighbors number of nearest neighbors to be found for each data point
+ ** @param numQueries number of query points.
+ ** @param distances distances of query points.
+ ** @param queries lisf of vectors to use as queries.
+ ** @return total number of comparisons.
+ **
+ ** The function is a faster version of
+ ** ::vl_kdforest_query_with_array for large numbers of queries. The
+ ** output has the same format.
+ **
+ ** The queries are processed in batches of
+ ** ::VL_KDFOREST_BATCH_NUM_QUERIES. The first phase of the search of
+ ** each query, which in each tree visits the data points in the
+ ** neighborhood of the query, is shared by all the queries of a
+ ** batch. The queries are grouped by the first node with at most
+ ** ::VL_KDFOREST_BATCH_BUCKET_SIZE data points that they reach
+ ** (bucket). The points in a bucket are gathered once in a contiguous
+ ** block, and their distances to all the queries of the group are
+ ** computed at once by ::vl_eval_vector_comparison_on_all_pairs_f
+ ** while the block is in the cache. Each query then continues the
+ ** search from the closest points found in the buckets, as done by
+ ** ::vl_kdforestsearcher_query.
+ **
+ ** For an exact search, the results are the same as
+ ** ::vl_kdforest_query_with_array. If the number of comparisons is
+ ** bounded (::vl_kdforest_set_max_num_comparisons), the buckets are
+ ** shrunk to use about a quarter of the comparisons, and the results
+ ** may differ slightly as the order in which the points are visited
+ ** is different.
+ **
+ ** @sa ::vl_kdforest_query_with_array.
+ **/
+
+vl_size
+vl_kdforest_query_batch (VlKDForest * self,
+                         vl_uint32 * indexes,
+                         vl_size numNeighbors,
+                         vl_size numQueries,
+                         void * distances,
+                         void const * queries)
+{
+  vl_size numComparisons = 0 ;
+  vl_size const dimension = self->dimension ;
+  vl_size const numTrees = self->numTrees ;
+  vl_size const typeSize = vl_get_type_size (self->dataType) ;
+  vl_size const dataSize = typeSize * dimension ;
+  vl_size const numBatches = (numQueries + VL_KDFOREST_BATCH_NUM_QUERIES - 1) / VL_KDFOREST_BATCH_NUM_QUERIES ;
+  vl_size bucketSize = VL_KDFOREST_BATCH_BUCKET_SIZE ;
+  VlKDForestBatchNode ** batchNodes ;
+  vl_uindex ti ;
+
+  /* leave most of the comparisons to the branch-and-bound search */
+  if (self->searchMaxNumComparisons > 0) {
+    bucketSize = VL_MIN(bucketSize, self->searchMaxNumComparisons / (4 * numTrees)) ;
+    bucketSize = VL_MAX(bucketSize, 1) ;
+  }
+
+  /* index the nodes above the buckets, which are shared by all the
+     queries */
+  batchNodes = vl_calloc (sizeof(VlKDForestBatchNode*), numTrees) ;
+  for (ti = 0 ; ti < numTrees ; ++ ti) {
+    VlKDTree const * tree = self->trees[ti] ;
+    vl_uindex splitDimension ;
+    double splitThreshold ;
+    vl_index lowerChild, upperChild ;
+    vl_size numNodes = 0, capacity = 0 ;
+    vl_kdtree_get_node_split (tree, 0, &splitDimension, &splitThreshold, &lowerChild, &upperChild) ;
+    if (self->numData > bucketSize && lowerChild > 0) {
+      vl_kdtree_index_batch_nodes (tree, 0, 0, self->numData, bucketSize,
+                                   batchNodes + ti, &numNodes, &capacity) ;
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) num_threads(vl_get_max_threads())
+#endif
+  {
+    vl_index b ;
+    vl_size thisNumComparisons = 0 ;
+    VlKDForestSearcher * searcher ;
+    vl_size const batchSize = VL_KDFOREST_BATCH_NUM_QUERIES ;
+
+    /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+    VlKDForestNeighbor * neighbors = malloc (sizeof(VlKDForestNeighbor) * numNeighbors * batchSize) ;
+    vl_size * numAddedNeighbors = malloc (sizeof(vl_size) * batchSize) ;
+    vl_size * queryNumComparisons = malloc (sizeof(vl_size) * batchSize) ;
+    VlKDForestBatchBucket * buckets = malloc (sizeof(VlKDForestBatchBucket) * numTrees * batchSize) ;
+    VlKDForestBatchEntry * entries = malloc (sizeof(VlKDForestBatchEntry) * batchSize) ;
+    char * groupQueries = malloc (dataSize * batchSize) ;
+    vl_size blockCapacity = 2 * VL_KDFOREST_BATCH_BUCKET_SIZE ;
+    char * block = malloc (dataSize * blockCapacity) ;
+    vl_uindex * blockIndexes = malloc (sizeof(vl_uindex) * blockCapacity) ;
+    char * blockDistances = malloc (typeSize * blockCapacity * batchSize) ;
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    searcher = vl_kdforest_new_searcher (self) ;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (b = 0 ; b < (signed)numBatches ; ++ b) {
+      vl_uindex q0 = b * batchSize ;
+      vl_size n = VL_MIN(batchSize, numQueries - q0) ;
+      vl_uindex q, ti, e, j ;
+
+      for (q = 0 ; q < n ; ++q) {
+        numAddedNeighbors[q] = 0 ;
+        queryNumComparisons[q] = 0 ;
+      }
+
+      /* shared phase: compare the queries to the buckets they reach */
+      for (ti = 0 ; ti < numTrees ; ++ ti) {
+        VlKDTree * tree = self->trees[ti] ;
+
+        for (q = 0 ; q < n ; ++q) {
+          void const * query = (char const*)queries + (q0 + q) * dataSize ;
+          VlKDForestBatchBucket * bucket = buckets + q * numTrees + ti ;
+          vl_kdforest_find_bucket (self, tree, batchNodes[ti], query, bucket) ;
+          entries[q].query = q ;
+          entries[q].bucket = bucket->nodeIndex ;
+        }
+        qsort (entries, n, sizeof(VlKDForestBatchEntry), vl_kdforest_compare_batch_entries) ;
+
+        for (e = 0 ; e < n ; ) {
+          VlKDForestBatchBucket const * bucket = buckets + entries[e].query * numTrees + ti ;
+          vl_uindex begin = bucket->begin ;
+          vl_size blockSize = bucket->end - bucket->begin ;
+          vl_size groupSize ;
+          vl_uindex e2, g ;
+          char const * blockData ;
+
+          /* gather the points of the bucket */
+          if (blockSize > blockCapacity) {
+            blockCapacity = blockSize ;
+            block = realloc (block, dataSize * blockCapacity) ;
+            blockIndexes = realloc (blockIndexes, sizeof(vl_uindex) * blockCapacity) ;
+            blockDistances = realloc (blockDistances, typeSize * blockCapacity * batchSize) ;
+          }
+          for (j = 0 ; j < blockSize ; ++j) {
+            blockIndexes[j] = tree->dataIndex[begin + j].index ;
+          }
+          if (ti == 0 && self->dataOrder) {
+            /* the data is sorted in the leaf order of the first tree */
+            blockData = (char const*)self->data + begin * dataSize ;
+          } else {
+            blockData = block ;
+            for (j = 0 ; j < blockSize ; ++j) {
+              memcpy (block + j * dataSize,
+                      (char const*)self->data + blockIndexes[j] * dataSize,
+                      dataSize) ;
+            }
+          }
+
+          /* compare them to all the queries that reach the bucket */
+          for (e2 = e ; e2 < n && entries[e2].bucket == entries[e].bucket ; ++ e2) {
+            memcpy (groupQueries + (e2 - e) * dataSize,
+                    (char const*)queries + (q0 + entries[e2].query) * dataSize,
+                    dataSize) ;
+          }
+          groupSize = e2 - e ;
+          switch (self->dataType) {
+            case VL_TYPE_FLOAT:
+              vl_eval_vector_comparison_on_all_pairs_f
+              ((float*)blockDistances, dimension,
+               (float const*)blockData, blockSize,
+               (float const*)groupQueries, groupSize,
+               (VlFloatVectorComparisonFunction)self->distanceFunction) ;
+              break ;
+            case VL_TYPE_DOUBLE:
+              vl_eval_vector_comparison_on_all_pairs_d
+              ((double*)blockDistances, dimension,
+               (double const*)blockData, blockSize,
+               (double const*)groupQueries, groupSize,
+               (VlDoubleVectorComparisonFunction)self->distanceFunction) ;
+              break ;
+            default:
+              abort() ;
+          }
+
+          for (g = 0 ; g < groupSize ; ++g) {
+            vl_uindex qe = entries[e + g].query ;
+            VlKDForestNeighbor * queryNeighbors = neighbors + qe * numNeighbors ;
+            queryNumComparisons[qe] += blockSize ;
+            for (j = 0 ; j < blockSize ; ++j) {
+              double dist ;
+              vl_uindex k ;
+              switch (self->dataType) {
+                case VL_TYPE_FLOAT:
+                  dist = ((float const*)blockDistances)[g * blockSize + j] ;
+                  break ;
+                case VL_TYPE_DOUBLE:
+                  dist = ((double const*)blockDistances)[g * blockSize + j] ;
+                  break ;
+                default:
+                  abort() ;
+              }
+              if (numAddedNeighbors[qe] == numNeighbors &&
+                  ! (queryNeighbors[0].distance > dist)) continue ;
+              /* the trees share the data points: skip the ones already found */
+              for (k = 0 ; k < numAddedNeighbors[qe] ; ++k) {
+                if (queryNeighbors[k].index == blockIndexes[j]) break ;
+              }
+              if (k < numAddedNeighbors[qe]) continue ;
+              if (numAddedNeighbors[qe] < numNeighbors) {
+                queryNeighbors[numAddedNeighbors[qe]].index = blockIndexes[j] ;
+                queryNeighbors[numAddedNeighbors[qe]].distance = dist ;
+                vl_kdforest_neighbor_heap_push (queryNeighbors, numAddedNeighbors + qe) ;
+              } else {
+                queryNeighbors[0].index = blockIndexes[j] ;
+                queryNeighbors[0].distance = dist ;
+                vl_kdforest_neighbor_heap_update (queryNeighbors, numNeighbors, 0) ;
+              }
+            }
+          }
+          e = e2 ;
+        }
+      }
+
+      /* continue the search of each query from its buckets */
+      for (q = 0 ; q < n ; ++q) {
+        void const * query = (char const*)queries + (q0 + q) * dataSize ;
+        VlKDForestNeighbor * queryNeighbors = neighbors + q * numNeighbors ;
+        vl_uindex ni ;
+
+        searcher->searchId += 1 ;
+        searcher->searchNumRecursions = 0 ;
+        searcher->searchNumComparisons = queryNumComparisons[q] ;
+        searcher->searchNumSimplifications = 0 ;
+        searcher->searchHeapNumNodes = 0 ;
+
+        for (ti = 0 ; ti < numTrees ; ++ ti) {
+          VlKDTree * tree = self->trees[ti] ;
+          VlKDForestBatchBucket const * bucket = buckets + q * numTrees + ti ;
+          for (j = bucket->begin ; j < bucket->end ; ++j) {
+            searcher->searchIdBook[tree->dataIndex[j].index] = searcher->searchId ;
+          }
+          vl_kdforest_descend (self, tree, query, bucket->depth, searcher,
+                               queryNeighbors, numNeighbors, numAddedNeighbors[q]) ;
+        }
+
+        thisNumComparisons += vl_kdforestsearcher_search (searcher, queryNeighbors, numNeighbors,
+                                                          numAddedNeighbors[q], query) ;
+
+        for (ni = 0 ; ni < numNeighbors ; ++ni) {
+          indexes [(q0 + q)*numNeighbors + ni] = (vl_uint32) queryNeighbors[ni].index ;
+          if (distances) {
+            switch (self->dataType) {
+              case VL_TYPE_FLOAT:
+                *((float*)distances + (q0 + q)*numNeighbors + ni) = (float) queryNeighbors[ni].distance ;
+                break ;
+              case VL_TYPE_DOUBLE:
+                *((double*)distances + (q0 + q)*numNeighbors + ni) = queryNeighbors[ni].distance ;
+                break ;
+              default:
+                abort() ;
+            }
+          }
+        }
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      numComparisons += thisNumComparisons ;
+      vl_kdforestsearcher_delete (searcher) ;
+    }
+
+    free (neighbors) ;
+    free (numAddedNeighbors) ;
+    free (queryNumComparisons) ;
+    free (buckets) ;
+    free (entries) ;
+    free (groupQueries) ;
+    free (block) ;
+    free (blockIndexes) ;
+    free (blockDistances) ;
+  }
+
+  for (ti = 0 ; ti < numTrees ; ++ ti) {
+    if (batchNodes[ti]) vl_free (batchNodes[ti]) ;
+  }
+  vl_free (batchNodes) ;
+  return numComparisons ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                   Range querying */
+/* ---------------------------------------------------------------- */
+
+static int
+vl_kdforest_compare_neighbors (void const * a, void const * b)
+{
+  VlKDForestNeighbor const * na = a ;
+  VlKDForestNeighbor const * nb = b ;
+  if (na->distance != nb->distance) return (na->distance < nb->distance) ? -1 : +1 ;
+  if (na->index != nb->index) return (na->index < nb->index) ? -1 : +1 ;
+  return 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Collect the points of a subtree within a radius
+ ** @param self searcher object.
+ ** @param tree KDTree object instance.
+ ** @param nodeIndex node.
+ ** @param dist lower bound of the distance of the query to the node.
+ ** @param maxDist nodes whose lower bound exceeds this value are pruned.
+ ** @param radius search radius.
+ ** @param query query point.
+ **
+ ** The points found are appended to the range buffer of the searcher.
+ **/
+
+static void
+vl_kdforestsearcher_query_range_recursively (VlKDForestSearcher * self,
+                                             VlKDTree const * tree,
+                                             vl_uindex nodeIndex,
+                                             double dist,
+                                             double maxDist,
+                                             double radius,
+                                             void const * query)
+{
+  VlKDForest const * forest = self->forest ;
+  vl_uindex i ;
+  vl_index lowerChild, upperChild, nextChild, saveChild ;
+  double saveDist ;
+  double x2 ;
+
+  self->searchNumRecursions ++ ;
+
+  vl_kdtree_get_node_split (tree, nodeIndex, &i, &x2, &lowerChild, &upperChild) ;
+
+  /* base case: this is a leaf node */
+  if (lowerChild < 0) {
+    vl_index begin = - lowerChild - 1 ;
+    vl_index end   = - upperChild - 1 ;
+    vl_index iter ;
+
+    for (iter = begin ; iter < end ; ++ iter) {
+      vl_index di = tree->dataIndex [iter].index ;
+      VlKDForestNeighbor * neighbor ;
+
+      switch (forest->dataType) {
+        case VL_TYPE_FLOAT:
+          dist = ((VlFloatVectorComparisonFunction)forest->distanceFunction)
+                 (forest->dimension,
+                  ((float const *)query),
+                  ((float const*)forest->data) + di * forest->dimension) ;
+          break ;
+        case VL_TYPE_DOUBLE:
+          dist = ((VlDoubleVectorComparisonFunction)forest->distanceFunction)
+                 (forest->dimension,
+                  ((double const *)query),
+                  ((double const*)forest->data) + di * forest->dimension) ;
+          break ;
+        default:
+          abort() ;
+      }
+      self->searchNumComparisons += 1 ;
+      if (dist > radius) continue ;
+
+      if (self->rangeNumNeighbors == self->rangeNumAllocatedNeighbors) {
+        self->rangeNumAllocatedNeighbors = VL_MAX(2 * self->rangeNumAllocatedNeighbors, 64) ;
+        /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+        self->rangeNeighbors = realloc (self->rangeNeighbors,
+                                        sizeof(VlKDForestNeighbor) *
+                                        self->rangeNumAllocatedNeighbors) ;
+      }
+      neighbor = self->rangeNeighbors + self->rangeNumNeighbors ++ ;
+      neighbor->index = di ;
+      neighbor->distance = dist ;
+    }
+    return ;
+  }
+
+  nextChild = vl_kdtree_descend_node (tree, nodeIndex,
+                                      vl_kdforest_get_query_component (forest, query, i),
+                                      x2, lowerChild, upperChild,
+                                      dist, &saveChild, &saveDist) ;
+
+  vl_kdforestsearcher_query_range_recursively (self, tree, nextChild, dist,
+                                               maxDist, radius, query) ;
+  if (saveDist <= maxDist) {
+    vl_kdforestsearcher_query_range_recursively (self, tree, saveChild, saveDist,
+                                                 maxDist, radius, query) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Find all the points within a radius of a query
+ ** @param self object.
+ ** @param neighbors neighbors found (output).
+ ** @param radius search radius.
+ ** @param query query point.
+ ** @return number of neighbors found.
+ **
+ ** The function finds all the indexed points whose distance to @a
+ ** query is not larger than @a radius. The radius is expressed in the
+ ** same units of the distances returned by the other queries (for
+ ** example, for the ::VlDistanceL2 distance, it is the squared
+ ** Euclidean distance). The neighbors are sorted by increasing
+ ** distance and stored in a buffer owned by the searcher, which is
+ ** returned in @a neighbors; the buffer is valid until the next range
+ ** query or until the searcher is deleted.
+ **
+ ** Differently from the nearest neighbor queries, this search is
+ ** always exact and ignores the maximum number of comparisons. Since
+ ** a single tree is sufficient for an exact search, only the first
+ ** tree of the forest is visited. Subtrees are pruned by using the
+ ** lower bounds on the distance derived from the node bounds, which
+ ** are valid for the ::VlDistanceL2 and ::VlDistanceL1 distances;
+ ** with other distances the search compares the query to all the
+ ** points.
+ **
+ ** @sa ::vl_kdforest_query_range_with_array.
+ **/
+
+vl_size
+vl_kdforestsearcher_query_range (VlKDForestSearcher * self,
+                                 VlKDForestNeighbor const ** neighbors,
+                                 double radius,
+                                 void const * query)
+{
+  double maxDist ;
+
+  assert (neighbors) ;
+  assert (query) ;
+
+  self->searchNumRecursions = 0 ;
+  self->searchNumComparisons = 0 ;
+  self->searchNumSimplifications = 0 ;
+  self->searchMaxHeapNumNodes = 0 ;
+  self->rangeNumNeighbors = 0 ;
+
+  /* the lower bounds are computed for the squared l2 distance, which
+   * is also a lower bound of the square of the l1 distance */
+  switch (self->forest->distance) {
+    case VlDistanceL2 : maxDist = radius ; break ;
+    case VlDistanceL1 : maxDist = radius * radius ; break ;
+    default : maxDist = VL_INFINITY_D ; break ;
+  }
+
+  if (radius >= 0) {
+    vl_kdforestsearcher_query_range_recursively (self, self->forest->trees[0], 0, 0,
+                                                 maxDist, radius, query) ;
+  }
+
+  vl_kdforest_restore_neighbor_indexes (self->forest, self->rangeNeighbors,
+                                        self->rangeNumNeighbors) ;
+  vl_kdforestsearcher_record_query (self) ;
+  qsort (self->rangeNeighbors, self->rangeNumNeighbors,
+         sizeof(VlKDForestNeighbor), vl_kdforest_compare_neighbors) ;
+
+  *neighbors = self->rangeNeighbors ;
+  return self->rangeNumNeighbors ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Find all the points within a radius of a query
+ ** @param self object.
+ ** @param neighbors neighbors found (output).
+ ** @param radius search radius.
+ ** @param query query point.
+ ** @return number of neighbors found.
+ **
+ ** The function is the same as ::vl_kdforestsearcher_query_range,
+ ** but uses the first searcher of the forest (creating it if needed).
+ **/
+
+vl_size
+vl_kdforest_query_range (VlKDForest * self,
+                         VlKDForestNeighbor const ** neighbors,
+                         double radius,
+                         void const * query)
+{
+  VlKDForestSearcher * searcher = vl_kdforest_get_searcher(self, 0) ;
+  if (searcher == NULL) {
+    searcher = vl_kdforest_new_searcher(self) ;
+  }
+  return vl_kdforestsearcher_query_range (searcher, neighbors, radius, query) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run multiple range queries
+ ** @param self object.
+ ** @param offsets offsets of the results of each query (output).
+ ** @param indexes indexes of the neighbors (output).
+ ** @param distances distances of the neighbors (output).
+ ** @param radius search radius.
+ ** @param numQueries number of query points.
+ ** @param queries list of vectors to use as queries.
+ ** @return total number of neighbors found.
+ **
+ ** The function runs ::vl_kdforestsearcher_query_range for each of the
+ ** @a numQueries queries @a queries, using multiple cores. Since the
+ ** number of neighbors varies from query to query, the results are
+ ** concatenated: @a offsets is an array of @a numQueries + 1 elements
+ ** and the neighbors of query @c q are found at positions
+ ** <code>offsets[q]</code> to <code>offsets[q+1]-1</code> of the
+ ** arrays @a indexes and @a distances.
+ **
+ ** The function allocates @c *indexes and, if @a distances is not @c
+ ** NULL, @c *distances (the latter has the same data type as the
+ ** forest). The caller must dispose of them by ::vl_free. If no
+ ** neighbor is found, the pointers are set to @c NULL.
+ **
+ ** @sa ::vl_kdforestsearcher_query_range.
+ **/
+
+vl_size
+vl_kdforest_query_range_with_array (VlKDForest * self,
+                                    vl_size * offsets,
+                                    vl_uint32 ** indexes,
+                                    void ** distances,
+                                    double radius,
+                                    vl_size numQueries,
+                                    void const * queries)
+{
+  vl_size numNeighbors = 0 ;
+  vl_size dataSize = vl_get_type_size (self->dataType) ;
+  vl_uindex qi ;
+  VlKDForestNeighbor ** results ;
+
+  assert (offsets) ;
+  assert (indexes) ;
+
+  results = vl_calloc (sizeof(VlKDForestNeighbor*), numQueries) ;
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) num_threads(vl_get_max_threads())
+#endif
+  {
+    vl_index qj ;
+    VlKDForestSearcher * searcher ;
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      searcher = vl_kdforest_new_searcher(self) ;
+    }
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+    for (qj = 0 ; qj < (signed)numQueries ; ++ qj) {
+      VlKDForestNeighbor const * neighbors ;
+      vl_size n = vl_kdforestsearcher_query_range
+        (searcher, &neighbors, radius,
+         (char const*)queries + qj * self->dimension * dataSize) ;
+      offsets[qj + 1] = n ;
+      if (n > 0) {
+        /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+        results[qj] = malloc (sizeof(VlKDForestNeighbor) * n) ;
+        memcpy (results[qj], neighbors, sizeof(VlKDForestNeighbor) * n) ;
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      vl_kdforestsearcher_delete (searcher) ;
+    }
+  }
+
+  /* concatenate the results */
+  offsets[0] = 0 ;
+  for (qi = 0 ; qi < numQueries ; ++ qi) {
+    numNeighbors += offsets[qi + 1] ;
+    offsets[qi + 1] = numNeighbors ;
+  }
+
+  *indexes = NULL ;
+  if (distances) *distances = NULL ;
+  if (numNeighbors > 0) {
+    *indexes = vl_malloc (sizeof(vl_uint32) * numNeighbors) ;
+    if (distances) *distances = vl_malloc (dataSize * numNeighbors) ;
+  }
+
+  for (qi = 0 ; qi < numQueries ; ++ qi) {
+    vl_uindex ni ;
+    vl_uindex begin = offsets[qi] ;
+    vl_size n = offsets[qi + 1] - begin ;
+    for (ni = 0 ; ni < n ; ++ ni) {
+      VlKDForestNeighbor const * neighbor = results[qi] + ni ;
+      (*indexes)[begin + ni] = (vl_uint32) neighbor->index ;
+      if (distances) {
+        switch (self->dataType) {
+          case VL_TYPE_FLOAT:
+            ((float*)*distances)[begin + ni] = (float) neighbor->distance ;
+            break ;
+          case VL_TYPE_DOUBLE:
+            ((double*)*distances)[begin + ni] = neighbor->distance ;
+            break ;
+          default:
+            abort() ;
+        }
+      }
+    }
+    free (results[qi]) ;
+  }
+
+  vl_free (results) ;
+  return numNeighbors ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Get the number of nodes of a given tree
  ** @param self KDForest object.
@@ -1045,6 +2575,93 @@ vl_kdforest_get_thresholding_method (VlKDForest const * self)
   return self->thresholdingMethod ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set whether to use the compact node layout
+ ** @param self KDForest object.
+ ** @param compact ::VL_TRUE to use the compact layout.
+ **
+ ** With the compact layout, the trees built by ::vl_kdforest_build
+ ** store their nodes in 16 bytes instead of about 50, using 32-bit
+ ** indexes and single precision thresholds and keeping the node
+ ** bounds in a separate array. The nodes are also stored in van
+ ** Emde Boas order. This makes queries faster as more nodes fit in
+ ** the cache. The layout is ignored for forests with more than
+ ** 2^30 data points.
+ **
+ ** Since the thresholds are stored in single precision, the
+ ** results of queries on ::VL_TYPE_DOUBLE data may differ from the
+ ** standard layout when the query is very close to a splitting
+ ** plane.
+ **
+ ** The setting takes effect the next time the forest is built.
+ **
+ ** @sa @ref kdtree-tech, ::vl_kdforest_get_compact_layout
+ **/
+
+void
+vl_kdforest_set_compact_layout (VlKDForest * self, vl_bool compact)
+{
+  self->compactLayout = compact ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get whether the compact node layout is used
+ ** @param self KDForest object.
+ ** @return whether the compact layout is used.
+ **
+ ** @sa ::vl_kdforest_set_compact_layout
+ **/
+
+vl_bool
+vl_kdforest_get_compact_layout (VlKDForest const * self)
+{
+  return self->compactLayout ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether to reorder the data in the leaf order
+ ** @param self KDForest object.
+ ** @param reorder ::VL_TRUE to reorder the data.
+ **
+ ** If @a reorder is ::VL_TRUE, ::vl_kdforest_build makes a copy of
+ ** the data sorted in the order of the leaves of the first tree, and
+ ** the forest uses the copy instead of the original data. Thus the
+ ** points in the leaves visited by a query, as well as the buckets
+ ** of ::vl_kdforest_query_batch and the subtrees visited by
+ ** ::vl_kdforest_query_range, are contiguous in memory, which
+ ** reduces cache misses and lets the hardware prefetch the data. The
+ ** copy doubles the memory used for the data. The other trees of the
+ ** forest visit the data in a different order and benefit only
+ ** partially.
+ **
+ ** The reordering does not change the results: the neighbors are
+ ** identified by their index in the original data, which is still
+ ** written by ::vl_kdforest_save. The setting takes effect the next
+ ** time the forest is built.
+ **
+ ** @sa ::vl_kdforest_get_data_reordering
+ **/
+
+void
+vl_kdforest_set_data_reordering (VlKDForest * self, vl_bool reorder)
+{
+  self->dataReordering = reorder ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get whether the data is reordered in the leaf order
+ ** @param self KDForest object.
+ ** @return whether the data is reordered.
+ **
+ ** @sa ::vl_kdforest_set_data_reordering
+ **/
+
+vl_bool
+vl_kdforest_get_data_reordering (VlKDForest const * self)
+{
+  return self->dataReordering ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Get the dimension of the data
  ** @param self KDForest object.
@@ -1080,3 +2697,749 @@ vl_kdforestsearcher_get_forest (VlKDForestSearcher const * self)
 {
   return self->forest;
 }
+
+/* ---------------------------------------------------------------- */
+/*                                           Statistics and tuning */
+/* ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @brief Get the search statistics of a searcher
+ ** @param self searcher object.
+ ** @return statistics of the queries run by the searcher.
+ **
+ ** The statistics include all the queries run by the searcher since
+ ** it was created or ::vl_kdforestsearcher_reset_statistics was
+ ** called. The heap size is zero for range queries.
+ **
+ ** @sa @ref kdtree-statistics
+ **/
+
+VlKDForestSearchStatistics const *
+vl_kdforestsearcher_get_statistics (VlKDForestSearcher const * self)
+{
+  return &self->statistics ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Reset the search statistics of a searcher
+ ** @param self searcher object.
+ **/
+
+void
+vl_kdforestsearcher_reset_statistics (VlKDForestSearcher * self)
+{
+  memset (&self->statistics, 0, sizeof(VlKDForestSearchStatistics)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the search statistics of a forest
+ ** @param self KDForest object.
+ ** @param statistics statistics (output).
+ **
+ ** The function returns the statistics of all the queries run on the
+ ** forest since it was created or
+ ** ::vl_kdforest_reset_search_statistics was called, including the
+ ** ones run by the temporary searchers of
+ ** ::vl_kdforest_query_with_array and of the other functions
+ ** processing many queries. The function must not be called while
+ ** the forest is queried by other threads.
+ **
+ ** @sa @ref kdtree-statistics
+ **/
+
+void
+vl_kdforest_get_search_statistics (VlKDForest const * self,
+                                   VlKDForestSearchStatistics * statistics)
+{
+  VlKDForestSearcher const * searcher ;
+  *statistics = self->searchStatistics ;
+  for (searcher = self->headSearcher ; searcher ; searcher = searcher->next) {
+    vl_kdforest_statistics_accumulate (statistics, &searcher->statistics) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Reset the search statistics of a forest
+ ** @param self KDForest object.
+ **
+ ** The function resets the statistics of the forest and of all its
+ ** searchers.
+ **/
+
+void
+vl_kdforest_reset_search_statistics (VlKDForest * self)
+{
+  VlKDForestSearcher * searcher ;
+  memset (&self->searchStatistics, 0, sizeof(VlKDForestSearchStatistics)) ;
+  for (searcher = self->headSearcher ; searcher ; searcher = searcher->next) {
+    vl_kdforestsearcher_reset_statistics (searcher) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Compute the recall of approximate neighbors
+ ** @param indexes approximate neighbors.
+ ** @param truth exact neighbors.
+ ** @param numNeighbors number of neighbors per query.
+ ** @param numQueries number of queries.
+ ** @return fraction of the exact neighbors that are found.
+ **/
+
+static double
+vl_kdforest_get_recall (vl_uint32 const * indexes,
+                        vl_uint32 const * truth,
+                        vl_size numNeighbors,
+                        vl_size numQueries)
+{
+  vl_size numFound = 0 ;
+  vl_uindex q, i, j ;
+  for (q = 0 ; q < numQueries ; ++q) {
+    vl_uint32 const * found = indexes + q * numNeighbors ;
+    vl_uint32 const * exact = truth + q * numNeighbors ;
+    for (i = 0 ; i < numNeighbors ; ++i) {
+      if (exact[i] == (vl_uint32) -1) { numFound ++ ; continue ; }
+      for (j = 0 ; j < numNeighbors ; ++j) {
+        if (found[j] == exact[i]) { numFound ++ ; break ; }
+      }
+    }
+  }
+  return (double) numFound / (numNeighbors * numQueries) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Find the smallest number of comparisons meeting a recall
+ ** @param self KDForest object.
+ ** @param recall recall obtained (output).
+ ** @param indexes buffer for the neighbors.
+ ** @param truth exact neighbors.
+ ** @param numNeighbors number of neighbors per query.
+ ** @param targetRecall target recall.
+ ** @param numQueries number of queries.
+ ** @param queries queries.
+ ** @return maximum number of comparisons (0 for exact search).
+ **
+ ** The recall is assumed to increase with the number of comparisons.
+ ** The function doubles the number of comparisons until the recall
+ ** is reached and then refines it by bisection.
+ **/
+
+static vl_size
+vl_kdforest_tune_max_num_comparisons (VlKDForest * self,
+                                      double * recall,
+                                      vl_uint32 * indexes,
+                                      vl_uint32 const * truth,
+                                      vl_size numNeighbors,
+                                      double targetRecall,
+                                      vl_size numQueries,
+                                      void const * queries)
+{
+  vl_size lower = 0 ;
+  vl_size upper = 0 ;
+  double upperRecall = 1 ;
+  vl_size n ;
+
+  /* with numData * numTrees comparisons the search is exact */
+  for (n = numNeighbors ; n < self->numData * self->numTrees ; n *= 2) {
+    double r ;
+    self->searchMaxNumComparisons = n ;
+    vl_kdforest_query_with_array (self, indexes, numNeighbors, numQueries, NULL, queries) ;
+    r = vl_kdforest_get_recall (indexes, truth, numNeighbors, numQueries) ;
+    if (r >= targetRecall) {
+      upper = n ;
+      upperRecall = r ;
+      break ;
+    }
+    lower = n ;
+  }
+
+  /* refine to about 1/8 of the upper bound */
+  while (upper > 0 && (upper - lower) * 8 > upper) {
+    double r ;
+    n = lower + (upper - lower) / 2 ;
+    self->searchMaxNumComparisons = n ;
+    vl_kdforest_query_with_array (self, indexes, numNeighbors, numQueries, NULL, queries) ;
+    r = vl_kdforest_get_recall (indexes, truth, numNeighbors, numQueries) ;
+    if (r >= targetRecall) {
+      upper = n ;
+      upperRecall = r ;
+    } else {
+      lower = n ;
+    }
+  }
+
+  *recall = upperRecall ;
+  return upper ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Select the search parameters meeting a target recall
+ ** @param self KDForest object.
+ ** @param tuning selected parameters (output).
+ ** @param numNeighbors number of nearest neighbors to find per query.
+ ** @param targetRecall target recall (between 0 and 1).
+ ** @param maxNumTrees maximum number of trees.
+ ** @param numQueries number of tuning queries.
+ ** @param queries tuning queries.
+ **
+ ** The function selects the number of trees and the maximum number
+ ** of comparisons (::vl_kdforest_set_max_num_comparisons) that find
+ ** a fraction @a targetRecall of the exact @a numNeighbors nearest
+ ** neighbors of the queries @a queries in the least time. The
+ ** queries should be held out from the data and representative of
+ ** the queries to be run.
+ **
+ ** The forest @a self must have been built. The function uses it to
+ ** find the exact neighbors of the queries. Then, for a number of
+ ** trees equal to 1, 2, 4, ... up to @a maxNumTrees, it builds a
+ ** temporary forest for the same data and with the same options, and
+ ** finds the smallest maximum number of comparisons that meets the
+ ** target recall. The time of the queries is measured by
+ ** ::vl_get_cpu_time, which is the processor time of all the threads.
+ ** The forest @a self is not changed, except for its search
+ ** statistics; to use the selected parameters, build a forest with
+ ** @c tuning->numTrees trees and set its maximum number of
+ ** comparisons to @c tuning->maxNumComparisons.
+ **
+ ** The temporary forests use the default random number generator
+ ** (::vl_get_rand).
+ **
+ ** @sa @ref kdtree-statistics
+ **/
+
+void
+vl_kdforest_tune (VlKDForest * self,
+                  VlKDForestTuning * tuning,
+                  vl_size numNeighbors,
+                  double targetRecall,
+                  vl_size maxNumTrees,
+                  vl_size numQueries,
+                  void const * queries)
+{
+  void const * data = self->dataOrder ? self->originalData : self->data ;
+  vl_size maxNumComparisons = self->searchMaxNumComparisons ;
+  vl_uint32 * truth = vl_malloc (sizeof(vl_uint32) * numNeighbors * numQueries) ;
+  vl_uint32 * indexes = vl_malloc (sizeof(vl_uint32) * numNeighbors * numQueries) ;
+  vl_size numTrees ;
+
+  assert (self->trees) ;
+  assert (tuning) ;
+  assert (numNeighbors >= 1) ;
+  assert (maxNumTrees >= 1) ;
+  assert (numQueries >= 1) ;
+  assert (queries) ;
+
+  /* exact neighbors */
+  self->searchMaxNumComparisons = 0 ;
+  vl_kdforest_query_with_array (self, truth, numNeighbors, numQueries, NULL, queries) ;
+  self->searchMaxNumComparisons = maxNumComparisons ;
+
+  tuning->numTrees = 0 ;
+  tuning->maxNumComparisons = 0 ;
+  tuning->recall = 0 ;
+  tuning->queryTime = VL_INFINITY_D ;
+
+  for (numTrees = 1 ; numTrees <= maxNumTrees ; numTrees *= 2) {
+    VlKDForest * forest = vl_kdforest_new (self->dataType, self->dimension,
+                                           numTrees, self->distance) ;
+    double recall, queryTime ;
+    vl_size n ;
+
+    forest->thresholdingMethod = self->thresholdingMethod ;
+    forest->compactLayout = self->compactLayout ;
+    forest->dataReordering = self->dataReordering ;
+    vl_kdforest_build (forest, self->numData, data) ;
+
+    n = vl_kdforest_tune_max_num_comparisons (forest, &recall, indexes, truth,
+                                              numNeighbors, targetRecall,
+                                              numQueries, queries) ;
+    forest->searchMaxNumComparisons = n ;
+    queryTime = vl_get_cpu_time () ;
+    vl_kdforest_query_with_array (forest, indexes, numNeighbors, numQueries, NULL, queries) ;
+    queryTime = (vl_get_cpu_time () - queryTime) / numQueries ;
+
+    if (queryTime < tuning->queryTime) {
+      tuning->numTrees = numTrees ;
+      tuning->maxNumComparisons = n ;
+      tuning->recall = recall ;
+      tuning->queryTime = queryTime ;
+    }
+    vl_kdforest_delete (forest) ;
+  }
+
+  vl_free (truth) ;
+  vl_free (indexes) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                               Saving and loading */
+/* ---------------------------------------------------------------- */
+
+#define VL_KDFOREST_FILE_MAGIC "VLKDFRST"
+#define VL_KDFOREST_FILE_VERSION 2
+#define VL_KDFOREST_FILE_BYTE_ORDER 0x01020304
+#define VL_KDFOREST_FILE_ALIGNMENT 64
+
+/* The file starts with a VlKDForestFileHeader, followed by one
+ * VlKDForestFileTree record per tree. The nodes (and, for the compact
+ * layout, the node bounds) and the data index of each tree, and
+ * optionally the data, follow in sections aligned to
+ * VL_KDFOREST_FILE_ALIGNMENT bytes. These sections are stored in
+ * the same binary layout used in memory, so that they can be mapped
+ * without copies; for this reason, a file can be loaded only on a
+ * host with the same byte order and structure layout. */
+
+typedef struct _VlKDForestFileHeader
+{
+  char magic [8] ;
+  vl_uint32 version ;
+  vl_uint32 byteOrder ;
+  vl_uint32 nodeSize ;
+  vl_uint32 dataIndexEntrySize ;
+  vl_uint32 dataType ;
+  vl_uint32 distance ;
+  vl_uint32 thresholdingMethod ;
+  vl_uint32 hasData ;
+  vl_uint32 compactLayout ;
+  vl_uint32 reserved ;
+  vl_uint64 dimension ;
+  vl_uint64 numData ;
+  vl_uint64 numTrees ;
+  vl_uint64 maxNumNodes ;
+  vl_uint64 dataOffset ;
+  vl_uint64 fileSize ;
+} VlKDForestFileHeader ;
+
+typedef struct _VlKDForestFileTree
+{
+  vl_uint64 numUsedNodes ;
+  vl_uint64 depth ;
+  vl_uint64 nodesOffset ;
+  vl_uint64 boundsOffset ;
+  vl_uint64 dataIndexOffset ;
+} VlKDForestFileTree ;
+
+static vl_uint64
+vl_kdforest_file_align (vl_uint64 offset)
+{
+  return (offset + VL_KDFOREST_FILE_ALIGNMENT - 1) &
+    ~ (vl_uint64) (VL_KDFOREST_FILE_ALIGNMENT - 1) ;
+}
+
+static vl_bool
+vl_kdforest_file_write (FILE * file, vl_uint64 * offset,
+                        void const * buffer, vl_size size)
+{
+  static char const zeros [VL_KDFOREST_FILE_ALIGNMENT] = {0} ;
+  vl_size padding = (vl_size) (vl_kdforest_file_align (*offset + size) - (*offset + size)) ;
+  if (size > 0 && fwrite (buffer, 1, size, file) != size) return VL_FALSE ;
+  if (padding > 0 && fwrite (zeros, 1, padding, file) != padding) return VL_FALSE ;
+  *offset += size + padding ;
+  return VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Save the forest to a file
+ ** @param self KDForest object.
+ ** @param fileName name of the file.
+ ** @param saveData whether to store a copy of the indexed data too.
+ ** @return error code.
+ **
+ ** The function writes the trees of the forest, which must have
+ ** been built by ::vl_kdforest_build, in a binary file that can be
+ ** loaded back by ::vl_kdforest_load. If @a saveData is ::VL_TRUE,
+ ** the file includes a copy of the indexed data, so that the loaded
+ ** forest is self-contained. Otherwise, the data must be provided
+ ** again when the forest is loaded.
+ **
+ ** The function returns ::VL_ERR_OK on success and ::VL_ERR_IO if
+ ** the file cannot be written.
+ **
+ ** @sa @ref kdtree-persistence
+ **/
+
+int
+vl_kdforest_save (VlKDForest const * self, char const * fileName, vl_bool saveData)
+{
+  VlKDForestFileHeader header ;
+  VlKDForestFileTree * trees ;
+  VlKDTreeDataIndexEntry * dataIndex = NULL ;
+  vl_size dataSize = self->numData * self->dimension *
+    vl_get_type_size (self->dataType) ;
+  vl_uint64 offset ;
+  vl_uindex ti ;
+  vl_bool ok ;
+  FILE * file ;
+
+  assert (self->trees) ;
+
+  memset (&header, 0, sizeof(header)) ;
+  memcpy (header.magic, VL_KDFOREST_FILE_MAGIC, sizeof(header.magic)) ;
+  header.version = VL_KDFOREST_FILE_VERSION ;
+  header.byteOrder = VL_KDFOREST_FILE_BYTE_ORDER ;
+  header.compactLayout = (self->trees[0]->compactNodes != NULL) ;
+  header.nodeSize = header.compactLayout ? sizeof(VlKDTreeCompactNode) : sizeof(VlKDTreeNode) ;
+  header.dataIndexEntrySize = sizeof(VlKDTreeDataIndexEntry) ;
+  header.dataType = self->dataType ;
+  header.distance = self->distance ;
+  header.thresholdingMethod = self->thresholdingMethod ;
+  header.hasData = (saveData != VL_FALSE) ;
+  header.dimension = self->dimension ;
+  header.numData = self->numData ;
+  header.numTrees = self->numTrees ;
+  header.maxNumNodes = self->maxNumNodes ;
+
+  /* lay out the sections */
+  trees = vl_calloc (sizeof(VlKDForestFileTree), self->numTrees) ;
+  offset = vl_kdforest_file_align (sizeof(VlKDForestFileHeader) +
+                                   sizeof(VlKDForestFileTree) * self->numTrees) ;
+  for (ti = 0 ; ti < self->numTrees ; ++ti) {
+    VlKDTree const * tree = self->trees[ti] ;
+    trees[ti].numUsedNodes = tree->numUsedNodes ;
+    trees[ti].depth = tree->depth ;
+    trees[ti].nodesOffset = offset ;
+    offset = vl_kdforest_file_align (offset + header.nodeSize * tree->numUsedNodes) ;
+    if (header.compactLayout) {
+      trees[ti].boundsOffset = offset ;
+      offset = vl_kdforest_file_align (offset + sizeof(float) * 2 * tree->numUsedNodes) ;
+    }
+    trees[ti].dataIndexOffset = offset ;
+    offset = vl_kdforest_file_align (offset + sizeof(VlKDTreeDataIndexEntry) * self->numData) ;
+  }
+  if (header.hasData) {
+    header.dataOffset = offset ;
+    offset = vl_kdforest_file_align (offset + dataSize) ;
+  }
+  header.fileSize = offset ;
+
+  file = fopen (fileName, "wb") ;
+  if (file == NULL) {
+    vl_free (trees) ;
+    return vl_set_last_error (VL_ERR_IO, "Could not open KDForest file `%s' for writing", fileName) ;
+  }
+  if (self->dataOrder) {
+    dataIndex = vl_malloc (sizeof(VlKDTreeDataIndexEntry) * self->numData) ;
+  }
+
+  offset = 0 ;
+  ok = (fwrite (&header, sizeof(header), 1, file) == 1) ;
+  offset += sizeof(header) ;
+  ok = ok && vl_kdforest_file_write (file, &offset, trees,
+                                     sizeof(VlKDForestFileTree) * self->numTrees) ;
+  for (ti = 0 ; ok && ti < self->numTrees ; ++ti) {
+    VlKDTree const * tree = self->trees[ti] ;
+    if (! self->dataOrder) dataIndex = tree->dataIndex ;
+    if (header.compactLayout) {
+      ok = vl_kdforest_file_write (file, &offset, tree->compactNodes,
+                                   header.nodeSize * tree->numUsedNodes) &&
+           vl_kdforest_file_write (file, &offset, tree->compactBounds,
+                                   sizeof(float) * 2 * tree->numUsedNodes) ;
+    } else {
+      ok = vl_kdforest_file_write (file, &offset, tree->nodes,
+                                   header.nodeSize * tree->numUsedNodes) ;
+    }
+    if (self->dataOrder) {
+      /* refer to the original data rather than to the reordered copy */
+      vl_uindex i ;
+      for (i = 0 ; i < self->numData ; ++i) {
+        dataIndex[i].index = self->dataOrder[tree->dataIndex[i].index] ;
+        dataIndex[i].value = tree->dataIndex[i].value ;
+      }
+    }
+    ok = ok &&
+         vl_kdforest_file_write (file, &offset, dataIndex,
+                                 sizeof(VlKDTreeDataIndexEntry) * self->numData) ;
+  }
+  if (ok && header.hasData) {
+    ok = vl_kdforest_file_write (file, &offset,
+                                 self->dataOrder ? self->originalData : self->data,
+                                 dataSize) ;
+  }
+  ok = (fclose (file) == 0) && ok ;
+  vl_free (trees) ;
+  if (self->dataOrder) vl_free (dataIndex) ;
+
+  if (! ok) {
+    return vl_set_last_error (VL_ERR_IO, "Error writing KDForest file `%s'", fileName) ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Map a file in memory (read only)
+ ** @param fileName name of the file.
+ ** @param size size of the file (output).
+ ** @return address of the mapping or @c NULL on failure.
+ **/
+
+static void *
+vl_kdforest_map_file (char const * fileName, vl_size * size)
+{
+  void * mapping = NULL ;
+#if defined(VL_OS_WIN)
+  LARGE_INTEGER fileSize ;
+  HANDLE fileMapping ;
+  HANDLE file = CreateFileA (fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) ;
+  if (file == INVALID_HANDLE_VALUE) return NULL ;
+  if (GetFileSizeEx (file, &fileSize) && fileSize.QuadPart > 0) {
+    fileMapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL) ;
+    if (fileMapping) {
+      mapping = MapViewOfFile (fileMapping, FILE_MAP_READ, 0, 0, 0) ;
+      /* the view keeps the mapping alive */
+      CloseHandle (fileMapping) ;
+      *size = (vl_size) fileSize.QuadPart ;
+    }
+  }
+  CloseHandle (file) ;
+#else
+  struct stat fileStat ;
+  int file = open (fileName, O_RDONLY) ;
+  if (file < 0) return NULL ;
+  if (fstat (file, &fileStat) == 0 && fileStat.st_size > 0) {
+    mapping = mmap (NULL, (size_t) fileStat.st_size, PROT_READ, MAP_SHARED, file, 0) ;
+    if (mapping == MAP_FAILED) {
+      mapping = NULL ;
+    } else {
+      *size = (vl_size) fileStat.st_size ;
+    }
+  }
+  /* the mapping keeps the file alive */
+  close (file) ;
+#endif
+  return mapping ;
+}
+
+static void
+vl_kdforest_unmap_file (void * mapping, vl_size size)
+{
+#if defined(VL_OS_WIN)
+  (void) size ;
+  UnmapViewOfFile (mapping) ;
+#else
+  munmap (mapping, size) ;
+#endif
+}
+
+/* Check that a section of count elements of elementSize bytes
+ * starting at offset is aligned and lies within a file of fileSize
+ * bytes. The test is written so that it cannot overflow. */
+
+static vl_bool
+vl_kdforest_file_has_section (vl_uint64 fileSize, vl_uint64 offset,
+                              vl_uint64 count, vl_uint64 elementSize)
+{
+  return
+    offset % VL_KDFOREST_FILE_ALIGNMENT == 0 &&
+    offset <= fileSize &&
+    elementSize > 0 &&
+    count <= (fileSize - offset) / elementSize ;
+}
+
+/* Check that the mapped nodes and data index of a tree form a valid
+ * tree, so that searching it cannot access memory out of bounds or
+ * loop. The nodes are created (and reordered for the compact
+ * layout) so that children always follow their parent; each node
+ * must have a single parent, internal nodes must split along a
+ * valid dimension, and leaves must refer to a valid range of the
+ * data index, whose entries must refer to valid data points. The
+ * function also recomputes the depth of the tree. */
+
+static vl_bool
+vl_kdforest_file_check_tree (VlKDForestFileHeader const * header,
+                             VlKDTree const * tree,
+                             unsigned int * depth)
+{
+  vl_size const numNodes = tree->numUsedNodes ;
+  unsigned int * nodeDepths = vl_calloc (numNodes, sizeof(unsigned int)) ;
+  vl_bool * hasParent = vl_calloc (numNodes, sizeof(vl_bool)) ;
+  vl_bool ok = VL_TRUE ;
+  vl_uindex i ;
+
+  *depth = 0 ;
+  for (i = 0 ; ok && i < numNodes ; ++i) {
+    vl_index lowerChild, upperChild ;
+    vl_uindex splitDimension ;
+    if (tree->compactNodes) {
+      lowerChild = tree->compactNodes[i].lowerChild ;
+      upperChild = tree->compactNodes[i].upperChild ;
+      splitDimension = tree->compactNodes[i].splitDimension ;
+    } else {
+      lowerChild = tree->nodes[i].lowerChild ;
+      upperChild = tree->nodes[i].upperChild ;
+      splitDimension = tree->nodes[i].splitDimension ;
+    }
+    if (i > 0 && ! hasParent[i]) {
+      ok = VL_FALSE ;
+    } else if (lowerChild < 0) {
+      /* leaf: the data index entries from -lowerChild-1 to -upperChild-2 */
+      ok = upperChild <= lowerChild &&
+        (vl_uindex) (- (upperChild + 1)) <= header->numData ;
+    } else {
+      ok = (vl_uindex) lowerChild > i && (vl_uindex) lowerChild < numNodes &&
+        upperChild > lowerChild && (vl_uindex) upperChild < numNodes &&
+        ! hasParent[lowerChild] && ! hasParent[upperChild] &&
+        splitDimension < header->dimension ;
+      if (ok) {
+        hasParent[lowerChild] = VL_TRUE ;
+        hasParent[upperChild] = VL_TRUE ;
+        nodeDepths[lowerChild] = nodeDepths[upperChild] = nodeDepths[i] + 1 ;
+        *depth = VL_MAX(*depth, nodeDepths[i] + 1) ;
+      }
+    }
+  }
+  for (i = 0 ; ok && i < header->numData ; ++i) {
+    vl_index index = tree->dataIndex[i].index ;
+    ok = index >= 0 && (vl_uindex) index < header->numData ;
+  }
+
+  vl_free (hasParent) ;
+  vl_free (nodeDepths) ;
+  return ok ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Load a forest from a file
+ ** @param fileName name of the file.
+ ** @param data indexed data (may be @c NULL).
+ ** @return new KDForest object or @c NULL on failure.
+ **
+ ** The function loads a forest saved by ::vl_kdforest_save. The file
+ ** is mapped in memory rather than read, so that the trees are not
+ ** copied and the pages are shared by all the processes that load
+ ** the same file. The trees are used in place and are never
+ ** modified. Their nodes and data index entries are validated, so
+ ** that a corrupted file is rejected rather than causing out of
+ ** bounds accesses during the search.
+ **
+ ** If @a data is not @c NULL, the forest indexes it, as if it was
+ ** passed to ::vl_kdforest_build; @a data must then contain the same
+ ** points used to build the saved forest. Otherwise, the file must
+ ** contain the data (see ::vl_kdforest_save) and the forest indexes
+ ** the mapped copy.
+ **
+ ** The mapping is released by ::vl_kdforest_delete. On failure, the
+ ** function returns @c NULL and sets the last error
+ ** (::vl_get_last_error) to ::VL_ERR_IO if the file cannot be
+ ** mapped or to ::VL_ERR_BAD_ARG if the file is not valid or was
+ ** saved on an incompatible host.
+ **
+ ** @sa @ref kdtree-persistence
+ **/
+
+VlKDForest *
+vl_kdforest_load (char const * fileName, void const * data)
+{
+  VlKDForestFileHeader const * header ;
+  VlKDForestFileTree const * trees ;
+  VlKDForest * self ;
+  vl_size size = 0 ;
+  vl_uindex ti ;
+  vl_uint64 numNodes ;
+  char * mapping = vl_kdforest_map_file (fileName, &size) ;
+
+  if (mapping == NULL) {
+    vl_set_last_error (VL_ERR_IO, "Could not map KDForest file `%s'", fileName) ;
+    return NULL ;
+  }
+
+  /* validate the header */
+  header = (VlKDForestFileHeader const *) mapping ;
+  if (size < sizeof(VlKDForestFileHeader) ||
+      memcmp (header->magic, VL_KDFOREST_FILE_MAGIC, sizeof(header->magic)) != 0) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "`%s' is not a KDForest file", fileName) ;
+    goto fail ;
+  }
+  if (header->version != VL_KDFOREST_FILE_VERSION) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' has unsupported version %d",
+                       fileName, header->version) ;
+    goto fail ;
+  }
+  if (header->byteOrder != VL_KDFOREST_FILE_BYTE_ORDER ||
+      header->nodeSize != (header->compactLayout ?
+                           sizeof(VlKDTreeCompactNode) : sizeof(VlKDTreeNode)) ||
+      header->dataIndexEntrySize != sizeof(VlKDTreeDataIndexEntry)) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' was saved on an incompatible host",
+                       fileName) ;
+    goto fail ;
+  }
+  if ((header->dataType != VL_TYPE_FLOAT && header->dataType != VL_TYPE_DOUBLE) ||
+      header->distance > VlKernelJS ||
+      header->dimension < 1 || header->numData < 1 || header->numTrees < 1 ||
+      header->fileSize != size ||
+      header->numTrees > (size - sizeof(VlKDForestFileHeader)) / sizeof(VlKDForestFileTree) ||
+      (header->hasData &&
+       (header->dimension > size / vl_get_type_size (header->dataType) ||
+        ! vl_kdforest_file_has_section (size, header->dataOffset, header->numData,
+                                        header->dimension *
+                                        vl_get_type_size (header->dataType))))) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+  if (! header->hasData && data == NULL) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' does not contain the data",
+                       fileName) ;
+    goto fail ;
+  }
+  trees = (VlKDForestFileTree const *) (header + 1) ;
+  numNodes = 0 ;
+  for (ti = 0 ; ti < header->numTrees ; ++ti) {
+    if (trees[ti].numUsedNodes < 1 ||
+        ! vl_kdforest_file_has_section (size, trees[ti].nodesOffset,
+                                        trees[ti].numUsedNodes, header->nodeSize) ||
+        (header->compactLayout &&
+         ! vl_kdforest_file_has_section (size, trees[ti].boundsOffset,
+                                         trees[ti].numUsedNodes, 2 * sizeof(float))) ||
+        ! vl_kdforest_file_has_section (size, trees[ti].dataIndexOffset,
+                                        header->numData, sizeof(VlKDTreeDataIndexEntry))) {
+      vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' is corrupted", fileName) ;
+      goto fail ;
+    }
+    /* each tree fits in the file, so the sum cannot overflow */
+    numNodes += trees[ti].numUsedNodes ;
+  }
+  /* the searchers size their heaps by maxNumNodes */
+  if (header->maxNumNodes != numNodes) {
+    vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' is corrupted", fileName) ;
+    goto fail ;
+  }
+
+  /* create the forest and point it to the mapped trees */
+  self = vl_kdforest_new (header->dataType, header->dimension,
+                          header->numTrees, header->distance) ;
+  self->thresholdingMethod = header->thresholdingMethod ;
+  self->compactLayout = header->compactLayout ;
+  self->numData = header->numData ;
+  self->data = data ? data : mapping + header->dataOffset ;
+  self->maxNumNodes = header->maxNumNodes ;
+  self->mapping = mapping ;
+  self->mappingSize = size ;
+  self->trees = vl_calloc (self->numTrees, sizeof(VlKDTree*)) ;
+  for (ti = 0 ; ti < self->numTrees ; ++ti) {
+    VlKDTree * tree = vl_malloc (sizeof(VlKDTree)) ;
+    if (header->compactLayout) {
+      tree->nodes = NULL ;
+      tree->compactNodes = (VlKDTreeCompactNode *) (mapping + trees[ti].nodesOffset) ;
+      tree->compactBounds = (float *) (mapping + trees[ti].boundsOffset) ;
+    } else {
+      tree->nodes = (VlKDTreeNode *) (mapping + trees[ti].nodesOffset) ;
+      tree->compactNodes = NULL ;
+      tree->compactBounds = NULL ;
+    }
+    tree->dataIndex = (VlKDTreeDataIndexEntry *) (mapping + trees[ti].dataIndexOffset) ;
+    tree->numUsedNodes = trees[ti].numUsedNodes ;
+    tree->numAllocatedNodes = trees[ti].numUsedNodes ;
+    self->trees[ti] = tree ;
+    if (! vl_kdforest_file_check_tree (header, tree, &tree->depth) ||
+        tree->depth != trees[ti].depth) {
+      vl_set_last_error (VL_ERR_BAD_ARG, "KDForest file `%s' is corrupted", fileName) ;
+      vl_kdforest_delete (self) ;
+      return NULL ;
+    }
+  }
+  return self ;
+
+fail:
+  vl_kdforest_unmap_file (mapping, size) ;
+  return NULL ;
+}
@@ -19,8 +19,17 @@ the terms of the BSD license (see the COPYING file).
 
 #define VL_KDTREE_SPLIT_HEAP_SIZE 5
 #define VL_KDTREE_VARIANCE_EST_NUM_SAMPLES 1024
+/** @brief Subsets of at most this size are built by a single thread */
+#define VL_KDTREE_BUILD_TASK_MIN_NUM_DATA 4096
+/** @brief Number of queries processed together by ::vl_kdforest_query_batch */
+#define VL_KDFOREST_BATCH_NUM_QUERIES 256
+/** @brief Number of data points compared to a query in each tree by ::vl_kdforest_query_batch */
+#define VL_KDFOREST_BATCH_BUCKET_SIZE 32
+/** @brief Number of bins of the histograms of ::VlKDForestSearchStatistics */
+#define VL_KDFOREST_STATISTICS_NUM_BINS 32
 
 typedef struct _VlKDTreeNode VlKDTreeNode ;
+typedef struct _VlKDTreeCompactNode VlKDTreeCompactNode ;
 typedef struct _VlKDTreeSplitDimension VlKDTreeSplitDimension ;
 typedef struct _VlKDTreeDataIndexEntry VlKDTreeDataIndexEntry ;
 typedef struct _VlKDForestSearchState VlKDForestSearchState ;
@@ -36,6 +45,15 @@ struct _VlKDTreeNode
   double upperBound ;
 } ;
 
+/* Node of a tree with the compact layout (see vl_kdforest_set_compact_layout) */
+struct _VlKDTreeCompactNode
+{
+  vl_int32 lowerChild ;
+  vl_int32 upperChild ;
+  vl_uint32 splitDimension ;
+  float splitThreshold ;
+} ;
+
 struct _VlKDTreeSplitDimension
 {
   unsigned int dimension ;
@@ -62,9 +80,36 @@ typedef struct _VlKDForestNeighbor {
   vl_uindex index ;   /**< index of the neighbor in the KDTree data */
 } VlKDForestNeighbor ;
 
+/** @brief Search statistics of a ::VlKDForest
+ **
+ ** Bin @c b of a histogram counts the queries with a value @c v such
+ ** that @c 2^(b-1) <= v < 2^b (bin 0 counts the queries with @c v
+ ** equal to zero and the last bin the larger values).
+ **/
+typedef struct _VlKDForestSearchStatistics {
+  vl_size numQueries ;           /**< number of queries */
+  vl_size numComparisons ;       /**< total number of comparisons */
+  vl_size numRecursions ;        /**< total number of visited nodes */
+  vl_size numSimplifications ;   /**< total number of pruned search states */
+  vl_size maxHeapSize ;          /**< largest size of the search heap */
+  vl_size comparisonsHistogram [VL_KDFOREST_STATISTICS_NUM_BINS] ; /**< comparisons per query */
+  vl_size recursionsHistogram [VL_KDFOREST_STATISTICS_NUM_BINS] ;  /**< visited nodes per query */
+  vl_size heapSizeHistogram [VL_KDFOREST_STATISTICS_NUM_BINS] ;    /**< largest heap size per query */
+} VlKDForestSearchStatistics ;
+
+/** @brief Search parameters selected by ::vl_kdforest_tune */
+typedef struct _VlKDForestTuning {
+  vl_size numTrees ;            /**< number of trees */
+  vl_size maxNumComparisons ;   /**< maximum number of comparisons (0 for exact search) */
+  double recall ;               /**< recall on the tuning queries */
+  double queryTime ;            /**< processor time per query (seconds) */
+} VlKDForestTuning ;
+
 typedef struct _VlKDTree
 {
   VlKDTreeNode * nodes ;
+  VlKDTreeCompactNode * compactNodes ;
+  float * compactBounds ;
   vl_size numUsedNodes ;
   vl_size numAllocatedNodes ;
   VlKDTreeDataIndexEntry * dataIndex ;
@@ -95,14 +140,18 @@ typedef struct _VlKDForest
   VlVectorComparisonType distance;
   void (*distanceFunction)(void) ;
 
+  /* copy of the data in the leaf order of the first tree (see vl_kdforest_set_data_reordering) */
+  void const * originalData ;
+  vl_uindex * dataOrder ;
+
   /* tree structure */
   VlKDTree ** trees ;
   vl_size numTrees ;
 
   /* build */
   VlKDTreeThresholdingMethod thresholdingMethod ;
-  VlKDTreeSplitDimension splitHeapArray [VL_KDTREE_SPLIT_HEAP_SIZE] ;
-  vl_size splitHeapNumNodes ;
+  vl_bool compactLayout ;
+  vl_bool dataReordering ;
   vl_size splitHeapSize ;
   vl_size maxNumNodes;
 
@@ -111,6 +160,13 @@ typedef struct _VlKDForest
   vl_size numSearchers;
   struct _VlKDForestSearcher * headSearcher ;  /* head of the double linked list with searchers */
 
+  /* memory mapped file (see vl_kdforest_load) */
+  void * mapping ;
+  vl_size mappingSize ;
+
+  /* statistics of the deleted searchers */
+  VlKDForestSearchStatistics searchStatistics ;
+
 } VlKDForest ;
 
 /** @brief ::VlKDForest searcher object */
@@ -129,7 +185,15 @@ typedef struct _VlKDForestSearcher
   vl_size searchNumSimplifications ;
 
   vl_size searchHeapNumNodes ;
+  vl_size searchMaxHeapNumNodes ;
   vl_uindex searchId ;
+
+  VlKDForestSearchStatistics statistics ;
+
+  /* results of the range queries */
+  VlKDForestNeighbor * rangeNeighbors ;
+  vl_size rangeNumNeighbors ;
+  vl_size rangeNumAllocatedNeighbors ;
 } VlKDForestSearcher ;
 
 /** @name Creating, copying and disposing
@@ -159,10 +223,61 @@ VL_EXPORT vl_size vl_kdforest_query_with_array (VlKDForest * self,
                                                 void * distance,
                                                 void const * queries) ;
 
+VL_EXPORT vl_size vl_kdforest_query_batch (VlKDForest * self,
+                                           vl_uint32 * index,
+                                           vl_size numNeighbors,
+                                           vl_size numQueries,
+                                           void * distance,
+                                           void const * queries) ;
+
 VL_EXPORT vl_size vl_kdforestsearcher_query (VlKDForestSearcher * self,
                                              VlKDForestNeighbor * neighbors,
                                              vl_size numNeighbors,
                                              void const * query) ;
+
+VL_EXPORT vl_size vl_kdforest_query_range (VlKDForest * self,
+                                           VlKDForestNeighbor const ** neighbors,
+                                           double radius,
+                                           void const * query) ;
+
+VL_EXPORT vl_size vl_kdforestsearcher_query_range (VlKDForestSearcher * self,
+                                                   VlKDForestNeighbor const ** neighbors,
+                                                   double radius,
+                                                   void const * query) ;
+
+VL_EXPORT vl_size vl_kdforest_query_range_with_array (VlKDForest * self,
+                                                      vl_size * offsets,
+                                                      vl_uint32 ** indexes,
+                                                      void ** distances,
+                                                      double radius,
+                                                      vl_size numQueries,
+                                                      void const * queries) ;
+/** @} */
+
+/** @name Statistics and tuning
+ ** @{ */
+VL_EXPORT VlKDForestSearchStatistics const *
+vl_kdforestsearcher_get_statistics (VlKDForestSearcher const * self) ;
+VL_EXPORT void vl_kdforestsearcher_reset_statistics (VlKDForestSearcher * self) ;
+VL_EXPORT void vl_kdforest_get_search_statistics (VlKDForest const * self,
+                                                  VlKDForestSearchStatistics * statistics) ;
+VL_EXPORT void vl_kdforest_reset_search_statistics (VlKDForest * self) ;
+VL_EXPORT void vl_kdforest_tune (VlKDForest * self,
+                                 VlKDForestTuning * tuning,
+                                 vl_size numNeighbors,
+                                 double targetRecall,
+                                 vl_size maxNumTrees,
+                                 vl_size numQueries,
+                                 void const * queries) ;
+/** @} */
+
+/** @name Saving and loading
+ ** @{ */
+VL_EXPORT int vl_kdforest_save (VlKDForest const * self,
+                                char const * fileName,
+                                vl_bool saveData) ;
+VL_EXPORT VlKDForest * vl_kdforest_load (char const * fileName,
+                                         void const * data) ;
 /** @} */
 
 /** @name Retrieving and setting parameters
@@ -176,6 +291,10 @@ VL_EXPORT void vl_kdforest_set_max_num_comparisons (VlKDForest * self, vl_size n
 VL_EXPORT vl_size vl_kdforest_get_max_num_comparisons (VlKDForest * self) ;
 VL_EXPORT void vl_kdforest_set_thresholding_method (VlKDForest * self, VlKDTreeThresholdingMethod method) ;
 VL_EXPORT VlKDTreeThresholdingMethod vl_kdforest_get_thresholding_method (VlKDForest const * self) ;
+VL_EXPORT void vl_kdforest_set_compact_layout (VlKDForest * self, vl_bool compact) ;
+VL_EXPORT vl_bool vl_kdforest_get_compact_layout (VlKDForest const * self) ;
+VL_EXPORT void vl_kdforest_set_data_reordering (VlKDForest * self, vl_bool reorder) ;
+VL_EXPORT vl_bool vl_kdforest_get_data_reordering (VlKDForest const * self) ;
 VL_EXPORT VlKDForest * vl_kdforest_searcher_get_forest (VlKDForestSearcher const * self) ;
 VL_EXPORT VlKDForestSearcher * vl_kdforest_get_searcher (VlKDForest const * self, vl_uindex pos) ;
 /** @} */
@@ -20,6 +20,7 @@ the terms of the BSD license (see the COPYING file).
 #include "random.h"
 #include "mathop.h"
 #include "kdtree.h"
+#include "kmtree.h"
 
 /* ---------------------------------------------------------------- */
 
@@ -28,16 +29,40 @@ the terms of the BSD license (see the COPYING file).
 typedef enum _VlKMeansAlgorithm {
   VlKMeansLloyd,       /**< Lloyd algorithm */
   VlKMeansElkan,       /**< Elkan algorithm */
-  VlKMeansANN          /**< Approximate nearest neighbors */
+  VlKMeansANN,         /**< Approximate nearest neighbors */
+  VlKMeansMiniBatch,   /**< Mini-batch algorithm */
+  VlKMeansHamerly,     /**< Hamerly algorithm */
+  VlKMeansYinyang      /**< Yinyang algorithm */
 } VlKMeansAlgorithm ;
 
+/** @brief Indexes used by the K-means ANN algorithm */
+
+typedef enum _VlKMeansANNIndex {
+  VlKMeansANNKDForest,   /**< Randomized KD-tree forest */
+  VlKMeansANNKMeansTree  /**< Priority search k-means tree */
+} VlKMeansANNIndex ;
+
 /** @brief K-means initialization algorithms */
 
 typedef enum _VlKMeansInitialization {
   VlKMeansRandomSelection,  /**< Randomized selection */
-  VlKMeansPlusPlus          /**< Plus plus raondomized selection */
+  VlKMeansPlusPlus,         /**< Plus plus raondomized selection */
+  VlKMeansParallelPlusPlus  /**< Oversampling plus plus selection (k-means||) */
 } VlKMeansInitialization ;
 
+/** @brief Function reading data for out-of-core K-means
+ ** @param buffer buffer receiving the data (output).
+ ** @param begin index of the first data point to read.
+ ** @param numData number of data points to read.
+ ** @param userData user data.
+ ** @sa vl_kmeans_refine_centers_with_reader
+ **/
+
+typedef void (*VlKMeansReadFunction) (void * buffer,
+                                      vl_uindex begin,
+                                      vl_size numData,
+                                      void * userData) ;
+
 /** ------------------------------------------------------------------
  ** @brief K-means quantizer
  **/
@@ -48,8 +73,11 @@ typedef struct _VlKMeans
   vl_type dataType ;                      /**< Data type. */
   vl_size dimension ;                     /**< Data dimensionality. */
   vl_size numCenters ;                    /**< Number of centers. */
+  VlKMeansANNIndex annIndex ;             /**< Index of the centers when using ANN-kmeans. */
   vl_size numTrees ;                      /**< Number of trees in forest when using ANN-kmeans. */
   vl_size maxNumComparisons ;             /**< Maximum number of comparisons when using ANN-kmeans. */
+  vl_size batchSize ;                     /**< Batch size when using mini-batch kmeans. */
+  vl_size numCenterGroups ;               /**< Number of center groups when using Yinyang kmeans. */
 
   VlKMeansInitialization initialization ; /**< Initalization algorithm. */
   VlKMeansAlgorithm algorithm ;           /**< Clustring algorithm. */
@@ -57,10 +85,13 @@ typedef struct _VlKMeans
   vl_size maxNumIterations ;              /**< Maximum number of refinement iterations. */
   double minEnergyVariation ;             /**< Minimum energy variation. */
   vl_size numRepetitions ;                /**< Number of clustering repetitions. */
+  vl_bool parallelRepetitions ;           /**< Whether repetitions run concurrently. */
   int verbosity ;                         /**< Verbosity level. */
 
   void * centers ;                        /**< Centers */
   void * centerDistances ;                /**< Centers inter-distances. */
+  VlKDForest * forest ;                   /**< KD-forest indexing the centers (ANN). */
+  VlKMTree * kmtree ;                     /**< K-means tree indexing the centers (ANN). */
 
   double energy ;                         /**< Current solution energy. */
   VlFloatVectorComparisonFunction floatVectorComparisonFn ;
@@ -97,7 +128,40 @@ VL_EXPORT void vl_kmeans_quantize_ANN (VlKMeans * self,
                                    void * distances,
                                    void const * data,
                                    vl_size numData,
-                                   vl_size iteration );
+                                   vl_bool update) ;
+
+VL_EXPORT void vl_kmeans_quantize_k (VlKMeans * self,
+                                     vl_uint32 * assignments,
+                                     void * distances,
+                                     void const * data,
+                                     vl_size numData,
+                                     vl_size numNeighbors) ;
+
+VL_EXPORT void vl_kmeans_quantize_k_ANN (VlKMeans * self,
+                                         vl_uint32 * assignments,
+                                         void * distances,
+                                         void const * data,
+                                         vl_size numData,
+                                         vl_size numNeighbors) ;
+
+VL_EXPORT double vl_kmeans_cluster_with_reader (VlKMeans * self,
+                                                VlKMeansReadFunction read,
+                                                void * userData,
+                                                vl_size dimension,
+                                                vl_size numData,
+                                                vl_size numCenters) ;
+
+VL_EXPORT double vl_kmeans_cluster_ui8 (VlKMeans * self,
+                                        vl_uint8 const * data,
+                                        vl_size dimension,
+                                        vl_size numData,
+                                        vl_size numCenters) ;
+
+VL_EXPORT void vl_kmeans_quantize_ui8 (VlKMeans * self,
+                                       vl_uint32 * assignments,
+                                       void * distances,
+                                       vl_uint8 const * data,
+                                       vl_size numData) ;
 /** @} */
 
 /** @name Advanced data processing
@@ -122,10 +186,26 @@ VL_EXPORT void vl_kmeans_init_centers_plus_plus
                    vl_size numData,
                    vl_size numCenters) ;
 
+VL_EXPORT void vl_kmeans_init_centers_parallel_plus_plus
+                  (VlKMeans * self,
+                   void const * data,
+                   vl_size dimensions,
+                   vl_size numData,
+                   vl_size numCenters) ;
+
 VL_EXPORT double vl_kmeans_refine_centers (VlKMeans * self,
                                            void const * data,
                                            vl_size numData) ;
 
+VL_EXPORT double vl_kmeans_refine_centers_with_reader (VlKMeans * self,
+                                                       VlKMeansReadFunction read,
+                                                       void * userData,
+                                                       vl_size numData) ;
+
+VL_EXPORT double vl_kmeans_refine_centers_ui8 (VlKMeans * self,
+                                               vl_uint8 const * data,
+                                               vl_size numData) ;
+
 /** @} */
 
 /** @name Retrieve data and parameters
@@ -137,6 +217,7 @@ VL_INLINE VlVectorComparisonType vl_kmeans_get_distance (VlKMeans const * self)
 VL_INLINE VlKMeansAlgorithm vl_kmeans_get_algorithm (VlKMeans const * self) ;
 VL_INLINE VlKMeansInitialization vl_kmeans_get_initialization (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_num_repetitions (VlKMeans const * self) ;
+VL_INLINE vl_bool vl_kmeans_get_parallel_repetitions (VlKMeans const * self) ;
 
 VL_INLINE vl_size vl_kmeans_get_dimension (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_num_centers (VlKMeans const * self) ;
@@ -145,7 +226,10 @@ VL_INLINE int vl_kmeans_get_verbosity (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_max_num_iterations (VlKMeans const * self) ;
 VL_INLINE double vl_kmeans_get_min_energy_variation (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_max_num_comparisons (VlKMeans const * self) ;
+VL_INLINE VlKMeansANNIndex vl_kmeans_get_ann_index (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_num_trees (VlKMeans const * self) ;
+VL_INLINE vl_size vl_kmeans_get_batch_size (VlKMeans const * self) ;
+VL_INLINE vl_size vl_kmeans_get_num_center_groups (VlKMeans const * self) ;
 VL_INLINE double vl_kmeans_get_energy (VlKMeans const * self) ;
 VL_INLINE void const * vl_kmeans_get_centers (VlKMeans const * self) ;
 /** @} */
@@ -156,11 +240,15 @@ VL_INLINE void const * vl_kmeans_get_centers (VlKMeans const * self) ;
 VL_INLINE void vl_kmeans_set_algorithm (VlKMeans * self, VlKMeansAlgorithm algorithm) ;
 VL_INLINE void vl_kmeans_set_initialization (VlKMeans * self, VlKMeansInitialization initialization) ;
 VL_INLINE void vl_kmeans_set_num_repetitions (VlKMeans * self, vl_size numRepetitions) ;
+VL_INLINE void vl_kmeans_set_parallel_repetitions (VlKMeans * self, vl_bool parallelRepetitions) ;
 VL_INLINE void vl_kmeans_set_max_num_iterations (VlKMeans * self, vl_size maxNumIterations) ;
 VL_INLINE void vl_kmeans_set_min_energy_variation (VlKMeans * self, double minEnergyVariation) ;
 VL_INLINE void vl_kmeans_set_verbosity (VlKMeans * self, int verbosity) ;
 VL_INLINE void vl_kmeans_set_max_num_comparisons (VlKMeans * self, vl_size maxNumComparisons) ;
+VL_INLINE void vl_kmeans_set_ann_index (VlKMeans * self, VlKMeansANNIndex annIndex) ;
 VL_INLINE void vl_kmeans_set_num_trees (VlKMeans * self, vl_size numTrees) ;
+VL_INLINE void vl_kmeans_set_batch_size (VlKMeans * self, vl_size batchSize) ;
+VL_INLINE void vl_kmeans_set_num_center_groups (VlKMeans * self, vl_size numCenterGroups) ;
 /** @} */
 
 /** ------------------------------------------------------------------
@@ -303,6 +391,32 @@ vl_kmeans_set_num_repetitions (VlKMeans * self,
   self->numRepetitions = numRepetitions ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get whether repetitions run concurrently.
+ ** @param self KMeans object instance.
+ ** @return ::VL_TRUE if the repetitions run concurrently.
+ **/
+
+VL_INLINE vl_bool
+vl_kmeans_get_parallel_repetitions (VlKMeans const * self)
+{
+  return self->parallelRepetitions ;
+}
+
+/** @brief Set whether repetitions run concurrently.
+ ** @param self KMeans object instance.
+ ** @param parallelRepetitions ::VL_TRUE to run the repetitions concurrently.
+ **
+ ** See ::vl_kmeans_cluster for details.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_parallel_repetitions (VlKMeans * self,
+                                    vl_bool parallelRepetitions)
+{
+  self->parallelRepetitions = parallelRepetitions ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Get the minimum relative energy variation for convergence.
  ** @param self KMeans object instance.
@@ -412,6 +526,38 @@ vl_kmeans_set_max_num_comparisons (VlKMeans * self,
     self->maxNumComparisons = maxNumComparisons;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get the index used by the ANN algorithm
+ ** @param self KMeans object instance.
+ ** @return index type.
+ **/
+
+VL_INLINE VlKMeansANNIndex
+vl_kmeans_get_ann_index (VlKMeans const * self)
+{
+  return self->annIndex ;
+}
+
+/** @brief Set the index used by the ANN algorithm
+ ** @param self KMeans object instance.
+ ** @param annIndex index type.
+ **
+ ** The index is used by the ::VlKMeansANN algorithm,
+ ** ::vl_kmeans_quantize_ANN, and ::vl_kmeans_quantize_k_ANN to find
+ ** the centers closest to the data points. The default is a
+ ** randomized KD-tree forest (::VlKMeansANNKDForest) with
+ ** ::vl_kmeans_get_num_trees trees. A priority search k-means tree
+ ** (::VlKMeansANNKMeansTree, see @ref kmtree) is often more accurate
+ ** for high dimensional data. In both cases, the search is limited
+ ** by ::vl_kmeans_set_max_num_comparisons.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_ann_index (VlKMeans * self, VlKMeansANNIndex annIndex)
+{
+  self->annIndex = annIndex ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Set the number of trees in the KD-forest ANN algorithm
  ** @param self KMeans object instance.
@@ -430,6 +576,61 @@ vl_kmeans_get_num_trees (VlKMeans const * self)
     return self->numTrees;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get the batch size of the mini-batch algorithm.
+ ** @param self KMeans object instance.
+ ** @return number of data points per batch.
+ **/
+
+VL_INLINE vl_size
+vl_kmeans_get_batch_size (VlKMeans const * self)
+{
+  return self->batchSize ;
+}
+
+/** @brief Set the batch size of the mini-batch algorithm.
+ ** @param self KMeans object instance.
+ ** @param batchSize number of data points per batch.
+ ** The batch size cannot be smaller than 1.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_batch_size (VlKMeans * self, vl_size batchSize)
+{
+  assert (batchSize >= 1) ;
+  self->batchSize = batchSize ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of center groups of the Yinyang algorithm.
+ ** @param self KMeans object instance.
+ ** @return number of center groups.
+ **
+ ** A value of zero means that the number of groups is chosen
+ ** automatically (see ::vl_kmeans_set_num_center_groups).
+ **/
+
+VL_INLINE vl_size
+vl_kmeans_get_num_center_groups (VlKMeans const * self)
+{
+  return self->numCenterGroups ;
+}
+
+/** @brief Set the number of center groups of the Yinyang algorithm.
+ ** @param self KMeans object instance.
+ ** @param numCenterGroups number of center groups.
+ **
+ ** The Yinyang algorithm stores one lower bound per data point and
+ ** center group. Setting @a numCenterGroups to zero (default)
+ ** uses a tenth of the number of centers, but no more than 256
+ ** groups.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_num_center_groups (VlKMeans * self, vl_size numCenterGroups)
+{
+  self->numCenterGroups = numCenterGroups ;
+}
 
 /* VL_IKMEANS_H */
 #endif
@@ -0,0 +1,826 @@
+/** @file kmtree.c
+ ** @brief Priority search k-means tree - Definition
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+/**
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@page kmtree Priority search k-means trees
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+@ref kmtree.h implements the priority search k-means tree of
+@cite{muja09fast}, an index for approximate nearest neighbor search
+which is an alternative to the randomized KD-tree forests of @ref
+kdtree. KD-trees split the data along one dimension at a time and
+become less effective as the dimension of the data grows, while
+k-means trees split the data by clustering, which adapts to the
+intrinsic dimension of the data. Thus k-means trees are often better
+for high dimensional data such as Fisher and VLAD encodings.
+
+- @ref kmtree-overview
+- @ref kmtree-tech
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section kmtree-overview Overview
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+The API mirrors the one of ::VlKDForest, so that the two indexes can
+be used interchangeably. To create a ::VlKMTree object use
+::vl_kmtree_new specifying the data type and dimension, the
+branching factor of the tree, and the distance. To index some data
+use ::vl_kmtree_build. As for ::VlKDForest, the data is not copied
+and must exist until the tree is deleted by ::vl_kmtree_delete.
+
+To find the nearest neighbors of a query use ::vl_kmtree_query or,
+from multiple threads, a ::VlKMTreeSearcher created by
+::vl_kmtree_new_searcher and ::vl_kmtreesearcher_query. The
+neighbors are returned as ::VlKDForestNeighbor records.
+::vl_kmtree_query_with_array processes many queries in parallel.
+The search is approximate if a maximum number of comparisons is set
+by ::vl_kmtree_set_max_num_comparisons.
+
+::VlKMeans can use a k-means tree instead of a KD-tree forest to
+accelerate the ANN algorithm and ::vl_kmeans_quantize_ANN (see
+::vl_kmeans_set_ann_index).
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@section kmtree-tech Technical details
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+<b>Construction.</b> The data is clustered by ::VlKMeans in as many
+clusters as the branching factor, and each cluster is clustered
+recursively. A node with no more points than the branching factor is
+a leaf. Each point is assigned to the cluster with the closest
+center, so that the clusters of the children of a node are the cells
+of the Voronoi diagram of their centers, restricted to the cell of
+the node. The children of a node are stored contiguously, together
+with their centers.
+
+<b>Querying.</b> A query descends the tree by moving to the child
+with the center closest to the query, until a leaf is reached and its
+points are compared to the query. The other children encountered
+along the way are stored in a priority queue, ordered by the distance
+of their center to the query. The search continues from the best
+child in the queue until the maximum number of comparisons is
+reached or the queue is empty. As for ::VlKDForest, only the
+comparisons with the data points count towards the maximum, while
+the comparisons with the centers do not.
+
+For the ::VlDistanceL2 distance, a point in the cell of a child @f$
+c @f$ is not closer to the query @f$ q @f$ than the hyperplane
+separating the cells of @f$ c @f$ and of the child @f$ c^* @f$
+closest to the query, which is at distance
+@f[
+ \frac{\|q - c\|^2 - \|q - c^*\|^2}{2 \|c - c^*\|}
+@f]
+from @f$ q @f$. Children whose lower bound is larger than the distance
+of the current neighbors are skipped, so that the search without a
+maximum number of comparisons is exact and yet does not visit all the
+points. For the other distances, no child is skipped.
+**/
+
+#include "kmtree.h"
+#include "kmeans.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define VL_HEAP_prefix     vl_kmtree_search_heap
+#define VL_HEAP_type       VlKMTreeSearchState
+#define VL_HEAP_cmp(v,x,y) (v[x].distance - v[y].distance)
+#include "heap-def.h"
+
+#define VL_HEAP_prefix     vl_kmtree_neighbor_heap
+#define VL_HEAP_type       VlKDForestNeighbor
+#define VL_HEAP_cmp(v,x,y) (v[y].distance - v[x].distance)
+#include "heap-def.h"
+
+/** ------------------------------------------------------------------
+ ** @brief Create new k-means tree
+ ** @param dataType type of data (::VL_TYPE_FLOAT or ::VL_TYPE_DOUBLE)
+ ** @param dimension data dimensionality.
+ ** @param branching maximum number of children of a node.
+ ** @param distance type of distance norm (::VlDistanceL1 or ::VlDistanceL2).
+ ** @return new k-means tree.
+ **
+ ** The data dimension @a dimension must not be smaller than one and
+ ** the branching factor @a branching must not be smaller than two.
+ **/
+
+VlKMTree *
+vl_kmtree_new (vl_type dataType,
+               vl_size dimension, vl_size branching,
+               VlVectorComparisonType distance)
+{
+  VlKMTree * self = vl_calloc (sizeof(VlKMTree), 1) ;
+
+  assert(dataType == VL_TYPE_FLOAT || dataType == VL_TYPE_DOUBLE) ;
+  assert(dimension >= 1) ;
+  assert(branching >= 2) ;
+
+  self->dataType = dataType ;
+  self->dimension = dimension ;
+  self->branching = branching ;
+  self->distance = distance ;
+  self->maxNumIterations = 11 ;
+  self->searchMaxNumComparisons = 0 ;
+
+  switch (self->dataType) {
+    case VL_TYPE_FLOAT:
+      self->distanceFunction = (void(*)(void))
+      vl_get_vector_comparison_function_f (distance) ;
+      break;
+    case VL_TYPE_DOUBLE :
+      self->distanceFunction = (void(*)(void))
+      vl_get_vector_comparison_function_d (distance) ;
+      break ;
+    default :
+      abort() ;
+  }
+  return self ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Create a k-means tree searcher object
+ ** @param tree k-means tree.
+ ** @return searcher object.
+ **
+ ** A searcher holds the state of a query, so that different threads
+ ** can query the same tree by using different searchers. Differently
+ ** from the searchers of a ::VlKDForest, the searchers must be
+ ** deleted by ::vl_kmtreesearcher_delete before the tree. The tree
+ ** must be built before the searcher is created.
+ **/
+
+VlKMTreeSearcher *
+vl_kmtree_new_searcher (VlKMTree * tree)
+{
+  VlKMTreeSearcher * self = vl_calloc (sizeof(VlKMTreeSearcher), 1) ;
+  assert (tree->nodes) ;
+  self->tree = tree ;
+  self->searchHeapArray = vl_malloc (sizeof(VlKMTreeSearchState) * tree->numNodes) ;
+  self->childDistances = vl_malloc (sizeof(double) * tree->branching) ;
+  return self ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete searcher object
+ ** @param self object.
+ **/
+
+void
+vl_kmtreesearcher_delete (VlKMTreeSearcher * self)
+{
+  vl_free (self->searchHeapArray) ;
+  vl_free (self->childDistances) ;
+  vl_free (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete k-means tree
+ ** @param self k-means tree to delete.
+ ** @sa ::vl_kmtree_new
+ **/
+
+void
+vl_kmtree_delete (VlKMTree * self)
+{
+  if (self->searcher) vl_kmtreesearcher_delete (self->searcher) ;
+  if (self->nodes) vl_free (self->nodes) ;
+  if (self->centers) vl_free (self->centers) ;
+  if (self->centerDistances) vl_free (self->centerDistances) ;
+  if (self->dataIndex) vl_free (self->dataIndex) ;
+  vl_free (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Compute the distance between two vectors
+ **/
+
+VL_INLINE double
+vl_kmtree_compare (VlKMTree const * self, void const * x, void const * y)
+{
+  switch (self->dataType) {
+    case VL_TYPE_FLOAT:
+      return ((VlFloatVectorComparisonFunction)self->distanceFunction)
+             (self->dimension, x, y) ;
+    case VL_TYPE_DOUBLE:
+      return ((VlDoubleVectorComparisonFunction)self->distanceFunction)
+             (self->dimension, x, y) ;
+    default:
+      abort() ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Add children to a node
+ ** @param self object.
+ ** @param nodeIndex node.
+ ** @param numChildren number of children.
+ **
+ ** The function allocates the children and the matrix of the
+ ** distances between their centers.
+ **/
+
+static void
+vl_kmtree_add_children (VlKMTree * self, vl_uindex nodeIndex, vl_size numChildren)
+{
+  vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+  VlKMTreeNode * node ;
+  vl_uindex i ;
+
+  if (self->numNodes + numChildren > self->numAllocatedNodes) {
+    self->numAllocatedNodes = VL_MAX(2 * self->numAllocatedNodes,
+                                     self->numNodes + numChildren) ;
+    self->nodes = vl_realloc (self->nodes, sizeof(VlKMTreeNode) * self->numAllocatedNodes) ;
+    self->centers = vl_realloc (self->centers, pointSize * self->numAllocatedNodes) ;
+  }
+  if (self->numCenterDistances + numChildren * numChildren >
+      self->numAllocatedCenterDistances) {
+    self->numAllocatedCenterDistances =
+      VL_MAX(2 * self->numAllocatedCenterDistances,
+             self->numCenterDistances + numChildren * numChildren) ;
+    self->centerDistances = vl_realloc (self->centerDistances,
+                                        sizeof(float) * self->numAllocatedCenterDistances) ;
+  }
+
+  node = self->nodes + nodeIndex ;
+  node->firstChild = self->numNodes ;
+  node->numChildren = numChildren ;
+  node->centerDistancesOffset = self->numCenterDistances ;
+  self->numCenterDistances += numChildren * numChildren ;
+
+  for (i = 0 ; i < numChildren ; ++i) {
+    VlKMTreeNode * child = self->nodes + self->numNodes++ ;
+    child->firstChild = 0 ;
+    child->numChildren = 0 ;
+    child->begin = 0 ;
+    child->end = 0 ;
+    child->centerDistancesOffset = 0 ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Build a subtree
+ ** @param self object.
+ ** @param kmeans k-means object used to split the nodes.
+ ** @param nodeIndex root of the subtree.
+ ** @param depth depth of the node.
+ ** @param buffer buffer to store the data of the node.
+ ** @param assignments buffer to store the cluster assignments.
+ ** @param permutation buffer to store the reordered data index.
+ **/
+
+static void
+vl_kmtree_build_recursively (VlKMTree * self, VlKMeans * kmeans,
+                             vl_uindex nodeIndex, vl_size depth,
+                             void * buffer, vl_uint32 * assignments,
+                             vl_uindex * permutation)
+{
+  vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+  vl_uindex begin = self->nodes[nodeIndex].begin ;
+  vl_uindex end = self->nodes[nodeIndex].end ;
+  vl_size numData = end - begin ;
+  vl_size numChildren = 0 ;
+  vl_size * counts ;
+  vl_uindex * childIndexes ;
+  vl_uindex i, j ;
+  void const * clusterCenters ;
+  float * centerDistances ;
+
+  self->depth = VL_MAX(self->depth, depth) ;
+
+  /* base case: this is a leaf node */
+  if (numData <= self->branching) return ;
+
+  for (i = 0 ; i < numData ; ++i) {
+    memcpy ((char*)buffer + i * pointSize,
+            (char const*)self->data + self->dataIndex[begin + i] * pointSize,
+            pointSize) ;
+  }
+  vl_kmeans_cluster (kmeans, buffer, self->dimension, numData, self->branching) ;
+  vl_kmeans_quantize (kmeans, assignments, NULL, buffer, numData) ;
+  clusterCenters = vl_kmeans_get_centers (kmeans) ;
+
+  /* skip the empty clusters */
+  counts = vl_calloc (sizeof(vl_size), self->branching) ;
+  childIndexes = vl_malloc (sizeof(vl_uindex) * self->branching) ;
+  for (i = 0 ; i < numData ; ++i) counts[assignments[i]] ++ ;
+  for (j = 0 ; j < self->branching ; ++j) {
+    if (counts[j] > 0) childIndexes[j] = numChildren++ ;
+  }
+
+  /* the data cannot be split further (for example, it is all equal) */
+  if (numChildren <= 1) {
+    vl_free (counts) ;
+    vl_free (childIndexes) ;
+    return ;
+  }
+
+  vl_kmtree_add_children (self, nodeIndex, numChildren) ;
+
+  /* sort the data index by child */
+  {
+    vl_uindex firstChild = self->nodes[nodeIndex].firstChild ;
+    vl_uindex offset = begin ;
+    for (j = 0 ; j < self->branching ; ++j) {
+      VlKMTreeNode * child ;
+      if (counts[j] == 0) continue ;
+      child = self->nodes + firstChild + childIndexes[j] ;
+      child->begin = offset ;
+      child->end = offset ;
+      offset += counts[j] ;
+      memcpy ((char*)self->centers + (firstChild + childIndexes[j]) * pointSize,
+              (char const*)clusterCenters + j * pointSize, pointSize) ;
+    }
+    for (i = 0 ; i < numData ; ++i) {
+      VlKMTreeNode * child = self->nodes + firstChild + childIndexes[assignments[i]] ;
+      permutation[child->end++] = self->dataIndex[begin + i] ;
+    }
+    memcpy (self->dataIndex + begin, permutation + begin, sizeof(vl_uindex) * numData) ;
+
+    /* Euclidean distances between the centers (see vl_kmtreesearcher_query) */
+    centerDistances = self->centerDistances + self->nodes[nodeIndex].centerDistancesOffset ;
+    for (i = 0 ; i < numChildren ; ++i) {
+      for (j = 0 ; j < numChildren ; ++j) {
+        double d = 0 ;
+        if (self->distance == VlDistanceL2) {
+          d = sqrt (vl_kmtree_compare (self,
+                                       (char const*)self->centers + (firstChild + i) * pointSize,
+                                       (char const*)self->centers + (firstChild + j) * pointSize)) ;
+        }
+        centerDistances[i * numChildren + j] = (float) d ;
+      }
+    }
+  }
+  vl_free (counts) ;
+  vl_free (childIndexes) ;
+
+  for (i = 0 ; i < numChildren ; ++i) {
+    vl_kmtree_build_recursively (self, kmeans,
+                                 self->nodes[nodeIndex].firstChild + i, depth + 1,
+                                 buffer, assignments, permutation) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Build the k-means tree from data
+ ** @param self object.
+ ** @param numData number of data points.
+ ** @param data pointer to the data.
+ **
+ ** The function builds the tree by clustering the data @a data
+ ** recursively (see @ref kmtree-tech). For efficiency, the tree does
+ ** not make a copy the data, but retains a pointer to it. Therefore
+ ** the data buffer must be valid and unchanged for the lifespan of
+ ** the object. The clustering uses the default random number
+ ** generator (::vl_get_rand).
+ **
+ ** The number of data points @c numData must not be smaller than one.
+ **/
+
+void
+vl_kmtree_build (VlKMTree * self, vl_size numData, void const * data)
+{
+  vl_size pointSize = vl_get_type_size(self->dataType) * self->dimension ;
+  VlKMeans * kmeans ;
+  void * buffer ;
+  vl_uint32 * assignments ;
+  vl_uindex * permutation ;
+  vl_uindex i ;
+
+  assert (data) ;
+  assert (numData >= 1) ;
+  assert (self->nodes == NULL) ;
+
+  self->data = data ;
+  self->numData = numData ;
+  self->depth = 0 ;
+  self->dataIndex = vl_malloc (sizeof(vl_uindex) * numData) ;
+  for (i = 0 ; i < numData ; ++i) self->dataIndex[i] = i ;
+
+  /* the root has no center */
+  self->numAllocatedNodes = 1 ;
+  self->numNodes = 1 ;
+  self->nodes = vl_malloc (sizeof(VlKMTreeNode)) ;
+  self->centers = vl_calloc (pointSize, 1) ;
+  self->nodes[0].firstChild = 0 ;
+  self->nodes[0].numChildren = 0 ;
+  self->nodes[0].begin = 0 ;
+  self->nodes[0].end = numData ;
+  self->nodes[0].centerDistancesOffset = 0 ;
+
+  kmeans = vl_kmeans_new (self->dataType, self->distance) ;
+  vl_kmeans_set_algorithm (kmeans, VlKMeansLloyd) ;
+  vl_kmeans_set_initialization (kmeans, VlKMeansPlusPlus) ;
+  vl_kmeans_set_max_num_iterations (kmeans, self->maxNumIterations) ;
+  vl_kmeans_set_num_repetitions (kmeans, 1) ;
+
+  buffer = vl_malloc (pointSize * numData) ;
+  assignments = vl_malloc (sizeof(vl_uint32) * numData) ;
+  permutation = vl_malloc (sizeof(vl_uindex) * numData) ;
+
+  vl_kmtree_build_recursively (self, kmeans, 0, 0, buffer, assignments, permutation) ;
+
+  vl_free (buffer) ;
+  vl_free (assignments) ;
+  vl_free (permutation) ;
+  vl_kmeans_delete (kmeans) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Descend the tree from a node to a leaf
+ ** @param self searcher.
+ ** @param nodeIndex node.
+ ** @param distanceLowerBound lower bound of the distance of the query to the node points.
+ ** @param neighbors neighbors found so far (a max-heap).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param numAddedNeighbors number of neighbors in @a neighbors (input/output).
+ ** @param query query point.
+ **/
+
+static void
+vl_kmtreesearcher_descend (VlKMTreeSearcher * self,
+                           vl_uindex nodeIndex,
+                           double distanceLowerBound,
+                           VlKDForestNeighbor * neighbors,
+                           vl_size numNeighbors,
+                           vl_size * numAddedNeighbors,
+                           void const * query)
+{
+  VlKMTree const * tree = self->tree ;
+  vl_size pointSize = vl_get_type_size(tree->dataType) * tree->dimension ;
+  VlKMTreeNode const * node = tree->nodes + nodeIndex ;
+  vl_uindex i ;
+
+  while (node->numChildren > 0) {
+    vl_uindex best = 0 ;
+    float const * centerDistances = tree->centerDistances + node->centerDistancesOffset ;
+
+    self->searchNumRecursions ++ ;
+
+    for (i = 0 ; i < node->numChildren ; ++i) {
+      self->childDistances[i] =
+        vl_kmtree_compare (tree, query,
+                           (char const*)tree->centers + (node->firstChild + i) * pointSize) ;
+      if (self->childDistances[i] < self->childDistances[best]) best = i ;
+    }
+
+    for (i = 0 ; i < node->numChildren ; ++i) {
+      VlKMTreeSearchState * searchState ;
+      double bound = distanceLowerBound ;
+      double separation = centerDistances[best * node->numChildren + i] ;
+      if (i == best) continue ;
+      if (separation > 0) {
+        double h = (self->childDistances[i] - self->childDistances[best]) / (2 * separation) ;
+        bound = VL_MAX(bound, h * h) ;
+      }
+      if (*numAddedNeighbors == numNeighbors && neighbors[0].distance < bound) {
+        self->searchNumSimplifications ++ ;
+        continue ;
+      }
+      searchState = self->searchHeapArray + self->searchHeapNumNodes ;
+      searchState->nodeIndex = node->firstChild + i ;
+      searchState->distance = self->childDistances[i] ;
+      searchState->distanceLowerBound = bound ;
+      vl_kmtree_search_heap_push (self->searchHeapArray, &self->searchHeapNumNodes) ;
+    }
+
+    node = tree->nodes + node->firstChild + best ;
+  }
+
+  /* this is a leaf node */
+  for (i = node->begin ;
+       i < node->end &&
+       (tree->searchMaxNumComparisons == 0 ||
+        self->searchNumComparisons < tree->searchMaxNumComparisons) ;
+       ++ i) {
+    vl_uindex di = tree->dataIndex[i] ;
+    double dist = vl_kmtree_compare (tree, query,
+                                     (char const*)tree->data + di * pointSize) ;
+    self->searchNumComparisons += 1 ;
+
+    if (*numAddedNeighbors < numNeighbors) {
+      VlKDForestNeighbor * newNeighbor = neighbors + *numAddedNeighbors ;
+      newNeighbor->index = di ;
+      newNeighbor->distance = dist ;
+      vl_kmtree_neighbor_heap_push (neighbors, numAddedNeighbors) ;
+    } else if (neighbors[0].distance > dist) {
+      neighbors[0].index = di ;
+      neighbors[0].distance = dist ;
+      vl_kmtree_neighbor_heap_update (neighbors, *numAddedNeighbors, 0) ;
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Query the k-means tree
+ ** @param self searcher object.
+ ** @param neighbors list of nearest neighbors found (output).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param query query point.
+ ** @return number of comparisons.
+ **
+ ** The function is the same as ::vl_kdforestsearcher_query. The
+ ** neighbors are sorted by increasing distance. If less than @a
+ ** numNeighbors neighbors are found, the remaining entries of @a
+ ** neighbors have index @c -1 and distance NaN.
+ **/
+
+vl_size
+vl_kmtreesearcher_query (VlKMTreeSearcher * self,
+                         VlKDForestNeighbor * neighbors,
+                         vl_size numNeighbors,
+                         void const * query)
+{
+  VlKMTree const * tree = self->tree ;
+  vl_bool exactSearch = tree->searchMaxNumComparisons == 0 ;
+  vl_size numAddedNeighbors = 0 ;
+  vl_uindex i ;
+
+  assert (neighbors) ;
+  assert (numNeighbors > 0) ;
+  assert (query) ;
+
+  self->searchNumComparisons = 0 ;
+  self->searchNumRecursions = 0 ;
+  self->searchNumSimplifications = 0 ;
+
+  /* put the root node into the search heap */
+  self->searchHeapNumNodes = 0 ;
+  self->searchHeapArray[0].nodeIndex = 0 ;
+  self->searchHeapArray[0].distance = 0 ;
+  self->searchHeapArray[0].distanceLowerBound = 0 ;
+  vl_kmtree_search_heap_push (self->searchHeapArray, &self->searchHeapNumNodes) ;
+
+  /* priority search */
+  while (exactSearch || self->searchNumComparisons < tree->searchMaxNumComparisons) {
+    VlKMTreeSearchState * searchState ;
+    if (self->searchHeapNumNodes == 0) break ;
+    searchState = self->searchHeapArray +
+                  vl_kmtree_search_heap_pop (self->searchHeapArray, &self->searchHeapNumNodes) ;
+    /* the queue is not sorted by lower bound, so the search continues */
+    if (numAddedNeighbors == numNeighbors &&
+        neighbors[0].distance < searchState->distanceLowerBound) {
+      self->searchNumSimplifications ++ ;
+      continue ;
+    }
+    vl_kmtreesearcher_descend (self,
+                               searchState->nodeIndex,
+                               searchState->distanceLowerBound,
+                               neighbors, numNeighbors, &numAddedNeighbors,
+                               query) ;
+  }
+
+  /* sort neighbors by increasing distance */
+  for (i = numAddedNeighbors ; i < numNeighbors ; ++ i) {
+    neighbors[i].index = -1 ;
+    neighbors[i].distance = VL_NAN_F ;
+  }
+  while (numAddedNeighbors) {
+    vl_kmtree_neighbor_heap_pop (neighbors, &numAddedNeighbors) ;
+  }
+  return self->searchNumComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Query the k-means tree
+ ** @param self object.
+ ** @param neighbors list of nearest neighbors found (output).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param query query point.
+ ** @return number of comparisons.
+ **
+ ** The function is the same as ::vl_kmtreesearcher_query, but uses
+ ** a searcher owned by the tree.
+ **/
+
+vl_size
+vl_kmtree_query (VlKMTree * self,
+                 VlKDForestNeighbor * neighbors,
+                 vl_size numNeighbors,
+                 void const * query)
+{
+  if (self->searcher == NULL) {
+    self->searcher = vl_kmtree_new_searcher (self) ;
+  }
+  return vl_kmtreesearcher_query (self->searcher, neighbors, numNeighbors, query) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run multiple queries
+ ** @param self object.
+ ** @param indexes assignments of points.
+ ** @param numNeighbors number of nearest neighbors to be found for each data point
+ ** @param numQueries number of query points.
+ ** @param distances distances of query points.
+ ** @param queries lisf of vectors to use as queries.
+ ** @return number of comparisons.
+ **
+ ** The function is the same as ::vl_kdforest_query_with_array.
+ **
+ ** @sa ::vl_kmtree_query.
+ **/
+
+vl_size
+vl_kmtree_query_with_array (VlKMTree * self,
+                            vl_uint32 * indexes,
+                            vl_size numNeighbors,
+                            vl_size numQueries,
+                            void * distances,
+                            void const * queries)
+{
+  vl_size numComparisons = 0 ;
+  vl_size dataSize = vl_get_type_size (self->dataType) ;
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) num_threads(vl_get_max_threads())
+#endif
+  {
+    vl_index qi ;
+    vl_size thisNumComparisons = 0 ;
+    VlKMTreeSearcher * searcher ;
+    VlKDForestNeighbor * neighbors ;
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      searcher = vl_kmtree_new_searcher (self) ;
+      neighbors = vl_calloc (sizeof(VlKDForestNeighbor), numNeighbors) ;
+    }
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (qi = 0 ; qi < (signed)numQueries ; ++ qi) {
+      vl_uindex ni ;
+      thisNumComparisons += vl_kmtreesearcher_query
+        (searcher, neighbors, numNeighbors,
+         (char const*)queries + qi * self->dimension * dataSize) ;
+      for (ni = 0 ; ni < numNeighbors ; ++ni) {
+        indexes [qi*numNeighbors + ni] = (vl_uint32) neighbors[ni].index ;
+        if (distances) {
+          switch (self->dataType) {
+            case VL_TYPE_FLOAT:
+              *((float*)distances + qi*numNeighbors + ni) = (float) neighbors[ni].distance ;
+              break ;
+            case VL_TYPE_DOUBLE:
+              *((double*)distances + qi*numNeighbors + ni) = neighbors[ni].distance ;
+              break ;
+            default:
+              abort() ;
+          }
+        }
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      numComparisons += thisNumComparisons ;
+      vl_kmtreesearcher_delete (searcher) ;
+      vl_free (neighbors) ;
+    }
+  }
+  return numComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the depth of the tree
+ ** @param self object.
+ ** @return depth of the tree.
+ **/
+
+vl_size
+vl_kmtree_get_depth (VlKMTree const * self)
+{
+  return self->depth ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of nodes of the tree
+ ** @param self object.
+ ** @return number of nodes.
+ **/
+
+vl_size
+vl_kmtree_get_num_nodes (VlKMTree const * self)
+{
+  return self->numNodes ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the branching factor of the tree
+ ** @param self object.
+ ** @return maximum number of children of a node.
+ **/
+
+vl_size
+vl_kmtree_get_branching (VlKMTree const * self)
+{
+  return self->branching ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the dimension of the data
+ ** @param self object.
+ ** @return dimension of the data.
+ **/
+
+vl_size
+vl_kmtree_get_data_dimension (VlKMTree const * self)
+{
+  return self->dimension ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the data type
+ ** @param self object.
+ ** @return data type (one of ::VL_TYPE_FLOAT, ::VL_TYPE_DOUBLE).
+ **/
+
+vl_type
+vl_kmtree_get_data_type (VlKMTree const * self)
+{
+  return self->dataType ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the maximum number of comparisons for a search
+ ** @param self object.
+ ** @param n maximum number of comparisons.
+ **
+ ** A value equal to zero means no limit.
+ **
+ ** @sa ::vl_kdforest_set_max_num_comparisons
+ **/
+
+void
+vl_kmtree_set_max_num_comparisons (VlKMTree * self, vl_size n)
+{
+  self->searchMaxNumComparisons = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of comparisons for a search
+ ** @param self object.
+ ** @return maximum number of comparisons.
+ ** @sa ::vl_kmtree_set_max_num_comparisons.
+ **/
+
+vl_size
+vl_kmtree_get_max_num_comparisons (VlKMTree const * self)
+{
+  return self->searchMaxNumComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the number of k-means iterations used to split a node
+ ** @param self object.
+ ** @param n maximum number of iterations.
+ **
+ ** The value must be set before building the tree. It defaults to
+ ** 11, as in @cite{muja09fast}.
+ **/
+
+void
+vl_kmtree_set_max_num_iterations (VlKMTree * self, vl_size n)
+{
+  assert (n >= 1) ;
+  self->maxNumIterations = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of k-means iterations used to split a node
+ ** @param self object.
+ ** @return maximum number of iterations.
+ ** @sa ::vl_kmtree_set_max_num_iterations.
+ **/
+
+vl_size
+vl_kmtree_get_max_num_iterations (VlKMTree const * self)
+{
+  return self->maxNumIterations ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the tree of a searcher
+ ** @param self object.
+ ** @return tree.
+ **/
+
+VlKMTree *
+vl_kmtreesearcher_get_tree (VlKMTreeSearcher const * self)
+{
+  return self->tree ;
+}
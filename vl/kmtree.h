@@ -0,0 +1,136 @@
+/** @file kmtree.h
+ ** @brief Priority search k-means tree (@ref kmtree)
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_KMTREE_H
+#define VL_KMTREE_H
+
+#include "generic.h"
+#include "mathop.h"
+#include "kdtree.h"
+
+/** @brief Default branching factor of a ::VlKMTree */
+#define VL_KMTREE_DEFAULT_BRANCHING 32
+
+typedef struct _VlKMTreeNode VlKMTreeNode ;
+typedef struct _VlKMTreeSearchState VlKMTreeSearchState ;
+
+struct _VlKMTreeNode
+{
+  vl_uindex firstChild ;            /* index of the first child */
+  vl_size numChildren ;             /* number of children (zero for leaves) */
+  vl_uindex begin ;                 /* first data index entry */
+  vl_uindex end ;                   /* one plus the last data index entry */
+  vl_uindex centerDistancesOffset ; /* distances between the children centers */
+} ;
+
+struct _VlKMTreeSearchState
+{
+  vl_uindex nodeIndex ;
+  double distance ;
+  double distanceLowerBound ;
+} ;
+
+/** @brief Priority search k-means tree */
+typedef struct _VlKMTree
+{
+  vl_size dimension ;
+
+  /* indexed data */
+  vl_type dataType ;
+  void const * data ;
+  vl_size numData ;
+  VlVectorComparisonType distance ;
+  void (*distanceFunction)(void) ;
+
+  /* tree structure */
+  VlKMTreeNode * nodes ;
+  vl_size numNodes ;
+  vl_size numAllocatedNodes ;
+  void * centers ;
+  float * centerDistances ;
+  vl_size numCenterDistances ;
+  vl_size numAllocatedCenterDistances ;
+  vl_uindex * dataIndex ;
+  vl_size depth ;
+
+  /* build */
+  vl_size branching ;
+  vl_size maxNumIterations ;
+
+  /* query */
+  vl_size searchMaxNumComparisons ;
+  struct _VlKMTreeSearcher * searcher ;
+} VlKMTree ;
+
+/** @brief ::VlKMTree searcher object */
+typedef struct _VlKMTreeSearcher
+{
+  VlKMTree * tree ;
+  VlKMTreeSearchState * searchHeapArray ;
+  vl_size searchHeapNumNodes ;
+  double * childDistances ;
+
+  vl_size searchNumComparisons ;
+  vl_size searchNumRecursions ;
+  vl_size searchNumSimplifications ;
+} VlKMTreeSearcher ;
+
+/** @name Creating and disposing
+ ** @{ */
+VL_EXPORT VlKMTree * vl_kmtree_new (vl_type dataType,
+                                    vl_size dimension, vl_size branching,
+                                    VlVectorComparisonType distance) ;
+VL_EXPORT VlKMTreeSearcher * vl_kmtree_new_searcher (VlKMTree * tree) ;
+VL_EXPORT void vl_kmtree_delete (VlKMTree * self) ;
+VL_EXPORT void vl_kmtreesearcher_delete (VlKMTreeSearcher * self) ;
+/** @} */
+
+/** @name Building and querying
+ ** @{ */
+VL_EXPORT void vl_kmtree_build (VlKMTree * self,
+                                vl_size numData,
+                                void const * data) ;
+
+VL_EXPORT vl_size vl_kmtree_query (VlKMTree * self,
+                                   VlKDForestNeighbor * neighbors,
+                                   vl_size numNeighbors,
+                                   void const * query) ;
+
+VL_EXPORT vl_size vl_kmtreesearcher_query (VlKMTreeSearcher * self,
+                                           VlKDForestNeighbor * neighbors,
+                                           vl_size numNeighbors,
+                                           void const * query) ;
+
+VL_EXPORT vl_size vl_kmtree_query_with_array (VlKMTree * self,
+                                              vl_uint32 * indexes,
+                                              vl_size numNeighbors,
+                                              vl_size numQueries,
+                                              void * distances,
+                                              void const * queries) ;
+/** @} */
+
+/** @name Retrieving and setting parameters
+ ** @{ */
+VL_EXPORT vl_size vl_kmtree_get_depth (VlKMTree const * self) ;
+VL_EXPORT vl_size vl_kmtree_get_num_nodes (VlKMTree const * self) ;
+VL_EXPORT vl_size vl_kmtree_get_branching (VlKMTree const * self) ;
+VL_EXPORT vl_size vl_kmtree_get_data_dimension (VlKMTree const * self) ;
+VL_EXPORT vl_type vl_kmtree_get_data_type (VlKMTree const * self) ;
+VL_EXPORT void vl_kmtree_set_max_num_comparisons (VlKMTree * self, vl_size n) ;
+VL_EXPORT vl_size vl_kmtree_get_max_num_comparisons (VlKMTree const * self) ;
+VL_EXPORT void vl_kmtree_set_max_num_iterations (VlKMTree * self, vl_size n) ;
+VL_EXPORT vl_size vl_kmtree_get_max_num_iterations (VlKMTree const * self) ;
+VL_EXPORT VlKMTree * vl_kmtreesearcher_get_tree (VlKMTreeSearcher const * self) ;
+/** @} */
+
+/* VL_KMTREE_H */
+#endif
@@ -624,6 +624,11 @@ typedef float (*VlFloatVector3ComparisonFunction)(vl_size dimension, float const
  **/
 typedef double (*VlDoubleVector3ComparisonFunction)(vl_size dimension, double const * X, double const * Y, double const * Z) ;
 
+/** @typedef VlUInt8VectorComparisonFunction
+ ** @brief Pointer to a function to compare vectors of 8-bit unsigned integers
+ **/
+typedef vl_uint32 (*VlUInt8VectorComparisonFunction)(vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
 /** @brief Vector comparison types */
 enum _VlVectorComparisonType {
   VlDistanceL1,        /**< l1 distance (squared intersection metric) */
@@ -668,6 +673,9 @@ vl_get_vector_comparison_function_f (VlVectorComparisonType type) ;
 VL_EXPORT VlDoubleVectorComparisonFunction
 vl_get_vector_comparison_function_d (VlVectorComparisonType type) ;
 
+VL_EXPORT VlUInt8VectorComparisonFunction
+vl_get_vector_comparison_function_ui8 (VlVectorComparisonType type) ;
+
 VL_EXPORT VlFloatVector3ComparisonFunction
 vl_get_vector_3_comparison_function_f (VlVectorComparisonType type) ;
 
@@ -687,6 +695,16 @@ vl_eval_vector_comparison_on_all_pairs_d (double * result, vl_size dimension,
                                           double const * Y, vl_size numDataY,
                                           VlDoubleVectorComparisonFunction function) ;
 
+VL_EXPORT void
+vl_eval_inner_product_on_all_pairs_f (float * result, vl_size dimension,
+                                      float const * X, vl_size numDataX,
+                                      float const * Y, vl_size numDataY) ;
+
+VL_EXPORT void
+vl_eval_inner_product_on_all_pairs_d (double * result, vl_size dimension,
+                                      double const * X, vl_size numDataX,
+                                      double const * Y, vl_size numDataY) ;
+
 /* ---------------------------------------------------------------- */
 /*                                               Numerical analysis */
 /* ---------------------------------------------------------------- */
@@ -269,6 +269,98 @@ VL_XCAT(_vl_weighted_sigma_avx_, SFX)
   }
 }
 
+VL_EXPORT T
+VL_XCAT(_vl_kernel_l2_avx_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T const * X_vec_end = X_end - VSIZEavx + 1 ;
+  T acc ;
+  VTYPEavx vacc = VSTZavx() ;
+
+  while (X < X_vec_end) {
+    VTYPEavx a = VLDUavx(X) ;
+    VTYPEavx b = VLDUavx(Y) ;
+    vacc = VADDavx(vacc, VMULavx(a, b)) ;
+    X += VSIZEavx ;
+    Y += VSIZEavx ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    acc += a * b ;
+  }
+  return acc ;
+}
+
+/* The inner products are computed in blocks of 2 x 2 pairs of
+ vectors, so that each vector loaded from memory is used twice. */
+
+VL_EXPORT void
+VL_XCAT(_vl_eval_inner_product_on_all_pairs_avx_, SFX)
+(T * result, vl_size dimension,
+ T const * X, vl_size numDataX,
+ T const * Y, vl_size numDataY)
+{
+  vl_size const vecDimension = dimension - dimension % VSIZEavx ;
+  vl_uindex xi, yi, k ;
+
+  for (yi = 0 ; yi + 1 < numDataY ; yi += 2) {
+    T const * Y0 = Y + yi * dimension ;
+    T const * Y1 = Y0 + dimension ;
+    T * R0 = result + yi * numDataX ;
+    T * R1 = R0 + numDataX ;
+    for (xi = 0 ; xi + 1 < numDataX ; xi += 2) {
+      T const * X0 = X + xi * dimension ;
+      T const * X1 = X0 + dimension ;
+      VTYPEavx acc00 = VSTZavx() ;
+      VTYPEavx acc10 = VSTZavx() ;
+      VTYPEavx acc01 = VSTZavx() ;
+      VTYPEavx acc11 = VSTZavx() ;
+      T r00, r10, r01, r11 ;
+      for (k = 0 ; k < vecDimension ; k += VSIZEavx) {
+        VTYPEavx x0 = VLDUavx(X0 + k) ;
+        VTYPEavx x1 = VLDUavx(X1 + k) ;
+        VTYPEavx y0 = VLDUavx(Y0 + k) ;
+        VTYPEavx y1 = VLDUavx(Y1 + k) ;
+        acc00 = VADDavx(acc00, VMULavx(x0, y0)) ;
+        acc10 = VADDavx(acc10, VMULavx(x1, y0)) ;
+        acc01 = VADDavx(acc01, VMULavx(x0, y1)) ;
+        acc11 = VADDavx(acc11, VMULavx(x1, y1)) ;
+      }
+      r00 = VL_XCAT(_vl_vhsum_avx_, SFX)(acc00) ;
+      r10 = VL_XCAT(_vl_vhsum_avx_, SFX)(acc10) ;
+      r01 = VL_XCAT(_vl_vhsum_avx_, SFX)(acc01) ;
+      r11 = VL_XCAT(_vl_vhsum_avx_, SFX)(acc11) ;
+      for ( ; k < dimension ; ++k) {
+        r00 += X0[k] * Y0[k] ;
+        r10 += X1[k] * Y0[k] ;
+        r01 += X0[k] * Y1[k] ;
+        r11 += X1[k] * Y1[k] ;
+      }
+      R0[xi] = r00 ;
+      R0[xi + 1] = r10 ;
+      R1[xi] = r01 ;
+      R1[xi + 1] = r11 ;
+    }
+    if (xi < numDataX) {
+      T const * X0 = X + xi * dimension ;
+      R0[xi] = VL_XCAT(_vl_kernel_l2_avx_, SFX)(dimension, X0, Y0) ;
+      R1[xi] = VL_XCAT(_vl_kernel_l2_avx_, SFX)(dimension, X0, Y1) ;
+    }
+  }
+  if (yi < numDataY) {
+    T const * Y0 = Y + yi * dimension ;
+    T * R0 = result + yi * numDataX ;
+    for (xi = 0 ; xi < numDataX ; ++xi) {
+      R0[xi] = VL_XCAT(_vl_kernel_l2_avx_, SFX)(dimension, X + xi * dimension, Y0) ;
+    }
+  }
+}
+
 /* VL_DISABLE_AVX */
 #endif
 #undef VL_MATHOP_AVX_INSTANTIATING
@@ -54,6 +54,16 @@ VL_EXPORT void
 VL_XCAT(_vl_weighted_mean_avx_, SFX)
 (vl_size dimension, T * MU, T const * X, T const W);
 
+VL_EXPORT T
+VL_XCAT(_vl_kernel_l2_avx_, SFX)
+(vl_size dimension, T const * X, T const * Y);
+
+VL_EXPORT void
+VL_XCAT(_vl_eval_inner_product_on_all_pairs_avx_, SFX)
+(T * result, vl_size dimension,
+ T const * X, vl_size numDataX,
+ T const * Y, vl_size numDataY);
+
 /* ! VL_DISABLE_AVX */
 #endif
 
@@ -0,0 +1,119 @@
+/** @file mathop_avx2.c
+ ** @brief mathop for AVX2 - Definition
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "mathop_avx2.h"
+
+#ifndef VL_DISABLE_AVX2
+
+#if !defined(__AVX2__)
+#error Compiling AVX2 functions but AVX2 does not seem to be supported by the compiler.
+#endif
+
+#include <immintrin.h>
+
+/* Sum the eight 32-bit integers in x. */
+
+VL_INLINE vl_uint32
+_vl_vhsum_avx2_i32 (__m256i x)
+{
+  __m128i y = _mm_add_epi32 (_mm256_castsi256_si128 (x),
+                             _mm256_extracti128_si256 (x, 1)) ;
+  y = _mm_add_epi32 (y, _mm_shuffle_epi32 (y, _MM_SHUFFLE(1, 0, 3, 2))) ;
+  y = _mm_add_epi32 (y, _mm_shuffle_epi32 (y, _MM_SHUFFLE(2, 3, 0, 1))) ;
+  return (vl_uint32) _mm_cvtsi128_si32 (y) ;
+}
+
+/* See mathop_sse2.c. Each iteration processes 32 components, widened
+ * to 16 bits in two halves of 16. */
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_avx2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~(vl_size)31) ;
+  __m256i vacc = _mm256_setzero_si256 () ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m256i dlo = _mm256_sub_epi16
+    (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) X)),
+     _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) Y))) ;
+    __m256i dhi = _mm256_sub_epi16
+    (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) (X + 16))),
+     _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) (Y + 16)))) ;
+    vacc = _mm256_add_epi32 (vacc, _mm256_madd_epi16 (dlo, dlo)) ;
+    vacc = _mm256_add_epi32 (vacc, _mm256_madd_epi16 (dhi, dhi)) ;
+    X += 32 ;
+    Y += 32 ;
+  }
+
+  acc = _vl_vhsum_avx2_i32 (vacc) ;
+  while (X < X_end) {
+    vl_int32 d = (vl_int32) *X++ - (vl_int32) *Y++ ;
+    acc += (vl_uint32) (d * d) ;
+  }
+  return acc ;
+}
+
+VL_EXPORT vl_uint32
+_vl_distance_l1_avx2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~(vl_size)31) ;
+  __m256i vacc = _mm256_setzero_si256 () ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m256i a = _mm256_loadu_si256 ((__m256i const *) X) ;
+    __m256i b = _mm256_loadu_si256 ((__m256i const *) Y) ;
+    vacc = _mm256_add_epi64 (vacc, _mm256_sad_epu8 (a, b)) ;
+    X += 32 ;
+    Y += 32 ;
+  }
+
+  /* the four 64-bit partial sums are smaller than 2^32 */
+  acc = _vl_vhsum_avx2_i32 (vacc) ;
+  while (X < X_end) {
+    vl_int32 d = (vl_int32) *X++ - (vl_int32) *Y++ ;
+    acc += (vl_uint32) VL_MAX(d, -d) ;
+  }
+  return acc ;
+}
+
+VL_EXPORT vl_uint32
+_vl_kernel_l2_avx2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~(vl_size)31) ;
+  __m256i vacc = _mm256_setzero_si256 () ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m256i alo = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) X)) ;
+    __m256i blo = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) Y)) ;
+    __m256i ahi = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) (X + 16))) ;
+    __m256i bhi = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((__m128i const *) (Y + 16))) ;
+    vacc = _mm256_add_epi32 (vacc, _mm256_madd_epi16 (alo, blo)) ;
+    vacc = _mm256_add_epi32 (vacc, _mm256_madd_epi16 (ahi, bhi)) ;
+    X += 32 ;
+    Y += 32 ;
+  }
+
+  acc = _vl_vhsum_avx2_i32 (vacc) ;
+  while (X < X_end) {
+    acc += (vl_uint32) *X++ * (vl_uint32) *Y++ ;
+  }
+  return acc ;
+}
+
+/* ! VL_DISABLE_AVX2 */
+#endif
@@ -0,0 +1,33 @@
+/** @file mathop_avx2.h
+ ** @brief mathop for AVX2
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_MATHOP_AVX2_H
+#define VL_MATHOP_AVX2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX2
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_avx2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+VL_EXPORT vl_uint32
+_vl_distance_l1_avx2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+VL_EXPORT vl_uint32
+_vl_kernel_l2_avx2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+/* ! VL_DISABLE_AVX2 */
+#endif
+
+/* ! VL_MATHOP_AVX2_H */
+#endif
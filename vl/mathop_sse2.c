@@ -26,6 +26,111 @@ the terms of the BSD license (see the COPYING file).
 #define VL_MATHOP_SSE2_INSTANTIATING
 #include "mathop_sse2.c"
 
+/* ---------------------------------------------------------------- */
+/*                                        8-bit unsigned integers */
+/* ---------------------------------------------------------------- */
+
+#ifndef VL_DISABLE_SSE2
+#include <emmintrin.h>
+
+/* Sum the four 32-bit integers in x. */
+
+VL_INLINE vl_uint32
+_vl_vhsum_sse2_i32 (__m128i x)
+{
+  x = _mm_add_epi32 (x, _mm_shuffle_epi32 (x, _MM_SHUFFLE(1, 0, 3, 2))) ;
+  x = _mm_add_epi32 (x, _mm_shuffle_epi32 (x, _MM_SHUFFLE(2, 3, 0, 1))) ;
+  return (vl_uint32) _mm_cvtsi128_si32 (x) ;
+}
+
+/* The squared differences and products of 8-bit integers fit in
+ * 16 bits, so that _mm_madd_epi16 can be used to multiply and add
+ * pairs of them into 32-bit integers. The l1 distance uses the
+ * sum of absolute differences instruction instead. */
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~(vl_size)15) ;
+  __m128i const zero = _mm_setzero_si128 () ;
+  __m128i vacc = _mm_setzero_si128 () ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m128i a = _mm_loadu_si128 ((__m128i const *) X) ;
+    __m128i b = _mm_loadu_si128 ((__m128i const *) Y) ;
+    __m128i dlo = _mm_sub_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero)) ;
+    __m128i dhi = _mm_sub_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero)) ;
+    vacc = _mm_add_epi32 (vacc, _mm_madd_epi16 (dlo, dlo)) ;
+    vacc = _mm_add_epi32 (vacc, _mm_madd_epi16 (dhi, dhi)) ;
+    X += 16 ;
+    Y += 16 ;
+  }
+
+  acc = _vl_vhsum_sse2_i32 (vacc) ;
+  while (X < X_end) {
+    vl_int32 d = (vl_int32) *X++ - (vl_int32) *Y++ ;
+    acc += (vl_uint32) (d * d) ;
+  }
+  return acc ;
+}
+
+VL_EXPORT vl_uint32
+_vl_distance_l1_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~(vl_size)15) ;
+  __m128i vacc = _mm_setzero_si128 () ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m128i a = _mm_loadu_si128 ((__m128i const *) X) ;
+    __m128i b = _mm_loadu_si128 ((__m128i const *) Y) ;
+    vacc = _mm_add_epi64 (vacc, _mm_sad_epu8 (a, b)) ;
+    X += 16 ;
+    Y += 16 ;
+  }
+
+  acc = (vl_uint32) _mm_cvtsi128_si32 (vacc)
+      + (vl_uint32) _mm_cvtsi128_si32 (_mm_srli_si128 (vacc, 8)) ;
+  while (X < X_end) {
+    vl_int32 d = (vl_int32) *X++ - (vl_int32) *Y++ ;
+    acc += (vl_uint32) VL_MAX(d, -d) ;
+  }
+  return acc ;
+}
+
+VL_EXPORT vl_uint32
+_vl_kernel_l2_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~(vl_size)15) ;
+  __m128i const zero = _mm_setzero_si128 () ;
+  __m128i vacc = _mm_setzero_si128 () ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m128i a = _mm_loadu_si128 ((__m128i const *) X) ;
+    __m128i b = _mm_loadu_si128 ((__m128i const *) Y) ;
+    vacc = _mm_add_epi32 (vacc, _mm_madd_epi16 (_mm_unpacklo_epi8 (a, zero),
+                                                _mm_unpacklo_epi8 (b, zero))) ;
+    vacc = _mm_add_epi32 (vacc, _mm_madd_epi16 (_mm_unpackhi_epi8 (a, zero),
+                                                _mm_unpackhi_epi8 (b, zero))) ;
+    X += 16 ;
+    Y += 16 ;
+  }
+
+  acc = _vl_vhsum_sse2_i32 (vacc) ;
+  while (X < X_end) {
+    acc += (vl_uint32) *X++ * (vl_uint32) *Y++ ;
+  }
+  return acc ;
+}
+
+/* VL_DISABLE_SSE2 */
+#endif
+
 /* ---------------------------------------------------------------- */
 /* VL_MATHOP_SSE2_INSTANTIATING */
 #else
@@ -558,6 +663,71 @@ VL_XCAT(_vl_weighted_mean_sse2_, SFX)
   }
 }
 
+/* The inner products are computed in blocks of 2 x 2 pairs of
+ vectors, so that each vector loaded from memory is used twice. */
+
+VL_EXPORT void
+VL_XCAT(_vl_eval_inner_product_on_all_pairs_sse2_, SFX)
+(T * result, vl_size dimension,
+ T const * X, vl_size numDataX,
+ T const * Y, vl_size numDataY)
+{
+  vl_size const vecDimension = dimension - dimension % VSIZE ;
+  vl_uindex xi, yi, k ;
+
+  for (yi = 0 ; yi + 1 < numDataY ; yi += 2) {
+    T const * Y0 = Y + yi * dimension ;
+    T const * Y1 = Y0 + dimension ;
+    T * R0 = result + yi * numDataX ;
+    T * R1 = R0 + numDataX ;
+    for (xi = 0 ; xi + 1 < numDataX ; xi += 2) {
+      T const * X0 = X + xi * dimension ;
+      T const * X1 = X0 + dimension ;
+      VTYPE acc00 = VSTZ() ;
+      VTYPE acc10 = VSTZ() ;
+      VTYPE acc01 = VSTZ() ;
+      VTYPE acc11 = VSTZ() ;
+      T r00, r10, r01, r11 ;
+      for (k = 0 ; k < vecDimension ; k += VSIZE) {
+        VTYPE x0 = VLDU(X0 + k) ;
+        VTYPE x1 = VLDU(X1 + k) ;
+        VTYPE y0 = VLDU(Y0 + k) ;
+        VTYPE y1 = VLDU(Y1 + k) ;
+        acc00 = VADD(acc00, VMUL(x0, y0)) ;
+        acc10 = VADD(acc10, VMUL(x1, y0)) ;
+        acc01 = VADD(acc01, VMUL(x0, y1)) ;
+        acc11 = VADD(acc11, VMUL(x1, y1)) ;
+      }
+      r00 = VL_XCAT(_vl_vhsum_sse2_, SFX)(acc00) ;
+      r10 = VL_XCAT(_vl_vhsum_sse2_, SFX)(acc10) ;
+      r01 = VL_XCAT(_vl_vhsum_sse2_, SFX)(acc01) ;
+      r11 = VL_XCAT(_vl_vhsum_sse2_, SFX)(acc11) ;
+      for ( ; k < dimension ; ++k) {
+        r00 += X0[k] * Y0[k] ;
+        r10 += X1[k] * Y0[k] ;
+        r01 += X0[k] * Y1[k] ;
+        r11 += X1[k] * Y1[k] ;
+      }
+      R0[xi] = r00 ;
+      R0[xi + 1] = r10 ;
+      R1[xi] = r01 ;
+      R1[xi + 1] = r11 ;
+    }
+    if (xi < numDataX) {
+      T const * X0 = X + xi * dimension ;
+      R0[xi] = VL_XCAT(_vl_kernel_l2_sse2_, SFX)(dimension, X0, Y0) ;
+      R1[xi] = VL_XCAT(_vl_kernel_l2_sse2_, SFX)(dimension, X0, Y1) ;
+    }
+  }
+  if (yi < numDataY) {
+    T const * Y0 = Y + yi * dimension ;
+    T * R0 = result + yi * numDataX ;
+    for (xi = 0 ; xi < numDataX ; ++xi) {
+      R0[xi] = VL_XCAT(_vl_kernel_l2_sse2_, SFX)(dimension, X + xi * dimension, Y0) ;
+    }
+  }
+}
+
 /* VL_DISABLE_SSE2 */
 #endif
 #undef VL_MATHOP_SSE2_INSTANTIATING
@@ -17,6 +17,19 @@ the terms of the BSD license (see the COPYING file).
 #ifndef VL_MATHOP_SSE2_H
 #define VL_MATHOP_SSE2_H
 
+#ifndef VL_DISABLE_SSE2
+#include "generic.h"
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+VL_EXPORT vl_uint32
+_vl_distance_l1_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+VL_EXPORT vl_uint32
+_vl_kernel_l2_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+#endif
+
 #undef FLT
 #define FLT VL_TYPE_DOUBLE
 #define VL_MATHOP_SSE2_H_INSTANTIATING
@@ -79,6 +92,12 @@ VL_EXPORT void
 VL_XCAT(_vl_weighted_mean_sse2_, SFX)
 (vl_size dimension, T * MU, T const * X, T const W);
 
+VL_EXPORT void
+VL_XCAT(_vl_eval_inner_product_on_all_pairs_sse2_, SFX)
+(T * result, vl_size dimension,
+ T const * X, vl_size numDataX,
+ T const * Y, vl_size numDataY);
+
 /* ! VL_DISABLE_SSE2 */
 #endif
 #undef VL_MATHOP_SSE2_INSTANTIATING
@@ -144,6 +144,12 @@ contrast. Filtering is controlled by the follow:
  <td>::vl_sift_set_peak_thresh</td>
  <td>increase to eliminate more keypoints</td>
  </tr>
+ <tr>
+ <td>keypoint budget</td>
+ <td> @ref sift-intro-budget </td>
+ <td>::vl_sift_set_max_nkeypoints, ::vl_sift_set_max_octave_nkeypoints</td>
+ <td>keeps the keypoints with the strongest response</td>
+ </tr>
 </table>
 
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -166,7 +172,8 @@ eight bins and the spatial coordinates into four each, as follows:
 @image html sift-descr-easy.png "The SIFT descriptor is a spatial histogram of the image gradient."
 
 SIFT descriptors are computed by either calling
-::vl_sift_calc_keypoint_descriptor or
+::vl_sift_calc_keypoint_descriptor (or
+::vl_sift_calc_keypoint_descriptors for many keypoints at once) or
 ::vl_sift_calc_raw_descriptor. They accept as input a keypoint
 frame, which specifies the descriptor center, its size, and its
 orientation on the image plane. The following parameters influence the
@@ -232,6 +239,37 @@ no descriptor is zeroed. Normally this option is useful only with
 custom keypoints, as detected keypoints are implicitly selected at
 high contrast image regions.
 
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@subsection sift-intro-budget Keypoint budget
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+The number of keypoints that pass the peak threshold depends heavily
+on the image content, and so does the cost of computing their
+orientations and descriptors. To bound it, the detector can be given
+a <b>keypoint budget</b>:
+
+- ::vl_sift_set_max_octave_nkeypoints() limits the keypoints of each
+  octave.
+- ::vl_sift_set_max_nkeypoints() limits the keypoints of the whole
+  image. The budget is split among the octaves in proportion to their
+  area (so that each octave gets about the share of keypoints it
+  would normally produce), and the part that an octave does not use
+  is passed on to the next one.
+
+When there are more keypoints than the budget, ::vl_sift_detect()
+keeps the ones with the largest absolute DoG response, which is
+stored in the @c response field of ::VlSiftKeypoint. The selection is
+done after the keypoint refinement but before any orientation or
+descriptor is computed, and uses a partial sort (linear time on
+average). As strong responses tend to cluster on highly textured
+regions, ::vl_sift_set_nbuckets() can be used to spread the keypoints
+over the image: the octave budget is divided equally among a grid of
+buckets, and the budget not used by the buckets with few keypoints
+goes to the strongest of the remaining keypoints.
+
+The budget of the image is reset by ::vl_sift_process_first_octave(),
+and ::vl_sift_detect() should be called once per octave.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section sift-usage Using the SIFT filter object
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -259,9 +297,41 @@ To use a <b>SIFT filter</b> object:
       - Use ::vl_sift_calc_keypoint_descriptor() to get the keypoint descriptor.
 - Delete the SIFT filter by ::vl_sift_delete().
 
+The orientations and the descriptors of all the keypoints of an
+octave can also be computed in parallel by
+::vl_sift_calc_keypoint_orientations_with_array and
+::vl_sift_calc_keypoint_descriptors, which is much faster for images
+with many keypoints on multi-core machines.
+
 To compute SIFT descriptors of custom keypoints, use
 ::vl_sift_calc_raw_descriptor().
 
+@subsection sift-usage-tiled Processing large images by tiles
+
+The buffers of a SIFT filter are proportional to the image size (four
+times the image size if the first octave is upsampled, i.e. @c o_min
+= -1), which is prohibitive for very large images such as aerial
+photographs. ::vl_sift_process_tiled processes such images by
+overlapping tiles instead:
+
+- Create a SIFT filter with ::vl_sift_new() with the size of a
+  <em>tile</em> rather than the size of the image. The number of
+  octaves must be set explicitly, as it determines the tile
+  overlap. Set the other parameters as usual.
+- Call ::vl_sift_process_tiled() to obtain the frames and descriptors
+  of the whole image.
+
+Each tile is extended by a halo (::vl_sift_get_tile_halo) large
+enough to contain the support of the Gaussian kernels and of the
+descriptors of the largest detectable keypoints, and each tile keeps
+only the keypoints that fall in its interior, so that the keypoints
+in the overlap regions are not duplicated. The tiles are aligned to
+the sampling grid of the coarsest octave and clipped to the image, so
+that the result is the same as processing the whole image at once (up
+to floating point rounding), including near the image boundary. The
+tiles are processed concurrently and the peak memory is proportional
+to the tile size times the number of threads.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section sift-tech Technical details
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -658,6 +728,7 @@ Gaussian window size is set to have standard deviation
 #include "sift.h"
 #include "imopv.h"
 #include "mathop.h"
+#include "sift_avx2.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -925,6 +996,11 @@ vl_sift_new (int width, int height,
   f-> magnif      = 3.0 ;
   f-> windowSize  = NBP / 2 ;
 
+  f-> max_nkeys        = 0 ;
+  f-> max_octave_nkeys = 0 ;
+  f-> nbuckets         = 1 ;
+  f-> image_nkeys      = 0 ;
+
   f-> grad_o  = o_min - 1 ;
 
   /* initialize fast_expn stuff */
@@ -995,6 +1071,7 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
   /* restart from the first */
   f->o_cur = o_min ;
   f->nkeys = 0 ;
+  f->image_nkeys = 0 ;
   w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
   h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
 
@@ -1138,6 +1215,135 @@ vl_sift_process_next_octave (VlSiftFilt *f)
   return VL_ERR_OK ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Partially sort keypoint indexes by decreasing score
+ **
+ ** @param indexes keypoint indexes.
+ ** @param scores  keypoint scores.
+ ** @param n       number of indexes.
+ ** @param k       number of indexes to select.
+ **
+ ** The function reorders @a indexes so that the first @a k elements
+ ** are the ones with the largest scores (in no particular order).
+ **/
+
+static void
+_vl_sift_partial_sort (vl_uindex * indexes, float const * scores,
+                       vl_size n, vl_size k)
+{
+  vl_index begin = 0 ;
+  vl_index end = n ;
+  while (end - begin > 1 && begin < (signed)k && (signed)k < end) {
+    vl_index mid = begin + (end - begin) / 2 ;
+    vl_index i, store ;
+    vl_uindex tmp ;
+    float pivot ;
+    /* median of three */
+    if (scores [indexes [mid]] > scores [indexes [begin]]) {
+      tmp = indexes [mid] ; indexes [mid] = indexes [begin] ; indexes [begin] = tmp ;
+    }
+    if (scores [indexes [end - 1]] > scores [indexes [begin]]) {
+      tmp = indexes [end - 1] ; indexes [end - 1] = indexes [begin] ; indexes [begin] = tmp ;
+    }
+    if (scores [indexes [mid]] > scores [indexes [end - 1]]) {
+      tmp = indexes [mid] ; indexes [mid] = indexes [end - 1] ; indexes [end - 1] = tmp ;
+    }
+    /* now indexes [end - 1] is the median; partition (descending) */
+    pivot = scores [indexes [end - 1]] ;
+    store = begin ;
+    for (i = begin ; i < end - 1 ; ++i) {
+      if (scores [indexes [i]] > pivot) {
+        tmp = indexes [i] ; indexes [i] = indexes [store] ; indexes [store] = tmp ;
+        ++ store ;
+      }
+    }
+    tmp = indexes [end - 1] ; indexes [end - 1] = indexes [store] ; indexes [store] = tmp ;
+    if (store < (signed)k) {
+      begin = store + 1 ;
+    } else {
+      end = store ;
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Keep the strongest keypoints
+ **
+ ** @param f      SIFT filter.
+ ** @param budget number of keypoints to keep.
+ **
+ ** The function keeps the @a budget keypoints of the current octave
+ ** with the largest absolute response, spreading them over the
+ ** spatial buckets if more than one is used (see @ref
+ ** sift-intro-budget). The order of the remaining keypoints is
+ ** preserved.
+ **/
+
+static void
+_vl_sift_select_keypoints (VlSiftFilt * f, int budget)
+{
+  vl_size n = f->nkeys ;
+  vl_size numSelected = 0 ;
+  vl_uindex i, j ;
+  vl_uindex * indexes = vl_malloc (sizeof(vl_uindex) * n) ;
+  float * scores = vl_malloc (sizeof(float) * n) ;
+  vl_bool * selected = vl_calloc (n, sizeof(vl_bool)) ;
+  int nb = VL_MAX(f->nbuckets, 1) ;
+
+  for (i = 0 ; i < n ; ++i) {
+    scores [i] = vl_abs_f (f->keys [i].response) ;
+  }
+
+  if (nb > 1) {
+    /* sort the keypoints by bucket (counting sort) */
+    int numBuckets = nb * nb ;
+    int quota = budget / numBuckets ;
+    vl_uindex * offsets = vl_calloc (numBuckets + 1, sizeof(vl_uindex)) ;
+    int * buckets = vl_malloc (sizeof(int) * n) ;
+    int b ;
+    for (i = 0 ; i < n ; ++i) {
+      int bx = VL_MIN(f->keys [i].ix * nb / f->octave_width, nb - 1) ;
+      int by = VL_MIN(f->keys [i].iy * nb / f->octave_height, nb - 1) ;
+      buckets [i] = bx + by * nb ;
+      offsets [buckets [i] + 1] ++ ;
+    }
+    for (b = 0 ; b < numBuckets ; ++b) offsets [b + 1] += offsets [b] ;
+    for (i = 0 ; i < n ; ++i) indexes [offsets [buckets [i]] ++] = i ;
+    for (b = numBuckets ; b > 0 ; --b) offsets [b] = offsets [b - 1] ;
+    offsets [0] = 0 ;
+
+    /* keep the strongest keypoints of each bucket */
+    for (b = 0 ; b < numBuckets ; ++b) {
+      vl_size size = offsets [b + 1] - offsets [b] ;
+      vl_size k = VL_MIN(size, (vl_size)quota) ;
+      _vl_sift_partial_sort (indexes + offsets [b], scores, size, k) ;
+      for (j = 0 ; j < k ; ++j) selected [indexes [offsets [b] + j]] = VL_TRUE ;
+      numSelected += k ;
+    }
+    vl_free (offsets) ;
+    vl_free (buckets) ;
+  }
+
+  /* spend the rest of the budget on the strongest remaining keypoints */
+  for (i = 0, j = 0 ; i < n ; ++i) {
+    if (! selected [i]) indexes [j++] = i ;
+  }
+  _vl_sift_partial_sort (indexes, scores, j, budget - numSelected) ;
+  for (i = 0 ; i < budget - numSelected ; ++i) selected [indexes [i]] = VL_TRUE ;
+
+  /* compact the keypoints preserving their order */
+  for (i = 0, j = 0 ; i < n ; ++i) {
+    if (selected [i]) f->keys [j++] = f->keys [i] ;
+  }
+  f->nkeys = (int) j ;
+
+  vl_free (indexes) ;
+  vl_free (scores) ;
+  vl_free (selected) ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Detect keypoints
  **
@@ -1420,6 +1626,7 @@ vl_sift_detect (VlSiftFilt * f)
         k-> x     = xn * xper ;
         k-> y     = yn * xper ;
         k-> sigma = f->sigma0 * pow (2.0, sn/f->S) * xper ;
+        k-> response = val ;
         ++ k ;
       }
 
@@ -1428,6 +1635,29 @@ vl_sift_detect (VlSiftFilt * f)
 
   /* update keypoint count */
   f-> nkeys = (int)(k - f->keys) ;
+
+  /* -----------------------------------------------------------------
+   *                                            Apply keypoint budget
+   * -------------------------------------------------------------- */
+
+  {
+    int budget = f->max_octave_nkeys > 0 ? f->max_octave_nkeys : f->nkeys ;
+    if (f->max_nkeys > 0) {
+      /* share of the remaining image budget proportional to the area */
+      double area = 0 ;
+      int o ;
+      for (o = f->o_cur ; o < f->o_min + f->O ; ++o) {
+        area += (double) VL_SHIFT_LEFT(f->width, -o) * VL_SHIFT_LEFT(f->height, -o) ;
+      }
+      budget = VL_MIN(budget,
+                      (int) ((f->max_nkeys - f->image_nkeys) * ((double) w * h / area) + 0.5)) ;
+      budget = VL_MAX(budget, 0) ;
+    }
+    if (budget < f->nkeys) {
+      _vl_sift_select_keypoints (f, budget) ;
+    }
+    f->image_nkeys += f->nkeys ;
+  }
 }
 
 
@@ -1530,6 +1760,26 @@ update_gradient (VlSiftFilt *f)
   f->grad_o = f->o_cur ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Calculate the keypoint orientation(s)
+ **
+ ** @param f        SIFT filter.
+ ** @param angles   orientations (output).
+ ** @param k        keypoint.
+ ** @return number of orientations found.
+ **
+ ** The function is the same as ::vl_sift_calc_keypoint_orientations,
+ ** but assumes that the gradient buffer is up-to-date, so that it
+ ** does not modify the filter and can be called from several
+ ** threads at once.
+ **/
+
+static int
+_vl_sift_calc_keypoint_orientations (VlSiftFilt const *f,
+                                     double angles [4],
+                                     VlSiftKeypoint const *k) ;
+
 /** ------------------------------------------------------------------
  ** @brief Calculate the keypoint orientation(s)
  **
@@ -1559,6 +1809,61 @@ int
 vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
                                     double angles [4],
                                     VlSiftKeypoint const *k)
+{
+  /* make gradient up to date */
+  if (k->o == f->o_cur) update_gradient (f) ;
+  return _vl_sift_calc_keypoint_orientations (f, angles, k) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Calculate the orientation(s) of many keypoints
+ **
+ ** @param f        SIFT filter.
+ ** @param nangles  number of orientations of each keypoint (output).
+ ** @param angles   orientations (output).
+ ** @param keys     keypoints.
+ ** @param nkeys    number of keypoints.
+ **
+ ** The function is equivalent to calling
+ ** ::vl_sift_calc_keypoint_orientations for each of the @a nkeys
+ ** keypoints @a keys, but computes the gradient of the current
+ ** octave only once and then processes the keypoints in parallel.
+ ** The number of orientations of the keypoint @c keys[i] is written
+ ** to @c nangles[i] and the orientations to @c angles[4*i],
+ ** ..., @c angles[4*i+nangles[i]-1], so that @a angles must have
+ ** room for @c 4*nkeys values.
+ **
+ ** As for ::vl_sift_calc_keypoint_orientations, keypoints that are
+ ** not on the current octave get zero orientations.
+ **
+ ** @sa ::vl_sift_calc_keypoint_descriptors
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_orientations_with_array (VlSiftFilt *f,
+                                               int *nangles,
+                                               double *angles,
+                                               VlSiftKeypoint const *keys,
+                                               vl_size nkeys)
+{
+  vl_index i ;
+
+  /* make gradient up to date */
+  update_gradient (f) ;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(shared) schedule(dynamic, 16) num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (signed)nkeys ; ++i) {
+    nangles [i] = _vl_sift_calc_keypoint_orientations (f, angles + 4 * i, keys + i) ;
+  }
+}
+
+static int
+_vl_sift_calc_keypoint_orientations (VlSiftFilt const *f,
+                                     double angles [4],
+                                     VlSiftKeypoint const *k)
 {
   double const winf   = 1.5 ;
   double       xper   = pow (2.0, f->o_cur) ;
@@ -1601,9 +1906,6 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
     return 0 ;
   }
 
-  /* make gradient up to date */
-  update_gradient (f) ;
-
   /* clear histogram */
   memset (hist, 0, sizeof(double) * nbins) ;
 
@@ -1902,6 +2204,27 @@ vl_sift_calc_raw_descriptor (VlSiftFilt const *f,
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the descriptor of a keypoint
+ **
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output)
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ **
+ ** The function is the same as ::vl_sift_calc_keypoint_descriptor,
+ ** but assumes that the gradient buffer is up-to-date, so that it
+ ** does not modify the filter and can be called from several
+ ** threads at once.
+ **/
+
+static void
+_vl_sift_calc_keypoint_descriptor (VlSiftFilt const *f,
+                                   vl_sift_pix *descr,
+                                   VlSiftKeypoint const* k,
+                                   double angle0) ;
+
 /** ------------------------------------------------------------------
  ** @brief Compute the descriptor of a keypoint
  **
@@ -1924,6 +2247,61 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
                                   vl_sift_pix *descr,
                                   VlSiftKeypoint const* k,
                                   double angle0)
+{
+  /* synchronize gradient buffer */
+  if (k->o == f->o_cur) update_gradient (f) ;
+  _vl_sift_calc_keypoint_descriptor (f, descr, k, angle0) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptors of many keypoints
+ **
+ ** @param f        SIFT filter.
+ ** @param descrs   SIFT descriptors (output).
+ ** @param keys     keypoints.
+ ** @param angles   keypoint orientations.
+ ** @param nkeys    number of keypoints.
+ **
+ ** The function is equivalent to calling
+ ** ::vl_sift_calc_keypoint_descriptor for each of the @a nkeys
+ ** keypoints @a keys with orientations @a angles, but computes the
+ ** gradient of the current octave only once and then processes the
+ ** keypoints in parallel. The descriptor of the keypoint @c keys[i]
+ ** is written to the 128 values starting at @c descrs+128*i. A
+ ** keypoint with several orientations (see
+ ** ::vl_sift_calc_keypoint_orientations_with_array) must be
+ ** repeated once for each orientation.
+ **
+ ** As for ::vl_sift_calc_keypoint_descriptor, the descriptors of the
+ ** keypoints that are not on the current octave are not written.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptors (VlSiftFilt *f,
+                                   vl_sift_pix *descrs,
+                                   VlSiftKeypoint const *keys,
+                                   double const *angles,
+                                   vl_size nkeys)
+{
+  vl_index i ;
+
+  /* synchronize gradient buffer */
+  update_gradient (f) ;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(shared) schedule(dynamic, 16) num_threads(vl_get_max_threads())
+#endif
+  for (i = 0 ; i < (signed)nkeys ; ++i) {
+    _vl_sift_calc_keypoint_descriptor (f, descrs + NBO*NBP*NBP * i, keys + i, angles [i]) ;
+  }
+}
+
+static void
+_vl_sift_calc_keypoint_descriptor (VlSiftFilt const *f,
+                                   vl_sift_pix *descr,
+                                   VlSiftKeypoint const* k,
+                                   double angle0)
 {
   /*
      The SIFT descriptor is a three dimensional histogram of the
@@ -1982,9 +2360,6 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
      si    >  f->s_max - 2     )
     return ;
 
-  /* synchronize gradient buffer */
-  update_gradient (f) ;
-
   /* VL_PRINTF("W = %d ; magnif = %g ; SBP = %g\n", W,magnif,SBP) ; */
 
   /* clear descriptor */
@@ -2003,6 +2378,17 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
    * Process pixels in the intersection of the image rectangle
    * (1,1)-(M-1,N-1) and the keypoint bounding box.
    */
+#ifndef VL_DISABLE_AVX2
+  if (vl_cpu_has_avx2() && vl_cpu_has_fma() && vl_get_simd_enabled()) {
+    _vl_sift_accumulate_descriptor_avx2
+      (dpt - (NBP/2) * binyo - (NBP/2) * binxo, pt, yo,
+       VL_MAX (- W, 1 - xi), VL_MIN (+ W, w - xi - 2),
+       VL_MAX (- W, 1 - yi), VL_MIN (+ W, h - yi - 2),
+       (vl_sift_pix) (xi - x), (vl_sift_pix) (yi - y),
+       ct0, st0, angle0, SBP, f->windowSize,
+       expn_tab, EXPN_SZ, EXPN_MAX) ;
+  } else
+#endif
   for(dyi =  VL_MAX (- W, 1 - yi    ) ;
       dyi <= VL_MIN (+ W, h - yi - 2) ; ++ dyi) {
 
@@ -2194,4 +2580,255 @@ vl_sift_keypoint_init (VlSiftFilt const *f,
   k -> s = s ;
 
   k->sigma = sigma ;
+  k->response = 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the halo of the tiles of the tiled SIFT detector
+ **
+ ** @param f SIFT filter.
+ ** @return halo width (in pixels).
+ **
+ ** The function returns the number of pixels that
+ ** ::vl_sift_process_tiled adds around each tile so that the
+ ** keypoints and descriptors computed in the interior of the tile
+ ** are not affected by the tile boundary. This is the support of
+ ** the descriptor (the largest support of the SIFT filter) of a
+ ** keypoint of the largest scale that @a f can detect, plus the
+ ** support of the largest Gaussian kernel, rounded up to a
+ ** multiple of the sampling step of the coarsest octave.
+ **
+ ** @sa @ref sift-usage-tiled
+ **/
+
+VL_EXPORT int
+vl_sift_get_tile_halo (VlSiftFilt const *f)
+{
+  int oMax = f->o_min + f->O - 1 ;
+  int step = 1 << VL_MAX(oMax, 0) ;
+  /* largest keypoint scale and largest Gaussian kernel */
+  double sigmaKey = f->sigma0 * pow (2.0, oMax + (double) (f->s_max - 1) / f->S) ;
+  double sigmaMax = f->sigma0 * pow (2.0, oMax + (double) f->s_max / f->S) ;
+  double support = VL_MAX(f->magnif * sqrt (2.0) * (NBP + 1) / 2.0, 3.0 * 1.5) ;
+  int halo = (int) ceil (support * sigmaKey + 4.0 * sigmaMax) ;
+  return ((halo + step - 1) / step) * step ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run the SIFT detector and descriptor on an image by tiles
+ **
+ ** @param f         SIFT filter (tile geometry and parameters).
+ ** @param im        image data.
+ ** @param width     image width.
+ ** @param height    image height.
+ ** @param frames    frames (output).
+ ** @param descrs    descriptors (output).
+ ** @return number of frames.
+ **
+ ** The function detects the SIFT keypoints of the image @a im of
+ ** size @a width by @a height, computes their orientations and (if
+ ** @a descrs is not @c NULL) their descriptors. Unlike the usual
+ ** ::vl_sift_process_first_octave and ::vl_sift_process_next_octave
+ ** loop, the image is processed by overlapping tiles of the size of
+ ** the filter @a f, so that the memory used is proportional to the
+ ** tile size rather than to the image size. The tiles at the image
+ ** boundary are clipped to the image and processed by smaller
+ ** filters, so that the boundary is handled exactly as by the
+ ** non-tiled loop. See @ref sift-usage-tiled for details.
+ **
+ ** The filter @a f is used only as a template: the tiles are
+ ** processed concurrently by filters with the same geometry and
+ ** parameters as @a f, one for each thread. The keypoint budget of
+ ** @a f (@ref sift-intro-budget) is not applied, as it is defined for
+ ** the whole image.
+ **
+ ** The function returns in @a *frames a newly allocated @c 4 by @c N
+ ** array with the frames (x, y, scale, orientation) of the @c N
+ ** keypoints, with one frame for each orientation of each keypoint,
+ ** and in @a *descrs a newly allocated @c 128 by @c N array with the
+ ** corresponding descriptors. Both must be freed by ::vl_free.
+ **
+ ** If the filter @a f is too small to contain the tile halos (see
+ ** ::vl_sift_get_tile_halo), the function sets the last error to
+ ** ::VL_ERR_BAD_ARG and returns zero.
+ **/
+
+VL_EXPORT vl_size
+vl_sift_process_tiled (VlSiftFilt const *f,
+                       vl_sift_pix const *im,
+                       int width, int height,
+                       double **frames,
+                       vl_sift_pix **descrs)
+{
+  int halo = vl_sift_get_tile_halo (f) ;
+  int oMax = f->o_min + f->O - 1 ;
+  int step = 1 << VL_MAX(oMax, 0) ;
+  int coreWidth = f->width - 2 * halo - step ;
+  int coreHeight = f->height - 2 * halo - step ;
+  int numTilesX, numTilesY ;
+  vl_index t ;
+  vl_size numFrames = 0 ;
+  vl_size *tileNumFrames ;
+  double **tileFrames ;
+  vl_sift_pix **tileDescrs ;
+
+  *frames = NULL ;
+  if (descrs) *descrs = NULL ;
+
+  if (coreWidth <= 0 || coreHeight <= 0) {
+    vl_set_last_error (VL_ERR_BAD_ARG,
+                       "The %d x %d SIFT filter is too small for tiles with a halo of %d pixels.",
+                       f->width, f->height, halo) ;
+    return 0 ;
+  }
+
+  numTilesX = (width + coreWidth - 1) / coreWidth ;
+  numTilesY = (height + coreHeight - 1) / coreHeight ;
+  tileNumFrames = vl_calloc (numTilesX * numTilesY, sizeof(vl_size)) ;
+  tileFrames = vl_calloc (numTilesX * numTilesY, sizeof(double*)) ;
+  tileDescrs = vl_calloc (numTilesX * numTilesY, sizeof(vl_sift_pix*)) ;
+
+#ifdef _OPENMP
+#pragma omp parallel default(shared) private(t) num_threads(vl_get_max_threads())
+#endif
+  {
+    VlSiftFilt * tf = NULL ;
+    /* vl_malloc cannot be used here if mapped to MATLAB malloc */
+    vl_sift_pix * tile = malloc (sizeof(vl_sift_pix) * f->width * f->height) ;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (t = 0 ; t < numTilesX * numTilesY ; ++t) {
+      /* the core is the region where this tile owns the keypoints */
+      int cx0 = (t % numTilesX) * coreWidth ;
+      int cy0 = (t / numTilesX) * coreHeight ;
+      int cx1 = VL_MIN(cx0 + coreWidth, width) ;
+      int cy1 = VL_MIN(cy0 + coreHeight, height) ;
+      /* the tile origin is aligned to the coarsest octave sampling
+         and the tile is clipped to the image, so that the image
+         boundary is handled as when processing the whole image */
+      int x0 = (VL_MAX(cx0 - halo, 0) / step) * step ;
+      int y0 = (VL_MAX(cy0 - halo, 0) / step) * step ;
+      int tileWidth = VL_MIN(f->width, width - x0) ;
+      int tileHeight = VL_MIN(f->height, height - y0) ;
+      int x, y, err ;
+      vl_size numAllocatedFrames = 0 ;
+
+      for (y = 0 ; y < tileHeight ; ++y) {
+        for (x = 0 ; x < tileWidth ; ++x) {
+          tile [x + y * tileWidth] = im [(vl_size) (y0 + y) * width + (x0 + x)] ;
+        }
+      }
+
+      /* the tiles at the image boundary may be smaller */
+      if (tf == NULL || tf->width != tileWidth || tf->height != tileHeight) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        {
+          if (tf) vl_sift_delete (tf) ;
+          tf = vl_sift_new (tileWidth, tileHeight, f->O, f->S, f->o_min) ;
+          tf->peak_thresh = f->peak_thresh ;
+          tf->edge_thresh = f->edge_thresh ;
+          tf->norm_thresh = f->norm_thresh ;
+          tf->magnif = f->magnif ;
+          tf->windowSize = f->windowSize ;
+        }
+      }
+
+      for (err = vl_sift_process_first_octave (tf, tile) ;
+           err == VL_ERR_OK ;
+           err = vl_sift_process_next_octave (tf)) {
+        VlSiftKeypoint * keys ;
+        int * nangles ;
+        double * angles ;
+        double * keyAngles ;
+        vl_size numKeys = 0 ;
+        vl_size numOriented = 0 ;
+        int i, j ;
+
+        vl_sift_detect (tf) ;
+        if (tf->nkeys == 0) continue ;
+
+        /* keep the keypoints in the core and drop the duplicates in the halo */
+        keys = malloc (sizeof(VlSiftKeypoint) * tf->nkeys * 4) ;
+        nangles = malloc (sizeof(int) * tf->nkeys) ;
+        angles = malloc (sizeof(double) * tf->nkeys * 4) ;
+        keyAngles = malloc (sizeof(double) * tf->nkeys * 4) ;
+        for (i = 0 ; i < tf->nkeys ; ++i) {
+          VlSiftKeypoint const * k = tf->keys + i ;
+          double kx = k->x + x0 ;
+          double ky = k->y + y0 ;
+          if (kx < cx0 || kx >= cx1 || ky < cy0 || ky >= cy1) continue ;
+          keys [numKeys++] = *k ;
+        }
+        vl_sift_calc_keypoint_orientations_with_array (tf, nangles, angles, keys, numKeys) ;
+
+        /* expand one keypoint per orientation */
+        for (i = 0 ; i < (signed)numKeys ; ++i) numOriented += nangles [i] ;
+        for (i = (signed)numKeys - 1, j = (signed)numOriented - 1 ; i >= 0 ; --i) {
+          int r ;
+          for (r = nangles [i] - 1 ; r >= 0 ; --r, --j) {
+            keys [j] = keys [i] ;
+            keyAngles [j] = angles [4*i + r] ;
+          }
+        }
+
+        if (tileNumFrames [t] + numOriented > numAllocatedFrames) {
+          numAllocatedFrames = VL_MAX(2 * numAllocatedFrames, tileNumFrames [t] + numOriented) ;
+          tileFrames [t] = realloc (tileFrames [t], sizeof(double) * 4 * numAllocatedFrames) ;
+          if (descrs) {
+            tileDescrs [t] = realloc (tileDescrs [t], sizeof(vl_sift_pix) * NBO*NBP*NBP * numAllocatedFrames) ;
+          }
+        }
+        if (descrs) {
+          vl_sift_calc_keypoint_descriptors (tf, tileDescrs [t] + NBO*NBP*NBP * tileNumFrames [t],
+                                             keys, keyAngles, numOriented) ;
+        }
+        for (i = 0 ; i < (signed)numOriented ; ++i) {
+          double * fr = tileFrames [t] + 4 * (tileNumFrames [t] + i) ;
+          fr [0] = keys [i].x + x0 ;
+          fr [1] = keys [i].y + y0 ;
+          fr [2] = keys [i].sigma ;
+          fr [3] = keyAngles [i] ;
+        }
+        tileNumFrames [t] += numOriented ;
+        free (keys) ;
+        free (nangles) ;
+        free (angles) ;
+        free (keyAngles) ;
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      if (tf) vl_sift_delete (tf) ;
+    }
+    free (tile) ;
+  }
+
+  /* collect the frames in tile order */
+  for (t = 0 ; t < numTilesX * numTilesY ; ++t) numFrames += tileNumFrames [t] ;
+  *frames = vl_malloc (sizeof(double) * 4 * VL_MAX(numFrames, 1)) ;
+  if (descrs) *descrs = vl_malloc (sizeof(vl_sift_pix) * NBO*NBP*NBP * VL_MAX(numFrames, 1)) ;
+  numFrames = 0 ;
+  for (t = 0 ; t < numTilesX * numTilesY ; ++t) {
+    if (tileNumFrames [t] == 0) continue ;
+    memcpy (*frames + 4 * numFrames, tileFrames [t],
+            sizeof(double) * 4 * tileNumFrames [t]) ;
+    if (descrs) {
+      memcpy (*descrs + NBO*NBP*NBP * numFrames, tileDescrs [t],
+              sizeof(vl_sift_pix) * NBO*NBP*NBP * tileNumFrames [t]) ;
+    }
+    numFrames += tileNumFrames [t] ;
+    free (tileFrames [t]) ;
+    free (tileDescrs [t]) ;
+  }
+  vl_free (tileNumFrames) ;
+  vl_free (tileFrames) ;
+  vl_free (tileDescrs) ;
+  return numFrames ;
 }
@@ -39,6 +39,8 @@ typedef struct _VlSiftKeypoint
   float y ;     /**< y coordinate. */
   float s ;     /**< s coordinate. */
   float sigma ; /**< scale. */
+
+  float response ; /**< DoG response (contrast). */
 } VlSiftKeypoint ;
 
 /** ------------------------------------------------------------------
@@ -83,6 +85,11 @@ typedef struct _VlSiftFilt
   double magnif ;       /**< magnification factor. */
   double windowSize ;   /**< size of Gaussian window (in spatial bins) */
 
+  int max_nkeys ;       /**< maximum number of keypoints per image. */
+  int max_octave_nkeys ;/**< maximum number of keypoints per octave. */
+  int nbuckets ;        /**< number of spatial buckets per side. */
+  int image_nkeys ;     /**< keypoints detected so far in the image. */
+
   vl_sift_pix *grad ;   /**< GSS gradient data. */
   int grad_o ;          /**< GSS gradient data octave. */
 
@@ -123,6 +130,28 @@ void  vl_sift_calc_keypoint_descriptor   (VlSiftFilt *f,
                                           VlSiftKeypoint const* k,
                                           double angle) ;
 
+VL_EXPORT
+void  vl_sift_calc_keypoint_orientations_with_array
+                                         (VlSiftFilt *f,
+                                          int *nangles,
+                                          double *angles,
+                                          VlSiftKeypoint const *keys,
+                                          vl_size nkeys) ;
+
+VL_EXPORT
+void  vl_sift_calc_keypoint_descriptors  (VlSiftFilt *f,
+                                          vl_sift_pix *descrs,
+                                          VlSiftKeypoint const *keys,
+                                          double const *angles,
+                                          vl_size nkeys) ;
+
+VL_EXPORT
+vl_size vl_sift_process_tiled            (VlSiftFilt const *f,
+                                          vl_sift_pix const *im,
+                                          int width, int height,
+                                          double **frames,
+                                          vl_sift_pix **descrs) ;
+
 VL_EXPORT
 void  vl_sift_calc_raw_descriptor        (VlSiftFilt const *f,
                                           vl_sift_pix const* image,
@@ -154,6 +183,10 @@ VL_INLINE double vl_sift_get_edge_thresh    (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_norm_thresh    (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_magnif         (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_window_size    (VlSiftFilt const *f) ;
+VL_INLINE int    vl_sift_get_max_nkeypoints (VlSiftFilt const *f) ;
+VL_INLINE int    vl_sift_get_max_octave_nkeypoints (VlSiftFilt const *f) ;
+VL_INLINE int    vl_sift_get_nbuckets       (VlSiftFilt const *f) ;
+VL_EXPORT int    vl_sift_get_tile_halo      (VlSiftFilt const *f) ;
 
 VL_INLINE vl_sift_pix *vl_sift_get_octave  (VlSiftFilt const *f, int s) ;
 VL_INLINE VlSiftKeypoint const *vl_sift_get_keypoints (VlSiftFilt const *f) ;
@@ -167,6 +200,9 @@ VL_INLINE void vl_sift_set_edge_thresh (VlSiftFilt *f, double t) ;
 VL_INLINE void vl_sift_set_norm_thresh (VlSiftFilt *f, double t) ;
 VL_INLINE void vl_sift_set_magnif      (VlSiftFilt *f, double m) ;
 VL_INLINE void vl_sift_set_window_size (VlSiftFilt *f, double m) ;
+VL_INLINE void vl_sift_set_max_nkeypoints (VlSiftFilt *f, int n) ;
+VL_INLINE void vl_sift_set_max_octave_nkeypoints (VlSiftFilt *f, int n) ;
+VL_INLINE void vl_sift_set_nbuckets (VlSiftFilt *f, int n) ;
 /** @} */
 
 /* -------------------------------------------------------------------
@@ -349,6 +385,45 @@ vl_sift_get_window_size (VlSiftFilt const *f)
   return f -> windowSize ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of keypoints per image
+ ** @param f SIFT filter.
+ ** @return maximum number of keypoints (0 for no limit).
+ ** @sa ::vl_sift_set_max_nkeypoints
+ **/
+
+VL_INLINE int
+vl_sift_get_max_nkeypoints (VlSiftFilt const *f)
+{
+  return f -> max_nkeys ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of keypoints per octave
+ ** @param f SIFT filter.
+ ** @return maximum number of keypoints (0 for no limit).
+ ** @sa ::vl_sift_set_max_octave_nkeypoints
+ **/
+
+VL_INLINE int
+vl_sift_get_max_octave_nkeypoints (VlSiftFilt const *f)
+{
+  return f -> max_octave_nkeys ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of spatial buckets
+ ** @param f SIFT filter.
+ ** @return number of buckets per side.
+ ** @sa ::vl_sift_set_nbuckets
+ **/
+
+VL_INLINE int
+vl_sift_get_nbuckets (VlSiftFilt const *f)
+{
+  return f -> nbuckets ;
+}
+
 
 
 /** ------------------------------------------------------------------
@@ -414,5 +489,52 @@ vl_sift_set_window_size (VlSiftFilt *f, double x)
   f -> windowSize = x ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set the maximum number of keypoints per image
+ ** @param f SIFT filter.
+ ** @param n maximum number of keypoints (0 for no limit).
+ **
+ ** The budget is split among the octaves in proportion to their
+ ** area, and the part not used by an octave is passed to the next
+ ** one. ::vl_sift_detect keeps the keypoints with the strongest
+ ** response. See @ref sift-intro-budget.
+ **/
+
+VL_INLINE void
+vl_sift_set_max_nkeypoints (VlSiftFilt *f, int n)
+{
+  f -> max_nkeys = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the maximum number of keypoints per octave
+ ** @param f SIFT filter.
+ ** @param n maximum number of keypoints (0 for no limit).
+ ** @sa @ref sift-intro-budget
+ **/
+
+VL_INLINE void
+vl_sift_set_max_octave_nkeypoints (VlSiftFilt *f, int n)
+{
+  f -> max_octave_nkeys = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the number of spatial buckets
+ ** @param f SIFT filter.
+ ** @param n number of buckets per side.
+ **
+ ** If @a n is larger than one, the keypoint budget is spread over a
+ ** grid of @a n by @a n buckets covering the image.
+ **
+ ** @sa @ref sift-intro-budget
+ **/
+
+VL_INLINE void
+vl_sift_set_nbuckets (VlSiftFilt *f, int n)
+{
+  f -> nbuckets = n ;
+}
+
 /* VL_SIFT_H */
 #endif
@@ -0,0 +1,215 @@
+/** @file sift_avx2.c
+ ** @brief SIFT for AVX2 - Definition
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "sift_avx2.h"
+#include "mathop.h"
+
+#ifndef VL_DISABLE_AVX2
+
+#if !defined(__AVX2__)
+#error Compiling AVX2 functions but AVX2 does not seem to be supported by the compiler.
+#endif
+
+#include <immintrin.h>
+#include <string.h>
+
+/* Same histogram geometry as sift.c. */
+#define NBO 8
+#define NBP 4
+
+/** @internal
+ ** @brief Accumulate the SIFT descriptor histogram (AVX2)
+ **
+ ** @param descr      histogram (NBP x NBP x NBO, cleared by the caller).
+ ** @param grad       gradient (modulus, angle pairs) at the keypoint pixel.
+ ** @param yStride    gradient row stride (in floats).
+ ** @param dxiBegin   first horizontal pixel displacement.
+ ** @param dxiEnd     last horizontal pixel displacement (included).
+ ** @param dyiBegin   first vertical pixel displacement.
+ ** @param dyiEnd     last vertical pixel displacement (included).
+ ** @param xOffset    horizontal displacement of the keypoint pixel from the keypoint.
+ ** @param yOffset    vertical displacement of the keypoint pixel from the keypoint.
+ ** @param ct0        cosine of the keypoint orientation.
+ ** @param st0        sine of the keypoint orientation.
+ ** @param angle0     keypoint orientation.
+ ** @param SBP        spatial bin size (in pixels).
+ ** @param windowSize standard deviation of the Gaussian window (in bins).
+ ** @param expnTable  table of the fast exponential.
+ ** @param expnSize   size of the table minus one.
+ ** @param expnMax    largest argument of the fast exponential.
+ **
+ ** This is the inner loop of the SIFT descriptor. Eight pixels of a
+ ** row are processed at once: the orientation, the Gaussian window
+ ** weight and the trilinear bin weights are evaluated in parallel.
+ ** Since AVX2 lacks a scatter instruction, each lane then adds its
+ ** eight contributions to a private copy of the histogram, and the
+ ** private copies are summed at the end. The result is the same as
+ ** the scalar code up to floating point rounding.
+ **/
+
+VL_EXPORT void
+_vl_sift_accumulate_descriptor_avx2 (float * descr,
+                                     float const * grad,
+                                     vl_index yStride,
+                                     vl_index dxiBegin, vl_index dxiEnd,
+                                     vl_index dyiBegin, vl_index dyiEnd,
+                                     float xOffset, float yOffset,
+                                     double ct0, double st0, double angle0,
+                                     double SBP, double windowSize,
+                                     double const * expnTable,
+                                     vl_size expnSize, double expnMax)
+{
+  float hists [8][NBO*NBP*NBP] ;
+  float weights [8][8] ;
+  vl_int32 bins [8][8] ;
+  vl_index dxi, dyi ;
+  int lane, i ;
+
+  __m256 const laneIndex = _mm256_setr_ps (0, 1, 2, 3, 4, 5, 6, 7) ;
+  __m256i const laneIndexI = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7) ;
+  __m256 const ct = _mm256_set1_ps ((float) (ct0 / SBP)) ;
+  __m256 const st = _mm256_set1_ps ((float) (st0 / SBP)) ;
+  __m256 const a0 = _mm256_set1_ps ((float) angle0) ;
+  __m256 const twoPi = _mm256_set1_ps ((float) (2 * VL_PI)) ;
+  __m256 const ntScale = _mm256_set1_ps ((float) (NBO / (2 * VL_PI))) ;
+  __m256 const winScale = _mm256_set1_ps ((float) (1.0 / (2.0 * windowSize * windowSize))) ;
+  __m256 const expnScale = _mm256_set1_ps ((float) (expnSize / expnMax)) ;
+  __m256 const expnLimit = _mm256_set1_ps ((float) expnMax) ;
+  __m256 const expnTop = _mm256_set1_ps ((float) expnSize) ;
+  __m256i const expnLast = _mm256_set1_epi32 ((int) expnSize - 1) ;
+  __m256 const half = _mm256_set1_ps (0.5f) ;
+  __m256 const one = _mm256_set1_ps (1.0f) ;
+  __m256 const zero = _mm256_setzero_ps () ;
+  __m256i const binMin = _mm256_set1_epi32 (- NBP/2) ;
+  __m256i const binMax = _mm256_set1_epi32 (NBP/2 - 1) ;
+  __m256i const binOne = _mm256_set1_epi32 (1) ;
+  __m256i const binMask = _mm256_set1_epi32 (NBO - 1) ;
+
+  memset (hists, 0, sizeof(hists)) ;
+
+  for (dyi = dyiBegin ; dyi <= dyiEnd ; ++ dyi) {
+    __m256 const dy = _mm256_set1_ps (yOffset + dyi) ;
+    float const * row = grad + dyi * yStride ;
+
+    for (dxi = dxiBegin ; dxi <= dxiEnd ; dxi += 8) {
+      vl_index n = VL_MIN(dxiEnd - dxi + 1, 8) ;
+      __m256 g0, g1, mod, angle, theta, dx, nx, ny, nt, win, wm ;
+      __m256 bx, by, bt, rx, ry, rt, wx [2], wy [2], wt [2] ;
+      __m256i ibx, iby, ibt, ix [2], iy [2], it [2] ;
+
+      /* load eight (modulus, angle) pairs and deinterleave them */
+      if (n == 8) {
+        g0 = _mm256_loadu_ps (row + 2 * dxi) ;
+        g1 = _mm256_loadu_ps (row + 2 * dxi + 8) ;
+      } else {
+        __m256i m = _mm256_set1_epi32 ((int) (2 * n)) ;
+        g0 = _mm256_maskload_ps (row + 2 * dxi,
+                                 _mm256_cmpgt_epi32 (m, laneIndexI)) ;
+        g1 = _mm256_maskload_ps (row + 2 * dxi + 8,
+                                 _mm256_cmpgt_epi32 (m, _mm256_add_epi32 (laneIndexI, _mm256_set1_epi32 (8)))) ;
+      }
+      mod = _mm256_castpd_ps (_mm256_permute4x64_pd
+        (_mm256_castps_pd (_mm256_shuffle_ps (g0, g1, _MM_SHUFFLE(2,0,2,0))), _MM_SHUFFLE(3,1,2,0))) ;
+      angle = _mm256_castpd_ps (_mm256_permute4x64_pd
+        (_mm256_castps_pd (_mm256_shuffle_ps (g0, g1, _MM_SHUFFLE(3,1,3,1))), _MM_SHUFFLE(3,1,2,0))) ;
+
+      /* theta = mod (angle - angle0, 2 pi) */
+      theta = _mm256_sub_ps (angle, a0) ;
+      theta = _mm256_add_ps (theta, _mm256_and_ps (_mm256_cmp_ps (theta, zero, _CMP_LT_OQ), twoPi)) ;
+      theta = _mm256_sub_ps (theta, _mm256_and_ps (_mm256_cmp_ps (theta, twoPi, _CMP_GT_OQ), twoPi)) ;
+
+      /* displacement normalized w.r.t. the keypoint orientation and extension */
+      dx = _mm256_add_ps (_mm256_set1_ps (xOffset + dxi), laneIndex) ;
+      nx = _mm256_add_ps (_mm256_mul_ps (ct, dx), _mm256_mul_ps (st, dy)) ;
+      ny = _mm256_sub_ps (_mm256_mul_ps (ct, dy), _mm256_mul_ps (st, dx)) ;
+      nt = _mm256_mul_ps (ntScale, theta) ;
+
+      /* Gaussian window weight by the fast exponential table */
+      {
+        __m256 x = _mm256_mul_ps (_mm256_add_ps (_mm256_mul_ps (nx, nx), _mm256_mul_ps (ny, ny)), winScale) ;
+        __m256 inRange = _mm256_cmp_ps (x, expnLimit, _CMP_LE_OQ) ;
+        __m256 xs = _mm256_mul_ps (x, expnScale) ;
+        __m256i k = _mm256_min_epi32 (_mm256_cvttps_epi32 (_mm256_min_ps (xs, expnTop)), expnLast) ;
+        __m256 r = _mm256_sub_ps (xs, _mm256_cvtepi32_ps (k)) ;
+        __m128i klo = _mm256_castsi256_si128 (k) ;
+        __m128i khi = _mm256_extracti128_si256 (k, 1) ;
+        __m256 a = _mm256_insertf128_ps
+          (_mm256_castps128_ps256 (_mm256_cvtpd_ps (_mm256_i32gather_pd (expnTable, klo, 8))),
+           _mm256_cvtpd_ps (_mm256_i32gather_pd (expnTable, khi, 8)), 1) ;
+        __m256 b = _mm256_insertf128_ps
+          (_mm256_castps128_ps256 (_mm256_cvtpd_ps (_mm256_i32gather_pd (expnTable + 1, klo, 8))),
+           _mm256_cvtpd_ps (_mm256_i32gather_pd (expnTable + 1, khi, 8)), 1) ;
+        win = _mm256_and_ps (_mm256_add_ps (a, _mm256_mul_ps (r, _mm256_sub_ps (b, a))), inRange) ;
+      }
+      wm = _mm256_mul_ps (win, mod) ;
+
+      /* the sample is distributed in eight adjacent bins, starting
+         from the ``lower-left'' one */
+      bx = _mm256_floor_ps (_mm256_sub_ps (nx, half)) ;
+      by = _mm256_floor_ps (_mm256_sub_ps (ny, half)) ;
+      bt = _mm256_floor_ps (nt) ;
+      rx = _mm256_sub_ps (nx, _mm256_add_ps (bx, half)) ;
+      ry = _mm256_sub_ps (ny, _mm256_add_ps (by, half)) ;
+      rt = _mm256_sub_ps (nt, bt) ;
+      ibx = _mm256_cvtps_epi32 (bx) ;
+      iby = _mm256_cvtps_epi32 (by) ;
+      ibt = _mm256_cvtps_epi32 (bt) ;
+
+      /* spatial bins out of the descriptor get zero weight; their
+         index is clamped so that the (null) update stays in range */
+      for (i = 0 ; i < 2 ; ++i) {
+        __m256i jx = _mm256_add_epi32 (ibx, _mm256_set1_epi32 (i)) ;
+        __m256i jy = _mm256_add_epi32 (iby, _mm256_set1_epi32 (i)) ;
+        __m256i okx = _mm256_andnot_si256
+          (_mm256_or_si256 (_mm256_cmpgt_epi32 (binMin, jx), _mm256_cmpgt_epi32 (jx, binMax)),
+           _mm256_set1_epi32 (-1)) ;
+        __m256i oky = _mm256_andnot_si256
+          (_mm256_or_si256 (_mm256_cmpgt_epi32 (binMin, jy), _mm256_cmpgt_epi32 (jy, binMax)),
+           _mm256_set1_epi32 (-1)) ;
+        wx [i] = _mm256_and_ps (i ? rx : _mm256_sub_ps (one, rx), _mm256_castsi256_ps (okx)) ;
+        wy [i] = _mm256_and_ps (i ? ry : _mm256_sub_ps (one, ry), _mm256_castsi256_ps (oky)) ;
+        wt [i] = i ? rt : _mm256_sub_ps (one, rt) ;
+        ix [i] = _mm256_mullo_epi32 (_mm256_sub_epi32 (_mm256_max_epi32 (_mm256_min_epi32 (jx, binMax), binMin), binMin),
+                                     _mm256_set1_epi32 (NBO)) ;
+        iy [i] = _mm256_mullo_epi32 (_mm256_sub_epi32 (_mm256_max_epi32 (_mm256_min_epi32 (jy, binMax), binMin), binMin),
+                                     _mm256_set1_epi32 (NBO * NBP)) ;
+        it [i] = _mm256_and_si256 (i ? _mm256_add_epi32 (ibt, binOne) : ibt, binMask) ;
+      }
+
+      for (i = 0 ; i < 8 ; ++i) {
+        int ax = (i >> 2) & 1, ay = (i >> 1) & 1, at = i & 1 ;
+        _mm256_storeu_ps (weights [i], _mm256_mul_ps (_mm256_mul_ps (_mm256_mul_ps (wm, wx [ax]), wy [ay]), wt [at])) ;
+        _mm256_storeu_si256 ((__m256i *) bins [i], _mm256_add_epi32 (_mm256_add_epi32 (ix [ax], iy [ay]), it [at])) ;
+      }
+
+      /* scatter into the per-lane histograms */
+      for (lane = 0 ; lane < n ; ++lane) {
+        float * hist = hists [lane] ;
+        for (i = 0 ; i < 8 ; ++i) {
+          hist [bins [i][lane]] += weights [i][lane] ;
+        }
+      }
+    }
+  }
+
+  /* reduce the per-lane histograms */
+  for (i = 0 ; i < NBO*NBP*NBP ; i += 8) {
+    __m256 acc = _mm256_loadu_ps (descr + i) ;
+    for (lane = 0 ; lane < 8 ; ++lane) {
+      acc = _mm256_add_ps (acc, _mm256_loadu_ps (hists [lane] + i)) ;
+    }
+    _mm256_storeu_ps (descr + i, acc) ;
+  }
+}
+
+/* ! VL_DISABLE_AVX2 */
+#endif
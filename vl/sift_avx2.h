@@ -0,0 +1,36 @@
+/** @file sift_avx2.h
+ ** @brief SIFT for AVX2
+ **/
+
+/*
+Copyright (C) 2026 The VLFeat Team.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_SIFT_AVX2_H
+#define VL_SIFT_AVX2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX2
+
+VL_EXPORT void
+_vl_sift_accumulate_descriptor_avx2 (float * descr,
+                                     float const * grad,
+                                     vl_index yStride,
+                                     vl_index dxiBegin, vl_index dxiEnd,
+                                     vl_index dyiBegin, vl_index dyiEnd,
+                                     float xOffset, float yOffset,
+                                     double ct0, double st0, double angle0,
+                                     double SBP, double windowSize,
+                                     double const * expnTable,
+                                     vl_size expnSize, double expnMax) ;
+
+/* ! VL_DISABLE_AVX2 */
+#endif
+
+/* ! VL_SIFT_AVX2_H */
+#endif